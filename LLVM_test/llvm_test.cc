@@ -1,5 +1,6 @@
 
 #include "llvm_test.h"
+#include "common/check_data.hpp"
 
 TestFramework::TestFramework(size_t num_rows, const std::vector< size_t >& concat_cols) : 
         num_rows_(num_rows), concat_sizes_(concat_cols) {
@@ -68,19 +69,16 @@ void TestFramework::clean_output_buf() {
 
 void TestFramework::verify() {
   dst_buf_.copyDToH();
-  checkme< false >(dst_buf_.data(), ref_buf_.data(), 
+  CheckOptions opts;
+  opts.absTol = 1e-10;
+  opts.maxReport = 1000;
+  // guard for OOB detection
+  opts.redzoneBytes = s_redzoneElems*sizeof(NT);
+  opts.redzoneValue = s_oobValue;
+  auto res = checkData< NT >(&pool_, dst_buf_.data(), ref_buf_.data(),
         //size_t width, size_t stride, size_t n_batches
-        concat_num_cols_, concat_num_cols_, num_rows_,
-        /*eps*/NT(1e-10), 
-        /*print_when_differs*/true, 
-        /*print_max*/1000);
-
-  auto ptr = (const uint8_t *)(dst_buf_.data() + ref_buf_.size());
-  for (uint32_t i = 0, num_errors = 0; i < s_redzoneElems; i++) {
-    if (ptr[i] != s_oobValue && num_errors++ < 50) {
-      VLOG(0) << i << " OOB error: 0x" << std::hex << (uint32_t)ptr[i];
-    }
-  }
+        concat_num_cols_, concat_num_cols_, num_rows_, opts);
+  res.print("concat");
 }
 
 int main() try {
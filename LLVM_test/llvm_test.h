@@ -2,8 +2,10 @@
 #define LLVM_TEST_H 1
 
 #include <cstdint>
+#include <thread>
 #include <vector>
 #include "common/common_utils.hpp"
+#include "common/threading.hpp"
 
 struct TestFramework {
 
@@ -38,6 +40,7 @@ private:
   std::vector< Vector > src_bufs_;
   Vector dst_buf_;
   std::vector< NT > ref_buf_; // reference solution
+  ThreadPool pool_{std::max(1u, std::thread::hardware_concurrency())}; // for verification
 };
 
 #endif // LLVM_TEST_H
@@ -0,0 +1,453 @@
+#ifndef HOST_TRANSPORT_HPP
+#define HOST_TRANSPORT_HPP 1
+
+// Host transport for QCCL (QCCL_HOST_TRANSPORT=1): every "GPU" is a host
+// thread calling qcclRun() and the exchange slots live in a shared memory
+// mapping. Work items follow exactly the protocol of rcclKernel: the receiver
+// publishes its XOR-encoded target buffer, the sender picks it up, resets
+// the slot, writes the data and bumps SReadyFlagCounter which the receiver
+// waits on. On the GPU each work item is a separate block; here the items
+// of one qcclRun() are polled round-robin by the calling thread, so that an
+// item waiting for its peer never blocks the progress of the others.
+// Data is copied by a shared pool using non-temporal SIMD stores.
+//
+// Persistent plans (qcclPlanCreate) run the pointer handshake only once.
+// Each execution is then synchronized through two steady counters: the
+// receiver bumps SPlanGeneration of its link to announce a new round and
+// waits on SReadyFlagCounter as usual, while each sender counts its own
+// rounds on that link and waits until the receiver has announced them.
+// Links with a registered receive buffer (qcclRegisterBuffer) run every
+// qcclRun() that way, since the sender knows the target buffer up front.
+// Direct senders count their rounds in SRoundsSent, gateways of plans on
+// the host.
+//
+// Transfers are split into QCCL_CHUNK_BYTES chunks: after each chunk the
+// sender bumps SChunksReady of the link. A relay node (qcclRelaySend) stages
+// incoming data in a ring of chunks, announced in SRingChunks, and forwards
+// every chunk as soon as it is ready. Then SChunksConsumed returns credits to
+// its sender, which never runs more than the ring size ahead.
+//
+// With tracing, the polling thread stamps the moments each item gets its
+// pointers, has sent its data and is done, and records the phases once the
+// item completes. Copies are not split into main loop and tail here: all
+// chunks count as MainLoop. Plan rounds have no handshake, so their OutPtrs
+// phase is the wait for the receiver to announce the round.
+
+#include <sys/mman.h>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "qccl_lib.h"
+#include "qccl_work.h"
+#include "qccl_trace.hpp"
+#include "common/host_memcpy.hpp"
+
+class HostTransport {
+
+  // idle polling rounds before the thread starts yielding to others
+  static constexpr uint32_t s_spinRounds = 64;
+  static constexpr bool s_tracePhases = QCCL_TRACE_PHASES;
+
+  struct ItemState {
+    WorkInfo w;
+    uint32_t *rounds = nullptr;   // plans: rounds sent on the outgoing link
+    uint64_t chunk = 0;           // next chunk to send
+    uint32_t peerRing = 0;        // ring size of the receiver (0: no ring)
+    uint32_t readyBase = 0;       // SChunksReady of the incoming link (relays)
+    uint32_t consumedBase = 0;    // SChunksConsumed of the outgoing link
+    bool inReady = false, outReady = false, sent = false, done = false;
+    // trace timestamps (ns): start and, with QCCL_TRACE_PHASES, in / out
+    // pointers ready and data sent
+    uint64_t t0 = 0, tIn = 0, tOut = 0, tSent = 0;
+  };
+
+public:
+  explicit HostTransport(size_t nCopyThreads) : m_pool(nCopyThreads) { }
+
+  // zero-initialized exchange slots shared between threads (and processes
+  // forked after the mapping is created)
+  void **allocExchange(size_t bytes) {
+    auto ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(ptr == MAP_FAILED) {
+      ThrowError<>("HostTransport: unable to map %zu bytes of shared memory",
+            bytes);
+    }
+    return (void **)ptr;
+  }
+
+  void freeExchange(void **buf, size_t bytes) {
+    if(buf != nullptr) {
+      (void)munmap(buf, bytes);
+    }
+  }
+
+  // host clock of trace events
+  static uint64_t nowNs() {
+    return std::chrono::duration_cast< std::chrono::nanoseconds >(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // trace timestamp: phases completed in one polling sweep share a clock
+  // read, which is retaken only after data was copied
+  static uint64_t stampNs() {
+    if(m_stamp == 0) m_stamp = nowNs();
+    return m_stamp;
+  }
+
+  // runs the work items to completion on the calling thread; phases are
+  // recorded to 'trace' (if not null) as call 'round' of this GPU
+  void execute(const WorkInfo *items, size_t num, 
+        QcclTraceRing *trace = nullptr, uint32_t round = 0) {
+    init(items, num, nullptr, trace, round);
+    poll(&HostTransport::step);
+  }
+
+  // runs the pointer handshake of plan items and stores the resolved 
+  // target (and gateway source) buffers back to 'items': returns false if
+  // some receiver is a relay (plan rounds are not chunked)
+  bool preparePlan(WorkInfo *items, size_t num) {
+    init(items, num, nullptr);
+    poll(&HostTransport::stepPrepare);
+    bool ok = true;
+    for(size_t i = 0; i < num; i++) {
+      items[i] = m_states[i].w;
+      ok &= m_states[i].peerRing == 0;
+    }
+    return ok;
+  }
+
+  // executes one round of prepared plan items: 'rounds[i]' counts the rounds
+  // sent by item i on its outgoing link (null if it does not send to a peer)
+  void executePlan(const WorkInfo *items, uint32_t *const *rounds, 
+        size_t num, QcclTraceRing *trace = nullptr, uint32_t round = 0) {
+    init(items, num, rounds, trace, round);
+    poll(&HostTransport::stepPlan);
+  }
+
+private:
+  void init(const WorkInfo *items, size_t num, uint32_t *const *rounds,
+        QcclTraceRing *trace = nullptr, uint32_t round = 0) {
+    m_trace = trace, m_round = round;
+    uint64_t t0 = trace != nullptr ? nowNs() : 0;
+    m_stamp = t0;
+    m_states.resize(num);
+    for(size_t i = 0; i < num; i++) {
+      m_states[i] = ItemState{ .w = items[i], 
+                .rounds = rounds != nullptr ? rounds[i] : nullptr, .t0 = t0 };
+    }
+  }
+
+  // records the phases of a completed item (or the whole item)
+  void traceItem(const ItemState& s) {
+    const auto& w = s.w;
+    uint64_t tDone = stampNs();
+    QcclTraceEvent evs[4];
+    uint32_t n = 0;
+    auto add = [&](QCCL_Phase ph, uint64_t b, uint64_t e) {
+      evs[n++] = QcclTraceEvent{ b, std::max(b, e), m_round,
+            (uint16_t)(&s - m_states.data()), (uint8_t)ph, w.dataOfs != 0,
+            w.incoming.peer, w.outgoing.peer };
+    };
+    if(s_tracePhases) {
+      if(s.tIn != 0) add(QCCL_Phase::InPtrs, s.t0, s.tIn);
+      add(QCCL_Phase::OutPtrs, s.t0, s.tOut);
+      add(QCCL_Phase::MainLoop, std::max(s.tIn, s.tOut), s.tSent);
+      add(QCCL_Phase::Finalize, s.tSent, tDone);
+    } else {
+      add(QCCL_Phase::Item, s.t0, tDone);
+    }
+    qccl_trace::record(m_trace, evs, n);
+  }
+
+  // advances all work items round-robin until all of them are done
+  void poll(bool (HostTransport::*step)(ItemState&)) {
+    uint32_t idle = 0;
+    for(size_t left = m_states.size(); left > 0; ) {
+      bool progress = false;
+      for(auto& s : m_states) {
+        if(s.done) continue;
+        progress |= (this->*step)(s);
+        if(s.done) {
+          left--;
+          if(m_trace != nullptr) traceItem(s);
+        }
+      }
+      m_stamp = 0;
+      if(progress) {
+        idle = 0;
+      } else if(++idle < s_spinRounds) {
+        cpuRelax();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  static uint64_t loadAcquire(void **slot) {
+    return __atomic_load_n((uint64_t *)slot, __ATOMIC_ACQUIRE);
+  }
+
+  static void storeRelease(void **slot, const void *val) {
+    __atomic_store_n((uint64_t *)slot, (uint64_t)val, __ATOMIC_RELEASE);
+  }
+
+  static uint32_t *counter(void **slot, SlotInfo which) {
+    return (uint32_t *)(slot + which);
+  }
+
+  // pointers are XOR'ed against the slot address so that nullptr can be sent
+  static void *encode(const void *ptr, void **slot) {
+    return (void *)(reinterpret_cast< uintptr_t >(ptr) ^
+                    reinterpret_cast< uintptr_t >(slot));
+  }
+
+  // see setupInPtrs(): returns false if the slot is still in use
+  static bool setupInPtrs(ItemState& s) {
+    auto& w = s.w;
+    if(w.ID == w.incoming.peer) {
+      return true; // we are receiving from ourselves
+    }
+    auto slot = w.incoming.exchangeBuf;
+    // wait for consumer to consume previous value before trampling it
+    if(loadAcquire(slot + STargetBuf) != 0) {
+      return false;
+    }
+    // senders count from zero: the number of subscribed peers may change
+    __atomic_store_n(counter(slot, SBufsReceivedCounter), 0, __ATOMIC_RELAXED);
+    w.readyFlagCache = __atomic_load_n(counter(slot, SReadyFlagCounter),
+          __ATOMIC_ACQUIRE);
+    s.readyBase = __atomic_load_n(counter(slot, SChunksReady),
+          __ATOMIC_ACQUIRE);
+    // the ring size must be visible before the target buffer
+    __atomic_store_n(counter(slot, SRingChunks), w.ringChunks, 
+          __ATOMIC_RELEASE);
+    storeRelease(slot + STargetBuf, encode(w.incoming.targetBuf, slot));
+    storeRelease(slot + SSourceBuf, encode(w.outgoing.sourceBuf, slot));
+    return true;
+  }
+
+  // see announceRound(): the receiver of a plan or registered link tells 
+  // its senders that it is ready for a new round
+  static bool announceRound(WorkInfo& w) {
+    if(w.dataOfs == 0 && w.ID != w.incoming.peer) {
+      auto slot = w.incoming.exchangeBuf;
+      w.readyFlagCache = __atomic_load_n(counter(slot, SReadyFlagCounter),
+            __ATOMIC_ACQUIRE);
+      __atomic_add_fetch(counter(slot, SPlanGeneration), 1, __ATOMIC_ACQ_REL);
+    }
+    return true;
+  }
+
+  // see waitRoundAnnounced(): true if the receiver is ready for the next
+  // round of a sender which has sent 'rounds' so far
+  static bool roundAnnounced(const WorkInfo& w, uint32_t rounds) {
+    auto gen = __atomic_load_n(counter(w.outgoing.exchangeBuf, 
+          SPlanGeneration), __ATOMIC_ACQUIRE);
+    return (int32_t)(gen - (rounds + 1)) >= 0;
+  }
+
+  // see setupGatewayPtrs(): forwards the source buffer of the incoming peer
+  static bool setupGatewayPtrs(WorkInfo& w) {
+    if(w.outgoing.sourceBuf != nullptr) {
+      return true; // the sender's own piece
+    }
+    auto slot = w.incoming.exchangeBuf;
+    auto ptr = loadAcquire(slot + SSourceBuf);
+    if(ptr == 0) {
+      return false;
+    }
+    w.outgoing.sourceBuf = (uint8_t *)encode((void *)ptr, slot);
+    return true;
+  }
+
+  // see setupOutPtrs(): obtains the target buffer of the outgoing peer
+  static bool setupOutPtrs(ItemState& s) {
+    auto& w = s.w;
+    if(w.ID == w.outgoing.peer) {
+      w.targetBuf = w.incoming.targetBuf;
+      return true;
+    }
+    auto slot = w.outgoing.exchangeBuf;
+    auto ptr = loadAcquire(slot + STargetBuf);
+    if(ptr == 0) {
+      return false;
+    }
+    w.targetBuf = (uint8_t *)encode((void *)ptr, slot);
+    s.peerRing = __atomic_load_n(counter(slot, SRingChunks), __ATOMIC_ACQUIRE);
+    s.consumedBase = __atomic_load_n(counter(slot, SChunksConsumed),
+          __ATOMIC_ACQUIRE);
+    return true;
+  }
+
+  // copies chunks [s.chunk, nChunks) as far as the input is ready and the 
+  // receiver has credits: returns true if at least one chunk was sent
+  bool sendChunks(ItemState& s) {
+    auto& w = s.w;
+    const uint64_t size = w.outgoing.size,
+                   nChunks = (size + QCCL_CHUNK_BYTES - 1) / QCCL_CHUNK_BYTES;
+    auto outSlot = w.outgoing.exchangeBuf, inSlot = w.incoming.exchangeBuf;
+    const bool toPeer = w.ID != w.outgoing.peer, relay = w.ringChunks > 0;
+    auto k0 = s.chunk;
+    for(; s.chunk < nChunks; s.chunk++) {
+      auto k = s.chunk;
+      if(relay) { // forward only chunks which have landed in our ring
+        auto ready = __atomic_load_n(counter(inSlot, SChunksReady),
+              __ATOMIC_ACQUIRE);
+        if((uint32_t)(ready - s.readyBase) <= (uint32_t)k) break;
+      }
+      if(s.peerRing > 0) { // wait for credits from a relay receiver
+        auto consumed = __atomic_load_n(counter(outSlot, SChunksConsumed),
+              __ATOMIC_ACQUIRE);
+        if((uint32_t)k - (uint32_t)(consumed - s.consumedBase) >= s.peerRing)
+          break;
+      }
+      uint64_t ofs = k * QCCL_CHUNK_BYTES, 
+               len = std::min< uint64_t >(QCCL_CHUNK_BYTES, size - ofs),
+               srcOfs = relay ? (k % w.ringChunks) * QCCL_CHUNK_BYTES : ofs,
+               dstOfs = s.peerRing > 0 ? 
+                        (k % s.peerRing) * QCCL_CHUNK_BYTES : ofs;
+      if(w.outgoing.sourceBuf != nullptr) {
+        parallelCopy(&m_pool, w.targetBuf + w.dataOfs + dstOfs,
+              w.outgoing.sourceBuf + w.dataOfs + srcOfs, len);
+      }
+      if(toPeer) {
+        __atomic_add_fetch(counter(outSlot, SChunksReady), 1, __ATOMIC_ACQ_REL);
+      }
+      if(relay) { // the ring slot can be reused by our sender
+        __atomic_add_fetch(counter(inSlot, SChunksConsumed), 1, 
+              __ATOMIC_ACQ_REL);
+      }
+    }
+    return s.chunk != k0;
+  }
+
+  static void resetBufferPtrs(const WorkInfo& w) {
+    auto slot = w.outgoing.exchangeBuf;
+    auto val = __atomic_add_fetch(counter(slot, SBufsReceivedCounter), 1,
+          __ATOMIC_ACQ_REL);
+    if(val % w.nPeers == 0) {
+      storeRelease(slot + STargetBuf, nullptr);
+    }
+  }
+
+  // see finalizeSendRecv(): true if the receive side is complete
+  static bool receiveDone(const WorkInfo& w) {
+    if(w.dataOfs != 0 || w.incoming.targetBuf == nullptr ||
+          w.ID == w.incoming.peer) {
+      return true; // gateway nodes and pure senders do not wait
+    }
+    auto val = __atomic_load_n(counter(w.incoming.exchangeBuf,
+          SReadyFlagCounter), __ATOMIC_ACQUIRE);
+    return val - w.readyFlagCache == w.nPeers;
+  }
+
+  // advances one work item as far as possible: returns true on progress
+  bool step(ItemState& s) {
+    auto& w = s.w;
+    bool progress = false;
+    const bool regOut = w.flags & WRegisteredOut;
+    if(!s.inReady) {
+      s.inReady = w.flags & WRegisteredIn ? announceRound(w) :
+                  w.dataOfs == 0 ? setupInPtrs(s) : setupGatewayPtrs(w);
+      progress |= s.inReady;
+      if(s.inReady && s_tracePhases && m_trace != nullptr) s.tIn = stampNs();
+    }
+    if(!s.outReady) {
+      s.outReady = regOut ? roundAnnounced(w, *w.roundsSent) : 
+                            setupOutPtrs(s);
+      progress |= s.outReady;
+      if(s.outReady) {
+        if(!regOut) resetBufferPtrs(w);
+        if(s_tracePhases && m_trace != nullptr) s.tOut = stampNs();
+      }
+    }
+    if(!(s.inReady && s.outReady)) {
+      return progress;
+    }
+    if(!s.sent) {
+      if(sendChunks(s)) {
+        progress = true, m_stamp = 0;
+      }
+      if(s.chunk * QCCL_CHUNK_BYTES < w.outgoing.size) {
+        return progress;
+      }
+      if(regOut) ++*w.roundsSent;
+      // publishes the data written above
+      __atomic_add_fetch(counter(w.outgoing.exchangeBuf, SReadyFlagCounter),
+            1, __ATOMIC_ACQ_REL);
+      s.sent = progress = true;
+      if(s_tracePhases && m_trace != nullptr) s.tSent = stampNs();
+    }
+    if(receiveDone(w)) {
+      s.done = progress = true;
+    }
+    return progress;
+  }
+
+  // pointer handshake only: resolves buffers and releases the slots
+  // (registered links have nothing to exchange)
+  bool stepPrepare(ItemState& s) {
+    auto& w = s.w;
+    const bool regOut = w.flags & WRegisteredOut;
+    bool progress = false;
+    if(!s.inReady) {
+      s.inReady = w.flags & WRegisteredIn ||
+            (w.dataOfs == 0 ? setupInPtrs(s) : setupGatewayPtrs(w));
+      progress |= s.inReady;
+    }
+    if(!s.outReady) {
+      s.outReady = regOut || setupOutPtrs(s);
+      progress |= s.outReady;
+    }
+    if(s.inReady && s.outReady) {
+      if(!regOut) resetBufferPtrs(w);
+      s.done = progress = true;
+    }
+    return progress;
+  }
+
+  // one round of a prepared plan item
+  bool stepPlan(ItemState& s) {
+    auto& w = s.w;
+    bool progress = false;
+    if(!s.inReady) { // announce the round to our senders
+      s.inReady = progress = announceRound(w);
+    }
+    if(!s.sent) {
+      auto slot = w.outgoing.exchangeBuf;
+      bool toPeer = w.ID != w.outgoing.peer;
+      if(toPeer && !roundAnnounced(w, *s.rounds)) {
+        return progress; // the receiver is not yet ready for this round
+      }
+      if(s_tracePhases && m_trace != nullptr) s.tOut = stampNs();
+      if(w.outgoing.sourceBuf != nullptr) {
+        parallelCopy(&m_pool, w.targetBuf + w.dataOfs,
+              w.outgoing.sourceBuf + w.dataOfs, w.outgoing.size);
+        m_stamp = 0;
+      }
+      if(toPeer) {
+        ++*s.rounds;
+        __atomic_add_fetch(counter(slot, SReadyFlagCounter), 1, 
+              __ATOMIC_ACQ_REL);
+      }
+      s.sent = progress = true;
+      if(s_tracePhases && m_trace != nullptr) s.tSent = stampNs();
+    }
+    if(receiveDone(w)) {
+      s.done = progress = true;
+    }
+    return progress;
+  }
+
+  ThreadPool m_pool;                // copy threads shared by all peers
+  // item states of the calling thread: GPU IDs are run concurrently
+  thread_local static inline std::vector< ItemState > m_states;
+  thread_local static inline QcclTraceRing *m_trace = nullptr;
+  thread_local static inline uint32_t m_round = 0;
+  thread_local static inline uint64_t m_stamp = 0; // see stampNs()
+}; // HostTransport
+
+#endif // HOST_TRANSPORT_HPP
@@ -2,17 +2,32 @@
 // hipcc -I.. -DCOMPILE_FOR_ROCM=1 -std=c++17 --offload-arch=gfx90a test_main.cc
 
 #include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <stdexcept>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <fstream>
 #include <numeric>
 #include <random>
 #include <thread>
+#include <unordered_map>
 #include "qccl_lib.h"
-#include "buffer_addressing.hpp"
+#include "qccl_work.h"
+#include "qccl_trace.hpp"
 #include "common/threading.hpp"
+#if QCCL_HOST_TRANSPORT
+#include "host_transport.hpp"
+#include "qccl_reduce.hpp"
+#else
+#include <hip/hip_fp16.h>
+#include <hip/hip_bfloat16.h>
+#include "buffer_addressing.hpp"
 #include "common/common_utils.hpp"
+#endif
 
 // AMDGPU docs https://llvm.org/docs/AMDGPU/
 
@@ -50,49 +65,32 @@
 #define ATOMIC_STORE(PTR, VAL) (PTR)[0] = (VAL)
 #endif
 
-enum SlotInfo {
-  STargetBuf = 0,
-  SSourceBuf,
-  SBufsReceivedCounter,
-  SReadyFlagCounter, // steady counter used to monitor if data write is done
-  STotalSlots,
-};
-
-struct OutgoingWorkItem { // outgoing/send work item (what this node sends out)
-  uint32_t peer;      // send peer
-  uint32_t size;      // buffer size in bytes (limited by 4GB!)
-  void **exchangeBuf; // shared buffer for exchanging pointers between GPUs:
-                      // this should be set accordingly for each p2p channel (pair of GPUs)
-                      // It has two entries: one for ptr exchange and one for end-of-transfer flag
-  uint8_t *sourceBuf; // source (send) buffer 
-};
+#if !QCCL_HOST_TRANSPORT
+template < uint32_t BlockSz, uint32_t NumRegs >
+__global__ void rcclKernel(WorkInfo *gworkInfo, QcclTraceRing *trace,
+      uint32_t round);
 
-struct IncomingWorkItem { // incoming/recv work item (place where to receive the data)
-  uint32_t peer;      // recv peer
-  uint32_t size;      // buffer size in bytes (limited by 4GB!)
-  void **exchangeBuf; // shared buffer for exchanging pointers between GPUs:
-                      // this should be set accordingly for each p2p channel (pair of GPUs)
-                      // It has two entries: one for ptr exchange and one for end-of-transfer flag
-  uint8_t *targetBuf; // target (recv) buffer 
-};
+// stores the device wall clock to *ticks (relates trace clocks to the host)
+__global__ void traceClockKernel(uint64_t *ticks);
 
-struct WorkInfo
-{
-  uint32_t ID;        // my own ID (debug only)
-  uint32_t nPeers;    // this should be the number of peers connected to a given 
-                      // exchange buffer
-  uint32_t dataOfs;   // data offset usually only set for gateway nodes !!
-  uint32_t readyFlagCache; // entry used to cache SReadyFlagCounter values
-  uint8_t *targetBuf;         // target buffer to be shared 
-  IncomingWorkItem incoming;
-  OutgoingWorkItem outgoing;
-};
+// dst[i] = op(dst[i], src[i]) on a stream (collectives)
+void qcclReduceDevice(QCCL_DataType dtype, QCCL_RedOp op, void *dst,
+      const void *src, size_t n, cudaStream_t stream);
+#endif
 
-static_assert(sizeof(WorkInfo) % sizeof(uint64_t) == 0, 
-    "Size must be aligned by 8 bytes");
+class GpuCommLib;
 
-template < uint32_t BlockSz, uint32_t NumRegs >
-__global__ void rcclKernel(WorkInfo *gworkInfo);
+struct QcclPlan {
+  GpuCommLib *comm;                // communicator of the plan
+  uint32_t ID;                     // GPU running this plan
+  std::vector< WorkInfo > items;   // work items with resolved buffers (host)
+#if QCCL_HOST_TRANSPORT
+  std::vector< uint32_t * > rounds;  // per-item rounds sent on its link
+#else
+  WorkInfo *workBuf = nullptr;     // items uploaded to device memory once
+#endif
+  uint64_t regGeneration;          // buffer registrations the items match
+};
 
 class GpuCommLib {
 
@@ -107,42 +105,79 @@ Data size: 32.00 Mb; time elapsed: 0.183 ms, bandwidth: 183.046 Gb/s
 */
 
   static constexpr size_t s_defNumWorkItems = 8;
+  static constexpr uint32_t s_queueSize = 1024; // submitted work items per GPU
   static constexpr size_t s_numWorkThreads = 256;
   static constexpr size_t s_numRegsPerThread = 32;
 
+  // receive buffer of a link registered by its receiver (qcclRegisterBuffer)
+  struct Registration {
+    uint8_t *buf;
+    size_t size;
+  };
+
   struct ThreadInfo {
     int gpuId;             // gpu ID assigned to this thread
     WorkInfo *workBuf;     // work buffer global memory
     void **exchangeBuf;    // shared buffer for exchanging pointers
     size_t numDevWorkItems;   // the number of workBuf items preallocated in device mem
-    std::vector< WorkInfo > workItems;  // the list of current work items submitted
+    // work items submitted by any thread and not yet taken by run()
+    std::unique_ptr< MpscQueue< WorkInfo, s_queueSize > > queue;
+    std::vector< WorkInfo > workItems;  // the work items taken for the next run
+    uint8_t *scratch = nullptr;   // temporary buffer of collectives
+    size_t scratchSz = 0;
+    uint32_t round = 0;           // qcclRun / qcclPlanExecute calls (tracing)
+    QcclTraceRing *trace = nullptr; // event ring (device memory for kernels)
+    QcclTraceRing hostRing{};     // host copy of the ring header
+    double usPerTick = 0, offsetUs = 0; // trace clock -> common clock
+    // registered receive buffers keyed by the sending peer
+    std::unordered_map< uint32_t, Registration > registered;
+#if QCCL_HOST_TRANSPORT
+    // gateway plan rounds sent on each link (keyed by the exchange slot)
+    std::unordered_map< void **, uint32_t > linkRounds;
+#endif
   };
 
   bool m_initialized = false;
+  size_t m_exchangeSz = 0;
+  uint64_t m_regGeneration = 0;   // bumped by every (de)registration
   std::vector< ThreadInfo > m_infos;
+#if QCCL_HOST_TRANSPORT
+  std::shared_ptr< HostTransport > m_host;
+#endif
 
 public:
-  static GpuCommLib& i() {
-    static GpuCommLib obj;
-    return obj;
-  }
+  GpuCommLib() = default;
+  GpuCommLib(const GpuCommLib&) = delete;
+  GpuCommLib& operator=(const GpuCommLib&) = delete;
 
   QCCL_Result init(size_t nGpus, const uint32_t *gpuIds) {
     if(m_initialized) return QCCL_Result::OK;
 
     m_infos.resize(nGpus);
-    size_t exchangeSz = sizeof(void *) * STotalSlots * 8;
+    m_exchangeSz = sizeof(void *) * STotalSlots * std::max< size_t >(nGpus, 8);
+#if QCCL_HOST_TRANSPORT
+    m_host = sharedHost();
     for(uint32_t i = 0; i < nGpus; i++) {
       auto& info = m_infos[i];
       info.gpuId = gpuIds != nullptr ? gpuIds[i] : i;
+      info.queue = std::make_unique< MpscQueue< WorkInfo, s_queueSize > >();
+      info.workItems.reserve(s_defNumWorkItems);
+      info.exchangeBuf = m_host->allocExchange(m_exchangeSz);
+      info.workBuf = nullptr, info.numDevWorkItems = 0;
+    }
+#else
+    for(uint32_t i = 0; i < nGpus; i++) {
+      auto& info = m_infos[i];
+      info.gpuId = gpuIds != nullptr ? gpuIds[i] : i;
+      info.queue = std::make_unique< MpscQueue< WorkInfo, s_queueSize > >();
       info.workItems.reserve(s_defNumWorkItems);
       CHK(cudaSetDevice(info.gpuId));
       int flags = //hipDeviceMallocDefault;
                   hipDeviceMallocFinegrained;
                   // hipDeviceMallocUncached;
                   // hipMallocSignalMemory;
-      CHK(hipExtMallocWithFlags((void **)&info.exchangeBuf, exchangeSz, flags));
-      CHK(cudaMemset(info.exchangeBuf, 0, exchangeSz));
+      CHK(hipExtMallocWithFlags((void **)&info.exchangeBuf, m_exchangeSz, flags));
+      CHK(cudaMemset(info.exchangeBuf, 0, m_exchangeSz));
       allocWorkBuf(&info, s_defNumWorkItems);
     }
     for(const auto& info : m_infos) {
@@ -156,9 +191,16 @@ public:
         if(enable == 0) {
           ThrowError<>("GPU %d is unable to access peer %d", info.gpuId, gj);
         }
-        CHK(cudaDeviceEnablePeerAccess(gj, 0));
+        // another communicator may have enabled it already
+        if(auto res = cudaDeviceEnablePeerAccess(gj, 0); 
+              res == cudaErrorPeerAccessAlreadyEnabled) {
+          (void)cudaGetLastError();
+        } else {
+          CHK(res);
+        }
       }
     } // for info
+#endif // QCCL_HOST_TRANSPORT
     m_initialized = true;
 
 #if 0
@@ -180,17 +222,31 @@ public:
     // exchangeBuf[2] - writing done flag.. (we also should have several ones)
 
     if(!m_initialized) return QCCL_Result::NotInitialized;
-    if(ID >= m_infos.size()) return QCCL_Result::InvalidParams;
+    if(ID >= m_infos.size() || inPeer >= m_infos.size() || 
+          outPeer >= m_infos.size()) return QCCL_Result::InvalidParams;
+    WorkInfo w;
+    if(auto res = directItem(ID, numSubscribedPeers, inPeer, targetBuf, 
+          inSize, outPeer, sourceBuf, outSize, w); res != QCCL_Result::OK) 
+      return res;
+    return submit(m_infos[ID], w);
+  }
+
+  // the send-recv item of GPU 'ID' with its registered links resolved
+  QCCL_Result directItem(uint32_t ID, uint32_t numSubscribedPeers, 
+        uint32_t inPeer, void *targetBuf, size_t inSize, 
+        uint32_t outPeer, void *sourceBuf, size_t outSize, WorkInfo& w) {
+
     auto& info = m_infos[ID];
     // NOTE: exchange pointers are always allocated on the receiver side!!
-    auto& w = info.workItems.emplace_back();
+    w = WorkInfo{};
     w.ID = ID;
     w.nPeers = numSubscribedPeers, // usually we know how many peers are there
     w.dataOfs = 0,
     w.readyFlagCache = 0,
+    w.ringChunks = 0,
     w.incoming = { // whom we are receiving from
           .peer = inPeer,
-          .size = (uint32_t)inSize,
+          .size = inSize,
           // exchange buf on the receiver side: two entries per link
           // (we are receiver here): there we always publish our pointer
           .exchangeBuf = (void **)m_infos[ID].exchangeBuf + inPeer*STotalSlots,
@@ -198,13 +254,15 @@ public:
     };
     w.outgoing = { // whom we are sending to
           .peer = outPeer,
-          .size = (uint32_t)outSize,
+          .size = outSize,
           // exchange buf on the receiver side: two entries per link
           // node 'outPeer' is a receiver 
           .exchangeBuf = (void **)m_infos[outPeer].exchangeBuf + ID*STotalSlots,
           .sourceBuf = (uint8_t *)sourceBuf,
     };
-    return QCCL_Result::OK;
+    w.roundsSent = ID != outPeer ? (uint32_t *)(info.exchangeBuf + 
+          outPeer*STotalSlots + SRoundsSent) : nullptr;
+    return resolveRegistered(ID, w);
   }
 
   // 2 needs read buffer from 0 and write buffer from 1
@@ -216,44 +274,105 @@ public:
          size_t dataOfs, size_t dataSize) {
 
     if(!m_initialized) return QCCL_Result::NotInitialized;
-    if(ID >= m_infos.size()) return QCCL_Result::InvalidParams;
+    if(ID >= m_infos.size() || peerStart >= m_infos.size() || 
+          peerEnd >= m_infos.size()) return QCCL_Result::InvalidParams;
     auto& info = m_infos[ID];
+    // registered links have a single sender
+    if(m_infos[peerEnd].registered.count(peerStart) != 0) 
+      return QCCL_Result::InvalidParams;
+    return submit(info, gatewayItem(ID, numSubscribedPeers, peerStart, 
+          peerEnd, dataOfs, dataSize));
+  }
+
+  WorkInfo gatewayItem(uint32_t ID, uint32_t numSubscribedPeers,
+         uint32_t peerStart, uint32_t peerEnd, 
+         size_t dataOfs, size_t dataSize) {
 
-    static int ii = 1000;
     // here we are receiving from 'peerStart' and forwarding to 'peerEnd'
-    auto& w = info.workItems.emplace_back();
+    WorkInfo w{};
     w.ID = 1000 + ID;
     w.nPeers = numSubscribedPeers,
     w.dataOfs = dataOfs,
     w.readyFlagCache = 0,
+    w.ringChunks = 0,
     // exchange buf is always on the "other" side for gateway nodes
     // we read pointers from peerStart and peerEnd
+    // NOTE: the source buffer is published by peerStart on its link with 
+    // peerEnd, hence peerStart must also receive from peerEnd (bidirectional)
     w.incoming = { // whom we are receiving from
           .peer = peerStart,
-          .size = (uint32_t)dataSize,
-          .exchangeBuf = (void **)m_infos[peerStart].exchangeBuf, 
+          .size = dataSize,
+          .exchangeBuf = (void **)m_infos[peerStart].exchangeBuf + peerEnd*STotalSlots, 
           .targetBuf = nullptr,
     };
     w.outgoing = { // whom we are sending to
           .peer = peerEnd,
-          .size = (uint32_t)dataSize,
+          .size = dataSize,
           // we are attaching to peerStart -- peerEnd communication link
           // since there must be a direct connection from peerStart to peerEnd too
-          .exchangeBuf = (void **)m_infos[peerEnd].exchangeBuf, 
+          .exchangeBuf = (void **)m_infos[peerEnd].exchangeBuf + peerStart*STotalSlots, 
           .sourceBuf = nullptr,
     };
-    return QCCL_Result::OK;
+    w.roundsSent = nullptr, w.flags = 0;
+    return w;
+  }
+
+  // receives from 'recvPeer' into a ring of chunks and forwards them to
+  // 'sendPeer' while the rest is still in flight
+  QCCL_Result relaySend(uint32_t ID, uint32_t recvPeer, uint32_t sendPeer,
+         void *stageBuf, size_t stageBytes, size_t size) {
+
+    if(!m_initialized) return QCCL_Result::NotInitialized;
+    if(ID >= m_infos.size() || recvPeer >= m_infos.size() || 
+          sendPeer >= m_infos.size() || recvPeer == ID || sendPeer == ID ||
+          stageBuf == nullptr || stageBytes < QCCL_CHUNK_BYTES ||
+          m_infos[ID].registered.count(recvPeer) != 0 ||
+          m_infos[sendPeer].registered.count(ID) != 0) 
+      return QCCL_Result::InvalidParams;
+    auto& info = m_infos[ID];
+    WorkInfo w{};
+    w.ID = ID;
+    w.nPeers = 1,
+    w.dataOfs = 0,
+    w.readyFlagCache = 0,
+    w.ringChunks = stageBytes / QCCL_CHUNK_BYTES,
+    w.incoming = { // recvPeer writes chunks into our ring
+          .peer = recvPeer,
+          .size = size,
+          .exchangeBuf = (void **)m_infos[ID].exchangeBuf + recvPeer*STotalSlots,
+          .targetBuf = (uint8_t *)stageBuf,
+    };
+    w.outgoing = { // and we forward them from the ring
+          .peer = sendPeer,
+          .size = size,
+          .exchangeBuf = (void **)m_infos[sendPeer].exchangeBuf + ID*STotalSlots,
+          .sourceBuf = (uint8_t *)stageBuf,
+    };
+    w.roundsSent = nullptr, w.flags = 0;
+    return submit(info, w);
   }
 
   // execute previously enqueued send-recv tasks for this thread (one GPU)
   QCCL_Result run(uint32_t ID, cudaStream_t stream) {
 
+    if(!m_initialized) return QCCL_Result::NotInitialized;
+    if(ID >= m_infos.size()) return QCCL_Result::InvalidParams;
     auto& info = m_infos[ID];
+    drain(info);
+#if QCCL_HOST_TRANSPORT
+    // transfers run on this thread after the work queued on the stream
+    if(cudaStreamSynchronize(stream) != cudaSuccess) return QCCL_Result::Failed;
+    m_host->execute(info.workItems.data(), info.workItems.size(), info.trace,
+          info.round++);
+    info.workItems.clear();
+    return QCCL_Result::OK;
+#else
     CHK(cudaSetDevice(info.gpuId));
 
     if(info.numDevWorkItems < info.workItems.size()) {
       CHK(cudaFree(info.workBuf));
-      allocWorkBuf(&info, info.numDevWorkItems * 3 / 2);
+      allocWorkBuf(&info, std::max(info.workItems.size(), 
+            info.numDevWorkItems * 3 / 2));
     }
     uint32_t nBlocks = info.workItems.size();
     // VLOG(ID << ": workItemSz: " << sizeof(WorkInfo) << " running with #blocks: " 
@@ -264,23 +383,567 @@ public:
     
     constexpr uint32_t BlockSz = s_numWorkThreads;
     rcclKernel<BlockSz, s_numRegsPerThread><<<nBlocks, BlockSz, 0, stream>>>
-                                      (info.workBuf);
+                                      (info.workBuf, info.trace, info.round++);
     info.workItems.clear();
     return QCCL_Result::OK;
+#endif // QCCL_HOST_TRANSPORT
+  }
+
+  QCCL_Result planCreate(uint32_t ID, QcclPlan **pplan) {
+
+    if(!m_initialized) return QCCL_Result::NotInitialized;
+    if(ID >= m_infos.size() || pplan == nullptr) 
+      return QCCL_Result::InvalidParams;
+    auto& info = m_infos[ID];
+    drain(info);
+    if(info.workItems.empty()) return QCCL_Result::InvalidParams;
+    for(const auto& w : info.workItems) {
+      // relays are not supported: plan rounds are not chunked
+      if(w.nPeers == 0 || w.ringChunks > 0 || w.incoming.peer >= m_infos.size() ||
+            w.outgoing.peer >= m_infos.size()) {
+        return QCCL_Result::InvalidParams;
+      }
+    }
+    auto plan = std::make_unique< QcclPlan >();
+    plan->comm = this;
+    plan->ID = ID;
+    plan->regGeneration = m_regGeneration;
+    plan->items.swap(info.workItems);
+    info.workItems.reserve(s_defNumWorkItems);
+#if QCCL_HOST_TRANSPORT
+    if(!m_host->preparePlan(plan->items.data(), plan->items.size())) {
+      return QCCL_Result::InvalidParams;
+    }
+    // direct sends count their rounds in the link's SRoundsSent, shared 
+    // with registered buffers; gateways attach to links of other GPUs
+    for(const auto& w : plan->items) {
+      plan->rounds.push_back(w.ID == w.outgoing.peer ? nullptr : 
+            w.dataOfs == 0 ? w.roundsSent : 
+            &info.linkRounds[w.outgoing.exchangeBuf]);
+    }
+#else
+    CHK(cudaSetDevice(info.gpuId));
+    auto bytes = sizeof(WorkInfo) * plan->items.size();
+    CHK(cudaMalloc((void **)&plan->workBuf, bytes));
+    CHK(cudaMemcpy(plan->workBuf, plan->items.data(), bytes, 
+          cudaMemcpyHostToDevice));
+#endif
+    *pplan = plan.release();
+    return QCCL_Result::OK;
+  }
+
+  QCCL_Result planExecute(QcclPlan *plan, cudaStream_t stream) {
+
+    if(!m_initialized) return QCCL_Result::NotInitialized;
+    if(plan == nullptr) return QCCL_Result::InvalidParams;
+    if(plan->regGeneration != m_regGeneration) {
+      // registrations changed since the plan was made: its items must still
+      // see the same registered links and buffers
+      for(const auto& w : plan->items) {
+        auto v = w;
+        if(w.dataOfs != 0) continue;
+        if(resolveRegistered(plan->ID, v) != QCCL_Result::OK || 
+              v.flags != w.flags || v.targetBuf != w.targetBuf) 
+          return QCCL_Result::InvalidParams;
+      }
+      plan->regGeneration = m_regGeneration;
+    }
+#if QCCL_HOST_TRANSPORT
+    if(cudaStreamSynchronize(stream) != cudaSuccess) return QCCL_Result::Failed;
+    auto& info = m_infos[plan->ID];
+    m_host->executePlan(plan->items.data(), plan->rounds.data(), 
+          plan->items.size(), info.trace, info.round++);
+#else
+    // the kernel only reads work items: no need to upload them again
+    auto& info = m_infos[plan->ID];
+    CHK(cudaSetDevice(info.gpuId));
+    constexpr uint32_t BlockSz = s_numWorkThreads;
+    rcclKernel<BlockSz, s_numRegsPerThread>
+          <<<(uint32_t)plan->items.size(), BlockSz, 0, stream>>>(plan->workBuf,
+                info.trace, info.round++);
+#endif
+    return QCCL_Result::OK;
+  }
+
+  // 'recvBuf' of GPU ID receives everything 'peer' sends to it from now on:
+  // the sender writes there without asking for the address
+  QCCL_Result registerBuffer(uint32_t ID, uint32_t peer, void *recvBuf,
+        size_t size) {
+
+    if(!m_initialized) return QCCL_Result::NotInitialized;
+    if(ID >= m_infos.size() || peer >= m_infos.size() || peer == ID ||
+          recvBuf == nullptr || size == 0) 
+      return QCCL_Result::InvalidParams;
+    m_infos[ID].registered[peer] = { (uint8_t *)recvBuf, size };
+    m_regGeneration++;
+    return QCCL_Result::OK;
+  }
+
+  QCCL_Result deregisterBuffer(uint32_t ID, uint32_t peer) {
+
+    if(!m_initialized) return QCCL_Result::NotInitialized;
+    if(ID >= m_infos.size() || m_infos[ID].registered.erase(peer) == 0) 
+      return QCCL_Result::InvalidParams;
+    m_regGeneration++;
+    return QCCL_Result::OK;
+  }
+
+  QCCL_Result planDestroy(QcclPlan *plan) {
+    if(plan == nullptr) return QCCL_Result::InvalidParams;
+#if !QCCL_HOST_TRANSPORT
+    (void)cudaSetDevice(m_infos[plan->ID].gpuId);
+    (void)cudaFree(plan->workBuf);
+#endif
+    delete plan;
+    return QCCL_Result::OK;
+  }
+
+  QCCL_Result allReduce(uint32_t ID, const void *sendBuf, void *recvBuf,
+        size_t count, QCCL_DataType dtype, QCCL_RedOp op, cudaStream_t stream,
+        QCCL_Algo algo) {
+
+    CollArgs a;
+    if(auto res = collInit(ID, count, dtype, op, stream, algo, false, a);
+          res != QCCL_Result::OK) return res;
+    a.work = (uint8_t *)recvBuf;
+    localCopy(a.work, sendBuf, count * a.elemSz, stream);
+    if(auto res = reduceScatter(a, algo); res != QCCL_Result::OK) return res;
+    return allGather(a, algo);
+  }
+
+  QCCL_Result reduceScatter(uint32_t ID, const void *sendBuf, void *recvBuf,
+        size_t recvCount, QCCL_DataType dtype, QCCL_RedOp op, 
+        cudaStream_t stream, QCCL_Algo algo) {
+
+    CollArgs a;
+    if(auto res = collInit(ID, recvCount * m_infos.size(), dtype, op, stream, 
+          algo, true, a); res != QCCL_Result::OK) return res;
+    // the send buffer is read-only: reduce a copy of it
+    localCopy(a.work, sendBuf, a.total * a.elemSz, stream);
+    if(auto res = reduceScatter(a, algo); res != QCCL_Result::OK) return res;
+    localCopy(recvBuf, a.ptr(ID), recvCount * a.elemSz, stream);
+    return QCCL_Result::OK;
+  }
+
+  QCCL_Result allGather(uint32_t ID, const void *sendBuf, void *recvBuf,
+        size_t sendCount, QCCL_DataType dtype, cudaStream_t stream, 
+        QCCL_Algo algo) {
+
+    CollArgs a;
+    if(auto res = collInit(ID, sendCount * m_infos.size(), dtype, 
+          QCCL_RedOp::Sum, stream, algo, false, a); res != QCCL_Result::OK) 
+      return res;
+    a.work = (uint8_t *)recvBuf;
+    localCopy(a.ptr(ID), sendBuf, sendCount * a.elemSz, stream);
+    return allGather(a, algo);
+  }
+
+  // every transfer is split into pieces of about QCCL_A2AV_PIECE_BYTES: the
+  // direct send-recv item carries piece 0, the others are gateway items of 
+  // the sender which know their source. Hence large transfers get more work
+  // items (blocks) than small ones instead of one per peer. Both ends of a 
+  // link must agree on the number of subscribed peers, i.e. pieces, which is
+  // why a link uses the larger piece count of its two directions
+  QCCL_Result allToAllv(uint32_t ID, const void *sendBuf, 
+        const size_t *sendCounts, const size_t *sendDispls, void *recvBuf,
+        const size_t *recvCounts, const size_t *recvDispls, 
+        QCCL_DataType dtype, cudaStream_t stream) {
+
+    if(!m_initialized) return QCCL_Result::NotInitialized;
+    if(ID >= m_infos.size() || sendCounts == nullptr || 
+          sendDispls == nullptr || recvCounts == nullptr || 
+          recvDispls == nullptr) return QCCL_Result::InvalidParams;
+    auto& info = m_infos[ID];
+    if(!info.queue->empty() || !info.workItems.empty()) 
+      return QCCL_Result::InvalidParams;
+    const size_t elemSz = dtype == QCCL_DataType::Float32 || 
+                          dtype == QCCL_DataType::Int32 ? 4 : 2;
+    // the items go straight to workItems since this thread runs ID: up to
+    // nGpus * QCCL_A2AV_MAX_PIECES of them need not fit into the queue.
+    // All are validated before any transfer starts, hence an invalid peer 
+    // fails the whole call and no rank is left half-submitted
+    auto src = (uint8_t *)sendBuf, dst = (uint8_t *)recvBuf;
+    auto& items = info.workItems;
+    for(uint32_t i = 0; i < m_infos.size(); i++) {
+      size_t sendBytes = sendCounts[i] * elemSz,
+             recvBytes = recvCounts[i] * elemSz;
+      if(sendBytes == 0 && recvBytes == 0) continue;
+      // registered links have a single sender
+      bool single = i == ID || info.registered.count(i) != 0 ||
+            m_infos[i].registered.count(ID) != 0;
+      uint32_t nPieces = single ? 1 : 
+            std::max(a2avPieces(sendBytes), a2avPieces(recvBytes));
+      auto s = src + sendDispls[i] * elemSz;
+      auto& w = items.emplace_back();
+      if(auto res = directItem(ID, nPieces, i, dst + recvDispls[i] * elemSz, 
+            recvBytes, i, s, a2avPieceEnd(sendBytes, nPieces, 0), w); 
+            res != QCCL_Result::OK) {
+        items.clear();
+        return res;
+      }
+      for(uint32_t k = 1; k < nPieces; k++) {
+        size_t ofs = a2avPieceOfs(sendBytes, nPieces, k);
+        auto& g = items.emplace_back(gatewayItem(ID, nPieces, ID, i, ofs, 
+              a2avPieceEnd(sendBytes, nPieces, k) - ofs));
+        g.outgoing.sourceBuf = s;
+      }
+    }
+    return run(ID, stream);
   }
 
   ~GpuCommLib() {
     for(auto& info : m_infos) {
+      freeTrace(info);
+#if QCCL_HOST_TRANSPORT
+      m_host->freeExchange(info.exchangeBuf, m_exchangeSz);
+      std::free(info.scratch);
+#else
       (void)cudaSetDevice(info.gpuId);
+      (void)cudaFree(info.scratch);
       (void)cudaFree(info.workBuf);
       (void)cudaFree(info.exchangeBuf);
+#endif
     }
   }
   
 protected:
-  // there should be a common buffer between each pair of GPUs communicated
-  GpuCommLib() = default;
+#if QCCL_HOST_TRANSPORT
+  // all communicators share one transport: its copy pool has a thread 
+  // per core
+  static std::shared_ptr< HostTransport > sharedHost() {
+    static std::mutex mtx;
+    static std::weak_ptr< HostTransport > host;
+    std::lock_guard _(mtx);
+    auto p = host.lock();
+    if(!p) {
+      p = std::make_shared< HostTransport >(
+            std::max(1u, std::thread::hardware_concurrency()));
+      host = p;
+    }
+    return p;
+  }
+#endif
+
+  // any thread may submit work items for ID, the lock-free queue keeps
+  // them until the thread running ID takes them
+  QCCL_Result submit(ThreadInfo& info, const WorkInfo& w) {
+    return info.queue->push(w) ? QCCL_Result::OK : QCCL_Result::Failed;
+  }
+
+  void drain(ThreadInfo& info) {
+    WorkInfo w;
+    while(info.queue->pop(w)) {
+      info.workItems.push_back(w);
+    }
+  }
+
+  // flags the sides of direct item 'w' of GPU 'ID' which run on registered
+  // links and gives the sender the registered target buffer. A registered 
+  // link has one subscribed peer and always receives into its buffer
+  QCCL_Result resolveRegistered(uint32_t ID, WorkInfo& w) {
+    w.flags = 0;
+    const auto& in = m_infos[ID].registered;
+    if(auto it = in.find(w.incoming.peer); it != in.end()) {
+      const auto& r = it->second;
+      if(w.nPeers != 1 || w.incoming.targetBuf != r.buf || 
+            w.incoming.size > r.size) 
+        return QCCL_Result::InvalidParams;
+      w.flags |= WRegisteredIn;
+    }
+    if(w.outgoing.peer == ID) {
+      return QCCL_Result::OK;
+    }
+    const auto& out = m_infos[w.outgoing.peer].registered;
+    if(auto it = out.find(ID); it != out.end()) {
+      const auto& r = it->second;
+      if(w.nPeers != 1 || w.outgoing.size > r.size) 
+        return QCCL_Result::InvalidParams;
+      w.flags |= WRegisteredOut;
+      w.targetBuf = r.buf;
+    }
+    return QCCL_Result::OK;
+  }
 
+  // one collective call: the vector of 'total' elements is split into 
+  // nGpus balanced blocks, block i is owned by GPU i
+  struct CollArgs {
+    uint32_t ID, n;
+    size_t total, elemSz;
+    uint8_t *work;    // the vector being reduced or gathered
+    uint8_t *tmp;     // receive buffer of reduction steps
+    QCCL_DataType dtype;
+    QCCL_RedOp op;
+    cudaStream_t stream;
+
+    size_t ofs(uint32_t b) const { return total * b / n; } // in elements
+    size_t count(uint32_t b, uint32_t e) const { return ofs(e) - ofs(b); }
+    size_t bytes(uint32_t b, uint32_t e) const { return count(b, e) * elemSz; }
+    uint8_t *ptr(uint32_t b) const { return work + ofs(b) * elemSz; }
+  };
+
+  static bool isPow2(uint32_t n) { return (n & (n - 1)) == 0; }
+
+  static uint32_t a2avPieces(size_t bytes) {
+    return (uint32_t)std::clamp< size_t >((bytes + QCCL_A2AV_PIECE_BYTES - 1) 
+          / QCCL_A2AV_PIECE_BYTES, 1, QCCL_A2AV_MAX_PIECES);
+  }
+
+  // pieces are 16-byte aligned; gateway items are told apart by a non-zero
+  // offset, hence pieces k > 0 start at 16 or later (and may be empty)
+  static size_t a2avPieceOfs(size_t bytes, uint32_t nPieces, uint32_t k) {
+    return k == 0 ? 0 : std::max< size_t >(bytes * k / nPieces & ~15ull, 16);
+  }
+
+  static size_t a2avPieceEnd(size_t bytes, uint32_t nPieces, uint32_t k) {
+    size_t end = k + 1 == nPieces ? bytes : 
+                 std::min(a2avPieceOfs(bytes, nPieces, k + 1), bytes);
+    return std::max(end, a2avPieceOfs(bytes, nPieces, k));
+  }
+
+  // validates the arguments, resolves the schedule and sets up the scratch:
+  // 'ownWork' also allocates the work vector from the scratch
+  QCCL_Result collInit(uint32_t ID, size_t total, QCCL_DataType dtype, 
+        QCCL_RedOp op, cudaStream_t stream, QCCL_Algo& algo, bool ownWork,
+        CollArgs& a) {
+
+    if(!m_initialized) return QCCL_Result::NotInitialized;
+    if(ID >= m_infos.size()) return QCCL_Result::InvalidParams;
+    auto& info = m_infos[ID];
+    if(!info.queue->empty() || !info.workItems.empty()) 
+      return QCCL_Result::InvalidParams;
+#if QCCL_HOST_TRANSPORT
+    // local copies run on this thread right away: the input may still be
+    // produced by work queued on the stream
+    if(cudaStreamSynchronize(stream) != cudaSuccess) return QCCL_Result::Failed;
+#endif
+    uint32_t n = m_infos.size();
+    a = CollArgs{ .ID = ID, .n = n, .total = total,
+        .elemSz = dtype == QCCL_DataType::Float32 || 
+                  dtype == QCCL_DataType::Int32 ? 4u : 2u,
+        .work = nullptr, .tmp = nullptr, 
+        .dtype = dtype, .op = op, .stream = stream };
+    if(algo == QCCL_Algo::Auto) {
+      algo = isPow2(n) && total * a.elemSz < QCCL_RING_THRESHOLD ? 
+            QCCL_Algo::HalvingDoubling : QCCL_Algo::Ring;
+    } else if(algo == QCCL_Algo::HalvingDoubling && !isPow2(n)) {
+      return QCCL_Result::InvalidParams;
+    }
+    // the largest block received in one step (rounded up to cache lines)
+    size_t maxRecv = algo == QCCL_Algo::Ring ? a.bytes(0, 1) + a.elemSz : 
+          a.bytes(0, n / 2) + a.elemSz, 
+           workSz = ownWork ? (total * a.elemSz + 63) & ~63ull : 0;
+    auto buf = scratch(info, workSz + maxRecv);
+    a.tmp = buf + workSz;
+    if(ownWork) a.work = buf;
+    return QCCL_Result::OK;
+  }
+
+  // the temporary buffer of one GPU: grown on demand
+  uint8_t *scratch(ThreadInfo& info, size_t bytes) {
+    if(info.scratchSz < bytes) {
+      bytes = (bytes + 63) & ~63ull;
+#if QCCL_HOST_TRANSPORT
+      std::free(info.scratch);
+      info.scratch = (uint8_t *)std::aligned_alloc(64, bytes);
+#else
+      CHK(cudaSetDevice(info.gpuId));
+      (void)cudaFree(info.scratch);
+      CHK(cudaMalloc((void **)&info.scratch, bytes));
+#endif
+      info.scratchSz = bytes;
+    }
+    return info.scratch;
+  }
+
+  void localCopy(void *dst, const void *src, size_t bytes, 
+        cudaStream_t stream) {
+    if(dst == src || bytes == 0) return;
+#if QCCL_HOST_TRANSPORT
+    (void)stream;
+    std::memcpy(dst, src, bytes);
+#else
+    CHK(cudaMemcpyAsync(dst, src, bytes, cudaMemcpyDeviceToDevice, stream));
+#endif
+  }
+
+  // dst = op(dst, tmp) for 'n' elements
+  void localReduce(const CollArgs& a, void *dst, size_t n) {
+    if(n == 0) return;
+#if QCCL_HOST_TRANSPORT
+    qcclReduceHost(a.dtype, a.op, dst, a.tmp, n);
+#else
+    qcclReduceDevice(a.dtype, a.op, dst, a.tmp, n, a.stream);
+#endif
+  }
+
+  // one send-recv step of a collective: sends and receives can go to 
+  // different peers but each link has a single subscriber
+  QCCL_Result collStep(const CollArgs& a, uint32_t recvPeer, void *recvBuf,
+        size_t recvBytes, uint32_t sendPeer, void *sendBuf, size_t sendBytes) {
+    if(auto res = sendRecv(a.ID, 1, recvPeer, recvBuf, recvBytes, 
+          sendPeer, sendBuf, sendBytes); res != QCCL_Result::OK) return res;
+    return run(a.ID, a.stream);
+  }
+
+  // afterwards block 'ID' of 'work' holds the reduction over all GPUs
+  QCCL_Result reduceScatter(const CollArgs& a, QCCL_Algo algo) {
+    const uint32_t n = a.n, r = a.ID;
+    if(algo == QCCL_Algo::Ring) {
+      // step s: send block r-s-1 to the next GPU, receive and reduce 
+      // block r-s-2 from the previous one
+      uint32_t next = (r + 1) % n, prev = (r + n - 1) % n;
+      for(uint32_t s = 0; s + 1 < n; s++) {
+        uint32_t sb = (r + 2*n - s - 1) % n, rb = (r + 2*n - s - 2) % n;
+        if(auto res = collStep(a, prev, a.tmp, a.bytes(rb, rb + 1), 
+              next, a.ptr(sb), a.bytes(sb, sb + 1)); res != QCCL_Result::OK)
+          return res;
+        localReduce(a, a.ptr(rb), a.count(rb, rb + 1));
+      }
+      return QCCL_Result::OK;
+    }
+    // recursive halving: keep the half of the current range containing 
+    // block r and send the other half to the peer at distance d
+    for(uint32_t d = n / 2, lo = 0; d >= 1; d /= 2) {
+      uint32_t peer = r ^ d, keep = (r & d) ? lo + d : lo, 
+               give = (r & d) ? lo : lo + d;
+      if(auto res = collStep(a, peer, a.tmp, a.bytes(keep, keep + d), 
+            peer, a.ptr(give), a.bytes(give, give + d)); res != QCCL_Result::OK)
+        return res;
+      localReduce(a, a.ptr(keep), a.count(keep, keep + d));
+      lo = keep;
+    }
+    return QCCL_Result::OK;
+  }
+
+  // block 'ID' of 'work' is distributed to all GPUs
+  QCCL_Result allGather(const CollArgs& a, QCCL_Algo algo) {
+    const uint32_t n = a.n, r = a.ID;
+    if(algo == QCCL_Algo::Ring) {
+      // step s: forward block r-s to the next GPU, receive block r-s-1
+      uint32_t next = (r + 1) % n, prev = (r + n - 1) % n;
+      for(uint32_t s = 0; s + 1 < n; s++) {
+        uint32_t sb = (r + n - s) % n, rb = (r + 2*n - s - 1) % n;
+        if(auto res = collStep(a, prev, a.ptr(rb), a.bytes(rb, rb + 1), 
+              next, a.ptr(sb), a.bytes(sb, sb + 1)); res != QCCL_Result::OK)
+          return res;
+      }
+      return QCCL_Result::OK;
+    }
+    // recursive doubling: exchange the d blocks gathered so far with the 
+    // peer at distance d
+    for(uint32_t d = 1; d < n; d *= 2) {
+      uint32_t peer = r ^ d, mine = r & ~(d - 1), theirs = mine ^ d;
+      if(auto res = collStep(a, peer, a.ptr(theirs), a.bytes(theirs, theirs + d),
+            peer, a.ptr(mine), a.bytes(mine, mine + d)); res != QCCL_Result::OK)
+        return res;
+    }
+    return QCCL_Result::OK;
+  }
+
+public:
+  QCCL_Result traceEnable(uint32_t eventsPerGpu) {
+
+    if(!m_initialized) return QCCL_Result::NotInitialized;
+    uint32_t cap = 1;
+    while(cap < eventsPerGpu) cap *= 2;
+    for(auto& info : m_infos) {
+      freeTrace(info);
+      if(eventsPerGpu == 0) continue;
+      info.hostRing = { nullptr, cap - 1, 0 };
+#if QCCL_HOST_TRANSPORT
+      // zeroed: recording must not take page faults
+      info.hostRing.events = new QcclTraceEvent[cap]();
+      info.trace = &info.hostRing;
+      info.usPerTick = 1e-3, info.offsetUs = 0; // nanoseconds
+#else
+      CHK(cudaSetDevice(info.gpuId));
+      CHK(cudaMalloc((void **)&info.hostRing.events, 
+            sizeof(QcclTraceEvent) * cap));
+      CHK(cudaMalloc((void **)&info.trace, sizeof(QcclTraceRing)));
+      CHK(cudaMemcpy(info.trace, &info.hostRing, sizeof(QcclTraceRing),
+            cudaMemcpyHostToDevice));
+      // the wall clock runs at a fixed rate: read it once in the middle of
+      // two host timestamps to relate it to the host clock
+      int kHz = 0;
+      CHK(hipDeviceGetAttribute(&kHz, hipDeviceAttributeWallClockRate, 
+            info.gpuId));
+      uint64_t *dticks, ticks;
+      CHK(cudaMalloc((void **)&dticks, sizeof(uint64_t)));
+      auto z1 = std::chrono::steady_clock::now();
+      traceClockKernel<<<1, 1>>>(dticks);
+      CHK(cudaDeviceSynchronize());
+      auto z2 = std::chrono::steady_clock::now();
+      CHK(cudaMemcpy(&ticks, dticks, sizeof(uint64_t), cudaMemcpyDeviceToHost));
+      CHK(cudaFree(dticks));
+      double hostUs = std::chrono::duration< double, std::micro >(
+            (z1 + (z2 - z1) / 2).time_since_epoch()).count();
+      info.usPerTick = 1e3 / kHz;
+      info.offsetUs = hostUs - ticks * info.usPerTick;
+#endif
+    }
+    return QCCL_Result::OK;
+  }
+
+  QCCL_Result traceClear() {
+
+    if(!m_initialized) return QCCL_Result::NotInitialized;
+    for(auto& info : m_infos) {
+      if(info.trace == nullptr) continue;
+      info.hostRing.head = 0;
+#if QCCL_HOST_TRANSPORT
+      info.trace->head = 0;
+#else
+      CHK(cudaSetDevice(info.gpuId));
+      CHK(cudaMemcpy(info.trace, &info.hostRing, sizeof(QcclTraceRing),
+            cudaMemcpyHostToDevice));
+#endif
+    }
+    return QCCL_Result::OK;
+  }
+
+  // copies the rings of all GPUs to the host
+  QCCL_Result traceCollect(std::vector< qccl_trace::GpuEvents > *pgpus) {
+
+    if(!m_initialized) return QCCL_Result::NotInitialized;
+    auto& gpus = *pgpus;
+    gpus.clear();
+    std::vector< QcclTraceEvent > ring;
+    for(uint32_t i = 0; i < m_infos.size(); i++) {
+      auto& info = m_infos[i];
+      if(info.trace == nullptr) continue;
+      auto& g = gpus.emplace_back();
+      g.gpu = i, g.usPerTick = info.usPerTick, g.offsetUs = info.offsetUs;
+      QcclTraceRing hdr;
+#if QCCL_HOST_TRANSPORT
+      hdr = *info.trace;
+      hdr.head = __atomic_load_n(&info.trace->head, __ATOMIC_ACQUIRE);
+      qccl_trace::unroll(hdr.events, hdr.mask, hdr.head, g.events);
+#else
+      CHK(cudaSetDevice(info.gpuId));
+      CHK(cudaMemcpy(&hdr, info.trace, sizeof(hdr), cudaMemcpyDeviceToHost));
+      ring.resize(hdr.mask + 1);
+      CHK(cudaMemcpy(ring.data(), hdr.events, sizeof(QcclTraceEvent) * 
+            ring.size(), cudaMemcpyDeviceToHost));
+      qccl_trace::unroll(ring.data(), hdr.mask, hdr.head, g.events);
+#endif
+    }
+    return QCCL_Result::OK;
+  }
+
+protected:
+  void freeTrace(ThreadInfo& info) {
+    if(info.trace == nullptr) return;
+#if QCCL_HOST_TRANSPORT
+    delete[] info.hostRing.events;
+#else
+    (void)cudaSetDevice(info.gpuId);
+    (void)cudaFree(info.hostRing.events);
+    (void)cudaFree(info.trace);
+#endif
+    info.trace = nullptr, info.hostRing = {};
+  }
+
+#if !QCCL_HOST_TRANSPORT
   QCCL_Result allocWorkBuf(ThreadInfo *pinfo, size_t num) {
     pinfo->numDevWorkItems = num;
     auto bytes = sizeof(WorkInfo) * num;
@@ -288,15 +951,38 @@ protected:
           hipDeviceMallocFinegrained));
     return QCCL_Result::OK;
   }
+#endif
 
 }; // GpuCommLib
 
+#if !QCCL_HOST_TRANSPORT
 #if !USE_CONSTANT_MEM
 __shared__ WorkInfo ds_work;
 //#define WORK(x) 
 #else
 __constant__ WorkInfo ds_work[MAX_NUM_NODES];
 #endif
+// chunk counters of relay links (see qcclRelaySend and sendChunks)
+struct ChunkState {
+  uint32_t readyBase;    // SChunksReady of the incoming link (relays)
+  uint32_t consumedBase; // SChunksConsumed of the outgoing link
+  uint32_t peerRing;     // ring size of the receiver (0: no ring)
+};
+__shared__ ChunkState ds_chunks;
+
+// records a phase of this block's work item (one thread calls it)
+__forceinline__ __device__ void traceEvent(QcclTraceRing *trace, 
+      uint32_t round, QCCL_Phase phase, uint64_t begin, uint64_t end) {
+  if(trace == nullptr) return;
+  auto idx = atomicAdd(&trace->head, 1u) & trace->mask;
+  trace->events[idx] = QcclTraceEvent{ begin, end, round, 
+        (uint16_t)blockIdx.x, (uint8_t)phase, ds_work.dataOfs != 0,
+        ds_work.incoming.peer, ds_work.outgoing.peer };
+}
+
+__global__ void traceClockKernel(uint64_t *ticks) {
+  *ticks = wall_clock64();
+}
 
 __forceinline__ __device__ void setupInPtrs() {
 
@@ -314,9 +1000,15 @@ __forceinline__ __device__ void setupInPtrs() {
   //! NOTE hangs here because we reset ready flag too fast (or too late)
   ds_work.readyFlagCache = ATOMIC_LOAD(counter);
   //atomicAdd(counter, 0);
+  ds_chunks.readyBase = ATOMIC_LOAD((uint32_t GLOBAL *)(slot + SChunksReady));
 
   // Wait for consumer to consume previous value before trampling it.
   while((void *)ATOMIC_LOAD((uint64_t GLOBAL *)(slot + STargetBuf)) != nullptr);
+  // the ring size must be visible before the target buffer
+  ATOMIC_STORE((uint32_t GLOBAL *)(slot + SRingChunks), ds_work.ringChunks);
+  // the senders of this round count from zero: the number of subscribed 
+  // peers of a link may change between rounds (see allToAllv)
+  ATOMIC_STORE((uint32_t GLOBAL *)(slot + SBufsReceivedCounter), 0u);
   // Encode pointer by XOR'ing against some address they definitely wouldn't send
   // since we want to allow them sending us nullptr while not colliding with
   // the empty slot value.
@@ -334,10 +1026,35 @@ __forceinline__ __device__ void setupInPtrs() {
   //         ds_work.ID, slot, targetBuf, ds_work.incoming.peer);
 }
 
+// registered incoming link: announce a new round instead of publishing
+// the target buffer
+__forceinline__ __device__ void announceRound() {
+
+  auto slot = (void *GLOBAL *)ds_work.incoming.exchangeBuf;
+  // the counter must be cached before any sender can bump it
+  ds_work.readyFlagCache = ATOMIC_LOAD((uint32_t GLOBAL *)(slot + 
+        SReadyFlagCounter));
+  __atomic_add_fetch((uint32_t GLOBAL *)(slot + SPlanGeneration), 1u, 
+        __ATOMIC_RELEASE);
+}
+
+// registered outgoing link: targetBuf is known, wait until the receiver 
+// has announced the round we are about to send
+__forceinline__ __device__ void waitRoundAnnounced() {
+
+  auto slot = (void *GLOBAL *)ds_work.outgoing.exchangeBuf;
+  auto gen = (uint32_t GLOBAL *)(slot + SPlanGeneration);
+  const uint32_t next = ds_work.roundsSent[0] + 1;
+  while((int32_t)(ATOMIC_LOAD(gen) - next) < 0);
+}
+
 __forceinline__ __device__ void setupGatewayPtrs() {
 
   // we read source buffer from incoming peer since we would like to 
   // forward its data to the outgoing peer
+  if(ds_work.outgoing.sourceBuf != nullptr) {
+    return; // the sender's own piece (see allToAllv)
+  }
   auto& item = ds_work.incoming;
   auto slot = (void *volatile GLOBAL *)item.exchangeBuf;
   // gprint("%d / %p: Starting receive GW input buf", ds_work.ID, slot);
@@ -373,6 +1090,9 @@ __forceinline__ __device__ void setupOutPtrs() {
   }
   ds_work.targetBuf = (uint8_t *)(reinterpret_cast<uintptr_t>(ptr) ^ 
                                   reinterpret_cast<uintptr_t>(slot));
+  ds_chunks.peerRing = ATOMIC_LOAD((uint32_t GLOBAL *)(slot + SRingChunks));
+  ds_chunks.consumedBase = ATOMIC_LOAD((uint32_t GLOBAL *)(slot + 
+        SChunksConsumed));
   // gprint("%d / %p: Received target buf: %p from recv peer %d", 
   //           ds_work.ID, slot, ds_work.incoming.targetBuf, 
   //                                ds_work.outgoing.peer);
@@ -391,11 +1111,15 @@ __forceinline__ __device__ void resetBufferPtrs()
   }
 }
 
-__forceinline__ __device__ void finalizeSendRecv(uint32_t tid) {
+__forceinline__ __device__ void finalizeSendRecv(uint32_t tid, 
+      QcclTraceRing *trace, uint32_t round) {
 
   // auto tid = gpuLaneId();
   if(tid == 0) {
     auto slot = (void *GLOBAL *)ds_work.outgoing.exchangeBuf;
+    if(ds_work.flags & WRegisteredOut) {
+      ds_work.roundsSent[0]++;  // our own memory: read by the next kernel
+    }
     //  __atomic_store_n(send_done, 1, __ATOMIC_SEQ_CST);
     auto readyCnt = (uint32_t *)(slot + SReadyFlagCounter);
     auto val = 1 + atomicAdd(readyCnt, 1u);
@@ -418,6 +1142,7 @@ __forceinline__ __device__ void finalizeSendRecv(uint32_t tid) {
     // gprint("%d: Receiver waiting peer counter: %p / %d", 
     //     ds_work.ID, readyCnt, readyCnt[0], cacheVal);
     // bool sleeping = false;
+    uint64_t t0 = QCCL_TRACE_PHASES && trace != nullptr ? wall_clock64() : 0;
     while(1) {
       //__builtin_amdgcn_s_sleep(1);
       auto val =  ATOMIC_LOAD(readyCnt);
@@ -427,6 +1152,9 @@ __forceinline__ __device__ void finalizeSendRecv(uint32_t tid) {
         break;
       }
     }
+    if(QCCL_TRACE_PHASES && trace != nullptr) {
+      traceEvent(trace, round, QCCL_Phase::Finalize, t0, wall_clock64());
+    }
     // this causes the program to crash
     // __asm__ __volatile__("s_wakeup");
   }
@@ -434,11 +1162,11 @@ __forceinline__ __device__ void finalizeSendRecv(uint32_t tid) {
 
 template < typename Word, uint32_t BlockSz, uint32_t NumRegs >
 __forceinline__ __device__ 
-void loadRegs(Word (&regs)[NumRegs], uint32_t src_ofs) {
+void loadRegs(Word (&regs)[NumRegs], uint64_t src_ofs) {
 
   const auto& work = ds_work;//const_work[ds_work.ID];
   auto srcBuf = (const Word GLOBAL *)(work.outgoing.sourceBuf);
-  const uint32_t dataOfs = work.dataOfs;
+  const uint64_t dataOfs = work.dataOfs;
   // preloading is only possible for non-gateway blocks
   if(!(srcBuf != nullptr && dataOfs == 0))
     return;
@@ -452,10 +1180,10 @@ void loadRegs(Word (&regs)[NumRegs], uint32_t src_ofs) {
 
 template < typename Word, uint32_t BlockSz, uint32_t NumRegs >
 __forceinline__ __device__ 
-void storeRegs(Word (&regs)[NumRegs], uint32_t ofs) {
+void storeRegs(Word (&regs)[NumRegs], uint64_t ofs) {
 
   const auto& work = ds_work;//const_work[ds_work.ID];
-  const uint32_t dataOfs = work.dataOfs;
+  const uint64_t dataOfs = work.dataOfs;
   auto srcBuf = (const Word GLOBAL *)(work.outgoing.sourceBuf);
   auto targetBuf = (Word GLOBAL *)(work.targetBuf);
 
@@ -474,10 +1202,10 @@ __constant__ WorkInfo const_work[MAX_NUM_NODES];
 template < typename Word, uint32_t BlockSz, uint32_t NumRegs, 
         bool UseOuterLoop, bool Check >
 __forceinline__ __device__ 
-void copyMainLoop(Word (&regs)[NumRegs], uint32_t ofs, const uint32_t niters, const uint32_t nwords) {
+void copyMainLoop(Word (&regs)[NumRegs], uint64_t ofs, const uint64_t niters, const uint64_t nwords) {
 
   const auto& work = ds_work; //const_work[ds_work.ID];
-  const uint32_t dataOfs = work.dataOfs;
+  const uint64_t dataOfs = work.dataOfs;
   auto srcBuf = (const Word GLOBAL *)(work.outgoing.sourceBuf + dataOfs);
   auto targetBuf = (Word GLOBAL *)(work.targetBuf + dataOfs);
 
@@ -606,10 +1334,88 @@ llvm_amdgcn_raw_buffer_load_i32x4(int32x4_t srsrc,
 #endif // USE_BUFFER_LOADS
 }
 
+// copies one chunk: NumRegs words per thread are loaded before they are stored
+template < uint32_t BlockSz, uint32_t NumRegs >
+__forceinline__ __device__ 
+void copyChunk(uint8_t *dst, const uint8_t *src, uint64_t len, uint32_t tid) {
+
+  using Word = uint64_t;
+  auto srcW = (const Word GLOBAL *)src;
+  auto dstW = (Word GLOBAL *)dst;
+  const uint64_t nwords = len / sizeof(Word);
+  Word regs[NumRegs];
+  uint64_t i = tid;
+  for(; i + (NumRegs - 1)*BlockSz < nwords; i += NumRegs*BlockSz) {
+#pragma unroll
+    for(uint32_t r = 0; r < NumRegs; r++) {
+      regs[r] = LOAD(srcW + i + r*BlockSz);
+    }
+#pragma unroll
+    for(uint32_t r = 0; r < NumRegs; r++) {
+      STORE(regs[r], dstW + i + r*BlockSz);
+    }
+  }
+  for(; i < nwords; i += BlockSz) {
+    STORE(LOAD(srcW + i), dstW + i);
+  }
+  if(tid == 0 && len % sizeof(Word) >= 4) { // 4 bytes left
+    auto val = LOAD((const uint32_t GLOBAL *)(src + len) - 1);
+    STORE(val, (uint32_t GLOBAL *)(dst + len) - 1);
+  }
+}
+
+// relays and senders to a relay go chunk by chunk as the host transport does
+// (see host_transport.hpp): thread 0 waits until the chunk has landed in our
+// ring and the receiver's ring has a free slot, then the block copies it
+template < uint32_t BlockSz, uint32_t NumRegs >
+__forceinline__ __device__ void sendChunks(uint32_t tid) {
+
+  const auto& w = ds_work;
+  const uint64_t size = w.outgoing.size,
+                 nChunks = (size + QCCL_CHUNK_BYTES - 1) / QCCL_CHUNK_BYTES;
+  auto inSlot = (void *GLOBAL *)w.incoming.exchangeBuf,
+       outSlot = (void *GLOBAL *)w.outgoing.exchangeBuf;
+  auto ready = (uint32_t GLOBAL *)(inSlot + SChunksReady),
+       consumed = (uint32_t GLOBAL *)(inSlot + SChunksConsumed),
+       outReady = (uint32_t GLOBAL *)(outSlot + SChunksReady),
+       credits = (uint32_t GLOBAL *)(outSlot + SChunksConsumed);
+  const bool toPeer = w.ID != w.outgoing.peer, relay = w.ringChunks > 0;
+  const uint32_t peerRing = ds_chunks.peerRing;
+
+  for(uint64_t k = 0; k < nChunks; k++) {
+    if(tid == 0) {
+      while(relay && (uint32_t)(ATOMIC_LOAD(ready) - ds_chunks.readyBase) <= 
+            (uint32_t)k);
+      while(peerRing > 0 && (uint32_t)k - (uint32_t)(ATOMIC_LOAD(credits) - 
+            ds_chunks.consumedBase) >= peerRing);
+    }
+    __syncthreads();
+    const uint64_t ofs = k * QCCL_CHUNK_BYTES,
+             len = size - ofs < QCCL_CHUNK_BYTES ? size - ofs : QCCL_CHUNK_BYTES,
+             srcOfs = relay ? (k % w.ringChunks) * QCCL_CHUNK_BYTES : ofs,
+             dstOfs = peerRing > 0 ? (k % peerRing) * QCCL_CHUNK_BYTES : ofs;
+    if(w.outgoing.sourceBuf != nullptr) {
+      copyChunk< BlockSz, NumRegs >(w.targetBuf + w.dataOfs + dstOfs,
+            w.outgoing.sourceBuf + w.dataOfs + srcOfs, len, tid);
+    }
+    __threadfence(); // the chunk is visible before it is announced
+    __syncthreads();
+    if(tid == 0) {
+      if(toPeer) {
+        __atomic_add_fetch(outReady, 1u, __ATOMIC_RELEASE);
+      }
+      if(relay) { // the ring slot can be reused by our sender
+        __atomic_add_fetch(consumed, 1u, __ATOMIC_RELEASE);
+      }
+    }
+  }
+}
+
 // there maybe many work items: one for each gpu block..
 template < uint32_t BlockSz, uint32_t NumRegs >
 __launch_bounds__(BlockSz, 1)
-__global__ void rcclKernel(WorkInfo *gworkInfo) { 
+__global__ void rcclKernel(WorkInfo *gworkInfo, QcclTraceRing *trace,
+      uint32_t round) { 
 
   using Word = uint64_t;
   
@@ -628,30 +1434,47 @@ __global__ void rcclKernel(WorkInfo *gworkInfo) {
   Word regs[NumRegs];
   loadRegs< Word, BlockSz, NumRegs >(regs, tid*2);
 #endif
+  // tracing: thread 0 stamps the phases it runs, thread warpSize the
+  // pointer and finalize waits (or thread 0 the whole item, see
+  // QCCL_TRACE_PHASES)
+  const uint64_t tStart = trace != nullptr ? wall_clock64() : 0;
   // we will use directWrite: that is, each sender writes data to receiver buffer directly
   // for that, receiver should provide sender the buffer address
   if(tid == 0) {
-    if(ds_work.dataOfs == 0) { // normal nodes always start from 0
+    if(ds_work.flags & WRegisteredIn) {
+      announceRound(); // the sender knows our buffer
+    } else if(ds_work.dataOfs == 0) { // normal nodes always start from 0
       setupInPtrs(); // share pointers from whom we are receiving
     } else {
       setupGatewayPtrs();
     }
+    if(QCCL_TRACE_PHASES && trace != nullptr) {
+      traceEvent(trace, round, QCCL_Phase::InPtrs, tStart, wall_clock64());
+    }
   } else if(tid == warpSize) {
-    setupOutPtrs(); // obtain pointers to whom we are sending
+    ds_chunks.peerRing = 0; // unless the receiver is a relay
+    if(ds_work.flags & WRegisteredOut) {
+      waitRoundAnnounced(); // targetBuf was set up by the host
+    } else {
+      setupOutPtrs(); // obtain pointers to whom we are sending
+    }
+    if(QCCL_TRACE_PHASES && trace != nullptr) {
+      traceEvent(trace, round, QCCL_Phase::OutPtrs, tStart, wall_clock64());
+    }
   }
   // NOTE: this sync is needed in order to share output pointers
   __syncthreads();
 
-  if(tid == 0) {
+  if(tid == 0 && !(ds_work.flags & WRegisteredOut)) {
     resetBufferPtrs(); // when spinning is done, we reset buffer pointers
-    gprint("============= %d: sourceBuf: %p, targetBuf: %p dataOfs: %d / %X size: %d / %X", 
+    gprint("============= %d: sourceBuf: %p, targetBuf: %p dataOfs: %lu / %lX size: %lu / %lX", 
       ds_work.ID, ds_work.outgoing.sourceBuf,
       ds_work.incoming.targetBuf, ds_work.dataOfs, ds_work.dataOfs,
       ds_work.outgoing.size, ds_work.outgoing.size);
   }
 #if 0
   if(ds_work.dataOfs != 0) {   // force quit gateway nodes earlier
-    finalizeSendRecv(tid);
+    finalizeSendRecv(tid, trace, round);
     return;
   }
 #endif
@@ -659,12 +1482,13 @@ __global__ void rcclKernel(WorkInfo *gworkInfo) {
   __syncthreads();
 
   // check if this node sends anything..
-  if(ds_work.outgoing.sourceBuf != nullptr) 
-  {
-    const uint32_t bytes = ds_work.outgoing.size, 
+  if(ds_work.ringChunks > 0 || ds_chunks.peerRing > 0) { // relay links
+    sendChunks< BlockSz, NumRegs >(tid);
+  } else if(ds_work.outgoing.sourceBuf != nullptr) {
+    const uint64_t bytes = ds_work.outgoing.size, 
                  nwords = bytes / sizeof(Word),
                  totalIters = nwords / (BlockSz * NumRegs);
-    uint32_t ofs = tid*2, niters = totalIters;
+    uint64_t ofs = tid*2, niters = totalIters;
 #if USE_PRELOAD_REGS
     storeRegs< Word, BlockSz, NumRegs >(regs, ofs);
     if(ds_work.dataOfs == 0) {// one less iteration for main nodes
@@ -674,16 +1498,19 @@ __global__ void rcclKernel(WorkInfo *gworkInfo) {
 #else
     Word regs[NumRegs];
 #endif
+    const bool tracePhases = QCCL_TRACE_PHASES && trace != nullptr && tid == 0;
+    uint64_t t0 = tracePhases ? wall_clock64() : 0;
     copyMainLoop< Word, BlockSz, NumRegs, true, false >
                          (regs, ofs, niters, 0);
+    uint64_t t1 = tracePhases ? wall_clock64() : 0;
 
     constexpr uint32_t bytesPerIter = BlockSz*NumRegs*sizeof(Word);
-    const uint32_t bytesLeft = bytes - totalIters*bytesPerIter,
+    const uint64_t bytesLeft = bytes - totalIters*bytesPerIter,
                    wordsLeft = bytesLeft / sizeof(Word);
 
     if(tid == 0) {
-      gprint("ID %d; nwords: %d; bytes: %d mod16: %d niters: %d "
-             "bytesPerIter: %d bytesLeft: %d wordsLeft: %d", 
+      gprint("ID %d; nwords: %lu; bytes: %lu mod16: %lu niters: %lu "
+             "bytesPerIter: %d bytesLeft: %lu wordsLeft: %lu", 
             ds_work.ID, nwords, bytes, bytes%16, totalIters, bytesPerIter, 
             bytesLeft, wordsLeft);
     }
@@ -696,37 +1523,291 @@ __global__ void rcclKernel(WorkInfo *gworkInfo) {
    
     const uint32_t nbytes16 = bytes % 16;
     if(tid < nbytes16 / 4) { // 12, 8 or 4 bytes left
-      const uint32_t dataOfs = ds_work.dataOfs + (bytes & ~15) + tid*4;
+      const uint64_t dataOfs = ds_work.dataOfs + (bytes & ~15ull) + tid*4;
       auto srcBuf = (const uint32_t GLOBAL *)(ds_work.outgoing.sourceBuf + dataOfs);
       auto targetBuf = (uint32_t GLOBAL *)(ds_work.targetBuf + dataOfs);
       auto val = LOAD(srcBuf);
       STORE(val, targetBuf);
     }
+    if(tracePhases) {
+      traceEvent(trace, round, QCCL_Phase::MainLoop, t0, t1);
+      traceEvent(trace, round, QCCL_Phase::TailCopy, t1, wall_clock64());
+    }
   }
   __threadfence(); // TODO check if it's correct
-  finalizeSendRecv(tid);
+  finalizeSendRecv(tid, trace, round);
+  if(!QCCL_TRACE_PHASES && trace != nullptr) {
+    __syncthreads(); // the finalize wait is over
+    if(tid == 0) {
+      traceEvent(trace, round, QCCL_Phase::Item, tStart, wall_clock64());
+    }
+  }
+}
+
+template < class T, QCCL_RedOp Op >
+__global__ void reduceKernel(T *dst, const T *src, size_t n) {
+
+  size_t stride = (size_t)gridDim.x * blockDim.x;
+  for(size_t i = (size_t)blockIdx.x * blockDim.x + threadIdx.x; i < n; 
+        i += stride) {
+    if constexpr(std::is_same_v< T, int32_t >) {
+      dst[i] = Op == QCCL_RedOp::Sum ? dst[i] + src[i] : max(dst[i], src[i]);
+    } else { // 16-bit floats are reduced in fp32
+      float a = (float)dst[i], b = (float)src[i];
+      dst[i] = T(Op == QCCL_RedOp::Sum ? a + b : fmaxf(a, b));
+    }
+  }
+}
+
+template < class T >
+void launchReduce(QCCL_RedOp op, void *dst, const void *src, size_t n,
+      cudaStream_t stream) {
+  constexpr uint32_t BlockSz = 256;
+  uint32_t nBlocks = std::min< size_t >((n + BlockSz - 1) / BlockSz, 1024);
+  if(op == QCCL_RedOp::Sum) {
+    reduceKernel< T, QCCL_RedOp::Sum ><<<nBlocks, BlockSz, 0, stream>>>
+          ((T *)dst, (const T *)src, n);
+  } else {
+    reduceKernel< T, QCCL_RedOp::Max ><<<nBlocks, BlockSz, 0, stream>>>
+          ((T *)dst, (const T *)src, n);
+  }
+}
+
+void qcclReduceDevice(QCCL_DataType dtype, QCCL_RedOp op, void *dst,
+      const void *src, size_t n, cudaStream_t stream) {
+  switch(dtype) {
+  case QCCL_DataType::Float32: 
+    return launchReduce< float >(op, dst, src, n, stream);
+  case QCCL_DataType::Float16: 
+    return launchReduce< __half >(op, dst, src, n, stream);
+  case QCCL_DataType::BFloat16: 
+    return launchReduce< hip_bfloat16 >(op, dst, src, n, stream);
+  case QCCL_DataType::Int32: 
+    return launchReduce< int32_t >(op, dst, src, n, stream);
+  }
+}
+#endif // !QCCL_HOST_TRANSPORT
+
+// a communicator is a group of GPUs with its own exchange buffers, plans, 
+// registrations and traces
+struct QcclComm : GpuCommLib { };
+
+// the communicator of the functions without QcclComm argument
+static QcclComm& defaultComm() {
+  static QcclComm obj;
+  return obj;
 }
 
 QCCL_Result qcclInit(uint32_t nGpus, const uint32_t *gpuIds) {
-  return GpuCommLib::i().init(nGpus, gpuIds);
+  return defaultComm().init(nGpus, gpuIds);
+}
+
+QCCL_Result qcclCommInit(QcclComm **comm, uint32_t nGpus, 
+        const uint32_t *gpuIds) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  auto c = std::make_unique< QcclComm >();
+  if(auto res = c->init(nGpus, gpuIds); res != QCCL_Result::OK) return res;
+  *comm = c.release();
+  return QCCL_Result::OK;
+}
+
+QCCL_Result qcclCommDestroy(QcclComm *comm) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  delete comm;
+  return QCCL_Result::OK;
+}
+
+QCCL_Result qcclSendRecv(QcclComm *comm, uint32_t ID, 
+        uint32_t numSubscribedPeers, uint32_t recvPeer, void *targetBuf, 
+        size_t recvSize, uint32_t sendPeer, void *sourceBuf, size_t sendSize) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->sendRecv(ID, numSubscribedPeers, recvPeer, targetBuf,
+        recvSize, sendPeer, sourceBuf, sendSize);
 }
 
 QCCL_Result qcclSendRecv(uint32_t ID, uint32_t numSubscribedPeers, 
         uint32_t recvPeer, void *targetBuf, size_t recvSize, 
         uint32_t sendPeer, void *sourceBuf, size_t sendSize) {
-  return GpuCommLib::i().sendRecv(ID, numSubscribedPeers, recvPeer, targetBuf,
-        recvSize, sendPeer, sourceBuf, sendSize);
+  return qcclSendRecv(&defaultComm(), ID, numSubscribedPeers, recvPeer, 
+        targetBuf, recvSize, sendPeer, sourceBuf, sendSize);
+}
+
+QCCL_Result qcclGatewaySend(QcclComm *comm, uint32_t ID, 
+        uint32_t numSubscribedPeers, uint32_t peerStart, uint32_t peerEnd, 
+        size_t dataOfs, size_t dataSize) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->gatewaySend(ID, numSubscribedPeers, peerStart, peerEnd, 
+        dataOfs, dataSize);
 }
 
 // register node ID as being a gateway for sending data from peerStart to peerEnd
 QCCL_Result qcclGatewaySend(uint32_t ID, uint32_t numSubscribedPeers, 
         uint32_t peerStart, uint32_t peerEnd, 
         size_t dataOfs, size_t dataSize) {
-  return GpuCommLib::i().gatewaySend(ID, numSubscribedPeers, 
+  return qcclGatewaySend(&defaultComm(), ID, numSubscribedPeers, 
           peerStart, peerEnd, dataOfs, dataSize);
 }
 
+QCCL_Result qcclRelaySend(QcclComm *comm, uint32_t ID, uint32_t recvPeer, 
+        uint32_t sendPeer, void *stageBuf, size_t stageBytes, size_t size) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->relaySend(ID, recvPeer, sendPeer, stageBuf, stageBytes, size);
+}
+
+QCCL_Result qcclRelaySend(uint32_t ID, uint32_t recvPeer, uint32_t sendPeer,
+        void *stageBuf, size_t stageBytes, size_t size) {
+  return qcclRelaySend(&defaultComm(), ID, recvPeer, sendPeer, stageBuf, 
+          stageBytes, size);
+}
+
+QCCL_Result qcclRun(QcclComm *comm, uint32_t ID, cudaStream_t stream) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->run(ID, stream);
+}
+
 QCCL_Result qcclRun(uint32_t ID, cudaStream_t stream) {
-  return GpuCommLib::i().run(ID, stream);
+  return defaultComm().run(ID, stream);
+}
+
+QCCL_Result qcclPlanCreate(QcclComm *comm, uint32_t ID, QcclPlan **plan) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->planCreate(ID, plan);
+}
+
+QCCL_Result qcclPlanCreate(uint32_t ID, QcclPlan **plan) {
+  return defaultComm().planCreate(ID, plan);
+}
+
+QCCL_Result qcclPlanExecute(QcclPlan *plan, cudaStream_t stream) {
+  if(plan == nullptr) return QCCL_Result::InvalidParams;
+  return plan->comm->planExecute(plan, stream);
 }
 
+QCCL_Result qcclPlanDestroy(QcclPlan *plan) {
+  if(plan == nullptr) return QCCL_Result::InvalidParams;
+  return plan->comm->planDestroy(plan);
+}
+
+QCCL_Result qcclRegisterBuffer(QcclComm *comm, uint32_t ID, uint32_t peer, 
+      void *recvBuf, size_t size) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->registerBuffer(ID, peer, recvBuf, size);
+}
+
+QCCL_Result qcclRegisterBuffer(uint32_t ID, uint32_t peer, void *recvBuf,
+      size_t size) {
+  return defaultComm().registerBuffer(ID, peer, recvBuf, size);
+}
+
+QCCL_Result qcclDeregisterBuffer(QcclComm *comm, uint32_t ID, uint32_t peer) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->deregisterBuffer(ID, peer);
+}
+
+QCCL_Result qcclDeregisterBuffer(uint32_t ID, uint32_t peer) {
+  return defaultComm().deregisterBuffer(ID, peer);
+}
+
+QCCL_Result qcclTraceEnable(QcclComm *comm, uint32_t eventsPerGpu) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->traceEnable(eventsPerGpu);
+}
+
+QCCL_Result qcclTraceEnable(uint32_t eventsPerGpu) {
+  return defaultComm().traceEnable(eventsPerGpu);
+}
+
+QCCL_Result qcclTraceClear(QcclComm *comm) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->traceClear();
+}
+
+QCCL_Result qcclTraceClear() {
+  return defaultComm().traceClear();
+}
+
+QCCL_Result qcclTraceExport(QcclComm *comm, const char *jsonPath) {
+  if(comm == nullptr || jsonPath == nullptr) return QCCL_Result::InvalidParams;
+  std::vector< qccl_trace::GpuEvents > gpus;
+  if(auto res = comm->traceCollect(&gpus); res != QCCL_Result::OK) 
+    return res;
+  return qccl_trace::writeChrome(jsonPath, gpus) ? QCCL_Result::OK : 
+                                                   QCCL_Result::Failed;
+}
+
+QCCL_Result qcclTraceExport(const char *jsonPath) {
+  return qcclTraceExport(&defaultComm(), jsonPath);
+}
+
+QCCL_Result qcclTraceStats(QcclComm *comm, QCCL_PhaseStats *stats) {
+  if(comm == nullptr || stats == nullptr) return QCCL_Result::InvalidParams;
+  std::vector< qccl_trace::GpuEvents > gpus;
+  if(auto res = comm->traceCollect(&gpus); res != QCCL_Result::OK) 
+    return res;
+  qccl_trace::computeStats(gpus, stats);
+  return QCCL_Result::OK;
+}
+
+QCCL_Result qcclTraceStats(QCCL_PhaseStats *stats) {
+  return qcclTraceStats(&defaultComm(), stats);
+}
+
+QCCL_Result qcclAllReduce(QcclComm *comm, uint32_t ID, const void *sendBuf, 
+        void *recvBuf, size_t count, QCCL_DataType dtype, QCCL_RedOp op, 
+        cudaStream_t stream, QCCL_Algo algo) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->allReduce(ID, sendBuf, recvBuf, count, dtype, op, stream, algo);
+}
+
+QCCL_Result qcclAllReduce(uint32_t ID, const void *sendBuf, void *recvBuf,
+        size_t count, QCCL_DataType dtype, QCCL_RedOp op, cudaStream_t stream,
+        QCCL_Algo algo) {
+  return defaultComm().allReduce(ID, sendBuf, recvBuf, count, dtype, op,
+        stream, algo);
+}
+
+QCCL_Result qcclReduceScatter(QcclComm *comm, uint32_t ID, const void *sendBuf,
+        void *recvBuf, size_t recvCount, QCCL_DataType dtype, QCCL_RedOp op, 
+        cudaStream_t stream, QCCL_Algo algo) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->reduceScatter(ID, sendBuf, recvBuf, recvCount, dtype, op,
+        stream, algo);
+}
+
+QCCL_Result qcclReduceScatter(uint32_t ID, const void *sendBuf, void *recvBuf,
+        size_t recvCount, QCCL_DataType dtype, QCCL_RedOp op, 
+        cudaStream_t stream, QCCL_Algo algo) {
+  return defaultComm().reduceScatter(ID, sendBuf, recvBuf, recvCount, dtype,
+        op, stream, algo);
+}
+
+QCCL_Result qcclAllGather(QcclComm *comm, uint32_t ID, const void *sendBuf, 
+        void *recvBuf, size_t sendCount, QCCL_DataType dtype, 
+        cudaStream_t stream, QCCL_Algo algo) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->allGather(ID, sendBuf, recvBuf, sendCount, dtype, stream, algo);
+}
+
+QCCL_Result qcclAllGather(uint32_t ID, const void *sendBuf, void *recvBuf,
+        size_t sendCount, QCCL_DataType dtype, cudaStream_t stream,
+        QCCL_Algo algo) {
+  return defaultComm().allGather(ID, sendBuf, recvBuf, sendCount, dtype,
+        stream, algo);
+}
+
+QCCL_Result qcclAllToAllv(QcclComm *comm, uint32_t ID, const void *sendBuf, 
+        const size_t *sendCounts, const size_t *sendDispls, void *recvBuf,
+        const size_t *recvCounts, const size_t *recvDispls, 
+        QCCL_DataType dtype, cudaStream_t stream) {
+  if(comm == nullptr) return QCCL_Result::InvalidParams;
+  return comm->allToAllv(ID, sendBuf, sendCounts, sendDispls, recvBuf,
+        recvCounts, recvDispls, dtype, stream);
+}
+
+QCCL_Result qcclAllToAllv(uint32_t ID, const void *sendBuf, 
+        const size_t *sendCounts, const size_t *sendDispls, void *recvBuf,
+        const size_t *recvCounts, const size_t *recvDispls, 
+        QCCL_DataType dtype, cudaStream_t stream) {
+  return defaultComm().allToAllv(ID, sendBuf, sendCounts, sendDispls, recvBuf,
+        recvCounts, recvDispls, dtype, stream);
+}
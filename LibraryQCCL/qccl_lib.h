@@ -5,6 +5,27 @@
 
 #include "common/common.h"
 
+// whether "GPUs" are host threads communicating through shared memory
+// (see host_transport.hpp): the default when there is no GPU runtime
+#ifndef QCCL_HOST_TRANSPORT
+#define QCCL_HOST_TRANSPORT COMPILE_FOR_HOST
+#endif
+
+// granularity of chunked transfers and of relay staging rings 
+// (host transport only, see qcclRelaySend)
+#ifndef QCCL_CHUNK_BYTES
+#define QCCL_CHUNK_BYTES (1u << 20)
+#endif
+
+// all-to-allv splits a transfer into pieces of about this size, each copied
+// by its own work item, and into at most QCCL_A2AV_MAX_PIECES pieces
+#ifndef QCCL_A2AV_PIECE_BYTES
+#define QCCL_A2AV_PIECE_BYTES (1u << 20)
+#endif
+#ifndef QCCL_A2AV_MAX_PIECES
+#define QCCL_A2AV_MAX_PIECES 16
+#endif
+
 enum QCCL_Result : uint32_t {
   OK,
   NotInitialized,
@@ -12,6 +33,59 @@ enum QCCL_Result : uint32_t {
   Failed,
 };
 
+enum class QCCL_DataType : uint32_t {
+  Float32,
+  Float16,   // __half
+  BFloat16,  // hip_bfloat16
+  Int32,
+};
+
+enum class QCCL_RedOp : uint32_t {
+  Sum,
+  Max,
+};
+
+// collective schedules: Auto picks recursive halving / doubling (log2(n)
+// steps) for messages below QCCL_RING_THRESHOLD bytes if the number of GPUs
+// is a power of two, and the ring (n-1 steps between neighbours) otherwise
+enum class QCCL_Algo : uint32_t {
+  Auto,
+  Ring,
+  HalvingDoubling,
+};
+
+#ifndef QCCL_RING_THRESHOLD
+#define QCCL_RING_THRESHOLD (1u << 20)
+#endif
+
+// 1: tracing records every phase of a work item below, 0: a single Item
+// event per work item, which keeps clock reads and ring stores off the
+// copy path
+#ifndef QCCL_TRACE_PHASES
+#define QCCL_TRACE_PHASES 0
+#endif
+
+// phases of a work item recorded by tracing (see qcclTraceEnable)
+enum class QCCL_Phase : uint32_t {
+  InPtrs,    // publish our target buffer (setupInPtrs / setupGatewayPtrs)
+  OutPtrs,   // spin for the target buffer of the peer (setupOutPtrs)
+  MainLoop,  // copy of whole blocks (copyMainLoop)
+  TailCopy,  // the remainder and the last bytes
+  Finalize,  // wait for the senders (finalizeSendRecv)
+  Item,      // the whole work item (QCCL_TRACE_PHASES == 0)
+  Count,
+};
+
+// log2 latency buckets of QCCL_PhaseStats: bucket 0 counts durations below
+// 1 us, bucket i > 0 those in [2^(i-1), 2^i) us, the last one all the rest
+#define QCCL_TRACE_BUCKETS 24
+
+struct QCCL_PhaseStats {
+  uint64_t count;
+  double totalUs, minUs, maxUs, p50Us, p99Us;
+  uint64_t buckets[QCCL_TRACE_BUCKETS];
+};
+
 #define CHKQCCL(cmd) \
   if(auto res = (cmd); res != QCCL_Result::OK) {   \
     ThrowError<>("%s:%d: QCCL failed with %d", __FILE__, __LINE__, (int)res); \
@@ -30,7 +104,164 @@ QCCL_Result qcclGatewaySend(uint32_t ID, uint32_t numSubscribedPeers,
         uint32_t peerStart, uint32_t peerEnd, 
         size_t dataOfs, size_t dataSize);
 
+// register node ID as a relay forwarding 'size' bytes from recvPeer to 
+// sendPeer: the data is staged in 'stageBuf' used as a ring of 
+// stageBytes / QCCL_CHUNK_BYTES chunks, and each chunk is forwarded as soon
+// as it lands, i.e. the relay does not wait for the whole message. 
+// recvPeer and sendPeer use plain qcclSendRecv with ID; both relay links must
+// have a single subscribed peer. Relay links are not supported by plans
+// and registered buffers
+QCCL_Result qcclRelaySend(uint32_t ID, uint32_t recvPeer, uint32_t sendPeer,
+        void *stageBuf, size_t stageBytes, size_t size);
+
 // run previously enqueued send-recv primitives on a stream
+// (with QCCL_HOST_TRANSPORT, the stream is synchronized first and
+// transfers are complete when this returns).
+// Primitives for ID may be enqueued by several threads at once, also while
+// qcclRun(ID) runs what was enqueued before; qcclRun(ID) and the functions
+// below must be called by one thread per ID at a time
 QCCL_Result qcclRun(uint32_t ID, cudaStream_t stream);
 
+// persistent communication plan (see qcclPlanCreate)
+struct QcclPlan;
+
+// moves the send-recv primitives enqueued for ID so far into a plan which
+// can be executed many times: work items are validated and laid out once.
+// With QCCL_HOST_TRANSPORT buffers are exchanged here, hence all peers of 
+// the plan must call this concurrently (as for qcclRun) and then execute
+// their plans the same number of times and in the same order
+QCCL_Result qcclPlanCreate(uint32_t ID, QcclPlan **plan);
+
+// executes a plan on a stream: the same as re-enqueueing its primitives 
+// and calling qcclRun
+QCCL_Result qcclPlanExecute(QcclPlan *plan, cudaStream_t stream);
+
+QCCL_Result qcclPlanDestroy(QcclPlan *plan);
+
+// registers the buffer into which ID receives everything 'peer' sends to it
+// (at most 'size' bytes per transfer): the sender learns the address here,
+// hence transfers on the link skip the pointer handshake and only wait for
+// the receiver to announce each round. Send-recv on a registered link must
+// use one subscribed peer and receive into 'recvBuf'; gateways and relays
+// cannot attach to it. Plans made before a (de)registration are checked 
+// again when executed. Must not be called while ops are enqueued or running
+QCCL_Result qcclRegisterBuffer(uint32_t ID, uint32_t peer, void *recvBuf,
+        size_t size);
+
+QCCL_Result qcclDeregisterBuffer(uint32_t ID, uint32_t peer);
+
+// Collectives are built from qcclSendRecv steps between pairs of GPUs and
+// local reductions; all nGpus IDs must call them concurrently with the same
+// arguments (except for buffers). Nothing else may be enqueued for ID at
+// that time. Temporary buffers are allocated by the library and reused.
+// With QCCL_HOST_TRANSPORT, they synchronize the stream first and are
+// complete when they return (like qcclRun).
+
+// recvBuf = reduction of sendBuf over all GPUs ('count' elements); 
+// sendBuf == recvBuf is allowed
+QCCL_Result qcclAllReduce(uint32_t ID, const void *sendBuf, void *recvBuf,
+        size_t count, QCCL_DataType dtype, QCCL_RedOp op, cudaStream_t stream,
+        QCCL_Algo algo = QCCL_Algo::Auto);
+
+// recvBuf = block ID of the reduction of sendBuf which has nGpus * recvCount 
+// elements
+QCCL_Result qcclReduceScatter(uint32_t ID, const void *sendBuf, void *recvBuf,
+        size_t recvCount, QCCL_DataType dtype, QCCL_RedOp op, 
+        cudaStream_t stream, QCCL_Algo algo = QCCL_Algo::Auto);
+
+// block i of recvBuf (nGpus * sendCount elements) = sendBuf of GPU i;
+// sendBuf may point to block ID of recvBuf
+QCCL_Result qcclAllGather(uint32_t ID, const void *sendBuf, void *recvBuf,
+        size_t sendCount, QCCL_DataType dtype, cudaStream_t stream,
+        QCCL_Algo algo = QCCL_Algo::Auto);
+
+// sends sendCounts[i] elements at sendDispls[i] of sendBuf to GPU i and 
+// receives recvCounts[i] elements from GPU i at recvDispls[i] of recvBuf 
+// (nGpus entries each, in elements); recvCounts[i] of ID must equal 
+// sendCounts[ID] of GPU i. Copy work is spread over work items in 
+// proportion to the bytes of each transfer (see QCCL_A2AV_PIECE_BYTES) 
+// rather than one item per peer, which suits skewed counts
+QCCL_Result qcclAllToAllv(uint32_t ID, const void *sendBuf, 
+        const size_t *sendCounts, const size_t *sendDispls, void *recvBuf,
+        const size_t *recvCounts, const size_t *recvDispls, 
+        QCCL_DataType dtype, cudaStream_t stream);
+
+// Tracing: every work item records timestamps (of its phases if built with
+// QCCL_TRACE_PHASES) into a ring of 'eventsPerGpu' events per GPU (the
+// oldest are overwritten): on the device by one thread per block, with the
+// host transport by the polling thread.
+// 0 disables tracing (the default). Must not be called while ops are running
+QCCL_Result qcclTraceEnable(uint32_t eventsPerGpu);
+
+// drops the events recorded so far
+QCCL_Result qcclTraceClear();
+
+// writes the events of all GPUs in Chrome trace format (chrome://tracing, 
+// ui.perfetto.dev): one process per GPU and one thread per work item. 
+// The streams of all GPUs must be synchronized before
+QCCL_Result qcclTraceExport(const char *jsonPath);
+
+// aggregates the durations of recorded events per phase: 'stats' has
+// QCCL_Phase::Count entries
+QCCL_Result qcclTraceStats(QCCL_PhaseStats *stats);
+
+// Communicators: independent groups of GPUs (which may overlap) with their
+// own exchange buffers, plans, registered buffers and traces, e.g. a tensor
+// parallel and a data parallel group running concurrently. The functions
+// above use a default communicator set up by qcclInit. IDs are ranks within
+// the communicator: ID i is gpuIds[i]
+struct QcclComm;
+
+QCCL_Result qcclCommInit(QcclComm **comm, uint32_t nGpus, 
+        const uint32_t *gpuIds);
+
+// all ops of the communicator must be complete
+QCCL_Result qcclCommDestroy(QcclComm *comm);
+
+QCCL_Result qcclSendRecv(QcclComm *comm, uint32_t ID, 
+        uint32_t numSubscribedPeers, uint32_t recvPeer, void *recvBuf, 
+        size_t recvSize, uint32_t sendPeer, void *sendBuf, size_t sendSize);
+
+QCCL_Result qcclGatewaySend(QcclComm *comm, uint32_t ID, 
+        uint32_t numSubscribedPeers, uint32_t peerStart, uint32_t peerEnd, 
+        size_t dataOfs, size_t dataSize);
+
+QCCL_Result qcclRelaySend(QcclComm *comm, uint32_t ID, uint32_t recvPeer, 
+        uint32_t sendPeer, void *stageBuf, size_t stageBytes, size_t size);
+
+QCCL_Result qcclRun(QcclComm *comm, uint32_t ID, cudaStream_t stream);
+
+// plans remember their communicator: qcclPlanExecute / qcclPlanDestroy
+QCCL_Result qcclPlanCreate(QcclComm *comm, uint32_t ID, QcclPlan **plan);
+
+QCCL_Result qcclRegisterBuffer(QcclComm *comm, uint32_t ID, uint32_t peer, 
+        void *recvBuf, size_t size);
+
+QCCL_Result qcclDeregisterBuffer(QcclComm *comm, uint32_t ID, uint32_t peer);
+
+QCCL_Result qcclAllReduce(QcclComm *comm, uint32_t ID, const void *sendBuf, 
+        void *recvBuf, size_t count, QCCL_DataType dtype, QCCL_RedOp op, 
+        cudaStream_t stream, QCCL_Algo algo = QCCL_Algo::Auto);
+
+QCCL_Result qcclReduceScatter(QcclComm *comm, uint32_t ID, const void *sendBuf,
+        void *recvBuf, size_t recvCount, QCCL_DataType dtype, QCCL_RedOp op, 
+        cudaStream_t stream, QCCL_Algo algo = QCCL_Algo::Auto);
+
+QCCL_Result qcclAllGather(QcclComm *comm, uint32_t ID, const void *sendBuf, 
+        void *recvBuf, size_t sendCount, QCCL_DataType dtype, 
+        cudaStream_t stream, QCCL_Algo algo = QCCL_Algo::Auto);
+
+QCCL_Result qcclAllToAllv(QcclComm *comm, uint32_t ID, const void *sendBuf, 
+        const size_t *sendCounts, const size_t *sendDispls, void *recvBuf,
+        const size_t *recvCounts, const size_t *recvDispls, 
+        QCCL_DataType dtype, cudaStream_t stream);
+
+QCCL_Result qcclTraceEnable(QcclComm *comm, uint32_t eventsPerGpu);
+
+QCCL_Result qcclTraceClear(QcclComm *comm);
+
+QCCL_Result qcclTraceExport(QcclComm *comm, const char *jsonPath);
+
+QCCL_Result qcclTraceStats(QcclComm *comm, QCCL_PhaseStats *stats);
+
 #endif // QCCL_LIB_H
\ No newline at end of file
@@ -0,0 +1,185 @@
+#ifndef QCCL_REDUCE_HPP
+#define QCCL_REDUCE_HPP 1
+
+// Host reduction kernels of QCCL collectives: dst[i] = op(dst[i], src[i]).
+// 16-bit floats are widened to float, reduced and rounded back to nearest
+// even. Vectorized with AVX-512 (16 lanes) or AVX2 + F16C (8 lanes); the
+// tails and other targets use the scalar loop.
+
+#include <algorithm>
+#include <cstring>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "common/float16.hpp"
+#include "qccl_lib.h"
+
+namespace qccl_reduce {
+
+// storage of 16-bit floats (__half / hip_bfloat16 on the device)
+using fp16::Half16;
+using fp16::BFloat16;
+using fp16::toFloat;
+using fp16::toHalf;
+using fp16::toBFloat16;
+
+template < QCCL_RedOp Op, class T >
+FORCEINLINE T scalarOp(T a, T b) {
+  if constexpr(Op == QCCL_RedOp::Sum) return a + b;
+  else return std::max(a, b);
+}
+
+template < QCCL_RedOp Op, class T >
+FORCEINLINE void scalarReduce(T& d, const T& s) {
+  if constexpr(std::is_same_v< T, Half16 >) {
+    d = toHalf(scalarOp< Op >(toFloat(d), toFloat(s)));
+  } else if constexpr(std::is_same_v< T, BFloat16 >) {
+    d = toBFloat16(scalarOp< Op >(toFloat(d), toFloat(s)));
+  } else {
+    d = scalarOp< Op >(d, s);
+  }
+}
+
+#if defined(__AVX512F__)
+constexpr size_t s_lanes = 16;
+using VecF = __m512;
+using VecI = __m512i;
+using VecH = __m256i; // 16 x 16-bit
+
+FORCEINLINE VecF loadF(const float *p) { return _mm512_loadu_ps(p); }
+FORCEINLINE void storeF(float *p, VecF x) { _mm512_storeu_ps(p, x); }
+FORCEINLINE VecI loadI(const int32_t *p) { return _mm512_loadu_si512(p); }
+FORCEINLINE void storeI(int32_t *p, VecI x) { _mm512_storeu_si512(p, x); }
+FORCEINLINE VecH loadH(const void *p) {
+  return _mm256_loadu_si256((const __m256i *)p);
+}
+FORCEINLINE void storeH(void *p, VecH x) { _mm256_storeu_si256((__m256i *)p, x); }
+
+FORCEINLINE VecF halfToF(VecH x) { return _mm512_cvtph_ps(x); }
+FORCEINLINE VecH fToHalf(VecF x) {
+  return _mm512_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+FORCEINLINE VecF bf16ToF(VecH x) {
+  return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(x), 16));
+}
+FORCEINLINE VecH fToBf16(VecF x) {
+  auto u = _mm512_castps_si512(x);
+  auto lsb = _mm512_and_si512(_mm512_srli_epi32(u, 16), _mm512_set1_epi32(1));
+  auto r = _mm512_srli_epi32(_mm512_add_epi32(u,
+        _mm512_add_epi32(lsb, _mm512_set1_epi32(0x7FFF))), 16);
+  // NaNs must not be rounded to inf: keep them quiet
+  auto nan = _mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q);
+  r = _mm512_mask_or_epi32(r, nan, _mm512_srli_epi32(u, 16),
+        _mm512_set1_epi32(0x40));
+  return _mm512_cvtepi32_epi16(r);
+}
+template < QCCL_RedOp Op >
+FORCEINLINE VecF vecOp(VecF a, VecF b) {
+  if constexpr(Op == QCCL_RedOp::Sum) return _mm512_add_ps(a, b);
+  else return _mm512_max_ps(a, b);
+}
+template < QCCL_RedOp Op >
+FORCEINLINE VecI vecOp(VecI a, VecI b) {
+  if constexpr(Op == QCCL_RedOp::Sum) return _mm512_add_epi32(a, b);
+  else return _mm512_max_epi32(a, b);
+}
+#define QCCL_REDUCE_SIMD 1
+
+#elif defined(__AVX2__) && defined(__F16C__)
+constexpr size_t s_lanes = 8;
+using VecF = __m256;
+using VecI = __m256i;
+using VecH = __m128i; // 8 x 16-bit
+
+FORCEINLINE VecF loadF(const float *p) { return _mm256_loadu_ps(p); }
+FORCEINLINE void storeF(float *p, VecF x) { _mm256_storeu_ps(p, x); }
+FORCEINLINE VecI loadI(const int32_t *p) {
+  return _mm256_loadu_si256((const __m256i *)p);
+}
+FORCEINLINE void storeI(int32_t *p, VecI x) { _mm256_storeu_si256((__m256i *)p, x); }
+FORCEINLINE VecH loadH(const void *p) { return _mm_loadu_si128((const __m128i *)p); }
+FORCEINLINE void storeH(void *p, VecH x) { _mm_storeu_si128((__m128i *)p, x); }
+
+FORCEINLINE VecF halfToF(VecH x) { return _mm256_cvtph_ps(x); }
+FORCEINLINE VecH fToHalf(VecF x) {
+  return _mm256_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+FORCEINLINE VecF bf16ToF(VecH x) {
+  return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(x), 16));
+}
+FORCEINLINE VecH fToBf16(VecF x) {
+  auto u = _mm256_castps_si256(x);
+  auto lsb = _mm256_and_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(1));
+  auto r = _mm256_srli_epi32(_mm256_add_epi32(u,
+        _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7FFF))), 16);
+  auto qnan = _mm256_or_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(0x40));
+  auto nan = _mm256_castps_si256(_mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+  r = _mm256_blendv_epi8(r, qnan, nan);
+  // all values fit in 16 bits: unsigned saturation is a plain narrowing
+  return _mm_packus_epi32(_mm256_castsi256_si128(r),
+        _mm256_extracti128_si256(r, 1));
+}
+template < QCCL_RedOp Op >
+FORCEINLINE VecF vecOp(VecF a, VecF b) {
+  if constexpr(Op == QCCL_RedOp::Sum) return _mm256_add_ps(a, b);
+  else return _mm256_max_ps(a, b);
+}
+template < QCCL_RedOp Op >
+FORCEINLINE VecI vecOp(VecI a, VecI b) {
+  if constexpr(Op == QCCL_RedOp::Sum) return _mm256_add_epi32(a, b);
+  else return _mm256_max_epi32(a, b);
+}
+#define QCCL_REDUCE_SIMD 1
+
+#else
+#define QCCL_REDUCE_SIMD 0
+#endif
+
+template < class T, QCCL_RedOp Op >
+void reduceInto(T *dst, const T *src, size_t n) {
+  size_t i = 0;
+#if QCCL_REDUCE_SIMD
+  for(; i + s_lanes <= n; i += s_lanes) {
+    if constexpr(std::is_same_v< T, float >) {
+      storeF(dst + i, vecOp< Op >(loadF(dst + i), loadF(src + i)));
+    } else if constexpr(std::is_same_v< T, int32_t >) {
+      storeI(dst + i, vecOp< Op >(loadI(dst + i), loadI(src + i)));
+    } else if constexpr(std::is_same_v< T, Half16 >) {
+      storeH(dst + i, fToHalf(vecOp< Op >(halfToF(loadH(dst + i)),
+            halfToF(loadH(src + i)))));
+    } else {
+      storeH(dst + i, fToBf16(vecOp< Op >(bf16ToF(loadH(dst + i)),
+            bf16ToF(loadH(src + i)))));
+    }
+  }
+#endif
+  for(; i < n; i++) {
+    scalarReduce< Op >(dst[i], src[i]);
+  }
+}
+
+template < class T >
+void reduceInto(QCCL_RedOp op, void *dst, const void *src, size_t n) {
+  if(op == QCCL_RedOp::Sum) {
+    reduceInto< T, QCCL_RedOp::Sum >((T *)dst, (const T *)src, n);
+  } else {
+    reduceInto< T, QCCL_RedOp::Max >((T *)dst, (const T *)src, n);
+  }
+}
+
+} // namespace qccl_reduce
+
+//! dst[i] = op(dst[i], src[i]) for \c n elements of type \c dtype
+inline void qcclReduceHost(QCCL_DataType dtype, QCCL_RedOp op, void *dst,
+      const void *src, size_t n) {
+  using namespace qccl_reduce;
+  switch(dtype) {
+  case QCCL_DataType::Float32: return reduceInto< float >(op, dst, src, n);
+  case QCCL_DataType::Float16: return reduceInto< Half16 >(op, dst, src, n);
+  case QCCL_DataType::BFloat16: return reduceInto< BFloat16 >(op, dst, src, n);
+  case QCCL_DataType::Int32: return reduceInto< int32_t >(op, dst, src, n);
+  }
+}
+
+#endif // QCCL_REDUCE_HPP
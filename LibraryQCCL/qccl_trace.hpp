@@ -0,0 +1,134 @@
+#ifndef QCCL_TRACE_HPP
+#define QCCL_TRACE_HPP 1
+
+// Timeline tracing of QCCL work items (see qcclTraceEnable). Each GPU owns
+// a ring of fixed-size events: writers bump 'head' atomically and store the
+// event at head & mask, so recording never allocates nor locks and a full
+// ring overwrites the oldest events. Rings live in device memory for the
+// kernel (one writer thread per block) and in host memory for the host
+// transport. On export the rings are copied to the host, unrolled in
+// recording order and put on a common clock (microseconds): the kernel
+// stamps wall clock ticks which are related to the host clock once per GPU.
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "qccl_lib.h"
+
+struct QcclTraceEvent {
+  uint64_t begin, end;  // device wall clock ticks or host nanoseconds
+  uint32_t round;       // qcclRun / qcclPlanExecute call of this GPU
+  uint16_t item;        // work item (block) index
+  uint8_t phase;        // QCCL_Phase
+  uint8_t gateway;      // 1: gateway work item
+  uint32_t inPeer, outPeer;
+};
+
+static_assert(sizeof(QcclTraceEvent) == 32, "Trace events must be 32 bytes");
+
+struct QcclTraceRing {
+  QcclTraceEvent *events;
+  uint32_t mask;        // capacity - 1, the capacity is a power of two
+  uint32_t head;        // the number of events ever recorded (wraps)
+};
+
+namespace qccl_trace {
+
+inline const char *phaseName(uint32_t phase) {
+  static const char *names[] = { "InPtrs", "OutPtrs", "MainLoop", "TailCopy",
+        "Finalize", "Item" };
+  return phase < (uint32_t)QCCL_Phase::Count ? names[phase] : "Unknown";
+}
+
+// host-side writer (the host transport): one reservation for 'num' events
+inline void record(QcclTraceRing *ring, const QcclTraceEvent *evs,
+      uint32_t num) {
+  auto idx = __atomic_fetch_add(&ring->head, num, __ATOMIC_RELAXED);
+  for(uint32_t i = 0; i < num; i++) {
+    ring->events[(idx + i) & ring->mask] = evs[i];
+  }
+}
+
+// events of one GPU copied out of its ring
+struct GpuEvents {
+  uint32_t gpu;
+  double usPerTick;  // timestamps to microseconds
+  double offsetUs;   // added to converted timestamps: the common clock
+  std::vector< QcclTraceEvent > events; // in recording order
+
+  double us(uint64_t ticks) const { return ticks * usPerTick + offsetUs; }
+};
+
+// the last min(head, capacity) events of a ring snapshot, oldest first
+inline void unroll(const QcclTraceEvent *events, uint32_t mask, uint32_t head,
+      std::vector< QcclTraceEvent >& out) {
+  uint32_t num = std::min(head, mask + 1);
+  out.resize(num);
+  for(uint32_t i = 0; i < num; i++) {
+    out[i] = events[(head - num + i) & mask];
+  }
+}
+
+inline void computeStats(const std::vector< GpuEvents >& gpus,
+      QCCL_PhaseStats *stats) {
+  constexpr uint32_t nPhases = (uint32_t)QCCL_Phase::Count;
+  std::vector< double > durs[nPhases];
+  for(const auto& g : gpus) {
+    for(const auto& e : g.events) {
+      if(e.phase < nPhases) {
+        durs[e.phase].push_back((e.end - e.begin) * g.usPerTick);
+      }
+    }
+  }
+  for(uint32_t p = 0; p < nPhases; p++) {
+    auto& d = durs[p];
+    auto& s = stats[p];
+    s = QCCL_PhaseStats{};
+    s.count = d.size();
+    if(d.empty()) continue;
+    std::sort(d.begin(), d.end());
+    s.minUs = d.front(), s.maxUs = d.back();
+    s.p50Us = d[(d.size() - 1) / 2];
+    s.p99Us = d[(d.size() - 1) * 99 / 100];
+    for(auto x : d) {
+      s.totalUs += x;
+      uint32_t b = 0;
+      while(b + 1 < QCCL_TRACE_BUCKETS && x >= (double)(1ull << b)) b++;
+      s.buckets[b]++;
+    }
+  }
+}
+
+// Chrome trace format: complete ('X') events with microsecond timestamps
+// relative to the earliest event
+inline bool writeChrome(const char *path, const std::vector< GpuEvents >& gpus) {
+  FILE *f = fopen(path, "w");
+  if(f == nullptr) return false;
+  double t0 = 1e300;
+  for(const auto& g : gpus) {
+    for(const auto& e : g.events) t0 = std::min(t0, g.us(e.begin));
+  }
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  bool first = true;
+  for(const auto& g : gpus) {
+    fprintf(f, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+        "\"args\":{\"name\":\"GPU %u\"}}", first ? "" : ",\n", g.gpu, g.gpu);
+    first = false;
+    for(const auto& e : g.events) {
+      fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%u,"
+          "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"round\":%u,"
+          "\"in\":%u,\"out\":%u}}", phaseName(e.phase),
+          e.gateway ? "gateway" : "sendrecv", g.gpu, e.item,
+          g.us(e.begin) - t0, (e.end - e.begin) * g.usPerTick, e.round,
+          e.inPeer, e.outPeer);
+    }
+  }
+  fprintf(f, "\n]}\n");
+  return fclose(f) == 0;
+}
+
+} // namespace qccl_trace
+
+#endif // QCCL_TRACE_HPP
@@ -0,0 +1,67 @@
+#ifndef QCCL_WORK_H
+#define QCCL_WORK_H 1
+
+// Work items and exchange slot layout shared by the device kernel
+// (qccl_lib.cc) and the host transport (host_transport.hpp)
+
+#include <cstdint>
+
+enum SlotInfo {
+  STargetBuf = 0,
+  SSourceBuf,
+  SBufsReceivedCounter,
+  SReadyFlagCounter, // steady counter used to monitor if data write is done
+  SPlanGeneration,   // steady counter: rounds the receiver is ready for
+                     // (plans and registered buffers)
+  SRingChunks,       // > 0: the receiver stages data in a ring of that many chunks
+  SChunksReady,      // steady counter of chunks written to the receiver
+  SChunksConsumed,   // steady counter of chunks released by the receiver (credits)
+  SRoundsSent,       // in the sender's own row of peer j: steady counter of
+                     // announced rounds it has sent directly to j
+  STotalSlots,
+};
+
+enum WorkFlags : uint32_t {
+  WRegisteredIn = 1,  // the incoming link has a registered buffer
+  WRegisteredOut = 2, // the outgoing link has a registered buffer: targetBuf
+                      // is known, the receiver only announces its rounds
+};
+
+struct OutgoingWorkItem { // outgoing/send work item (what this node sends out)
+  uint32_t peer;      // send peer
+  uint64_t size;      // buffer size in bytes
+  void **exchangeBuf; // shared buffer for exchanging pointers between GPUs:
+                      // this should be set accordingly for each p2p channel (pair of GPUs)
+                      // It has two entries: one for ptr exchange and one for end-of-transfer flag
+  uint8_t *sourceBuf; // source (send) buffer 
+};
+
+struct IncomingWorkItem { // incoming/recv work item (place where to receive the data)
+  uint32_t peer;      // recv peer
+  uint64_t size;      // buffer size in bytes
+  void **exchangeBuf; // shared buffer for exchanging pointers between GPUs:
+                      // this should be set accordingly for each p2p channel (pair of GPUs)
+                      // It has two entries: one for ptr exchange and one for end-of-transfer flag
+  uint8_t *targetBuf; // target (recv) buffer 
+};
+
+struct WorkInfo
+{
+  uint32_t ID;        // my own ID (debug only)
+  uint32_t nPeers;    // this should be the number of peers connected to a given 
+                      // exchange buffer
+  uint64_t dataOfs;   // data offset usually only set for gateway nodes !!
+  uint32_t readyFlagCache; // entry used to cache SReadyFlagCounter values
+  uint32_t ringChunks; // relay nodes: incoming data is staged in a ring 
+                       // of that many chunks and forwarded chunk by chunk
+  uint8_t *targetBuf;         // target buffer to be shared 
+  IncomingWorkItem incoming;
+  OutgoingWorkItem outgoing;
+  uint32_t *roundsSent; // SRoundsSent of the outgoing link (direct sends)
+  uint32_t flags;       // WorkFlags
+};
+
+static_assert(sizeof(WorkInfo) % sizeof(uint64_t) == 0, 
+    "Size must be aligned by 8 bytes");
+
+#endif // QCCL_WORK_H
@@ -0,0 +1,124 @@
+#ifndef RCCL_ALLTOALLV_DIST_HPP
+#define RCCL_ALLTOALLV_DIST_HPP 1
+
+// Per-peer element counts for all-to-allv tests, e.g. MoE token dispatch:
+//  - Balanced: every GPU sends the same to every peer;
+//  - Zipf: GPU i sends to its peers in proportion to 1 / rank^s where the
+//    ranks are a random permutation of the peers (per sender);
+//  - HotExpert: every GPU sends 'hotFraction' of its tokens to one hot GPU
+//    and spreads the rest evenly.
+// Counts are scaled such that no GPU sends or receives more than 'maxElems'
+// elements (the hot GPU receives far more than it sends).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace a2av {
+
+enum class Dist : uint32_t { Balanced, Zipf, HotExpert };
+
+inline const char *distName(Dist d) {
+  const char *names[] = { "balanced", "zipf", "hot-expert" };
+  return names[(uint32_t)d];
+}
+
+struct Layout {
+  uint32_t n = 0;
+  // counts[i*n + j]: elements sent by GPU i to GPU j, recvCounts[j*n + i]
+  // the same seen by the receiver; displacements are prefix sums of both
+  std::vector< size_t > counts, sendDispls, recvCounts, recvDispls;
+
+  const size_t *sendCountsOf(uint32_t i) const { return counts.data() + i*n; }
+  const size_t *sendDisplsOf(uint32_t i) const { return sendDispls.data() + i*n; }
+  const size_t *recvCountsOf(uint32_t i) const { return recvCounts.data() + i*n; }
+  const size_t *recvDisplsOf(uint32_t i) const { return recvDispls.data() + i*n; }
+
+  size_t sendTotal(uint32_t i) const {
+    return std::accumulate(sendCountsOf(i), sendCountsOf(i) + n, size_t{0});
+  }
+  size_t recvTotal(uint32_t i) const {
+    return std::accumulate(recvCountsOf(i), recvCountsOf(i) + n, size_t{0});
+  }
+  // elements leaving their GPU (self transfers excluded)
+  size_t crossTotal() const {
+    size_t s = 0;
+    for(uint32_t i = 0; i < n; i++) {
+      for(uint32_t j = 0; j < n; j++) s += i != j ? counts[i*n + j] : 0;
+    }
+    return s;
+  }
+};
+
+// shares of 'total' proportional to 'weights' (the rounding error goes to
+// the largest share)
+inline void apportion(const std::vector< double >& weights, size_t total,
+      size_t *out) {
+  double sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+  size_t given = 0, imax = 0;
+  for(size_t j = 0; j < weights.size(); j++) {
+    out[j] = (size_t)(total * (weights[j] / sum));
+    given += out[j];
+    if(weights[j] > weights[imax]) imax = j;
+  }
+  out[imax] += total - given;
+}
+
+inline Layout makeLayout(Dist dist, uint32_t n, size_t maxElems,
+      uint64_t seed = 1, double zipfS = 1.1, double hotFraction = 0.5) {
+  Layout L;
+  L.n = n;
+  L.counts.resize(n * n);
+  std::mt19937_64 gen(seed);
+  uint32_t hot = seed % n;
+  std::vector< double > w(n);
+  for(uint32_t i = 0; i < n; i++) {
+    switch(dist) {
+    case Dist::Balanced:
+      std::fill(w.begin(), w.end(), 1.0);
+      break;
+    case Dist::Zipf: {
+      std::vector< uint32_t > rank(n);
+      std::iota(rank.begin(), rank.end(), 0);
+      std::shuffle(rank.begin(), rank.end(), gen);
+      for(uint32_t j = 0; j < n; j++) w[j] = std::pow(rank[j] + 1.0, -zipfS);
+      break;
+    }
+    case Dist::HotExpert:
+      for(uint32_t j = 0; j < n; j++) {
+        w[j] = j == hot ? hotFraction : (1 - hotFraction) / (n - 1);
+      }
+      break;
+    }
+    apportion(w, maxElems, L.counts.data() + i*n);
+  }
+  // scale down until no GPU receives more than maxElems
+  size_t maxRecv = 0;
+  for(uint32_t j = 0; j < n; j++) {
+    size_t s = 0;
+    for(uint32_t i = 0; i < n; i++) s += L.counts[i*n + j];
+    maxRecv = std::max(maxRecv, s);
+  }
+  if(maxRecv > maxElems) {
+    for(auto& c : L.counts) c = (size_t)((double)c * maxElems / maxRecv);
+  }
+  L.sendDispls.resize(n * n);
+  L.recvCounts.resize(n * n);
+  L.recvDispls.resize(n * n);
+  for(uint32_t i = 0; i < n; i++) {
+    size_t sofs = 0, rofs = 0;
+    for(uint32_t j = 0; j < n; j++) {
+      L.sendDispls[i*n + j] = sofs, sofs += L.counts[i*n + j];
+      L.recvCounts[i*n + j] = L.counts[j*n + i];
+      L.recvDispls[i*n + j] = rofs, rofs += L.counts[j*n + i];
+    }
+  }
+  return L;
+}
+
+} // namespace a2av
+
+#endif // RCCL_ALLTOALLV_DIST_HPP
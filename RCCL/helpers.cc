@@ -1,5 +1,6 @@
 
 #include <algorithm>
+#include <chrono>
 #include <stdexcept>
 #include <iomanip>
 #include <numeric>
@@ -37,55 +38,39 @@ std::vector< uint32_t > TestFramework::permute_op()
 void TestFramework::init_extra_peers() {
 
   auto permute = permute_op();
-  for(uint32_t i = 0; i < m_nGpus; i++) {
-    //VLOG(0) << i << " permute: " << permute[i];
-    m_commGraph[i][0].out = permute[i];  // gpu i sends to gpu permute[i]
-    m_commGraph[permute[i]][0].in = i;   // gpu permute[i] receives from gpu i
-  }
+  auto topo = std::string(LINK_TOPOLOGY_FILE).empty() ?
+      route::Topology::uniform(m_nGpus, LINK_BANDWIDTH_GBS, LINK_LATENCY_US) :
+      route::Topology::load(LINK_TOPOLOGY_FILE, m_nGpus, LINK_BANDWIDTH_GBS,
+                            LINK_LATENCY_US);
+  // gateways and splits are planned for the largest message: smaller ones
+  // reuse the same graph
+  auto z1 = std::chrono::high_resolution_clock::now();
+  m_plan = route::planPermutation(topo, permute,
+        (double)m_maxElems * sizeof(T), m_nExtraPeers);
+  std::chrono::duration< double, std::milli > ms = 
+        std::chrono::high_resolution_clock::now() - z1;
+  VLOG(0) << "Route plan: " << ms.count() << " ms; link time " << 
+        m_plan.sol.linkUs << " us (lower bound " << m_plan.sol.boundUs << " us)";
+  // expected completion time with handshakes and chunk pipelining
+  auto sim = netsim::Simulator(topo).run(netsim::Simulator::fromPlan(m_plan,
+        m_maxElems * sizeof(T)));
+  VLOG(0) << "Simulated permute of " << m_maxElems * sizeof(T) << " bytes: "
+          << sim.timeUs << " us";
 
-  // the # of incoming links and outgoing links (the target link is already counted)
-  std::vector< uint32_t > numLinks(m_nGpus, 1);
   for(uint32_t i = 0; i < m_nGpus; i++) {
-
-    auto t = m_commGraph[i][0].out; // target node for GPU i
-    // iterate until all outgoing links for GPU i are filled
-    // VLOG(0) << "Examining " << i << " -> " << t;
-#if 1
-    for(uint32_t jc = i + 1, n = 1; 
-                         jc < 500 && n <= m_nExtraPeers; jc++) {
-      uint32_t j = jc % m_nGpus; // sometimes we need 2 rounds
-      // skip self, the target node, and nodes with too many extra peers
-      if(i == j || t == j || numLinks[j] > m_nExtraPeers) { 
-        continue;
-      }
-      // graph[j][z] can include (i,t) if:
-      // 1. there is no (i,t) in graph[j] - in that row
-      // 2. i != j and t != j 
-
-      // NOTE: for N extra peers we need N rounds ??/
-      // check if this slot is empty
-      if(m_commGraph[j][n].in != s_bogus)
-        continue;
-      
-      // VLOG(0) << "Found " << n << "th gateway " << i << "," << j << "," << t; 
-      // increase the number of nodes processed
-      // use node j as a gateway to send data from i to t
-      auto z = n++;
-      numLinks[j]++;
-      m_commGraph[j][z].in = i;  // node j receives z-th piece from node i
-      m_commGraph[j][z].out = t; // node j forwards z-th piece to node t
+    auto row = m_plan.row(i);
+    for(uint32_t z = 0; z <= m_nExtraPeers; z++) {
+      // node i receives z-th piece from node row[z].in and forwards it to
+      // node row[z].out (z == 0: direct send from i to its target)
+      m_commGraph[i][z].in = row[z].in;
+      m_commGraph[i][z].out = row[z].out;
     }
-#else
-    // alternative approach: use gateways living on target target nodes
-    // so that we have one direct write and one direct read kernel
-    if(m_nExtraPeers != 1) {
-      throw std::runtime_error("This approach works only for one peer!");
+    std::ostringstream oss;
+    for(uint32_t z = 0; z <= m_nExtraPeers; z++) {
+      oss << std::setprecision(3) << m_plan.splits[i*m_plan.nSlots + z] << ' ';
     }
-    int z = 1;
-    m_commGraph[t][z].in = i;   // node t receives z-th piece from node i
-    m_commGraph[t][z].out = t;  // node t saves z-th piece to itself
-#endif
-  } // for i m_nGpus
+    VLOG(0) << "GPU " << i << " splits: " << oss.str();
+  }
   VLOG(0) << "Legend: GPU x send: (i,j): gpu[x] receives from gpu[i] and sends to gpu[j]";
   for(uint32_t i = 0; i < m_nGpus; i++) { 
     VLOG(0) << "GPU " << i << " send: " << m_commGraph.printRow(i);
@@ -100,6 +85,21 @@ void TestFramework::init_extra_peers() {
   //     ThrowError<>("Uninitialized node for stageB!");
   //   }
   // }
+#if USE_CUSTOM_QCCL && GATEWAY_MODE == 1
+  // relays need a link of their own on both hops: source -> gateway and
+  // gateway -> target (the direct links never collide with them)
+  Matrix< uint32_t > senders(m_nGpus, m_nGpus, 0);
+  for(uint32_t g = 0; g < m_nGpus; g++) {
+    senders[g][m_commGraph[g][0].out]++;
+    for(uint32_t z = 1; z <= m_nExtraPeers; z++) {
+      auto [src, dst] = m_commGraph[g][z];
+      if(++senders[src][g] > 1 || ++senders[g][dst] > 1) {
+        ThrowError<>("Relays %u -> %u -> %u share a link: use GATEWAY_MODE 2",
+              src, g, dst);
+      }
+    }
+  }
+#endif
   output_dot();
 }
 
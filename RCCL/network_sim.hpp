@@ -0,0 +1,284 @@
+#ifndef RCCL_NETWORK_SIM_HPP
+#define RCCL_NETWORK_SIM_HPP 1
+
+// Discrete-event simulation of QCCL point-to-point traffic: predicts the
+// completion time of a schedule in the m_commGraph layout (direct sends plus
+// gateway slots) without GPUs, e.g. to compare plans, split factors and
+// gateway counts over message sizes.
+//
+// Model:
+//  - every hop of a transfer (source -> target, or source -> gateway ->
+//    target) starts after the kernel launch and the pointer handshake of
+//    setupInPtrs / setupOutPtrs: the peer publishes its buffer (one link
+//    latency) and the sender spins on it ('spinUs');
+//  - data moves in chunks of 'chunkBytes'; each chunk occupies one copy
+//    engine of the sending GPU and the link for bytes / bandwidth and
+//    arrives one link latency later. Links and engines serve chunks in
+//    request order, each hop keeps at most 'window' chunks in flight (sent
+//    but not arrived), so hops sharing a link interleave their chunks;
+//  - a gateway forwards chunk c once it has arrived (or once the whole
+//    piece has arrived if 'pipelined' is false). With 'ringChunks' > 0 the
+//    gateway stages at most that many chunks: a slot is returned to the
+//    source when its chunk has reached the target.
+//
+// The event queue is a binary heap over a vector reserved up front: there
+// are at most 'window' + 1 pending events per hop, hence running a schedule
+// performs no allocation per event.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "route_planner.hpp"
+
+namespace netsim {
+
+struct Config {
+  double launchUs = 5.0;       // kernel launch until the work items start
+  double spinUs = 1.0;         // polling granularity of the handshake flags
+  double chunkBytes = 1 << 20; // QCCL_CHUNK_BYTES
+  uint32_t window = 2;         // chunks in flight per hop
+  uint32_t ringChunks = 0;     // gateway staging in chunks (0: whole piece)
+  bool pipelined = true;       // gateways forward chunk by chunk
+  uint32_t enginesPerGpu = 8;  // concurrent copies of one GPU
+  double engineGBs = 0;        // bandwidth of one copy engine (0: no limit)
+};
+
+// 'bytes' from 'src' to 'dst', directly or via gateway 'via'
+struct Transfer {
+  uint32_t src, via, dst;
+  double bytes;
+};
+
+struct Result {
+  double timeUs = 0;            // the last chunk arrives at its target
+  std::vector< double > gpuUs;  // the last chunk arrives at GPU i
+  uint64_t nEvents = 0;
+};
+
+// link bandwidth (GB/s) and latency (us) of i -> j; bandwidth 0: no link
+struct LinkInfo {
+  double bwGBs, latUs;
+};
+
+class Simulator {
+
+  enum EventType : uint32_t { HopReady, ChunkArrived };
+
+  struct Event {
+    double t;
+    uint64_t seq;       // FIFO among events at the same time
+    EventType type;
+    uint32_t hop;
+  };
+
+  struct Hop {
+    uint32_t from, to, link;
+    uint32_t prev, next;     // the hops feeding / forwarding this one or ~0
+    uint32_t nChunks;
+    double lastChunk;        // size of the last chunk
+    double lat, bw;
+    bool ready = false;
+    uint32_t sent = 0, inFlight = 0, arrived = 0, credits = 0;
+  };
+
+public:
+  Simulator(uint32_t nGpus, std::function< LinkInfo(uint32_t, uint32_t) > links,
+        const Config& cfg = {}) : m_n(nGpus), m_links(std::move(links)),
+        m_cfg(cfg) {
+    if(m_cfg.window == 0 || m_cfg.enginesPerGpu == 0 || m_cfg.chunkBytes <= 0) {
+      throw std::runtime_error("Invalid simulator config");
+    }
+  }
+
+  Simulator(const route::Topology& t, const Config& cfg = {}) :
+      Simulator(t.n, [t](uint32_t i, uint32_t j) {
+        return LinkInfo{ t.bandwidth(i, j), t.latency(i, j) };
+      }, cfg) { }
+
+  const Config& config() const { return m_cfg; }
+
+  Result run(const std::vector< Transfer >& xs) {
+    setup(xs);
+    Result res;
+    res.gpuUs.assign(m_n, 0);
+    for(uint32_t h = 0; h < m_hops.size(); h++) {
+      const auto& hp = m_hops[h];
+      // the peer publishes its buffer, the sender sees it at the next poll
+      push(m_cfg.launchUs + hp.lat + m_cfg.spinUs, HopReady, h);
+    }
+    while(!m_queue.empty()) {
+      std::pop_heap(m_queue.begin(), m_queue.end(), later);
+      auto ev = m_queue.back();
+      m_queue.pop_back();
+      res.nEvents++;
+      auto& hp = m_hops[ev.hop];
+      switch(ev.type) {
+      case HopReady:
+        hp.ready = true;
+        break;
+      case ChunkArrived:
+        hp.arrived++, hp.inFlight--;
+        if(hp.next != s_none) {
+          trySend(hp.next, ev.t);
+          break;
+        }
+        res.gpuUs[hp.to] = std::max(res.gpuUs[hp.to], ev.t);
+        res.timeUs = std::max(res.timeUs, ev.t);
+        if(hp.prev != s_none) { // staging slot goes back to the source
+          m_hops[hp.prev].credits++;
+          trySend(hp.prev, ev.t);
+        }
+        break;
+      }
+      trySend(ev.hop, ev.t);
+    }
+    for(const auto& hp : m_hops) {
+      if(hp.arrived != hp.nChunks) {
+        throw std::runtime_error("Simulation deadlock: check ringChunks");
+      }
+    }
+    return res;
+  }
+
+  //! transfers of a collective permute in the m_commGraph layout: slot 0 of
+  //! GPU j sends j's piece 0 to graph[j][0].out, slot z > 0 forwards piece z
+  //! of GPU graph[j][z].in to graph[j][z].out; sizes[i*nSlots + z] is the
+  //! size of piece z of GPU i
+  template < class Slot >
+  static std::vector< Transfer > fromCommGraph(const Slot *graph, uint32_t n,
+        uint32_t nSlots, const size_t *sizes) {
+    std::vector< Transfer > xs;
+    xs.reserve(n * nSlots);
+    for(uint32_t j = 0; j < n; j++) {
+      auto row = graph + j*nSlots;
+      xs.push_back({ j, route::s_direct, row[0].out, (double)sizes[j*nSlots] });
+      for(uint32_t z = 1; z < nSlots; z++) {
+        auto i = row[z].in;
+        xs.push_back({ i, j, row[z].out, (double)sizes[i*nSlots + z] });
+      }
+    }
+    return xs;
+  }
+
+  //! transfers of a route plan for messages of 'bytes'
+  static std::vector< Transfer > fromPlan(const route::SlotPlan& sp,
+        size_t bytes) {
+    std::vector< size_t > ofs(sp.n * sp.nSlots), sizes(sp.n * sp.nSlots);
+    for(uint32_t i = 0; i < sp.n; i++) {
+      sp.pieces(i, bytes, ofs.data() + i*sp.nSlots, sizes.data() + i*sp.nSlots);
+    }
+    return fromCommGraph(sp.slots.data(), sp.n, sp.nSlots, sizes.data());
+  }
+
+private:
+  static constexpr uint32_t s_none = ~0u;
+
+  static bool later(const Event& a, const Event& b) {
+    return a.t > b.t || (a.t == b.t && a.seq > b.seq);
+  }
+
+  void push(double t, EventType type, uint32_t hop) {
+    m_queue.push_back({ t, m_seq++, type, hop });
+    std::push_heap(m_queue.begin(), m_queue.end(), later);
+  }
+
+  LinkInfo link(uint32_t i, uint32_t j) const {
+    auto L = m_links(i, j);
+    if(i == j || L.bwGBs <= 0) {
+      throw std::runtime_error("Transfer over a missing link");
+    }
+    return L;
+  }
+
+  void addHop(uint32_t from, uint32_t to, double bytes, uint32_t prev) {
+    auto L = link(from, to);
+    Hop hp{};
+    hp.from = from, hp.to = to;
+    hp.prev = prev, hp.next = s_none;
+    hp.nChunks = std::max(1.0, std::ceil(bytes / m_cfg.chunkBytes));
+    hp.lastChunk = bytes - (hp.nChunks - 1) * m_cfg.chunkBytes;
+    hp.lat = L.latUs;
+    hp.bw = m_cfg.engineGBs > 0 ? std::min(L.bwGBs, m_cfg.engineGBs) : L.bwGBs;
+    hp.credits = hp.nChunks;
+    m_hops.push_back(hp);
+  }
+
+  void setup(const std::vector< Transfer >& xs) {
+    m_hops.clear();
+    m_hops.reserve(xs.size() * 2);
+    for(const auto& x : xs) {
+      if(x.src >= m_n || x.dst >= m_n || (x.via != route::s_direct &&
+            x.via >= m_n)) {
+        throw std::runtime_error("Transfer GPU out of range");
+      }
+      if(x.bytes <= 0) continue;
+      if(x.via == route::s_direct) {
+        addHop(x.src, x.dst, x.bytes, s_none);
+        continue;
+      }
+      uint32_t h = m_hops.size();
+      addHop(x.src, x.via, x.bytes, s_none);
+      addHop(x.via, x.dst, x.bytes, h);
+      m_hops[h].next = h + 1;
+      if(m_cfg.ringChunks > 0) {
+        m_hops[h].credits = std::min(m_hops[h].nChunks, m_cfg.ringChunks);
+      }
+    }
+    // links are numbered by the sorted (from, to) pairs actually used
+    std::vector< uint64_t > keys(m_hops.size());
+    for(size_t h = 0; h < m_hops.size(); h++) {
+      keys[h] = (uint64_t)m_hops[h].from << 32 | m_hops[h].to;
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    for(auto& hp : m_hops) {
+      uint64_t k = (uint64_t)hp.from << 32 | hp.to;
+      hp.link = std::lower_bound(keys.begin(), keys.end(), k) - keys.begin();
+    }
+    m_linkFree.assign(keys.size(), 0);
+    m_engineFree.assign((size_t)m_n * m_cfg.enginesPerGpu, 0);
+    m_queue.clear();
+    m_queue.reserve(m_hops.size() * (m_cfg.window + 1));
+    m_seq = 0;
+  }
+
+  // sends the chunks of hop 'h' which are allowed to go at time 'now'
+  void trySend(uint32_t h, double now) {
+    auto& hp = m_hops[h];
+    if(!hp.ready) return;
+    while(hp.sent < hp.nChunks && hp.inFlight < m_cfg.window &&
+          hp.credits > 0) {
+      if(hp.prev != s_none) { // forwarding: the chunk must be here
+        const auto& up = m_hops[hp.prev];
+        bool avail = m_cfg.pipelined ? hp.sent < up.arrived :
+                                       up.arrived == up.nChunks;
+        if(!avail) return;
+      }
+      double bytes = hp.sent + 1 == hp.nChunks ? hp.lastChunk : m_cfg.chunkBytes,
+             dur = route::detail::linkTime(bytes, hp.bw);
+      auto engines = m_engineFree.begin() + (size_t)hp.from*m_cfg.enginesPerGpu;
+      auto eng = std::min_element(engines, engines + m_cfg.enginesPerGpu);
+      double start = std::max({ now, m_linkFree[hp.link], *eng }),
+             end = start + dur;
+      m_linkFree[hp.link] = *eng = end;
+      hp.sent++, hp.inFlight++, hp.credits--;
+      push(end + hp.lat, ChunkArrived, h);
+    }
+  }
+
+  uint32_t m_n;
+  std::function< LinkInfo(uint32_t, uint32_t) > m_links;
+  Config m_cfg;
+  std::vector< Hop > m_hops;
+  std::vector< double > m_linkFree, m_engineFree;
+  std::vector< Event > m_queue;
+  uint64_t m_seq = 0;
+};
+
+} // namespace netsim
+
+#endif // RCCL_NETWORK_SIM_HPP
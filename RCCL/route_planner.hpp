@@ -0,0 +1,658 @@
+#ifndef RCCL_ROUTE_PLANNER_HPP
+#define RCCL_ROUTE_PLANNER_HPP 1
+
+// Routing of point-to-point traffic over direct links and one-hop gateways,
+// i.e. the paths which qcclSendRecv and qcclGatewaySend can express.
+// The planner minimizes the time of the busiest link, max_e load_e / bw_e,
+// over fractional routings: the LP relaxation of the concurrent
+// multi-commodity flow restricted to paths of at most two hops. It is solved
+// by flow deviation on a log-sum-exp smoothing of the max: each sweep moves
+// the bytes of every commodity from its most expensive path to its cheapest
+// one under the gradient link weights. The same weights yield a lower bound
+// on the optimum and the sweeps stop once the gap is small enough, or once
+// the busiest link has stopped improving (the bound is not always tight).
+//
+// For permutations, planPermutation() rounds the routing to the slot layout
+// of TestFramework::m_commGraph: every GPU forwards exactly 'nGateways'
+// pieces of other GPUs (each link has the same number of subscribers).
+// Gateways are assigned slot by slot as min-cost perfect matchings, refined
+// by annealing over gateway exchanges which spread the link load, then the
+// splits are re-optimized over the chosen paths.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace route {
+
+constexpr uint32_t s_direct = 0xFFFFFFFFu; // 'via' of a direct path
+constexpr double s_inf = std::numeric_limits< double >::infinity();
+
+struct Topology {
+  uint32_t n = 0;
+  std::vector< double > bw;  // n x n link bandwidth in GB/s (0: no link)
+  std::vector< double > lat; // n x n link latency in us
+
+  double bandwidth(uint32_t i, uint32_t j) const { return bw[i*n + j]; }
+  double latency(uint32_t i, uint32_t j) const { return lat[i*n + j]; }
+
+  // fully connected GPUs, e.g. xGMI within one node
+  static Topology uniform(uint32_t n, double bwGBs, double latUs) {
+    Topology t{ n, std::vector< double >(n*n, bwGBs),
+                   std::vector< double >(n*n, latUs) };
+    for(uint32_t i = 0; i < n; i++) {
+      t.bw[i*n + i] = 0, t.lat[i*n + i] = 0;
+    }
+    return t;
+  }
+
+  // reads edges of a graphviz-like file: "i -> j [bw=50, lat=1.5];" for
+  // one direction or "i -- j [...]" for both; attributes not given take the
+  // defaults, links which are not listed do not exist
+  static Topology load(const char *path, uint32_t n, double defBwGBs,
+        double defLatUs) {
+    std::ifstream ifs(path);
+    if(!ifs) {
+      throw std::runtime_error(std::string("Unable to open ") + path);
+    }
+    Topology t{ n, std::vector< double >(n*n, 0),
+                   std::vector< double >(n*n, 0) };
+    auto attr = [](const std::string& s, const char *name, double def) {
+      auto p = s.find(std::string(name) + '=');
+      return p == std::string::npos ? def :
+             std::stod(s.substr(p + std::char_traits<char>::length(name) + 1));
+    };
+    for(std::string line; std::getline(ifs, line); ) {
+      auto p = line.find("->"), q = line.find("--");
+      bool both = p == std::string::npos;
+      if(both) p = q;
+      if(p == std::string::npos) continue;
+      uint32_t i = std::stoul(line.substr(0, p)),
+               j = std::stoul(line.substr(p + 2));
+      if(i >= n || j >= n || i == j) {
+        throw std::runtime_error("Invalid link: " + line);
+      }
+      double b = attr(line, "bw", defBwGBs), l = attr(line, "lat", defLatUs);
+      t.bw[i*n + j] = b, t.lat[i*n + j] = l;
+      if(both) t.bw[j*n + i] = b, t.lat[j*n + i] = l;
+    }
+    return t;
+  }
+};
+
+// traffic in bytes: 'bytes[i*n + j]' is sent from GPU i to GPU j
+struct Demand {
+  uint32_t n = 0;
+  std::vector< double > bytes;
+
+  // GPU i sends 'size' bytes to GPU target[i]
+  static Demand permutation(const std::vector< uint32_t >& target,
+        double size) {
+    uint32_t n = target.size();
+    Demand d{ n, std::vector< double >(n*n, 0) };
+    for(uint32_t i = 0; i < n; i++) {
+      if(target[i] != i) d.bytes[i*n + target[i]] = size;
+    }
+    return d;
+  }
+
+  static Demand allToAll(uint32_t n, double sizePerPair) {
+    Demand d{ n, std::vector< double >(n*n, sizePerPair) };
+    for(uint32_t i = 0; i < n; i++) d.bytes[i*n + i] = 0;
+    return d;
+  }
+};
+
+struct Options {
+  uint32_t maxIters = 300;
+  double relGap = 0.01;   // stop when (time - bound) / bound is below that
+  // or when the time has not improved by relGap for that many iterations
+  uint32_t stallIters = 8;
+  // gateway assignment (planPermutation): sweeps of n^2 exchanges, at most
+  // maxAnnealMoves in total, and iterations of the fractional routing over
+  // all gateways which only breaks ties between equally loaded choices
+  uint32_t annealSweeps = 100;
+  uint32_t maxAnnealMoves = 100000;
+  uint32_t guideIters = 20;
+};
+
+// one commodity: traffic src -> dst split between candidate paths
+struct Commodity {
+  uint32_t src, dst;
+  double bytes;
+  std::vector< uint32_t > vias; // s_direct or the gateway GPU
+  std::vector< double > frac;   // fraction of 'bytes' per path
+};
+
+struct Solution {
+  std::vector< Commodity > flows;
+  double linkUs = 0;   // time of the busiest link
+  double boundUs = 0;  // lower bound on 'linkUs' for any routing
+  double timeUs = 0;   // linkUs plus the largest latency of the paths used
+  uint32_t iters = 0;
+};
+
+namespace detail {
+
+// bytes / (GB/s) -> us
+inline double linkTime(double bytes, double bwGBs) {
+  return bytes / (bwGBs * 1e3);
+}
+
+template < class F >
+void forEachLink(const Commodity& c, uint32_t via, F&& f) {
+  if(via == s_direct) {
+    f(c.src, c.dst);
+  } else {
+    f(c.src, via), f(via, c.dst);
+  }
+}
+
+inline bool usable(const Topology& t, const Commodity& c, uint32_t via) {
+  return via == s_direct ? t.bandwidth(c.src, c.dst) > 0 :
+        t.bandwidth(c.src, via) > 0 && t.bandwidth(via, c.dst) > 0;
+}
+
+// link loads in us of busy time (n x n)
+inline void linkLoads(const Topology& t, const std::vector< Commodity >& cs,
+      std::vector< double >& load) {
+  const uint32_t n = t.n;
+  load.assign(n*n, 0);
+  for(const auto& c : cs) {
+    for(size_t p = 0; p < c.vias.size(); p++) {
+      if(c.frac[p] == 0) continue;
+      forEachLink(c, c.vias[p], [&](uint32_t a, uint32_t b) {
+        load[a*n + b] += linkTime(c.frac[p] * c.bytes, t.bandwidth(a, b));
+      });
+    }
+  }
+}
+
+// (1/beta) * log(sum exp(beta * u)) over the links: a smooth max
+inline double softMax(const std::vector< double >& u, double beta) {
+  double m = *std::max_element(u.begin(), u.end()), s = 0;
+  for(auto x : u) s += std::exp(beta * (x - m));
+  return m + std::log(s) / beta;
+}
+
+// busiest link time and the largest latency of the paths used
+inline void evaluate(const Topology& t, Solution& sol) {
+  std::vector< double > load;
+  linkLoads(t, sol.flows, load);
+  sol.linkUs = *std::max_element(load.begin(), load.end());
+  double latUs = 0;
+  for(const auto& c : sol.flows) {
+    for(size_t p = 0; p < c.vias.size(); p++) {
+      if(c.frac[p] < 1e-3) continue;
+      auto v = c.vias[p];
+      latUs = std::max(latUs, v == s_direct ? t.latency(c.src, c.dst) :
+            t.latency(c.src, v) + t.latency(v, c.dst));
+    }
+  }
+  sol.timeUs = sol.linkUs + latUs;
+}
+
+} // namespace detail
+
+//! minimizes the busiest link time over the candidate paths of each
+//! commodity, starting from the given fractions (if any)
+inline Solution optimize(const Topology& t, std::vector< Commodity > cs,
+      const Options& opts = {}) {
+  using namespace detail;
+  const uint32_t n = t.n;
+  for(auto& c : cs) {
+    bool any = false;
+    for(auto v : c.vias) any |= usable(t, c, v);
+    if(!any) {
+      throw std::runtime_error("No usable path from GPU " +
+            std::to_string(c.src) + " to GPU " + std::to_string(c.dst));
+    }
+    if(c.frac.size() != c.vias.size()) { // start with the fastest single path
+      c.frac.assign(c.vias.size(), 0);
+      size_t best = 0;
+      double bestBw = -1;
+      for(size_t p = 0; p < c.vias.size(); p++) {
+        if(!usable(t, c, c.vias[p])) continue;
+        double b = c.vias[p] == s_direct ? t.bandwidth(c.src, c.dst) :
+              std::min(t.bandwidth(c.src, c.vias[p]),
+                       t.bandwidth(c.vias[p], c.dst)) / 2;
+        if(b > bestBw) bestBw = b, best = p;
+      }
+      c.frac[best] = 1;
+    }
+  }
+  // us per byte of each link, its load, weight exp(beta * (load - U)) and
+  // the gradient w / bw (infinite for missing links)
+  std::vector< double > invBw(n*n), load, w(n*n), grad(n*n);
+  for(uint32_t e = 0; e < n*n; e++) {
+    invBw[e] = t.bw[e] > 0 ? 1 / (t.bw[e] * 1e3) : 0;
+  }
+  linkLoads(t, cs, load);
+  Solution sol;
+  double bestUs = s_inf;
+  std::vector< double > best; // fractions of all commodities at bestUs
+  auto saveBest = [&] {
+    best.clear();
+    for(const auto& c : cs) {
+      best.insert(best.end(), c.frac.begin(), c.frac.end());
+    }
+  };
+  // relative smoothing of the max: tightened as the iterations go
+  double mu = 0.1, gainUs = s_inf;
+  uint32_t lastGain = 0;
+  for(sol.iters = 0; sol.iters < opts.maxIters; sol.iters++, 
+        mu = std::max(mu * 0.9, opts.relGap / 2)) {
+    double U = *std::max_element(load.begin(), load.end());
+    if(U < bestUs) {
+      bestUs = U, saveBest();
+    }
+    if(bestUs < gainUs * (1 - opts.relGap)) {
+      gainUs = bestUs, lastGain = sol.iters;
+    }
+    // stop when converged or stalled
+    if(U == 0 || sol.iters > lastGain + opts.stallIters) break;
+    double beta = std::log((double)n*n) / (mu * U), wsum = 0;
+    auto setWeight = [&](uint32_t e) {
+      w[e] = t.bw[e] > 0 ? std::exp(beta * (load[e] - U)) : 0;
+      grad[e] = t.bw[e] > 0 ? w[e] * invBw[e] : s_inf;
+    };
+    for(uint32_t e = 0; e < n*n; e++) {
+      setWeight(e);
+      wsum += w[e];
+    }
+    auto pathCost = [&](const Commodity& c, uint32_t via) {
+      return via == s_direct ? grad[c.src*n + c.dst] :
+            grad[c.src*n + via] + grad[via*n + c.dst];
+    };
+    // any weights give a bound: sum_e w_e load_e <= U * sum_e w_e and 
+    // every commodity pays at least its cheapest path
+    if(sol.iters % 4 == 0) {
+      double dual = 0;
+      for(const auto& c : cs) {
+        double dmin = s_inf;
+        for(auto v : c.vias) dmin = std::min(dmin, pathCost(c, v));
+        dual += dmin * c.bytes;
+      }
+      sol.boundUs = std::max(sol.boundUs, dual / wsum);
+      if(bestUs - sol.boundUs <= opts.relGap * sol.boundUs) break;
+    }
+    // pairwise steps: shift bytes of a commodity from its most expensive
+    // used path to the cheapest one, minimizing the smooth max over the
+    // few links involved
+    for(auto& c : cs) {
+      size_t lo = 0, hi = 0;
+      double glo = s_inf, ghi = -1;
+      for(size_t p = 0; p < c.vias.size(); p++) {
+        double g = pathCost(c, c.vias[p]);
+        if(g < glo) glo = g, lo = p;
+        if(c.frac[p] > 0 && g > ghi) ghi = g, hi = p;
+      }
+      if(lo == hi || ghi <= glo * (1 + 1e-6)) continue;
+      // first and second derivatives of the smooth max in the bytes moved
+      auto derivs = [&](double x, double& d1, double& d2) {
+        d1 = d2 = 0;
+        auto f = [&](uint32_t a, uint32_t b, double sign) {
+          auto e = a*n + b;
+          double v = invBw[e] * std::exp(beta * (load[e] + sign*x*invBw[e] - U));
+          d1 += sign * v, d2 += beta * invBw[e] * v;
+        };
+        forEachLink(c, c.vias[hi], [&](uint32_t a, uint32_t b) { f(a, b, -1); });
+        forEachLink(c, c.vias[lo], [&](uint32_t a, uint32_t b) { f(a, b, 1); });
+      };
+      // safeguarded Newton on [0, xmax]: the function is convex
+      double xa = 0, xb = c.frac[hi] * c.bytes, x = 0, d1, d2;
+      for(int i = 0; i < 8 && xb - xa > 1e-6 * c.bytes; i++) {
+        derivs(x, d1, d2);
+        if(d1 < 0) xa = x; else xb = x;
+        double xn = x - d1 / d2;
+        x = xn > xa && xn < xb ? xn : (xa + xb) / 2;
+      }
+      double df = x / c.bytes;
+      c.frac[hi] = std::max(0.0, c.frac[hi] - df);
+      c.frac[lo] += df;
+      forEachLink(c, c.vias[hi], [&](uint32_t a, uint32_t b) {
+        load[a*n + b] -= x * invBw[a*n + b];
+        setWeight(a*n + b);
+      });
+      forEachLink(c, c.vias[lo], [&](uint32_t a, uint32_t b) {
+        load[a*n + b] += x * invBw[a*n + b];
+        setWeight(a*n + b);
+      });
+    }
+    if(sol.iters % 8 == 7) {
+      linkLoads(t, cs, load); // no drift of the incremental updates
+    }
+  }
+  auto f = best.begin();
+  for(auto& c : cs) {
+    std::copy(f, f + c.frac.size(), c.frac.begin()), f += c.frac.size();
+  }
+  sol.flows = std::move(cs);
+  evaluate(t, sol);
+  return sol;
+}
+
+//! routes arbitrary traffic over all direct and one-gateway paths
+inline Solution plan(const Topology& t, const Demand& d,
+      const Options& opts = {}) {
+  if(t.n != d.n) throw std::runtime_error("Topology and demand mismatch");
+  std::vector< Commodity > cs;
+  for(uint32_t i = 0; i < t.n; i++) {
+    for(uint32_t j = 0; j < t.n; j++) {
+      if(i == j || d.bytes[i*t.n + j] <= 0) continue;
+      Commodity c{ i, j, d.bytes[i*t.n + j], { s_direct }, {} };
+      for(uint32_t v = 0; v < t.n; v++) {
+        if(v != i && v != j) c.vias.push_back(v);
+      }
+      cs.push_back(std::move(c));
+    }
+  }
+  return optimize(t, std::move(cs), opts);
+}
+
+//! min-cost perfect assignment of rows to columns (Hungarian method, O(n^3)):
+//! returns the column of each row; forbidden pairs have infinite cost
+inline std::vector< uint32_t > assign(const std::vector< double >& cost,
+      uint32_t n) {
+  std::vector< double > u(n + 1), v(n + 1), minv(n + 1);
+  std::vector< uint32_t > p(n + 1), way(n + 1);
+  std::vector< bool > used(n + 1);
+  for(uint32_t i = 1; i <= n; i++) {
+    p[0] = i;
+    uint32_t j0 = 0;
+    std::fill(minv.begin(), minv.end(), s_inf);
+    std::fill(used.begin(), used.end(), false);
+    do {
+      used[j0] = true;
+      uint32_t i0 = p[j0], j1 = 0;
+      double delta = s_inf;
+      for(uint32_t j = 1; j <= n; j++) {
+        if(used[j]) continue;
+        double c = cost[(i0 - 1)*n + j - 1] - u[i0] - v[j];
+        if(c < minv[j]) minv[j] = c, way[j] = j0;
+        if(minv[j] < delta) delta = minv[j], j1 = j;
+      }
+      if(delta == s_inf) {
+        throw std::runtime_error("No feasible gateway assignment");
+      }
+      for(uint32_t j = 0; j <= n; j++) {
+        if(used[j]) u[p[j]] += delta, v[j] -= delta;
+        else minv[j] -= delta;
+      }
+      j0 = j1;
+    } while(p[j0] != 0);
+    do {
+      uint32_t j1 = way[j0];
+      p[j0] = p[j1], j0 = j1;
+    } while(j0 != 0);
+  }
+  std::vector< uint32_t > col(n);
+  for(uint32_t j = 1; j <= n; j++) col[p[j] - 1] = j - 1;
+  return col;
+}
+
+// routing of a permutation in the m_commGraph layout
+struct SlotPlan {
+  struct Slot { uint32_t in, out; };
+
+  uint32_t n = 0, nSlots = 0;   // nSlots = 1 + nGateways
+  // slot z of GPU j: receives from 'in' and sends to 'out'; slot 0 is the
+  // direct link, slot z > 0 forwards the z-th piece of GPU 'in'
+  std::vector< Slot > slots;
+  // fraction of the message of GPU i sent in its z-th piece
+  std::vector< double > splits;
+  Solution sol;
+
+  const Slot *row(uint32_t j) const { return slots.data() + j*nSlots; }
+
+  // byte ranges of the pieces of GPU i for a message of 'bytes': all but
+  // the last piece are aligned to 'align', the last one takes the rest
+  void pieces(uint32_t i, size_t bytes, size_t *ofs, size_t *sizes,
+        size_t align = 16) const {
+    size_t o = 0;
+    for(uint32_t z = 0; z < nSlots; z++) {
+      size_t sz = z + 1 < nSlots ?
+            (size_t)(splits[i*nSlots + z] * bytes) & ~(align - 1) : bytes - o;
+      sz = std::min(sz, bytes - o);
+      ofs[z] = o, sizes[z] = sz, o += sz;
+    }
+  }
+};
+
+//! GPU i sends 'bytes' to target[i] directly and via 'nGateways' other GPUs;
+//! a gateway piece shorter than the extra latency of its path (in link
+//! time) is not worth sending and its share goes to the other paths
+inline SlotPlan planPermutation(const Topology& t,
+      const std::vector< uint32_t >& target, double bytes, uint32_t nGateways,
+      const Options& opts = {}) {
+
+  const uint32_t n = t.n;
+  if(target.size() != n || (nGateways > 0 && nGateways + 2 > n)) {
+    throw std::runtime_error("Invalid permutation or number of gateways");
+  }
+  SlotPlan sp{ n, nGateways + 1,
+      std::vector< SlotPlan::Slot >(n * (nGateways + 1)),
+      std::vector< double >(n * (nGateways + 1)), {} };
+  for(uint32_t i = 0; i < n; i++) {
+    sp.slots[target[i] * sp.nSlots].in = i;
+    sp.slots[i * sp.nSlots].out = target[i];
+  }
+  // the fractional routing over all gateways guides the assignment: it
+  // converges slowly with n paths per commodity, a rough one does here
+  auto guideOpts = opts;
+  guideOpts.maxIters = std::min(opts.maxIters, opts.guideIters);
+  auto full = plan(t, Demand::permutation(target, bytes), guideOpts);
+  std::vector< double > frac(n*n, 0); // (source, gateway)
+  for(const auto& c : full.flows) {
+    for(size_t p = 0; p < c.vias.size(); p++) {
+      if(c.vias[p] != s_direct) frac[c.src*n + c.vias[p]] = c.frac[p];
+    }
+  }
+  // gateways are chosen on nominal link loads (us), every piece carrying an
+  // equal share, by minimizing the sum of squared loads: each slot is a
+  // min-cost perfect matching given the other slots and slots are re-matched
+  // while this helps
+  const double share = bytes / (nGateways + 1),
+        unit = detail::linkTime(share,
+              *std::max_element(t.bw.begin(), t.bw.end()));
+  auto sq = [](double x) { return x * x; };
+  std::vector< double > L(n*n, 0), cost(n*n);
+  std::vector< std::vector< uint32_t > > gws(n, // gateways of each source
+        std::vector< uint32_t >(nGateways, n));
+
+  auto addPath = [&](uint32_t i, uint32_t j, double sign) {
+    L[i*n + j] += sign * detail::linkTime(share, t.bandwidth(i, j));
+    L[j*n + target[i]] += sign *
+          detail::linkTime(share, t.bandwidth(j, target[i]));
+  };
+  auto allowed = [&](uint32_t i, uint32_t j) {
+    return j != i && j != target[i] &&
+        std::find(gws[i].begin(), gws[i].end(), j) == gws[i].end() &&
+        t.bandwidth(i, j) > 0 && t.bandwidth(j, target[i]) > 0;
+  };
+  auto sumSq = [&] {
+    double sum = 0;
+    for(auto x : L) sum += sq(x);
+    return sum;
+  };
+  auto matchSlot = [&](uint32_t z) {
+    for(uint32_t i = 0; i < n; i++) {
+      for(uint32_t j = 0; j < n; j++) {
+        if(!allowed(i, j)) {
+          cost[i*n + j] = s_inf;
+          continue;
+        }
+        // increase of the sum of squares; the LP solution breaks the ties
+        auto &a = L[i*n + j], &b = L[j*n + target[i]];
+        double da = detail::linkTime(share, t.bandwidth(i, j)),
+               db = detail::linkTime(share, t.bandwidth(j, target[i]));
+        cost[i*n + j] = (da*(2*a + da) + db*(2*b + db)) / sq(unit) -
+              frac[i*n + j] * 1e-3;
+      }
+    }
+    auto col = assign(cost, n);
+    for(uint32_t i = 0; i < n; i++) {
+      gws[i][z] = col[i];
+      addPath(i, col[i], 1);
+    }
+  };
+  for(uint32_t i = 0; i < n; i++) {
+    L[i*n + target[i]] = detail::linkTime(share, t.bandwidth(i, target[i]));
+  }
+  for(uint32_t z = 0; z < nGateways; z++) {
+    matchSlot(z);
+  }
+  for(uint32_t round = 0; round < 10 && nGateways > 1; round++) {
+    double before = sumSq();
+    auto saved = gws;
+    auto savedL = L;
+    for(uint32_t z = 0; z < nGateways; z++) {
+      for(uint32_t i = 0; i < n; i++) {
+        addPath(i, gws[i][z], -1);
+        gws[i][z] = n;
+      }
+      matchSlot(z);
+    }
+    if(double after = sumSq(); after >= before * (1 - 1e-9)) {
+      if(after > before) {
+        gws = std::move(saved), L = std::move(savedL);
+      }
+      break;
+    }
+  }
+  // Only the sets of gateways matter for the loads: as long as every GPU
+  // forwards for nGateways sources, the sets split into per-slot matchings.
+  // Sources may collide on links even so, which is fixed by annealing over
+  // exchanges of gateways between two sources.
+  // trySwap exchanges gws[i1][z1] and gws[i2][z2] if 'accept' agrees with
+  // the change of the sum of squared loads
+  auto trySwap = [&](uint32_t i1, uint32_t z1, uint32_t i2, uint32_t z2,
+        auto&& accept) {
+    uint32_t j1 = gws[i1][z1], j2 = gws[i2][z2];
+    gws[i1][z1] = gws[i2][z2] = n; // exclude from the checks
+    bool ok = allowed(i1, j2) && allowed(i2, j1);
+    gws[i1][z1] = j1, gws[i2][z2] = j2;
+    if(!ok) return false;
+    // links may repeat here: both sums count them the same way
+    const uint32_t es[] = { i1*n + j1, j1*n + target[i1],
+        i2*n + j2, j2*n + target[i2], i1*n + j2, j2*n + target[i1],
+        i2*n + j1, j1*n + target[i2] };
+    double before = 0, after = 0;
+    for(auto e : es) before += sq(L[e]);
+    addPath(i1, j1, -1), addPath(i2, j2, -1);
+    addPath(i1, j2, 1), addPath(i2, j1, 1);
+    for(auto e : es) after += sq(L[e]);
+    if(accept((after - before) / sq(unit))) {
+      gws[i1][z1] = j2, gws[i2][z2] = j1;
+      return true;
+    }
+    addPath(i1, j2, -1), addPath(i2, j1, -1);
+    addPath(i1, j1, 1), addPath(i2, j2, 1);
+    return false;
+  };
+  if(nGateways > 0 && opts.annealSweeps > 0) {
+    std::mt19937 rng(1); // plans must be the same on all ranks
+    std::uniform_real_distribution< double > uni(0, 1);
+    auto best = gws;
+    double cur = sumSq() / sq(unit), bestSq = cur;
+    const uint64_t nMoves = std::min< uint64_t >(
+          (uint64_t)opts.annealSweeps * n * n, opts.maxAnnealMoves);
+    // temperature goes from 1 to 1e-3 (squared units)
+    const double cool = std::pow(1e-3, 1.0 / std::max< uint64_t >(nMoves, 1));
+    double T = 1;
+    for(uint64_t m = 0; m < nMoves; m++, T *= cool) {
+      uint32_t i1 = rng() % n, i2 = rng() % n;
+      if(i1 == i2) continue;
+      trySwap(i1, rng() % nGateways, i2, rng() % nGateways,
+          [&](double delta) {
+        if(delta > 0 && uni(rng) >= std::exp(-delta / T)) return false;
+        cur += delta;
+        return true;
+      });
+      if(cur < bestSq * (1 - 1e-9)) {
+        best = gws, bestSq = cur;
+      }
+    }
+    for(uint32_t i = 0; i < n; i++) { // back to the best assignment
+      for(uint32_t z = 0; z < nGateways; z++) {
+        addPath(i, gws[i][z], -1), addPath(i, best[i][z], 1);
+      }
+    }
+    gws = std::move(best);
+  }
+  for(bool improved = true; improved; ) { // down to a local minimum
+    improved = false;
+    for(uint32_t i1 = 0; i1 < n; i1++) {
+      for(uint32_t i2 = i1 + 1; i2 < n; i2++) {
+        for(uint32_t z1 = 0; z1 < nGateways; z1++) {
+          for(uint32_t z2 = 0; z2 < nGateways; z2++) {
+            improved |= trySwap(i1, z1, i2, z2,
+                  [](double d) { return d < -1e-9; });
+          }
+        }
+      }
+    }
+  }
+  // the gateways form an nGateways-regular bipartite graph which is a union
+  // of perfect matchings (Koenig): peel them off one slot at a time
+  std::vector< std::vector< uint32_t > > sets(std::move(gws));
+  gws.assign(n, std::vector< uint32_t >(nGateways, n));
+  for(uint32_t z = 0; z < nGateways; z++) {
+    for(uint32_t i = 0; i < n; i++) {
+      for(uint32_t j = 0; j < n; j++) {
+        auto& s = sets[i];
+        cost[i*n + j] = std::find(s.begin(), s.end(), j) != s.end() ? 0 : 1;
+      }
+    }
+    auto col = assign(cost, n);
+    for(uint32_t i = 0; i < n; i++) {
+      auto& s = sets[i];
+      s.erase(std::find(s.begin(), s.end(), col[i]));
+      gws[i][z] = col[i];
+    }
+  }
+  for(uint32_t i = 0; i < n; i++) {
+    for(uint32_t z = 1; z <= nGateways; z++) {
+      sp.slots[gws[i][z - 1] * sp.nSlots + z] = { i, target[i] };
+    }
+  }
+  // re-optimize the splits over the chosen paths only
+  std::vector< Commodity > cs;
+  for(uint32_t i = 0; i < n; i++) {
+    if(target[i] == i) continue;
+    Commodity c{ i, target[i], bytes, { s_direct }, {} };
+    c.vias.insert(c.vias.end(), gws[i].begin(), gws[i].end());
+    cs.push_back(std::move(c));
+  }
+  sp.sol = optimize(t, std::move(cs), opts);
+  for(auto& c : sp.sol.flows) {
+    auto dst = sp.splits.data() + c.src * sp.nSlots;
+    double kept = 0;
+    for(size_t p = 0; p < c.vias.size(); p++) {
+      auto v = c.vias[p];
+      if(v != s_direct && t.bandwidth(c.src, c.dst) > 0) {
+        double extraUs = t.latency(c.src, v) + t.latency(v, c.dst) -
+                         t.latency(c.src, c.dst);
+        if(c.frac[p] * c.bytes < extraUs * t.bandwidth(c.src, c.dst) * 1e3) {
+          c.frac[p] = 0;
+        }
+      }
+      dst[p] = c.frac[p], kept += c.frac[p];
+    }
+    for(size_t p = 0; p < c.vias.size(); p++) {
+      dst[p] = c.frac[p] /= kept;
+    }
+  }
+  detail::evaluate(t, sp.sol);
+  return sp;
+}
+
+} // namespace route
+
+#endif // RCCL_ROUTE_PLANNER_HPP
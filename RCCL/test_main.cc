@@ -1,5 +1,6 @@
 
 // hipcc -I.. -DCOMPILE_FOR_ROCM=1 -std=c++17 --offload-arch=gfx90a test_main.cc
+// g++ -I.. -I../LibraryQCCL -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread test_main.cc helpers.cc ../LibraryQCCL/qccl_lib.cc ../common/common.cc ../common/host_runtime.cc ../common/host_nccl.cc
 
 #include <algorithm>
 #include <stdexcept>
@@ -9,6 +10,7 @@
 #include <random>
 #include "common/threading.hpp"
 #include "common/common_utils.hpp"
+#include "common/check_data.hpp"
 #include "common/roc_profiler.h"
 
 #include "test_main.h"
@@ -39,16 +41,20 @@ TestFramework::TestFramework(size_t nGpus, const uint32_t *gpuIDs,
        size_t maxElems) : m_nGpus(nGpus), m_maxElems(maxElems),
       m_curElems(maxElems), 
       m_nExtraPeers(NUM_EXTRA_PEERS), 
-      m_splitFactor(EXTRA_PEERS_SPLIT_FACTOR), 
       m_infos(nGpus), m_barrier(nGpus), m_pool(nGpus),
-      m_commGraph(nGpus, m_nExtraPeers + 1, Node{s_bogus,s_bogus}) 
+      m_commGraph(nGpus, m_nExtraPeers + 1, Node{s_bogus,s_bogus}),
+      m_offsets(nGpus, m_nExtraPeers + 1), m_sizes(nGpus, m_nExtraPeers + 1)
 { 
 #if !USE_DEBUG_CONFIG_3_GPUS
   if(m_nExtraPeers >= m_nGpus-1) {
     VLOG(0) << "Wrong number of extra peers!";
     throw std::runtime_error("Wrong number of extra peers!");
   }
-  if(m_nExtraPeers == 0) m_splitFactor = 1.0; 
+#endif
+#if USE_CUSTOM_QCCL && GATEWAY_MODE != 0
+  // a ring of chunks for each relayed piece or the whole piece
+  m_stageBytes = m_nExtraPeers == 0 ? 0 : GATEWAY_MODE == 1 ? 
+        RELAY_RING_CHUNKS * (size_t)QCCL_CHUNK_BYTES : m_maxElems * sizeof(T);
 #endif
 
 #if USE_CUSTOM_QCCL
@@ -69,6 +75,11 @@ TestFramework::TestFramework(size_t nGpus, const uint32_t *gpuIDs,
                 // hipMallocSignalMemory;
     CHK(hipExtMallocWithFlags((void **)&info.sendBuf, nBytes*2, flags));
     info.recvBuf = info.sendBuf + m_maxElems + s_redzoneElems;
+    info.stageBuf = nullptr;
+    if(m_stageBytes != 0) {
+      CHK(hipExtMallocWithFlags((void **)&info.stageBuf, 
+            m_stageBytes * m_nExtraPeers, flags));
+    }
     CHK(cudaStreamCreateWithFlags(&info.stream, cudaStreamNonBlocking));
 
     CHK(cudaMemsetAsync(info.sendBuf, s_fillValue ^ 0xFF, nBytes, info.stream));
@@ -89,6 +100,7 @@ TestFramework::~TestFramework() {
     (void)cudaSetDevice(info.gpuId);
     (void)cudaStreamDestroy(info.stream);
     (void)cudaFree(info.sendBuf);
+    (void)cudaFree(info.stageBuf);
 #if !USE_CUSTOM_QCCL
     (void)ncclCommDestroy(info.comm);
 #endif
@@ -116,11 +128,15 @@ void TestFramework::fill_verify_data(int id) {
   CHK(cudaMemsetAsync(info.recvBuf, fillVal, nBytes, info.stream));
   CHK(cudaMemsetAsync(info.recvBuf + m_curElems, s_oobValue, obytes, info.stream));
 
-  std::vector< T > refBuf(m_curElems);
+  auto& refBuf = info.hostBuf;
+  refBuf.resize(m_curElems);
 #if VERIFY_DATA
-  for(size_t i = 0; i < m_curElems; i++) {
-    refBuf[i] = getElement(id, i);
-  }
+  // other threads can steal parts of this loop once they are done with their GPUs
+  m_pool.parallelFor(0, m_curElems, [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; i++) {
+      refBuf[i] = getElement(id, i);
+    }
+  });
 #else
   std::fill(refBuf.begin(), refBuf.end(), T(id));
 #endif
@@ -129,13 +145,13 @@ void TestFramework::fill_verify_data(int id) {
 }
 
 void TestFramework::verify(int id) {
-  std::lock_guard _(m_verifyMtx);
+  auto& info = m_infos[id];
   auto sz = m_curElems + s_redzoneElems;
-  if(m_hostBuf.size() < sz) {
-    m_hostBuf.resize(sz);
+  if(info.hostBuf.size() < sz) {
+    info.hostBuf.resize(sz);
   }
-  auto dst = m_hostBuf.data();
-  CHK(cudaMemcpy(dst, m_infos[id].recvBuf, sz*sizeof(T), cudaMemcpyDeviceToHost));
+  auto dst = info.hostBuf.data();
+  CHK(cudaMemcpy(dst, info.recvBuf, sz*sizeof(T), cudaMemcpyDeviceToHost));
   // Node id should receive original data from node m_commGraph[id][0].in
   auto t = m_commGraph[id][0].in;
 #if USE_DEBUG_CONFIG_3_GPUS  
@@ -144,39 +160,50 @@ void TestFramework::verify(int id) {
   t = 1 - id;
 #endif
 
-#if TEST_ALL_TO_ALL
+  auto& truth = info.truthBuf;
+  truth.resize(m_curElems);
+#if TEST_ALL_TO_ALLV
+  VLOG(0) << "Device " << id << " verifying outputs..";
+  // block j at recvDispls[j] comes from the block for id of device j; the
+  // rest of the buffer keeps the fill value
+  const T fill = (T)(0x01010101u * (0x80 + id));
+  std::fill(truth.begin(), truth.end(), fill);
+  for(uint32_t j = 0; j < m_nGpus; j++) {
+    auto count = m_a2av.recvCountsOf(id)[j];
+    auto rofs = m_a2av.recvDisplsOf(id)[j], sofs = m_a2av.sendDisplsOf(j)[id];
+    m_pool.parallelFor(0, count, [&](size_t b, size_t e) {
+      for(size_t i = b; i < e; i++) {
+        truth[rofs + i] = getElement(j, sofs + i);
+      }
+    });
+  }
+#elif TEST_ALL_TO_ALL
   VLOG(0) << "Device " << id << " verifying outputs..";
   uint32_t chunk_len = m_curElems / m_nGpus;
   // device ID: gets id's chunk from all devices  
-  for(uint32_t j = 0, num = 0; j < m_curElems; j++) {
-    auto gpuID = j / chunk_len, idx = j % chunk_len;
-    auto truth = getElement(gpuID, id*chunk_len + idx);
-    if(dst[j] != truth) {
-      PRINTZ("0x%X/%d: verify failed truth: %d gpu: %d (%X)", j, j, 
-              truth, dst[j], dst[j]);
+  m_pool.parallelFor(0, m_curElems, [&](size_t b, size_t e) {
+    for(uint32_t j = b; j < e; j++) {
+      auto gpuID = j / chunk_len, idx = j % chunk_len;
+      truth[j] = getElement(gpuID, id*chunk_len + idx);
     }
-  }
+  });
 #else
   VLOG(0) << "Device " << id << " verifying: expecting data from: " << t;
-  for(uint32_t j = 0, num = 0; j < m_curElems; j++) {
-    auto truth = getElement(t, j);
-    if(dst[j] != truth) {
-      //ThrowError<>("%d: verify failed truth: %f gpu: %f", j, truth, dst[j]);
-      PRINTZ("0x%X/%d: verify failed truth: %d gpu: %d (%X)", j, j, 
-              truth, dst[j], dst[j]);
-      if(num++ >= 5)
-        break;
-    }
-  }
-  auto bdst = (const uint8_t *)(dst + m_curElems);
-  for(uint32_t j = 0, num = 0; j < s_redzoneElems*sizeof(T); j++) {
-    if(bdst[j] != s_oobValue) {
-      PRINTZ("%X: redzone value modified truth: %X gpu %X", j, s_oobValue, bdst[j]);
-      if(num++ >= 5)
-        break;
+  m_pool.parallelFor(0, m_curElems, [&](size_t b, size_t e) {
+    for(uint32_t j = b; j < e; j++) {
+      truth[j] = getElement(t, j);
     }
-  }
+  });
 #endif
+  CheckOptions opts;
+  opts.maxReport = 5;
+  opts.redzoneBytes = s_redzoneElems*sizeof(T);
+  opts.redzoneValue = s_oobValue;
+  auto res = checkData(&m_pool, dst, truth.data(), m_curElems, m_curElems, 1,
+        opts);
+  if(!res.ok()) {
+    res.print(("Device " + std::to_string(id)).c_str());
+  }
 }
 
 #if USE_CUSTOM_QCCL
@@ -185,8 +212,14 @@ void TestFramework::run_single_gpu(int id)
   auto& info = m_infos[id];
 #if !USE_DEBUG_CONFIG_3_GPUS
 
-#if TEST_ALL_TO_ALL
-  size_t size = m_sizes[0] / m_nGpus, ofs = 0;
+#if TEST_ALL_TO_ALLV
+  // runs the work items itself: nothing left for qcclRun
+  CHKQCCL(qcclAllToAllv(id, info.sendBuf, m_a2av.sendCountsOf(id), 
+        m_a2av.sendDisplsOf(id), info.recvBuf, m_a2av.recvCountsOf(id),
+        m_a2av.recvDisplsOf(id), QCCL_DataType::Int32, info.stream));
+  return;
+#elif TEST_ALL_TO_ALL
+  size_t size = m_sizes[id][0] / m_nGpus, ofs = 0;
   uint32_t numSubscribedPeers = 1;
   auto recvBuf = (uint8_t *)info.recvBuf, 
        sendBuf = (uint8_t *)info.sendBuf;
@@ -196,18 +229,70 @@ void TestFramework::run_single_gpu(int id)
             i, sendBuf + ofs, size));
   }
 
-#else // TEST_ALL_TO_ALL
+#elif GATEWAY_MODE != 0
+  // every link has a single sender (see init_extra_peers): the direct
+  // piece, the pieces this GPU sends to its gateways and receives from 
+  // the gateways of its source, and the pieces it forwards as a gateway
+  const auto& V = m_commGraph[id];
+  auto sendBuf = (uint8_t *)info.sendBuf, recvBuf = (uint8_t *)info.recvBuf;
+  CHKQCCL(qcclSendRecv(id, 1, V[0].in, recvBuf, m_sizes[V[0].in][0], 
+        V[0].out, sendBuf, m_sizes[id][0]));
+  for(uint32_t g = 0; g < m_nGpus; g++) {
+    for(uint32_t z = 1; z <= m_nExtraPeers; z++) {
+      auto src = m_commGraph[g][z].in;
+      if(src == (uint32_t)id) { // our z-th piece goes through gateway g
+        CHKQCCL(qcclSendRecv(id, 1, id, nullptr, 0, g, 
+              sendBuf + m_offsets[id][z], m_sizes[id][z]));
+      }
+      if(m_commGraph[g][z].out == (uint32_t)id && GATEWAY_MODE == 1) {
+        CHKQCCL(qcclSendRecv(id, 1, g, recvBuf + m_offsets[src][z], 
+              m_sizes[src][z], id, nullptr, 0));
+      }
+    }
+  }
+  for(uint32_t z = 1; z <= m_nExtraPeers; z++) {
+    auto stage = info.stageBuf + (z - 1) * m_stageBytes;
+    auto src = V[z].in;
+    if(GATEWAY_MODE == 1) {
+      CHKQCCL(qcclRelaySend(id, src, V[z].out, stage, m_stageBytes, 
+            m_sizes[src][z]));
+    } else { // the whole piece lands first
+      CHKQCCL(qcclSendRecv(id, 1, src, stage, m_sizes[src][z], id, 
+            nullptr, 0));
+    }
+  }
+#if GATEWAY_MODE == 2
+  CHKQCCL(qcclRun(id, info.stream));
+  // second round: forward the staged pieces
+  for(uint32_t z = 1; z <= m_nExtraPeers; z++) {
+    auto src = V[z].in;
+    CHKQCCL(qcclSendRecv(id, 1, id, nullptr, 0, V[z].out, 
+          info.stageBuf + (z - 1) * m_stageBytes, m_sizes[src][z]));
+  }
+  for(uint32_t g = 0; g < m_nGpus; g++) {
+    for(uint32_t z = 1; z <= m_nExtraPeers; z++) {
+      auto src = m_commGraph[g][z].in;
+      if(m_commGraph[g][z].out == (uint32_t)id) {
+        CHKQCCL(qcclSendRecv(id, 1, g, recvBuf + m_offsets[src][z], 
+              m_sizes[src][z], id, nullptr, 0));
+      }
+    }
+  }
+#endif // GATEWAY_MODE == 2
+
+#else // GATEWAY_MODE == 0
   const auto& V = m_commGraph[id];
   uint32_t numSubscribedPeers = 1 + m_nExtraPeers;
   for(int i = 0; i <= m_nExtraPeers; i++) {
       int inP = V[i].in, outP = V[i].out;
-      auto size = m_sizes[i];
       if(i == 0) {
-        CHKQCCL(qcclSendRecv(id, numSubscribedPeers, inP, info.recvBuf, size,
-            outP, info.sendBuf, size));
+        // the direct pieces of the source and of this GPU may differ in size
+        CHKQCCL(qcclSendRecv(id, numSubscribedPeers, inP, info.recvBuf, 
+            m_sizes[inP][0], outP, info.sendBuf, m_sizes[id][0]));
       } else {
+        // slot i forwards the i-th piece of the message of GPU inP
         CHKQCCL(qcclGatewaySend(id, numSubscribedPeers, inP, outP, 
-              m_offsets[i], size));
+              m_offsets[inP][i], m_sizes[inP][i]));
       }
   }
 #endif // TEST_ALL_TO_ALL
@@ -246,7 +331,16 @@ void TestFramework::run_single_gpu(int id)
 {
   auto& info = m_infos[id];
   auto type = (ncclDataType_t)getNcclType();
-#if TEST_ALL_TO_ALL
+#if TEST_ALL_TO_ALLV
+  CHKNCCL(ncclGroupStart());
+  for(uint32_t i = 0; i < m_nGpus; i++) {
+    CHKNCCL(ncclSend(info.sendBuf + m_a2av.sendDisplsOf(id)[i], 
+          m_a2av.sendCountsOf(id)[i], type, i, info.comm, info.stream));
+    CHKNCCL(ncclRecv(info.recvBuf + m_a2av.recvDisplsOf(id)[i], 
+          m_a2av.recvCountsOf(id)[i], type, i, info.comm, info.stream));
+  }
+  CHKNCCL(ncclGroupEnd());
+#elif TEST_ALL_TO_ALL
   CHKNCCL(ncclAllToAll(info.sendBuf, info.recvBuf, m_curElems / m_nGpus, 
         type, info.comm, info.stream));
 #else
@@ -267,7 +361,58 @@ void TestFramework::run_single_gpu(int id)
 }
 #endif // USE_CUSTOM_QCCL
 
-void TestFramework::run(size_t numElems, int numIters, bool measureTime, bool verifyData) {
+// (de)registers the receive buffers of all links for messages of m_curElems
+void TestFramework::register_buffers(bool enable) {
+#if USE_CUSTOM_QCCL && !USE_DEBUG_CONFIG_3_GPUS
+  if(m_nExtraPeers != 0) {
+    return; // gateways subscribe to the direct links
+  }
+  for(uint32_t id = 0; id < m_nGpus; id++) {
+    auto recvBuf = (uint8_t *)m_infos[id].recvBuf;
+#if TEST_ALL_TO_ALLV
+    for(uint32_t i = 0; i < m_nGpus; i++) {
+      size_t size = m_a2av.recvCountsOf(id)[i] * sizeof(T);
+      if(i == id || size == 0) continue;
+      auto buf = recvBuf + m_a2av.recvDisplsOf(id)[i] * sizeof(T);
+      CHKQCCL(enable ? qcclRegisterBuffer(id, i, buf, size) :
+                       qcclDeregisterBuffer(id, i));
+    }
+#elif TEST_ALL_TO_ALL
+    size_t size = m_sizes[id][0] / m_nGpus;
+    for(uint32_t i = 0; i < m_nGpus; i++) {
+      if(i == id) continue;
+      CHKQCCL(enable ? qcclRegisterBuffer(id, i, recvBuf + i*size, size) :
+                       qcclDeregisterBuffer(id, i));
+    }
+#else
+    auto inP = m_commGraph[id][0].in;
+    if(inP == id) continue;
+    CHKQCCL(enable ? qcclRegisterBuffer(id, inP, recvBuf, m_sizes[inP][0]) :
+                     qcclDeregisterBuffer(id, inP));
+#endif
+  }
+#else
+  (void)enable;
+#endif
+}
+
+void TestFramework::set_distribution(a2av::Dist dist) {
+  if(dist != m_dist && m_regElems != 0) {
+    register_buffers(false); // receive blocks move
+    m_regElems = 0;
+  }
+  m_dist = dist;
+}
+
+void TestFramework::use_registered(bool enable) {
+  if(!enable && m_regElems != 0) {
+    register_buffers(false);
+    m_regElems = 0;
+  }
+  m_registered = enable;
+}
+
+double TestFramework::run(size_t numElems, int numIters, bool measureTime, bool verifyData) {
 
   m_measureTime = measureTime;
   m_curElems = numElems;
@@ -280,38 +425,48 @@ void TestFramework::run(size_t numElems, int numIters, bool measureTime, bool ve
     });
   }
 
-  m_offsets.resize(m_nExtraPeers + 1);
-  m_sizes.resize(m_nExtraPeers + 1);
-  m_offsets[0] = 0;
   size_t total = m_curElems * sizeof(T);
-  m_sizes[0] = (size_t)(total * m_splitFactor) & ~15;
-  // remaining is to be split evenly between m_nExtraPeers
-  size_t remaining = total - m_sizes[0], ofs = m_sizes[0],
-      step = m_nExtraPeers > 0 ? (remaining / m_nExtraPeers) & ~15 : 0;
-  for(uint32_t i = 1; i <= m_nExtraPeers; i++, ofs += step) {
-    m_offsets[i] = ofs;
-    m_sizes[i] = step;
-  }
-  m_sizes[m_nExtraPeers] = total - m_offsets[m_nExtraPeers];
 #if !USE_DEBUG_CONFIG_3_GPUS // this is not relevant for debug config
+  // split each message according to the route plan (16-byte aligned pieces)
+  for(uint32_t id = 0; id < m_nGpus; id++) {
+    m_plan.pieces(id, total, m_offsets[id], m_sizes[id]);
+  }
   if(verifyData) {
     PRINTZ("curElems: %zu / 0x%lX (%zu / %lX bytes)", 
           m_curElems, m_curElems, total, total);
   }
   for(uint32_t i = 0; i <= m_nExtraPeers && verifyData; i++) {
-    PRINTZ("%d: ofs: %ld/%lX mod16: %lu; size: %ld/%lX; sum: 0x%lX bytes", 
-          i, m_offsets[i], m_offsets[i], m_offsets[i] % 16,
-          m_sizes[i], m_sizes[i], m_offsets[i] + m_sizes[i]);
+    PRINTZ("%d: ofs: %ld/%lX mod16: %lu; size: %ld/%lX; sum: 0x%lX bytes "
+          "(GPU 0)", i, m_offsets[0][i], m_offsets[0][i], m_offsets[0][i] % 16,
+          m_sizes[0][i], m_sizes[0][i], m_offsets[0][i] + m_sizes[0][i]);
+  }
+  // chunk addresses depend on the message size
+  if(m_regElems != 0 && m_regElems != m_curElems) {
+    register_buffers(false); // with the counts they were registered for
+    m_regElems = 0;
+  }
+#if TEST_ALL_TO_ALLV
+  m_a2av = a2av::makeLayout(m_dist, m_nGpus, m_curElems, 1, A2AV_ZIPF_S,
+        A2AV_HOT_FRACTION);
+#endif
+  if(m_registered && m_regElems != m_curElems) {
+    register_buffers(true);
+    m_regElems = m_curElems;
   }
 #endif
   m_pool.runJob([&,this](int id) {
     run_thread(id, numIters, verifyData);
   });
+  double avgMs = 0;
+  for(const auto& s : m_infos) {
+    avgMs += s.elapsedMs / m_nGpus;
+  }
+  return avgMs;
 }
 
 void TestFramework::run_thread(int id, int numIters, bool verifyData) 
 {
-  m_barrier.wait(); // wait all threads to arrive here before starting timing
+  m_barrier.wait(id); // wait all threads to arrive here before starting timing
   auto& info = m_infos[id];
 
   CPU_BEGIN_TIMING(T);
@@ -327,7 +482,7 @@ void TestFramework::run_thread(int id, int numIters, bool verifyData)
   size_t bytes = m_curElems*sizeof(T);
   info.elapsedMs = ms.count() / numIters;
 
-  m_barrier.wait(); // wait before data verification since it requires all GPUs
+  m_barrier.wait(id); // wait before data verification since it requires all GPUs
   if(id == 0 && m_measureTime) {
     double avgMs = 0;
     for(const auto& s : m_infos) {
@@ -335,8 +490,10 @@ void TestFramework::run_thread(int id, int numIters, bool verifyData)
     }
     avgMs /= m_nGpus;
     double baseBw = (double)bytes / 1.0E6 / avgMs;
-    PRINTZ("Data size: %.2f Mb; time elapsed: %.3f ms, bandwidth: %.3f Gb/s", 
-          (double)bytes/(1024*1024), avgMs, baseBw);
+    PRINTZ("Data size: %.2f Mb; time elapsed: %.3f ms, bandwidth: %.3f Gb/s; "
+          "arrival skew: %.3f ms (slowest GPU %d)", 
+          (double)bytes/(1024*1024), avgMs, baseBw, m_barrier.lastSkewMs(),
+          slowestGpu());
   }
   if(verifyData) {
     verify(id);
@@ -352,7 +509,7 @@ void runRCCLTest(size_t elemsMin, size_t elemsMax)
 #else
   nGpus = 3;
 #endif  
-  VLOG("Num devices: " << nGpus << "; max data size: " << 
+  VLOG(0) << "Num devices: " << nGpus << "; max data size: " << 
       (double)(elemsMax*sizeof(TestFramework::T))/(1024*1024) << 
         " Mb; neighbour exchange with "
 #if USE_CUSTOM_QCCL
@@ -360,7 +517,7 @@ void runRCCLTest(size_t elemsMin, size_t elemsMax)
 #else
       "RCCL"
 #endif
-  );
+      ;
   std::vector< uint32_t > deviceAssignment{ 0, 1, 2, 3, 4, 5, 6, 7 };
   if(nGpus > deviceAssignment.size()) {
     throw std::runtime_error("Invalid device assignment!");
@@ -405,6 +562,46 @@ void runRCCLTest(size_t elemsMin, size_t elemsMax)
   }
 #endif
 
+#if TEST_ALL_TO_ALLV
+  // skewed per-peer counts: the busiest GPU sends or receives elemsMax
+  double balancedGBs = 0;
+  for(auto dist : { a2av::Dist::Balanced, a2av::Dist::Zipf, 
+                    a2av::Dist::HotExpert }) {
+    obj.set_distribution(dist);
+#if VERIFY_DATA
+    obj.run(elemsMax, 1, false, true);
+#endif
+    obj.run(elemsMax, nwarmups);
+    double ms = obj.run(elemsMax, niters), 
+           gbs = obj.moved_bytes() / (ms * 1e6);
+    if(dist == a2av::Dist::Balanced) balancedGBs = gbs;
+    PRINTZ("All-to-allv %s: %.2f Mb moved; time elapsed: %.3f ms, effective "
+          "bandwidth: %.3f Gb/s (%.2fx of balanced)", a2av::distName(dist),
+          obj.moved_bytes() / (1024.0 * 1024), ms, gbs, gbs / balancedGBs);
+  }
+  obj.set_distribution(a2av::Dist::Balanced);
+#endif
+
+#if USE_CUSTOM_QCCL && USE_REGISTERED_BUFFERS
+  // small messages: the pointer handshake vs registered buffers
+  obj.use_registered(true);
+#if VERIFY_DATA
+  obj.run(LATENCY_ELEMS_MIN, 1, false, true);
+#endif
+  for(size_t sz = LATENCY_ELEMS_MIN; sz <= LATENCY_ELEMS_MAX; sz *= 4) {
+    obj.use_registered(false);
+    obj.run(sz, nwarmups);
+    double ms = obj.run(sz, niters * 5);
+    obj.use_registered(true);
+    obj.run(sz, nwarmups);
+    double regMs = obj.run(sz, niters * 5);
+    PRINTZ("Data size: %.2f Kb; latency: %.2f us; registered buffers: "
+          "%.2f us (%.1f%% less)", sz * sizeof(TestFramework::T) / 1024.0, 
+          ms * 1e3, regMs * 1e3, (1 - regMs / ms) * 100);
+  }
+  obj.use_registered(false);
+#endif
+
 }
 // NCCL_DEBUG=INFO NCCL_DEBUG_SUBSYS=INIT,COLL
 
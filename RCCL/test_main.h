@@ -7,6 +7,9 @@
 
 #include "common/common.h"
 #include "common/threading.hpp"
+#include "route_planner.hpp"
+#include "network_sim.hpp"
+#include "alltoallv_dist.hpp"
 
 // whether to test all-to-all or collective-permute
 #define TEST_ALL_TO_ALL 1
@@ -21,15 +24,41 @@
 // if zero, all traffic is sent directly to target GPUs 
 // this has no effect if USE_CUSTOM_QCCL = 0
 #define NUM_EXTRA_PEERS 1
-// this portion of traffic is sent to target GPUs directly (1: whole traffic)
-// this has no effect if USE_CUSTOM_QCCL = 0
-#define EXTRA_PEERS_SPLIT_FACTOR 0.7
+// how gateways forward their pieces: 
+// 0 - qcclGatewaySend: the gateway copies from the source's send buffer 
+//     (the source must also receive from the target);
+// 1 - qcclRelaySend: each chunk is forwarded as soon as it lands in a ring
+//     of RELAY_RING_CHUNKS chunks on the gateway;
+// 2 - store-and-forward: the gateway receives whole pieces in one qcclRun
+//     and forwards them in the next one (baseline for 1)
+#define GATEWAY_MODE 1
+#define RELAY_RING_CHUNKS 4
 #else
 #define USE_DEBUG_CONFIG_3_GPUS 0
 #define NUM_EXTRA_PEERS 0
-#define EXTRA_PEERS_SPLIT_FACTOR 1.0
+#define GATEWAY_MODE 0
 #endif
 
+// all-to-all with per-peer counts (qcclAllToAllv / grouped ncclSend-Recv):
+// also compares Zipf (exponent A2AV_ZIPF_S) and hot-expert (A2AV_HOT_FRACTION
+// of all traffic goes to one GPU) distributions against the balanced one
+#define TEST_ALL_TO_ALLV (TEST_ALL_TO_ALL && 1)
+#define A2AV_ZIPF_S 1.1
+#define A2AV_HOT_FRACTION 0.5
+
+// links between GPUs for the route planner: graphviz-like file with
+// "i -> j [bw=50, lat=2];" edges (see route_planner.hpp) or, if empty,
+// all GPUs are connected by links with the default bandwidth and latency
+#define LINK_TOPOLOGY_FILE ""
+#define LINK_BANDWIDTH_GBS 50.0
+#define LINK_LATENCY_US 2.0
+
+// compare small-message latencies with and without registered receive
+// buffers (qcclRegisterBuffer) over [LATENCY_ELEMS_MIN, LATENCY_ELEMS_MAX]
+#define USE_REGISTERED_BUFFERS 1
+#define LATENCY_ELEMS_MIN 1024
+#define LATENCY_ELEMS_MAX 64*1024
+
 #define VERIFY_DATA 1
 // run only one verify iteration and then quit
 #define STOP_AFTER_VERIFY 0
@@ -100,10 +129,13 @@ public:
     int gpuId;            // gpu ID assigned to this thread
     cudaStream_t stream; // associated streams
     T *sendBuf, *recvBuf; // send and receive buffers
+    uint8_t *stageBuf;    // pieces forwarded by this gateway (GATEWAY_MODE)
 #if !USE_CUSTOM_QCCL
     ncclComm_t comm;      // NCCL handle
 #endif
     double elapsedMs;     // time elapsed per thread
+    std::vector< T > hostBuf; // host buffer for reference data and verification
+    std::vector< T > truthBuf; // expected output for verification
   };
 
   struct Node {
@@ -135,15 +167,34 @@ public:
   }
 
   void run_single_gpu(int id);
-  void run(size_t numElems, int numIters, bool measureTime = false, bool verifyData = false);
+  // returns the time per iteration (ms) averaged over GPUs
+  double run(size_t numElems, int numIters, bool measureTime = false, bool verifyData = false);
+  // links with a single peer receive into registered buffers from now on
+  void use_registered(bool enable);
+  // per-peer counts of the following all-to-allv runs
+  void set_distribution(a2av::Dist dist);
+  // bytes leaving their GPU in one all-to-allv iteration of the last run
+  size_t moved_bytes() const {
+    return m_a2av.crossTotal() * sizeof(T);
+  }
   void run_thread(int id, int numIters, bool verifyData);
 
 private:
   void init_extra_peers();
+  void register_buffers(bool enable);
   T getElement(int device, size_t idx);
   void fill_verify_data(int id);
   void verify(int id);
 
+  // GPU which arrived last at the barrier in the last completed phase
+  int slowestGpu() const {
+    int id = 0;
+    for(uint32_t i = 1; i < m_nGpus; i++) {
+      if(m_barrier.arrivalSkewMs(i) > m_barrier.arrivalSkewMs(id)) id = i;
+    }
+    return id;
+  }
+
   void output_dot();
   std::vector< uint32_t > permute_op();
 
@@ -155,16 +206,20 @@ private:
   ncclUniqueId m_ncclId;
   size_t m_nGpus, m_maxElems, m_curElems; // total and current data transfer size
   size_t m_nExtraPeers; // if zero, all traffic is sent directly
-  double m_splitFactor; // this much of traffic is sent to target GPUs directly
+  size_t m_stageBytes = 0; // staging per gateway slot (GATEWAY_MODE != 0)
 
   bool m_measureTime = false;
+  bool m_registered = false;
+  size_t m_regElems = 0; // buffers are registered for messages of that size
+  a2av::Dist m_dist = a2av::Dist::Balanced;
+  a2av::Layout m_a2av;   // all-to-allv counts for messages of m_curElems
   std::vector< ThreadInfo > m_infos;
-  std::vector< T > m_hostBuf;
-  std::mutex m_verifyMtx;
   Barrier m_barrier;
   ThreadPool m_pool;
   Matrix<Node> m_commGraph; // "topology graph" for all-to-all communication
-  std::vector< size_t > m_offsets, m_sizes;
+  route::SlotPlan m_plan;   // gateways and splits of the collective permute
+  // pieces of the message of GPU i: sent directly (0) and via gateways
+  Matrix<size_t> m_offsets, m_sizes;
 
 }; // struct TestFramework
 
@@ -0,0 +1,182 @@
+#ifndef RCCL_BUBBLES_COLLECTIVE_MATMUL_HPP
+#define RCCL_BUBBLES_COLLECTIVE_MATMUL_HPP 1
+
+// Chunked collective matmul: a (batched) GEMM whose output is reduced
+// across ranks is split along the batch or along N into chunks, and the
+// collective of chunk i runs on a second stream while the GEMM of chunk
+// i+1 runs on the compute stream. Only the collective of the last chunk
+// is exposed, at the price of smaller GEMMs and more collective launches:
+// the number of chunks is autotuned.
+// Chunks are contiguous in the output (column-major D, ldD = M): N splits
+// are only possible for a single GEMM. Each rank ends up with block 'rank'
+// of every chunk (at offset chunk.ofs / nRanks of its receive buffer)
+// rather than with one block of the whole output.
+// GEMMs and collectives are passed as callables enqueueing work for a
+// chunk on a stream: the same code drives rocBLAS + RCCL and CPU GEMMs +
+// the QCCL host transport, whose collectives run on the calling thread once
+// their stream is drained: that is why the GEMM of the next chunk is
+// enqueued before the collective of the current one.
+
+#include <numeric>
+#include <vector>
+
+#include "timeline.hpp"
+
+namespace cmm {
+
+enum class Split : uint32_t { Batch, N };
+
+inline const char *splitName(Split s) {
+  return s == Split::Batch ? "batch" : "N";
+}
+
+struct Shape {
+  int64_t M, N, K, batch;
+  size_t outElems() const { return (size_t)(M * N * batch); }
+};
+
+// batches [begin, end) of all columns or, for Split::N, columns
+// [begin, end) of the single GEMM
+struct Chunk {
+  int64_t begin, end;
+  size_t ofs, count;  // output elements
+};
+
+// chunk lengths along the split dimension are multiples of this such that
+// the chunks can be reduce-scattered over nRanks
+inline int64_t chunkAlign(const Shape& sh, Split split, uint32_t nRanks) {
+  int64_t unit = split == Split::Batch ? sh.M * sh.N : sh.M;
+  return nRanks / std::gcd(unit, (int64_t)nRanks);
+}
+
+// about 'nChunks' chunks of (almost) equal length; throws if the shape
+// cannot be split this way
+inline std::vector< Chunk > makeChunks(const Shape& sh, Split split,
+      uint32_t nChunks, uint32_t nRanks) {
+  if(split == Split::N && sh.batch != 1) {
+    ThrowError< >("N splits need a single GEMM (batch = %ld)", sh.batch);
+  }
+  int64_t len = split == Split::Batch ? sh.batch : sh.N,
+        align = chunkAlign(sh, split, nRanks);
+  if(len % align != 0) {
+    ThrowError< >("%s = %ld does not split into %u ranks", splitName(split),
+          len, nRanks);
+  }
+  int64_t nUnits = len / align, n = std::clamp< int64_t >(nChunks, 1, nUnits);
+  size_t unitElems = (size_t)(split == Split::Batch ? sh.M * sh.N : sh.M);
+  std::vector< Chunk > chunks;
+  for(int64_t i = 0, begin = 0; i < n; i++) {
+    int64_t end = (nUnits * (i + 1) / n) * align;
+    chunks.push_back(Chunk{ begin, end, begin * unitElems,
+          (end - begin) * unitElems });
+    begin = end;
+  }
+  return chunks;
+}
+
+// powers of two up to 'maxChunks' which give distinct chunkings
+inline std::vector< uint32_t > chunkCandidates(const Shape& sh, Split split,
+      uint32_t nRanks, uint32_t maxChunks) {
+  int64_t len = split == Split::Batch ? sh.batch : sh.N,
+        nUnits = len / chunkAlign(sh, split, nRanks);
+  std::vector< uint32_t > res;
+  for(uint32_t n = 1; n <= maxChunks && n <= nUnits; n *= 2) {
+    res.push_back(n);
+  }
+  return res;
+}
+
+// per-rank driver: holds one event per chunk to hand chunks over from the
+// compute to the communication stream
+struct Pipeline {
+
+  Pipeline() = default;
+  Pipeline(const Pipeline&) = delete;
+  Pipeline& operator=(const Pipeline&) = delete;
+
+  ~Pipeline() {
+    for(auto e : m_events) (void)cudaEventDestroy(e);
+  }
+
+  // Gemm: (const Chunk&, cudaStream_t) computes the chunk, Coll: (const
+  // Chunk&, cudaStream_t) runs its collective. With overlap == false both
+  // run on 'compute' one after another (the serial schedule). Ops are
+  // recorded on streams 0 and 1 of 'rec' unless it is null. Returns when
+  // everything is enqueued: both streams must be synchronized
+  template < class Gemm, class Coll >
+  void run(const std::vector< Chunk >& chunks, cudaStream_t compute,
+        cudaStream_t comm, Gemm&& gemm, Coll&& coll,
+        bool overlap = true, timeline::Op collOp = timeline::Op::ReduceScatter,
+        timeline::EventRecorder *rec = nullptr) {
+
+    while(m_events.size() < chunks.size()) {
+      cudaEvent_t e;
+      CHK(cudaEventCreate(&e));
+      m_events.push_back(e);
+    }
+    auto issue = [&](size_t i) {
+      auto s = overlap ? comm : compute;
+      if(overlap) {
+        CHK(cudaStreamWaitEvent(comm, m_events[i], 0));
+      }
+      uint32_t token = rec ? rec->begin(collOp, s, overlap) : 0;
+      coll(chunks[i], s);
+      if(rec) rec->end(token, s);
+    };
+    for(size_t i = 0; i < chunks.size(); i++) {
+      uint32_t token = rec ? rec->begin(timeline::Op::Gemm, compute) : 0;
+      gemm(chunks[i], compute);
+      if(rec) rec->end(token, compute);
+      if(!overlap) {
+        issue(i);
+        continue;
+      }
+      CHK(cudaEventRecord(m_events[i], compute));
+      if(i > 0) issue(i - 1);
+    }
+    if(overlap && !chunks.empty()) issue(chunks.size() - 1);
+  }
+
+private:
+  std::vector< cudaEvent_t > m_events;
+};
+
+struct TuneResult {
+  uint32_t nChunks = 0;
+  double ms = 0;
+  std::vector< std::pair< uint32_t, double > > all;  // (chunks, ms)
+};
+
+// 'step(nChunks)' runs one step on all ranks and returns its time in ms:
+// every candidate is run 'nReps' times after a warm-up, the best time
+// counts
+template < class Step >
+TuneResult autotune(const std::vector< uint32_t >& candidates, int nReps,
+      Step&& step) {
+  TuneResult res;
+  for(auto n : candidates) {
+    (void)step(n);
+    double best = 1e30;
+    for(int i = 0; i < nReps; i++) {
+      best = std::min(best, step(n));
+    }
+    res.all.emplace_back(n, best);
+    if(res.nChunks == 0 || best < res.ms) {
+      res.nChunks = n, res.ms = best;
+    }
+  }
+  return res;
+}
+
+inline void printTuning(const char *title, const TuneResult& res,
+      double serialMs) {
+  PRINTZ("%s: serial %.3f ms", title, serialMs);
+  for(const auto& [n, ms] : res.all) {
+    PRINTZ("%5u chunks: %9.3f ms (%.2fx)%s", n, ms, serialMs / ms,
+          n == res.nChunks ? " <- best" : "");
+  }
+}
+
+} // namespace cmm
+
+#endif // RCCL_BUBBLES_COLLECTIVE_MATMUL_HPP
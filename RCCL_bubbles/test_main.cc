@@ -1,4 +1,6 @@
 
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -DNUM_ACTIVE_GPUS=4 -DNUM_ELEMS_MIN=0x80000 -DNUM_ELEMS_MAX=0x80000 -DGEMM_BATCH_COUNT=4 -std=c++20 -O3 -march=native -pthread test_main.cc ../common/common.cc ../common/host_runtime.cc ../common/host_nccl.cc
+
 #include <algorithm>
 #include <stdexcept>
 #include <iomanip>
@@ -12,12 +14,32 @@
 #include "test_main.h"
 
 // the number of GPUs communicating (set to -1 to use all available GPUs)
+#ifndef NUM_ACTIVE_GPUS
 #define NUM_ACTIVE_GPUS 8
+#endif
 #define VERIFY_DATA 0
 #define USE_GRAPH_API 1
 
+// host builds (COMPILE_FOR_HOST=1) pass smaller sizes and batch counts
+// on the command line
+#ifndef NUM_ELEMS_MIN
 #define NUM_ELEMS_MIN 0x6000000
 #define NUM_ELEMS_MAX 0x6000000
+#endif
+#ifndef GEMM_BATCH_COUNT
+#define GEMM_BATCH_COUNT 1000
+#endif
+
+// record op intervals and compare the bubbles of the schedules in
+// runRCCLTest (written to bubbles_<schedule>.json)
+#define BUBBLE_ANALYSIS 1
+#define BUBBLE_ITERS 5
+
+// split the GEMM into chunks reduce-scattered while the next chunk is
+// computed: the number of chunks is autotuned (trace in bubbles_cmm.json)
+#define COLLECTIVE_MATMUL 1
+#define CMM_MAX_CHUNKS 32
+#define CMM_ITERS 3
 
 #define CHKNCCL(cmd) \
   if(auto res = (cmd); res != ncclSuccess) {           \
@@ -49,6 +71,7 @@ TestFramework::TestFramework(size_t nGpus, const uint32_t *gpuIDs,
     CHK(hipExtMallocWithFlags((void **)&info.sendBuf, nBytes*2, flags));
     info.recvBuf = info.sendBuf + m_maxElems;
     CHK(cudaStreamCreateWithFlags(&info.stream, cudaStreamNonBlocking));
+    CHK(cudaStreamCreateWithFlags(&info.commStream, cudaStreamNonBlocking));
 
     CHK(cudaMemsetAsync(info.sendBuf, s_fillValue ^ 0xFF, nBytes, info.stream));
     CHK(cudaMemsetAsync(info.recvBuf, s_fillValue, nBytes, info.stream));
@@ -69,6 +92,7 @@ TestFramework::~TestFramework() {
     }
 #endif
     (void)cudaStreamDestroy(info.stream);
+    (void)cudaStreamDestroy(info.commStream);
     (void)cudaFree(info.sendBuf);
     (void)ncclCommDestroy(info.comm);
   }
@@ -128,6 +152,13 @@ void TestFramework::verify(int id) {
 }
 
 void TestFramework::run_rccl_op(int id, int iter) 
+{
+  const timeline::Op ops[] = { timeline::Op::Permute, timeline::Op::AllReduce,
+        timeline::Op::AllToAll, timeline::Op::ReduceScatter };
+  run_collective(id, ops[iter % 4]);
+}
+
+void TestFramework::run_collective(int id, timeline::Op op) 
 {
   auto& info = m_infos[id];
   auto type = (ncclDataType_t)getNcclType();
@@ -136,8 +167,9 @@ void TestFramework::run_rccl_op(int id, int iter)
   // CHKNCCL(ncclCommCuDevice(m_comms[i], &dev));
   ncclCommUserRank(info.comm, &rank);
 
-  switch(iter % 4) {
-  case 0: { // collective-permute
+  uint32_t token = m_analyze ? info.rec.begin(op, info.stream) : 0;
+  switch(op) {
+  case timeline::Op::Permute: { // collective-permute
     CHKNCCL(ncclGroupStart());
     int sendP = (id + 1) % m_nGpus,
       recvP = (id - 1 + m_nGpus) % m_nGpus;
@@ -148,25 +180,33 @@ void TestFramework::run_rccl_op(int id, int iter)
     CHKNCCL(ncclGroupEnd());
     break;
   }
-  case 1: { // all-reduce
-    ncclRedOp_t op = ncclSum;
+  case timeline::Op::AllReduce: {
+    ncclRedOp_t redOp = ncclSum;
     CHKNCCL(ncclAllReduce(info.sendBuf, info.recvBuf, m_curElems, 
-        type, op, info.comm, info.stream));
+        type, redOp, info.comm, info.stream));
     break;
   }
-  case 2: { // all-to-all
+  case timeline::Op::AllToAll: {
     // each GPU sends its part of the buf to all other GPUs..
     CHKNCCL(ncclAllToAll(info.sendBuf, info.recvBuf, m_curElems / m_nGpus, 
         type, info.comm, info.stream));
     break;
   }
-  case 3: { // reduce-scatter
-    ncclRedOp_t op = ncclSum;
+  case timeline::Op::ReduceScatter: {
+    ncclRedOp_t redOp = ncclSum;
     CHKNCCL(ncclReduceScatter(info.sendBuf, info.recvBuf, m_curElems / m_nGpus, 
-        type, op, info.comm, info.stream));
+        type, redOp, info.comm, info.stream));
+    break;
+  }
+  case timeline::Op::AllGather: {
+    CHKNCCL(ncclAllGather(info.sendBuf, info.recvBuf, m_curElems / m_nGpus, 
+        type, info.comm, info.stream));
     break;
   }
+  default:
+    ThrowError< >("Unsupported collective: %s", timeline::opName(op));
   } // switch
+  if(m_analyze) info.rec.end(token, info.stream);
 }
 
 void TestFramework::init_gemm_op(int id) {
@@ -178,7 +218,7 @@ void TestFramework::init_gemm_op(int id) {
   auto transA = rocblas_operation_transpose,
        transB = rocblas_operation_none;
 
-  int64_t batchCount = 1000;
+  int64_t batchCount = GEMM_BATCH_COUNT;
   gemm.init(m_infos[id].stream);
   gemm.FillParams(M, N, K, transA, transB, batchCount);
   gemm.AllocBuffers();
@@ -187,16 +227,35 @@ void TestFramework::init_gemm_op(int id) {
 void TestFramework::run_gemm_op(int id, int nIters) {
   
   auto& info = m_infos[id];
+  uint32_t token = m_analyze ? 
+        info.rec.begin(timeline::Op::Gemm, info.stream) : 0;
   info.gemm.run(info.stream, nIters);
+  if(m_analyze) info.rec.end(token, info.stream);
+}
+
+void TestFramework::run_step(int id, int iter) {
+  if(m_schedule.empty()) {
+    run_gemm_op(id, 2);
+    run_rccl_op(id, iter);
+    run_rccl_op(id, iter+1);
+    return;
+  }
+  for(auto op : m_schedule) {
+    if(op == timeline::Op::Gemm) {
+      run_gemm_op(id, 2);
+    } else {
+      run_collective(id, op);
+    }
+  }
 }
 
 void TestFramework::run_thread(int id, int numIters, bool verifyData) 
 {
-  m_barrier.wait(); // wait all threads to arrive here before starting timing
+  m_barrier.wait(id); // wait all threads to arrive here before starting timing
   auto& info = m_infos[id];
 
 #if USE_GRAPH_API
-  if(!info.graphCreated) {
+  if(!m_analyze && !info.graphCreated) {
 
     VLOG(0) << "Starting stream capture.." << numIters;
     //CHK(cudaGraphCreate(&info.graph, /*flags=*/0));
@@ -230,17 +289,24 @@ void TestFramework::run_thread(int id, int numIters, bool verifyData)
 
     info.graphCreated = true;
   }
+#endif
+  if(m_analyze) {
+    // event timestamps would not survive graph capture: run eagerly
+    info.rec.start(info.stream);
+    m_barrier.wait(id);
+  }
   CPU_BEGIN_TIMING(T); 
-  CHK(cudaGraphLaunch(info.graphExec, info.stream));
-#else
-  CPU_BEGIN_TIMING(T); 
-  for(int i = 0; i < numIters; i++) {
-    //VLOG(0) << "\n============================ " << m_curElems << " =============================\n";
-    run_gemm_op(id, 2);
-    run_rccl_op(id, i);
-    run_rccl_op(id, i+1);
-  } 
-#endif  
+  if(m_analyze || !USE_GRAPH_API) {
+    for(int i = 0; i < numIters; i++) {
+      //VLOG(0) << "\n============================ " << m_curElems << " =============================\n";
+      run_step(id, i);
+    } 
+  }
+#if USE_GRAPH_API
+  else {
+    CHK(cudaGraphLaunch(info.graphExec, info.stream));
+  }
+#endif
 
   CHK(cudaStreamSynchronize(info.stream));
   auto tnow = std::chrono::high_resolution_clock::now();
@@ -248,19 +314,25 @@ void TestFramework::run_thread(int id, int numIters, bool verifyData)
   size_t bytes = m_curElems*sizeof(T);
   info.elapsedMs = ms.count() / numIters;
   
-  m_barrier.wait(); // wait before data verification since it requires all GPUs
+  m_barrier.wait(id); // wait before data verification since it requires all GPUs
   if(id == 0 && m_measureTime) {
     double avgMs = 0;
     for(const auto& s : m_infos) {
       avgMs += s.elapsedMs;
     }
     avgMs /= m_nGpus;
-    PRINTZ("Data size: %.2f Mb; avg time elapsed: %.3f ms", 
-          (double)bytes/(1024*1024), avgMs);
+    PRINTZ("Data size: %.2f Mb; avg time elapsed: %.3f ms; "
+          "arrival skew: %.3f ms (slowest GPU %d)", 
+          (double)bytes/(1024*1024), avgMs, m_barrier.lastSkewMs(),
+          slowestGpu());
   }
   if(verifyData) {
     verify(id);
   }
+  if(m_analyze) {
+    info.intervals.clear();
+    info.rec.collect(id, info.intervals);
+  }
 }
 
 void TestFramework::run(size_t numElems, int numIters, bool measureTime, bool verifyData) {
@@ -285,15 +357,113 @@ void TestFramework::run(size_t numElems, int numIters, bool measureTime, bool ve
   });
 }
 
+double TestFramework::analyze(size_t numElems, int numIters,
+        const std::vector< timeline::Op >& schedule, const char *name,
+        const char *tracePath) {
+
+  m_analyze = true;
+  m_schedule = schedule;
+  run(numElems, numIters);
+  m_analyze = false;
+  m_schedule.clear();
+  return report(name, tracePath).stepUs * 1e-3;
+}
+
+timeline::Report TestFramework::report(const char *name, 
+        const char *tracePath) {
+
+  std::vector< timeline::Interval > all;
+  for(const auto& info : m_infos) {
+    all.insert(all.end(), info.intervals.begin(), info.intervals.end());
+  }
+  auto rep = timeline::analyze(all);
+  timeline::printReport(name, rep);
+  if(tracePath != nullptr && !timeline::writeChrome(tracePath, all, &rep)) {
+    PRINTZ("Unable to write %s", tracePath);
+  }
+  return rep;
+}
+
+void TestFramework::run_collective_matmul(int id, uint32_t nChunks, 
+        bool overlap, bool record) {
+
+  auto& info = m_infos[id];
+  auto sh = info.gemm.shape();
+  auto split = sh.batch > 1 ? cmm::Split::Batch : cmm::Split::N;
+  auto chunks = cmm::makeChunks(sh, split, nChunks, m_nGpus);
+  if(sh.outElems() / m_nGpus > m_maxElems) {
+    ThrowError< >("Receive buffer too small for the GEMM output");
+  }
+  auto gemm = [&](const cmm::Chunk& c, cudaStream_t s) {
+    info.gemm.runChunk(s, split, c);
+  };
+  // block 'id' of every chunk goes to offset c.ofs / m_nGpus
+  auto coll = [&](const cmm::Chunk& c, cudaStream_t s) {
+    CHKNCCL(ncclReduceScatter(info.gemm.d.devPtr + c.ofs, 
+        (float *)info.recvBuf + c.ofs / m_nGpus, c.count / m_nGpus, 
+        ncclFloat32, ncclSum, info.comm, s));
+  };
+  info.pipe.run(chunks, info.stream, info.commStream, gemm, coll, overlap,
+        timeline::Op::ReduceScatter, record ? &info.rec : nullptr);
+}
+
+double TestFramework::collective_matmul_step(uint32_t nChunks, bool overlap,
+        int numIters, bool record) {
+
+  m_pool.runJob([&,this](int id) {
+    auto& info = m_infos[id];
+    CHK(cudaSetDevice(info.gpuId));
+    if(record) info.rec.start(info.stream);
+    m_barrier.wait(id);
+    CPU_BEGIN_TIMING(T);
+    for(int i = 0; i < numIters; i++) {
+      run_collective_matmul(id, nChunks, overlap, record);
+    }
+    CHK(cudaStreamSynchronize(info.stream));
+    CHK(cudaStreamSynchronize(info.commStream));
+    std::chrono::duration<double, std::milli> ms = 
+          std::chrono::high_resolution_clock::now() - z1_T;
+    info.elapsedMs = ms.count() / numIters;
+    if(record) {
+      info.intervals.clear();
+      info.rec.collect(id, info.intervals);
+    }
+    m_barrier.wait(id);
+  });
+  double ms = 0;
+  for(const auto& info : m_infos) {
+    ms = std::max(ms, info.elapsedMs);
+  }
+  return ms;
+}
+
+double TestFramework::collective_matmul(int numIters, const char *tracePath) {
+
+  auto sh = m_infos[0].gemm.shape();
+  auto split = sh.batch > 1 ? cmm::Split::Batch : cmm::Split::N;
+  double serialMs = collective_matmul_step(1, false, numIters);
+  serialMs = std::min(serialMs, collective_matmul_step(1, false, numIters));
+  auto res = cmm::autotune(
+        cmm::chunkCandidates(sh, split, m_nGpus, CMM_MAX_CHUNKS), 1,
+        [&](uint32_t n) { return collective_matmul_step(n, true, numIters); });
+
+  char title[128];
+  snprintf(title, sizeof(title), "collective matmul %ldx%ldx%ld x %ld, "
+        "split along %s", sh.M, sh.N, sh.K, sh.batch, cmm::splitName(split));
+  cmm::printTuning(title, res, serialMs);
+  collective_matmul_step(res.nChunks, true, 1, true);
+  report("tuned collective matmul", tracePath);
+  return serialMs / res.ms;
+}
+
 void runRCCLTest(size_t elemsMin, size_t elemsMax)
 {
   int nGpus = 0, nwarmups = 10, niters = 20;
   CHK(hipGetDeviceCount(&nGpus));
   if(NUM_ACTIVE_GPUS > 0) nGpus = NUM_ACTIVE_GPUS;
-  VLOG("Num devices: " << nGpus << "; max data size: " << 
+  VLOG(0) << "Num devices: " << nGpus << "; max data size: " << 
       (double)(elemsMax*sizeof(TestFramework::T))/(1024*1024) << 
-        " Mb; neighbour exchange with RCCL"
-  );
+        " Mb; neighbour exchange with RCCL";
   
   std::vector< uint32_t > deviceAssignment{0, 1, 2, 3, 4, 5, 6, 7 };
   if(nGpus > deviceAssignment.size()) {
@@ -328,6 +498,35 @@ void runRCCLTest(size_t elemsMin, size_t elemsMax)
   }
 #endif
 
+#if BUBBLE_ANALYSIS
+  // the same ops in different orders: how much of the step is bubbles
+  using timeline::Op;
+  const struct {
+    const char *name;
+    std::vector< Op > ops;
+  } schedules[] = {
+    { "gemm_ar_rs", { Op::Gemm, Op::AllReduce, Op::ReduceScatter } },
+    { "ar_gemm_rs", { Op::AllReduce, Op::Gemm, Op::ReduceScatter } },
+    { "rs_ar_gemm", { Op::ReduceScatter, Op::AllReduce, Op::Gemm } },
+    { "gemm_ar_gemm_rs", { Op::Gemm, Op::AllReduce, Op::Gemm, 
+                           Op::ReduceScatter } },
+  };
+  double baseMs = 0;
+  for(const auto& sch : schedules) {
+    auto path = std::string("bubbles_") + sch.name + ".json";
+    double ms = obj.analyze(elemsMin, BUBBLE_ITERS, sch.ops, sch.name, 
+          path.c_str());
+    if(baseMs == 0) baseMs = ms;
+    PRINTZ("%s: %.3f ms per %d iterations (%.2fx of %s)", sch.name, ms, 
+          BUBBLE_ITERS, ms / baseMs, schedules[0].name);
+  }
+#endif
+
+#if COLLECTIVE_MATMUL
+  double speedup = obj.collective_matmul(CMM_ITERS, "bubbles_cmm.json");
+  PRINTZ("collective matmul: %.2fx over GEMM + reduce-scatter", speedup);
+#endif
+
 }
 // NCCL_DEBUG=INFO NCCL_DEBUG_SUBSYS=INIT,COLL
 
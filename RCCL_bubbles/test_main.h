@@ -4,13 +4,19 @@
 
 #include <iostream>
 #include <fstream>
+#if COMPILE_FOR_HOST
+#include "common/host_rocblas.hpp"
+#else
 #include <hip/hip_fp16.h>
 #include <hip/hip_bfloat16.h>
 #include <hip/hip_complex.h>
 #include <rocblas/rocblas.h>
+#endif
 
 #include "common/common_utils.hpp"
 #include "common/threading.hpp"
+#include "timeline.hpp"
+#include "collective_matmul.hpp"
 
 #define CHK_ROCBLAS(error) if(error != rocblas_status_success) { \
     fprintf(stderr, "RocBlas error %s at %s:%d\n", rocblas_status_to_string(error), \
@@ -179,6 +185,35 @@ struct BlasGemm
     }
   }
 
+  // columns [c.begin, c.end) of D for a single GEMM, or batches
+  // [c.begin, c.end) of a batched one (see cmm::makeChunks)
+  void runChunk(cudaStream_t stream, cmm::Split split, const cmm::Chunk& ch) {
+
+    CHK_ROCBLAS(rocblas_set_stream(handle_, stream));
+    TypeD alpha{1}, beta{0};
+    auto saved = cfg_;
+    int64_t ofsA = 0, ofsB;
+    if(split == cmm::Split::Batch) {
+      cfg_.batchCount = ch.end - ch.begin;
+      ofsA = ch.begin * cfg_.sizeA, ofsB = ch.begin * cfg_.sizeB;
+    } else {
+      cfg_.N = ch.end - ch.begin;
+      ofsB = ch.begin * cfg_.strideB2;  // column ch.begin of op(B)
+    }
+    if(cfg_.batchCount == 1) {
+      gemm_ex(a.devPtr + ofsA, b.devPtr + ofsB, c.devPtr + ch.ofs,
+            d.devPtr + ch.ofs, alpha, beta);
+    } else {
+      gemm_strided_batched_ex(a.devPtr + ofsA, b.devPtr + ofsB,
+            c.devPtr + ch.ofs, d.devPtr + ch.ofs, alpha, beta);
+    }
+    cfg_ = saved;
+  }
+
+  cmm::Shape shape() const {
+    return cmm::Shape{ cfg_.M, cfg_.N, cfg_.K, cfg_.batchCount };
+  }
+
   DeviceBuf< TypeA > a;
   DeviceBuf< TypeB > b;
   DeviceBuf< TypeC > c;
@@ -203,6 +238,10 @@ public:
     ncclComm_t comm;      // NCCL handle
     BlasGemm gemm;        // gemm op handle
     double elapsedMs;     // time elapsed per thread
+    timeline::EventRecorder rec; // op intervals for the bubble analysis
+    std::vector< timeline::Interval > intervals;
+    cudaStream_t commStream; // collectives of the collective matmul
+    cmm::Pipeline pipe;
   };
 
   constexpr static uint32_t s_bogus = 0xFFFFFFFFu; // to catch uninitialized entries
@@ -228,22 +267,56 @@ public:
   }
 
   void run_rccl_op(int id, int iter);
+  void run_collective(int id, timeline::Op op);
   void init_gemm_op(int id);
   void run_gemm_op(int id, int nIters);
+  // one iteration: the ops of the schedule or, if it is empty, a gemm and
+  // two collectives chosen by iter
+  void run_step(int id, int iter);
 
   void run(size_t numElems, int numIters, bool measureTime = false, bool verifyData = false);
   void run_thread(int id, int numIters, bool verifyData);
+  // runs the schedule without graphs recording op intervals of all ranks,
+  // prints the bubble analysis and writes a timeline trace to 'tracePath'
+  // (unless null); returns the step time in ms
+  double analyze(size_t numElems, int numIters,
+        const std::vector< timeline::Op >& schedule, const char *name,
+        const char *tracePath);
+  // collective matmul: the GEMM split into 'nChunks' chunks, each
+  // reduce-scattered on the communication stream while the next one is
+  // computed (or after it on the same stream unless 'overlap')
+  void run_collective_matmul(int id, uint32_t nChunks, bool overlap,
+        bool record);
+  // time per step in ms (the slowest GPU)
+  double collective_matmul_step(uint32_t nChunks, bool overlap, int numIters,
+        bool record = false);
+  // autotunes the number of chunks, prints the speedup over the serial
+  // schedule and the bubble analysis of the tuned one; returns the speedup
+  double collective_matmul(int numIters, const char *tracePath);
  
 private:
   T getElement(int device, size_t idx);
+  // bubble analysis of the intervals collected by all GPUs
+  timeline::Report report(const char *name, const char *tracePath);
   void fill_verify_data(int id);
   void verify(int id);
 
+  // GPU which arrived last at the barrier in the last completed phase
+  int slowestGpu() const {
+    int id = 0;
+    for(uint32_t i = 1; i < m_nGpus; i++) {
+      if(m_barrier.arrivalSkewMs(i) > m_barrier.arrivalSkewMs(id)) id = i;
+    }
+    return id;
+  }
+
 private:
   ncclUniqueId m_ncclId;
   size_t m_nGpus, m_maxElems, m_curElems; // total and current data transfer size
 
   bool m_measureTime = false;
+  bool m_analyze = false;  // record op intervals (no graphs)
+  std::vector< timeline::Op > m_schedule;
   std::vector< ThreadInfo > m_infos;
   std::vector< T > m_hostBuf;
   std::mutex m_verifyMtx;
@@ -0,0 +1,328 @@
+#ifndef RCCL_BUBBLES_TIMELINE_HPP
+#define RCCL_BUBBLES_TIMELINE_HPP 1
+
+// Interval timelines of GEMMs and collectives per rank and stream, and the
+// "bubble" analysis of a step:
+//  - idle gaps: periods within a rank's window where none of its streams
+//    is busy;
+//  - overlap: time where compute and communication run at once, relative
+//    to the communication time (1: all communication is hidden);
+//  - stragglers: instances of a collective are matched across ranks by op
+//    and sequence number; the rank arriving last holds up the others, and
+//    is charged with the spread of the arrival times;
+//  - critical path: walked back from the last interval to finish, through
+//    the latest interval of the same rank which finished before the current
+//    one began, and through the last arriving rank at every collective.
+// Intervals come from device (or host runtime) events, see EventRecorder,
+// or are added directly by host code. Timestamps are microseconds on a
+// common host clock (steady_clock).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include "common/common.h"
+
+namespace timeline {
+
+enum class Op : uint32_t { Gemm, AllReduce, ReduceScatter, AllGather,
+      Permute, AllToAll, Other, Count };
+
+inline const char *opName(Op op) {
+  const char *names[] = { "gemm", "all-reduce", "reduce-scatter",
+        "all-gather", "permute", "all-to-all", "other" };
+  return op < Op::Count ? names[(uint32_t)op] : "unknown";
+}
+
+inline bool isComm(Op op) {
+  return op != Op::Gemm && op != Op::Other;
+}
+
+struct Interval {
+  uint32_t rank, stream;  // stream index within the rank
+  Op op;
+  uint32_t seq;           // the n-th op of this kind on the rank
+  double beginUs, endUs;
+  double durUs() const { return endUs - beginUs; }
+};
+
+inline double hostNowUs() {
+  return std::chrono::duration< double, std::micro >(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// records intervals of one rank with pairs of events: start() records a
+// reference event and ties it to the host clock (it synchronizes the
+// stream), begin() / end() bracket ops on any stream of the rank, collect()
+// converts the events once they have completed. Events are reused by the
+// following steps
+struct EventRecorder {
+
+  EventRecorder() = default;
+  EventRecorder(const EventRecorder&) = delete;
+  EventRecorder& operator=(const EventRecorder&) = delete;
+
+  ~EventRecorder() {
+    for(auto e : m_events) (void)cudaEventDestroy(e);
+  }
+
+  void start(cudaStream_t stream) {
+    m_ops.clear();
+    m_numUsed = 0;
+    m_seq.clear();
+    m_ref = event();
+    CHK(cudaEventRecord(m_ref, stream));
+    CHK(cudaEventSynchronize(m_ref));
+    m_refUs = hostNowUs();
+  }
+
+  // returns a token for end()
+  uint32_t begin(Op op, cudaStream_t stream, uint32_t streamIdx = 0) {
+    auto ev = event();
+    CHK(cudaEventRecord(ev, stream));
+    m_ops.push_back(Pending{ op, streamIdx, m_seq[op]++, ev, nullptr });
+    return m_ops.size() - 1;
+  }
+
+  void end(uint32_t token, cudaStream_t stream) {
+    auto ev = event();
+    CHK(cudaEventRecord(ev, stream));
+    m_ops[token].end = ev;
+  }
+
+  // appends the intervals recorded since start(): all of them must have
+  // completed
+  void collect(uint32_t rank, std::vector< Interval >& out) {
+    for(const auto& p : m_ops) {
+      if(p.end == nullptr) continue;
+      float b, e;
+      CHK(cudaEventElapsedTime(&b, m_ref, p.begin));
+      CHK(cudaEventElapsedTime(&e, m_ref, p.end));
+      out.push_back(Interval{ rank, p.stream, p.op, p.seq,
+            m_refUs + b * 1e3, m_refUs + e * 1e3 });
+    }
+  }
+
+private:
+  struct Pending {
+    Op op;
+    uint32_t stream, seq;
+    cudaEvent_t begin, end;
+  };
+
+  cudaEvent_t event() {
+    if(m_numUsed == m_events.size()) {
+      cudaEvent_t e;
+      CHK(cudaEventCreate(&e));
+      m_events.push_back(e);
+    }
+    return m_events[m_numUsed++];
+  }
+
+  std::vector< cudaEvent_t > m_events;
+  size_t m_numUsed = 0;
+  std::vector< Pending > m_ops;
+  std::map< Op, uint32_t > m_seq;
+  cudaEvent_t m_ref = nullptr;
+  double m_refUs = 0;
+};
+
+struct RankStats {
+  double windowUs = 0;    // first begin to last end
+  double busyUs = 0;      // any stream busy
+  double computeUs = 0, commUs = 0, overlapUs = 0;
+  double idleUs = 0, maxGapUs = 0;
+  uint32_t numGaps = 0;
+  double waitUs = 0;      // arrived at collectives before the last rank
+  double stragglerUs = 0; // delay caused to the others as the last rank
+  uint32_t numStraggler = 0;
+
+  double overlapRatio() const {
+    return commUs > 0 ? overlapUs / commUs : 0;
+  }
+};
+
+struct Report {
+  double stepUs = 0;            // first begin to last end over all ranks
+  std::vector< RankStats > ranks;
+  std::vector< Interval > criticalPath;  // in time order
+  double pathComputeUs = 0, pathCommUs = 0, pathIdleUs = 0;
+};
+
+namespace detail {
+
+// total length of the union of [b, e) ranges; 'gaps' receives the holes
+inline double unionLength(std::vector< std::pair< double, double > >& r,
+      std::vector< double > *gaps = nullptr) {
+  std::sort(r.begin(), r.end());
+  double total = 0, cb = 0, ce = 0;
+  bool open = false;
+  for(auto [b, e] : r) {
+    if(open && b <= ce) {
+      ce = std::max(ce, e);
+      continue;
+    }
+    if(open) {
+      total += ce - cb;
+      if(gaps) gaps->push_back(b - ce);
+    }
+    cb = b, ce = e, open = true;
+  }
+  return open ? total + ce - cb : 0;
+}
+
+} // namespace detail
+
+inline Report analyze(const std::vector< Interval >& all) {
+  Report rep;
+  if(all.empty()) return rep;
+  uint32_t nRanks = 0;
+  double t0 = 1e300, t1 = -1e300;
+  for(const auto& iv : all) {
+    nRanks = std::max(nRanks, iv.rank + 1);
+    t0 = std::min(t0, iv.beginUs), t1 = std::max(t1, iv.endUs);
+  }
+  rep.stepUs = t1 - t0;
+  rep.ranks.resize(nRanks);
+  std::vector< std::vector< const Interval * > > byRank(nRanks);
+  for(const auto& iv : all) byRank[iv.rank].push_back(&iv);
+
+  for(uint32_t r = 0; r < nRanks; r++) {
+    auto& s = rep.ranks[r];
+    std::vector< std::pair< double, double > > any, comp, comm;
+    double b = 1e300, e = -1e300;
+    for(auto iv : byRank[r]) {
+      any.emplace_back(iv->beginUs, iv->endUs);
+      (isComm(iv->op) ? comm : comp).emplace_back(iv->beginUs, iv->endUs);
+      b = std::min(b, iv->beginUs), e = std::max(e, iv->endUs);
+    }
+    if(any.empty()) continue;
+    std::vector< double > gaps;
+    s.windowUs = e - b;
+    s.busyUs = detail::unionLength(any, &gaps);
+    s.computeUs = detail::unionLength(comp);
+    s.commUs = detail::unionLength(comm);
+    s.overlapUs = s.computeUs + s.commUs - s.busyUs;
+    s.idleUs = s.windowUs - s.busyUs;
+    s.numGaps = gaps.size();
+    for(auto g : gaps) s.maxGapUs = std::max(s.maxGapUs, g);
+  }
+
+  // collective instances across ranks: the last arriving rank of each
+  std::map< std::pair< Op, uint32_t >, std::vector< const Interval * > > colls;
+  for(const auto& iv : all) {
+    if(isComm(iv.op)) colls[{ iv.op, iv.seq }].push_back(&iv);
+  }
+  std::map< const Interval *, const Interval * > lastOf;
+  for(auto& [key, ivs] : colls) {
+    auto last = *std::max_element(ivs.begin(), ivs.end(),
+          [](auto a, auto b) { return a->beginUs < b->beginUs; });
+    double first = last->beginUs;
+    for(auto iv : ivs) {
+      first = std::min(first, iv->beginUs);
+      rep.ranks[iv->rank].waitUs += last->beginUs - iv->beginUs;
+      lastOf[iv] = last;
+    }
+    if(ivs.size() > 1 && last->beginUs > first) {
+      rep.ranks[last->rank].stragglerUs += last->beginUs - first;
+      rep.ranks[last->rank].numStraggler++;
+    }
+  }
+
+  // critical path
+  for(auto& v : byRank) {
+    std::sort(v.begin(), v.end(), [](auto a, auto b) {
+      return a->endUs < b->endUs;
+    });
+  }
+  auto cur = &*std::max_element(all.begin(), all.end(),
+        [](const auto& a, const auto& b) { return a.endUs < b.endUs; });
+  const double eps = 1e-3;
+  double pathEnd = cur->endUs;
+  // (bounded in case of inconsistent timestamps)
+  while(cur != nullptr && rep.criticalPath.size() < all.size()) {
+    if(auto it = lastOf.find(cur); it != lastOf.end()) cur = it->second;
+    rep.criticalPath.push_back(*cur);
+    const auto& v = byRank[cur->rank];
+    // the latest interval finished before 'cur' began
+    auto it = std::upper_bound(v.begin(), v.end(), cur->beginUs + eps,
+          [](double t, auto iv) { return t < iv->endUs; });
+    const Interval *pred = nullptr;
+    while(it != v.begin()) {
+      --it;
+      if(*it != cur) {
+        pred = *it;
+        break;
+      }
+    }
+    cur = pred;
+  }
+  std::reverse(rep.criticalPath.begin(), rep.criticalPath.end());
+  double t = rep.criticalPath.front().beginUs;
+  for(const auto& iv : rep.criticalPath) {
+    rep.pathIdleUs += std::max(0.0, iv.beginUs - t);
+    double d = iv.endUs - std::max(t, iv.beginUs);
+    if(d > 0) (isComm(iv.op) ? rep.pathCommUs : rep.pathComputeUs) += d;
+    t = std::max(t, iv.endUs);
+  }
+  rep.pathIdleUs += std::max(0.0, pathEnd - t);
+  return rep;
+}
+
+inline void printReport(const char *title, const Report& rep) {
+  PRINTZ("%s: step %.3f ms; critical path: %zu ops, compute %.3f ms, "
+      "communication %.3f ms, idle %.3f ms", title, rep.stepUs * 1e-3,
+      rep.criticalPath.size(), rep.pathComputeUs * 1e-3,
+      rep.pathCommUs * 1e-3, rep.pathIdleUs * 1e-3);
+  PRINTZ("%4s %10s %10s %10s %8s %10s %6s %10s %10s %12s", "rank",
+      "window ms", "compute ms", "comm ms", "overlap", "idle ms", "gaps",
+      "max gap ms", "wait ms", "straggler ms");
+  for(size_t r = 0; r < rep.ranks.size(); r++) {
+    const auto& s = rep.ranks[r];
+    PRINTZ("%4zu %10.3f %10.3f %10.3f %7.1f%% %10.3f %6u %10.3f %10.3f "
+        "%8.3f (%u)", r, s.windowUs * 1e-3, s.computeUs * 1e-3,
+        s.commUs * 1e-3, s.overlapRatio() * 100, s.idleUs * 1e-3, s.numGaps,
+        s.maxGapUs * 1e-3, s.waitUs * 1e-3, s.stragglerUs * 1e-3,
+        s.numStraggler);
+  }
+}
+
+// Chrome trace format: one process per rank, one thread per stream;
+// intervals on the critical path are in category "critical"
+inline bool writeChrome(const char *path, const std::vector< Interval >& all,
+      const Report *rep = nullptr) {
+  FILE *f = fopen(path, "w");
+  if(f == nullptr) return false;
+  double t0 = 1e300;
+  uint32_t nRanks = 0;
+  for(const auto& iv : all) {
+    t0 = std::min(t0, iv.beginUs), nRanks = std::max(nRanks, iv.rank + 1);
+  }
+  auto onPath = [rep](const Interval& iv) {
+    if(rep == nullptr) return false;
+    for(const auto& p : rep->criticalPath) {
+      if(p.rank == iv.rank && p.stream == iv.stream && p.op == iv.op &&
+            p.seq == iv.seq) return true;
+    }
+    return false;
+  };
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  for(uint32_t r = 0; r < nRanks; r++) {
+    fprintf(f, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+        "\"args\":{\"name\":\"rank %u\"}}", r == 0 ? "" : ",\n", r, r);
+  }
+  for(const auto& iv : all) {
+    fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%u,"
+        "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"seq\":%u}}",
+        opName(iv.op), onPath(iv) ? "critical" : isComm(iv.op) ? "comm" :
+        "compute", iv.rank, iv.stream, iv.beginUs - t0, iv.durUs(), iv.seq);
+  }
+  fprintf(f, "\n]}\n");
+  return fclose(f) == 0;
+}
+
+} // namespace timeline
+
+#endif // RCCL_BUBBLES_TIMELINE_HPP
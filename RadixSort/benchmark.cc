@@ -6,6 +6,8 @@
 
 #include "common/gpu_prim.h"
 #include "common/common_utils.hpp"
+#include "common/random.hpp"
+#include "radix_sort_cpu.hpp"
 
 //! hipcc -std=c++17 -O3 benchmark.cc --offload-arch=gfx90a
 //---------------------------------------------------------------------
@@ -39,15 +41,14 @@ struct SumOp
 };
 
 template < class KeyT, class DevKeyT = KeyT >
-void benchmark_sort(const char *name, size_t num_items) {
+void benchmark_sort(ThreadPool& pool, const char *name, size_t num_items) {
 
     static_assert(sizeof(KeyT) == sizeof(DevKeyT), "Must be equal in size!");
 
     HVector<KeyT> keys_in(num_items), keys_out(num_items);
+    std::vector<KeyT> truth(num_items);
 
-    for(size_t i = 0; i < keys_in.size(); i++) {
-        RandomBits(keys_in[i]);
-    }
+    RandomBits(&pool, keys_in.data(), num_items, num_items);
     // std::sort(items.begin(), items.end());
     // for(size_t i = 0; i < keys_in.size(); i++) {
     //       OUTZ(i << " = " << keys_in[i]);
@@ -58,9 +59,17 @@ void benchmark_sort(const char *name, size_t num_items) {
         
     HVector< uint8_t > temp(temp_bytes);
 
+    size_t cpu_temp_bytes = 0;
+    CHK(CpuSortKeys<DevKeyT>(pool, nullptr, cpu_temp_bytes, keys_in.data(), truth.data(), num_items, false));
+    std::vector< uint8_t > cpu_temp(cpu_temp_bytes);
+
     GpuTimer timer;
     for(int j = 0; j < 2; j++) {
         bool descending = j > 0;
+        // ground truth from the host radix sort with the same key ordering
+        CPU_BEGIN_TIMING(CPU);
+        CHK(CpuSortKeys<DevKeyT>(pool, cpu_temp.data(), cpu_temp_bytes, keys_in.data(), truth.data(), num_items, descending));
+        CPU_END_TIMING(CPU, 1, "%s host sorting %zu items %s", name, num_items, descending ? "desc" : "asc");
         for(size_t i = 0; i < num_iters; i++) {
             if(i == 1) timer.Start(); // skip first iteration for warm-up
             keys_in.copyHToD();
@@ -71,6 +80,12 @@ void benchmark_sort(const char *name, size_t num_items) {
         timer.Stop();
         OUTZ(name << " sorting " << num_items << " items " << 
                 (descending ? "desc: " : "asc: ") << timer.ElapsedMillis()/(num_iters-1) << " ms");
+        if(std::memcmp(keys_out.data(), truth.data(), num_items * sizeof(KeyT)) != 0) {
+            auto pos = std::mismatch(keys_out.data(), keys_out.data() + num_items, truth.data(),
+                    [](const KeyT& a, const KeyT& b) { return std::memcmp(&a, &b, sizeof(KeyT)) == 0; });
+            OUTZ(name << (descending ? " desc" : " asc") << ": mismatch with host sort at " 
+                    << (pos.first - keys_out.data()));
+        }
     }
     // for(size_t i = 0; i < keys_out.size(); i++) {
     //     OUTZ(i << " = " << keys_out[i]);
@@ -123,6 +138,7 @@ int main(int argc, char** argv) try
     int num_items = argc > 1 ? atoi(argv[1]) : 1000000;
 
     DeviceInit();
+    ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
 
     std::ifstream ifs("input.csv");
     std::vector< float > input;
@@ -139,12 +155,12 @@ int main(int argc, char** argv) try
     }
 
     //benchmark_sort<float>();
-    // benchmark_sort<int16_t>("int16_t", num_items);
-    // benchmark_sort<int32_t>("int32_t", num_items);
-    // benchmark_sort<uint16_t, __half>("halffloat", num_items);
-    // benchmark_sort<uint16_t, hip_bfloat16>("bfloat16", num_items);
-    // benchmark_sort<float>("float", num_items);
-    // benchmark_sort<double>("double", num_items);
+    // benchmark_sort<int16_t>(pool, "int16_t", num_items);
+    // benchmark_sort<int32_t>(pool, "int32_t", num_items);
+    // benchmark_sort<uint16_t, __half>(pool, "halffloat", num_items);
+    // benchmark_sort<uint16_t, hip_bfloat16>(pool, "bfloat16", num_items);
+    // benchmark_sort<float>(pool, "float", num_items);
+    // benchmark_sort<double>(pool, "double", num_items);
 }
 catch(std::exception& ex) {
     OUTZ("Exception: " << ex.what());
@@ -0,0 +1,515 @@
+
+#ifndef RADIX_SORT_CPU_HPP_
+#define RADIX_SORT_CPU_HPP_
+
+// Host radix sort with the two-phase temp storage API of
+// hipcub::DeviceRadixSort (see CubSortKeys in benchmark.cc): the first call
+// with d_temp_storage == nullptr returns the required temp_bytes. Used as the
+// CPU sort and as ground truth for the device benchmark.
+//
+// Keys are mapped to unsigned integers with the same order (two's complement
+// integers: flip the sign bit; sign-magnitude floats incl. half and bfloat16:
+// flip all bits of negatives, the sign bit of positives) and sorted by 8-bit
+// digits from the least significant one (LSD). Each pass is split into one
+// part per thread: parts count their digits, offsets are prefix sums over
+// (digit, part) and keys are scattered through per-digit software
+// write-combining buffers of one cache line, which keeps 256 output streams
+// from thrashing the TLB and caches. Passes where all keys share the digit are
+// skipped. Sorting is stable; descending order sorts inverted keys.
+//
+// Skewed inputs (one top digit holding a large share of keys, e.g. Zipf) are
+// first partitioned by the most significant digit (MSD): large buckets are
+// then sorted by parallel LSD which skips their constant digits, small
+// buckets are sorted recursively by one thread each.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "common/common.h"
+#include "common/threading.hpp"
+
+namespace radix_cpu {
+
+constexpr uint32_t s_digitBits = 8, s_numBuckets = 1u << s_digitBits;
+constexpr size_t s_wcBytes = 64;        // write-combining buffer per digit
+constexpr size_t s_msdLeaf = 64;        // insertion sort below this size
+constexpr size_t s_minParallel = 64 * 1024;
+
+template < size_t Size > struct UIntOf;
+template < > struct UIntOf< 1 > { using type = uint8_t; };
+template < > struct UIntOf< 2 > { using type = uint16_t; };
+template < > struct UIntOf< 4 > { using type = uint32_t; };
+template < > struct UIntOf< 8 > { using type = uint64_t; };
+
+// sign-magnitude floats: float, double, __half, hip_bfloat16
+template < class KeyT, class = void >
+struct KeyTraits {
+  using U = typename UIntOf< sizeof(KeyT) >::type;
+  constexpr static uint32_t s_top = sizeof(U) * 8 - 1;
+  constexpr static U s_sign = (U)((U)1 << s_top);
+
+  static FORCEINLINE U twiddleIn(U u) {
+    return u ^ (U)((U)(0 - (u >> s_top)) | s_sign);
+  }
+  static FORCEINLINE U twiddleOut(U u) {
+    return u ^ (U)((U)((u >> s_top) - 1) | s_sign);
+  }
+};
+
+template < class KeyT >
+struct KeyTraits< KeyT, std::enable_if_t< std::is_integral_v< KeyT > > > {
+  using U = typename UIntOf< sizeof(KeyT) >::type;
+  constexpr static U s_flip = std::is_signed_v< KeyT > ?
+        (U)((U)1 << (sizeof(U) * 8 - 1)) : 0;
+
+  static FORCEINLINE U twiddleIn(U u) { return u ^ s_flip; }
+  static FORCEINLINE U twiddleOut(U u) { return u ^ s_flip; }
+};
+
+struct NullValue { };
+
+FORCEINLINE size_t alignUp(size_t x) {
+  return (x + 63) & ~(size_t)63;
+}
+
+// number of parts (threads) used for n keys
+inline size_t numParts(ThreadPool& pool, size_t n) {
+  return n < s_minParallel ? 1 : std::max< size_t >(pool.numThreads(), 1);
+}
+
+// sorts U-encoded keys (and optional values V) by bits [begin_bit, end_bit)
+template < class KeyT, class V >
+class Sorter {
+
+  using Tr = KeyTraits< KeyT >;
+  using U = typename Tr::U;
+  constexpr static bool HasValues = !std::is_same_v< V, NullValue >;
+  constexpr static uint32_t L = std::max< size_t >(1, s_wcBytes / sizeof(U));
+  using Hist = size_t[s_numBuckets];
+
+public:
+  // bytes of temp storage: alternate key and value buffers and histograms
+  static size_t tempBytes(size_t n, size_t parts, uint32_t passes) {
+    return alignUp(n * sizeof(U)) + (HasValues ? alignUp(n * sizeof(V)) : 0) +
+           parts * (passes + 1) * sizeof(Hist);
+  }
+
+  Sorter(ThreadPool& pool, void *temp, U *kout, V *vout, size_t n,
+      bool descending, int begin_bit, int end_bit) : m_pool(pool),
+      m_kout(kout), m_vout(vout), m_n(n),
+      m_flip(descending ? (U)~(U)0 : 0), m_begin(begin_bit),
+      m_passes((end_bit - begin_bit + s_digitBits - 1) / s_digitBits),
+      m_parts(numParts(pool, n)) {
+
+    auto ptr = (uint8_t *)temp;
+    m_kalt = (U *)ptr, ptr += alignUp(n * sizeof(U));
+    if constexpr(HasValues) {
+      m_valt = (V *)ptr, ptr += alignUp(n * sizeof(V));
+    }
+    m_hist = (Hist *)ptr; // [parts][passes + 1]: the last one for offsets
+    U mask = end_bit - begin_bit >= (int)sizeof(U) * 8 ? (U)~(U)0 :
+          (U)(((U)1 << (end_bit - begin_bit)) - 1);
+    m_keyMask = (U)(mask << begin_bit);
+  }
+
+  void sort(const U *kin, const V *vin) {
+    if(m_n == 0)
+      return;
+    // histograms of all digits in one read of the input
+    forParts(m_n, [&](size_t part, size_t b, size_t e) {
+      auto hist = m_hist + part * (m_passes + 1);
+      std::fill(hist[0], hist[0] + m_passes * s_numBuckets, 0);
+      for(size_t i = b; i < e; i++) {
+        U k = in(kin, i);
+        for(uint32_t p = 0; p < m_passes; p++) {
+          hist[p][digit(k, p)]++;
+        }
+      }
+    });
+    std::vector< size_t > total(m_passes * s_numBuckets, 0);
+    for(size_t part = 0; part < m_parts; part++) {
+      auto hist = m_hist + part * (m_passes + 1);
+      for(size_t i = 0; i < total.size(); i++) {
+        total[i] += hist[0][i];
+      }
+    }
+    std::vector< uint32_t > active;
+    size_t topMax = 0;
+    for(uint32_t p = 0; p < m_passes; p++) {
+      auto t = total.data() + p * s_numBuckets;
+      auto mx = *std::max_element(t, t + s_numBuckets);
+      if(mx != m_n) {
+        active.push_back(p), topMax = mx;
+      }
+    }
+    // skewed: the top digit has a bucket with a quarter of all keys
+    if(active.size() >= 2 && topMax * 4 >= m_n && m_n >= s_minParallel) {
+      msdTop(kin, vin, active.back(), total.data());
+    } else {
+      lsd(kin, false, m_kout, vin, m_vout, active, true, m_n);
+    }
+  }
+
+private:
+  FORCEINLINE U in(const U *p, size_t i) const {
+    U u;
+    std::memcpy(&u, p + i, sizeof(U));
+    return (U)(Tr::twiddleIn(u) ^ m_flip);
+  }
+  FORCEINLINE U out(U u) const {
+    return Tr::twiddleOut((U)(u ^ m_flip));
+  }
+  FORCEINLINE uint32_t digit(U k, uint32_t pass) const {
+    return (uint32_t)(k >> (m_begin + pass * s_digitBits)) &
+           (s_numBuckets - 1) & (uint32_t)(m_keyMask >> (m_begin +
+           pass * s_digitBits));
+  }
+
+  // calls f(part, b, e) for the parts of [0, n)
+  template < class F >
+  void forParts(size_t n, F&& f) {
+    const size_t parts = n < s_minParallel ? 1 : m_parts;
+    auto g = [&](size_t pb, size_t pe) {
+      for(size_t part = pb; part < pe; part++) {
+        f(part, n * part / parts, n * (part + 1) / parts);
+      }
+    };
+    if(parts == 1) {
+      g(0, 1);
+    } else {
+      m_pool.parallelFor(0, parts, 1, g);
+    }
+  }
+
+  // LSD over 'passes' of keys src[0..n): src is either the input (twiddled
+  // on load) or already twiddled; the result goes to dst (untwiddled).
+  // If 'histValid', m_hist already holds the per-part counts of passes[0]
+  void lsd(const U *src, bool srcTwiddled, U *dst, const V *vsrc, V *vdst,
+        const std::vector< uint32_t >& passes, bool histValid, size_t n) {
+
+    const size_t A = passes.size(), parts = n < s_minParallel ? 1 : m_parts;
+    if(A == 0) {
+      forParts(n, [&](size_t, size_t b, size_t e) {
+        copyOut(src, srcTwiddled, dst, vsrc, vdst, b, e);
+      });
+      return;
+    }
+    // alternate buffers occupy the same offsets as dst
+    U *kalt = m_kalt + (dst - m_kout);
+    V *valt = nullptr;
+    if constexpr(HasValues) {
+      valt = m_valt + (vdst - m_vout);
+    }
+    // ping-pong so that the last pass writes dst; a twiddled src already
+    // lives in kalt, in that case the first pass must go to dst
+    bool toDst = A % 2 == 1 || srcTwiddled;
+    const U *ks = src;
+    const V *vs = vsrc;
+    for(size_t j = 0; j < A; j++, toDst = !toDst) {
+      const uint32_t p = passes[j];
+      if(j > 0 || !histValid) {
+        count(ks, j == 0 && !srcTwiddled, p, n);
+      }
+      U *kd = toDst ? dst : kalt;
+      V *vd = toDst ? vdst : valt;
+      bool first = j == 0 && !srcTwiddled, last = j == A - 1 && toDst;
+      offsets(p, parts);
+      forParts(n, [&](size_t part, size_t b, size_t e) {
+        auto off = m_hist[part * (m_passes + 1) + m_passes];
+        if(first && last)  scatter< true, true >(ks, kd, vs, vd, p, b, e, off);
+        else if(first)     scatter< true, false >(ks, kd, vs, vd, p, b, e, off);
+        else if(last)      scatter< false, true >(ks, kd, vs, vd, p, b, e, off);
+        else               scatter< false, false >(ks, kd, vs, vd, p, b, e, off);
+      });
+      ks = kd, vs = vd;
+    }
+    if(ks != dst) { // even number of passes from a twiddled src
+      forParts(n, [&](size_t, size_t b, size_t e) {
+        copyOut(ks, true, dst, vs, vdst, b, e);
+      });
+    }
+  }
+
+  // per-part counts of one pass
+  void count(const U *ks, bool twiddle, uint32_t p, size_t n) {
+    forParts(n, [&](size_t part, size_t b, size_t e) {
+      auto& hist = m_hist[part * (m_passes + 1) + p];
+      std::fill(hist, hist + s_numBuckets, 0);
+      if(twiddle) {
+        for(size_t i = b; i < e; i++) hist[digit(in(ks, i), p)]++;
+      } else {
+        for(size_t i = b; i < e; i++) hist[digit(ks[i], p)]++;
+      }
+    });
+  }
+
+  // scatter offsets of each (part, digit): written to the last slot of parts
+  void offsets(uint32_t p, size_t parts) {
+    size_t sum = 0;
+    for(uint32_t d = 0; d < s_numBuckets; d++) {
+      for(size_t part = 0; part < parts; part++) {
+        auto h = m_hist + part * (m_passes + 1);
+        h[m_passes][d] = sum, sum += h[p][d];
+      }
+    }
+  }
+
+  template < bool First, bool Last >
+  void scatter(const U *ks, U *kd, const V *vs, V *vd, uint32_t p, size_t b,
+          size_t e, size_t *off) {
+
+    alignas(64) U kbuf[s_numBuckets][L];
+    std::vector< V > vbuf(HasValues ? s_numBuckets * L : 0);
+    uint32_t fill[s_numBuckets] = {};
+
+    auto flush = [&](uint32_t d, uint32_t num) {
+      std::memcpy((void *)(kd + off[d]), kbuf[d], num * sizeof(U));
+      if constexpr(HasValues) {
+        std::copy(vbuf.data() + d * L, vbuf.data() + d * L + num, vd + off[d]);
+      }
+      off[d] += num;
+    };
+    for(size_t i = b; i < e; i++) {
+      U k = First ? in(ks, i) : ks[i];
+      uint32_t d = digit(k, p), f = fill[d];
+      kbuf[d][f] = Last ? out(k) : k;
+      if constexpr(HasValues) {
+        vbuf[d * L + f] = vs[i];
+      }
+      if(++f == L) {
+        flush(d, L), f = 0;
+      }
+      fill[d] = f;
+    }
+    for(uint32_t d = 0; d < s_numBuckets; d++) {
+      if(fill[d] > 0) flush(d, fill[d]);
+    }
+  }
+
+  void copyOut(const U *ks, bool twiddled, U *kd, const V *vs, V *vd,
+          size_t b, size_t e) {
+    if(twiddled) {
+      for(size_t i = b; i < e; i++) kd[i] = out(ks[i]);
+    } else {
+      std::memcpy((void *)(kd + b), ks + b, (e - b) * sizeof(U));
+    }
+    if constexpr(HasValues) {
+      std::copy(vs + b, vs + e, vd + b);
+    }
+  }
+
+  // MSD partition by the top active digit into the alternate buffers, then
+  // each bucket is sorted into kout at the same offsets
+  void msdTop(const U *kin, const V *vin, uint32_t top, const size_t *total) {
+
+    // per-part counts of pass 'top' are valid from the first read
+    offsets(top, m_parts);
+    forParts(m_n, [&](size_t part, size_t b, size_t e) {
+      auto off = m_hist[part * (m_passes + 1) + m_passes];
+      scatter< true, false >(kin, m_kalt, vin, m_valt, top, b, e, off);
+    });
+    std::vector< size_t > start(s_numBuckets + 1, 0);
+    auto t = total + top * s_numBuckets;
+    for(uint32_t d = 0; d < s_numBuckets; d++) {
+      start[d + 1] = start[d] + t[d];
+    }
+    std::vector< uint32_t > lower;
+    for(uint32_t p = 0; p < top; p++) {
+      lower.push_back(p);
+    }
+    // large buckets use all threads; their constant digits are skipped
+    std::vector< uint32_t > small;
+    for(uint32_t d = 0; d < s_numBuckets; d++) {
+      size_t b = start[d], n = start[d + 1] - b;
+      if(n == 0)
+        continue;
+      if(n * m_parts * 2 < m_n || n < s_minParallel) {
+        small.push_back(d);
+        continue;
+      }
+      auto active = activePasses(m_kalt + b, lower, n);
+      lsd(m_kalt + b, true, m_kout + b, m_valt + vofs(b), m_vout + vofs(b),
+            active, false, n);
+    }
+    m_pool.parallelFor(0, small.size(), 1, [&](size_t sb, size_t se) {
+      for(size_t i = sb; i < se; i++) {
+        size_t b = start[small[i]], n = start[small[i] + 1] - b;
+        msd(m_kalt + b, m_kout + b, m_valt + vofs(b), m_vout + vofs(b), n,
+              (int)top - 1, false);
+      }
+    });
+  }
+
+  FORCEINLINE size_t vofs(size_t b) const {
+    return HasValues ? b : 0;
+  }
+
+  // passes from 'passes' where twiddled keys ks[0..n) differ: one read
+  std::vector< uint32_t > activePasses(const U *ks,
+          const std::vector< uint32_t >& passes, size_t n) {
+    U all = 0;
+    for(size_t i = 0; i < n; i++) {
+      all |= ks[i] ^ ks[0];
+    }
+    std::vector< uint32_t > res;
+    for(auto p : passes) {
+      U m = (U)((U)(s_numBuckets - 1) << (m_begin + p * s_digitBits)) & m_keyMask;
+      if(all & m) res.push_back(p);
+    }
+    return res;
+  }
+
+  // sequential MSD of keys 'src' (twiddled) by passes [0, pass]: the result
+  // is written untwiddled to 'dst'. 'srcIsDst' tells that src already lives
+  // in the output buffer (and the alternate buffer is free)
+  void msd(U *src, U *dst, V *vsrc, V *vdst, size_t n, int pass,
+        bool srcIsDst) {
+
+    if(n <= s_msdLeaf) {
+      insertionSort(src, vsrc, n);
+      finish(src, dst, vsrc, vdst, n, srcIsDst);
+      return;
+    }
+    size_t hist[s_numBuckets];
+    for(; pass >= 0; pass--) {
+      std::fill(hist, hist + s_numBuckets, 0);
+      for(size_t i = 0; i < n; i++) hist[digit(src[i], pass)]++;
+      if(*std::max_element(hist, hist + s_numBuckets) != n)
+        break;
+    }
+    if(pass < 0) { // all keys equal in the remaining bits
+      finish(src, dst, vsrc, vdst, n, srcIsDst);
+      return;
+    }
+    // scatter to the other buffer: the alternate one at the same offsets
+    U *other = srcIsDst ? m_kalt + (src - m_kout) : dst;
+    V *vother = nullptr;
+    if constexpr(HasValues) {
+      vother = srcIsDst ? m_valt + (vsrc - m_vout) : vdst;
+    }
+    size_t off[s_numBuckets], sum = 0;
+    for(uint32_t d = 0; d < s_numBuckets; d++) {
+      off[d] = sum, sum += hist[d];
+    }
+    for(size_t i = 0; i < n; i++) {
+      auto& o = off[digit(src[i], pass)];
+      other[o] = src[i];
+      if constexpr(HasValues) {
+        vother[o] = vsrc[i];
+      }
+      o++;
+    }
+    size_t b = 0;
+    for(uint32_t d = 0; d < s_numBuckets; b += hist[d++]) {
+      if(hist[d] == 0)
+        continue;
+      msd(other + b, dst + b, vofsPtr(vother, b), vofsPtr(vdst, b), hist[d],
+            pass - 1, !srcIsDst);
+    }
+  }
+
+  static FORCEINLINE V *vofsPtr(V *p, size_t b) {
+    return HasValues ? p + b : p;
+  }
+
+  void finish(const U *src, U *dst, const V *vsrc, V *vdst, size_t n,
+        bool srcIsDst) {
+    for(size_t i = 0; i < n; i++) {
+      dst[i] = out(src[i]);
+    }
+    if constexpr(HasValues) {
+      if(!srcIsDst) std::copy(vsrc, vsrc + n, vdst);
+    }
+  }
+
+  // stable insertion sort by the key bits
+  void insertionSort(U *ks, V *vs, size_t n) {
+    for(size_t i = 1; i < n; i++) {
+      U k = ks[i];
+      size_t j = i;
+      if constexpr(HasValues) {
+        V v = vs[i];
+        for(; j > 0 && (ks[j - 1] & m_keyMask) > (k & m_keyMask); j--) {
+          ks[j] = ks[j - 1], vs[j] = vs[j - 1];
+        }
+        ks[j] = k, vs[j] = v;
+      } else {
+        for(; j > 0 && (ks[j - 1] & m_keyMask) > (k & m_keyMask); j--) {
+          ks[j] = ks[j - 1];
+        }
+        ks[j] = k;
+      }
+    }
+  }
+
+  ThreadPool& m_pool;
+  U *m_kout;
+  V *m_vout;
+  const size_t m_n;
+  const U m_flip;
+  const int m_begin;
+  const uint32_t m_passes;
+  const size_t m_parts;
+  U m_keyMask;
+  U *m_kalt = nullptr;
+  V *m_valt = nullptr;
+  Hist *m_hist = nullptr;
+};
+
+template < class KeyT, class V >
+cudaError_t sortImpl(ThreadPool& pool, void *d_temp_storage,
+        size_t& temp_bytes, const void *keys_in, void *keys_out,
+        const void *values_in, void *values_out, size_t num_items,
+        bool descending, int begin_bit, int end_bit) {
+
+  using S = Sorter< KeyT, V >;
+  using U = typename KeyTraits< KeyT >::U;
+  end_bit = std::min< int >(end_bit, sizeof(KeyT) * 8);
+  if(begin_bit < 0 || begin_bit >= end_bit) {
+    return cudaErrorInvalidValue;
+  }
+  uint32_t passes = (end_bit - begin_bit + s_digitBits - 1) / s_digitBits;
+  size_t bytes = S::tempBytes(num_items, numParts(pool, num_items), passes);
+  if(d_temp_storage == nullptr) {
+    temp_bytes = bytes;
+    return cudaSuccess;
+  }
+  if(temp_bytes < bytes) {
+    return cudaErrorInvalidValue;
+  }
+  S sorter(pool, d_temp_storage, (U *)keys_out, (V *)values_out, num_items,
+        descending, begin_bit, end_bit);
+  sorter.sort((const U *)keys_in, (const V *)values_in);
+  return cudaSuccess;
+}
+
+} // namespace radix_cpu
+
+//! sorts keys [begin_bit, end_bit) on the host: same arguments as
+//! hipcub::DeviceRadixSort::SortKeys(Descending); KeyT can be any integer,
+//! float, double or 16-bit float type (__half, hip_bfloat16)
+template < class KeyT >
+cudaError_t CpuSortKeys(ThreadPool& pool, void *d_temp_storage,
+        size_t& temp_bytes, const void *keys_in, void *keys_out,
+        size_t num_items, bool descending, int begin_bit = 0,
+        int end_bit = sizeof(KeyT) * 8) {
+  return radix_cpu::sortImpl< KeyT, radix_cpu::NullValue >(pool,
+        d_temp_storage, temp_bytes, keys_in, keys_out, nullptr, nullptr,
+        num_items, descending, begin_bit, end_bit);
+}
+
+//! key-value version: values are reordered with their keys (stable)
+template < class KeyT, class ValueT >
+cudaError_t CpuSortPairs(ThreadPool& pool, void *d_temp_storage,
+        size_t& temp_bytes, const void *keys_in, void *keys_out,
+        const ValueT *values_in, ValueT *values_out, size_t num_items,
+        bool descending, int begin_bit = 0, int end_bit = sizeof(KeyT) * 8) {
+  return radix_cpu::sortImpl< KeyT, ValueT >(pool, d_temp_storage, temp_bytes,
+        keys_in, keys_out, values_in, values_out, num_items, descending,
+        begin_bit, end_bit);
+}
+
+#endif // RADIX_SORT_CPU_HPP_
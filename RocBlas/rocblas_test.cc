@@ -5,13 +5,19 @@
 // https://github.com/ROCmSoftwarePlatform/rocBLAS-Examples/blob/develop/Extensions/gemm_ex_f16_r/gemm_ex_f16_r.cpp
 
 #define ROCBLAS_BETA_FEATURES_API
+#include <memory>
+#include <iostream>
+#if COMPILE_FOR_HOST
+#include "common/host_rocblas.hpp"
+#else
 #include <hip/hip_fp16.h>
 #include <hip/hip_bfloat16.h>
 #include <hip/hip_complex.h>
-#include <memory>
-#include <iostream>
 #include <rocblas/rocblas.h>
+#endif
 #include "common/common_utils.hpp"
+#include "common/check_data.hpp"
+#include "common/cpu_gemm.hpp"
 
 #define USE_BATCHED_GEMM 0
 
@@ -28,27 +34,6 @@ std::ostream& operator<<(std::ostream& os, hipDoubleComplex Z) {
   return os << Z.x << "+i*" << Z.y;
 }
 
-template <typename T, typename U = T, typename V = U>
-void matMatMultMixPrec(T alpha, T beta, int M, int N, int K,
-    U*  A, int As1, int As2,
-    U*  B, int Bs1, int Bs2,
-    V*  C, int Cs1, int Cs2,
-    V*  D, int Ds1, int Ds2)
-{
-  for(int i1 = 0; i1 < M; i1++)
-  {
-    for(int i2 = 0; i2 < N; i2++)
-    {
-      T t = T(0.0);
-      for(int i3 = 0; i3 < K; i3++)
-      {
-        t += T(A[i1 * As1 + i3 * As2]) * T(B[i3 * Bs1 + i2 * Bs2]);
-      }
-      D[i1 * Ds1 + i2 * Ds2] = V(beta * T(C[i1 * Cs1 + i2 * Cs2]) + alpha * t);
-    }
-  }
-}
-
 struct BlasGemm
 {
 
@@ -203,7 +188,7 @@ int main(int argc, char *argv[]) try
   HVector< TypeA > a(totalA);
   HVector< TypeB > b(totalB);
   HVector< TypeC > c(totalC);
-  HVector< TypeD > d(totalD), dHost(cfg.sizeD);
+  HVector< TypeD > d(totalD), dHost(totalD);
 
   initRange(a.data(), 1.0, 0.01, a.size());
   initRange(b.data(), 3.0, 0.5, b.size());
@@ -256,20 +241,22 @@ int main(int argc, char *argv[]) try
 #endif // USE_BATCHED_GEMM
 //  } // for
 
-#if 0
-  for(int i = 0; i < batchCount; i++) {
-    matMatMultMixPrec(alpha, beta,
-      M, N, K, 
-      a.data(), strideA1, strideA2,
-      b.data(), strideB1, strideB2,
-      c.data(), 1, ldc,
-      dHost.data(), 1, ldd);
-
-    TypeD eps = 1e-4;
-    checkme(d.data(), dHost.data(), d.size(), d.size(),
-        1, eps, true);
-  }
-#endif        
+  // host reference: all batches at once, whole GEMMs per thread
+  ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+  CPU_BEGIN_TIMING(verify);
+  gemmHostBatched(&pool, alpha, beta, M, N, K,
+      a.data(), cfg.strideA1, cfg.strideA2, cfg.sizeA,
+      b.data(), cfg.strideB1, cfg.strideB2, cfg.sizeB,
+      c.data(), 1, cfg.ldC, cfg.sizeC,
+      dHost.data(), 1, cfg.ldD, cfg.sizeD, batchCount);
+  CPU_END_TIMING(verify, 1, "host GEMM (%s): batch: %ld, %d x %d x %d",
+      gemmHostKernel< TypeD >(), batchCount, M, N, K);
+
+  CheckOptions opts;
+  opts.relTol = 1e-4;
+  auto res = checkData(&pool, d.data(), dHost.data(), cfg.sizeD, cfg.sizeD,
+      batchCount, opts);
+  res.print("rocBLAS GEMM");
   return 0;
 }
 catch(std::exception& ex) {
@@ -0,0 +1,101 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread check_bench.cc ../common/common.cc ../common/host_runtime.cc
+// Compares throughput of checkme and checkData (common/check_data.hpp) and
+// checks tolerances, NaN policies, 16-bit types and redzone detection.
+
+#include <random>
+#include <thread>
+
+#include "common/common_utils.hpp"
+#include "common/check_data.hpp"
+
+bool expect(const char *name, const CheckResult& res, size_t mismatches,
+      size_t redzoneErrors = 0) {
+  bool ok = res.numMismatches == mismatches && 
+            res.redzoneErrors == redzoneErrors;
+  if(!ok) {
+    res.print(name);
+  }
+  PRINTZ("%s: %s", name, ok ? "OK" : "FAILED");
+  return ok;
+}
+
+bool test_policies(ThreadPool& pool) {
+  bool ok = true;
+  const float nan = std::numeric_limits< float >::quiet_NaN(),
+              inf = std::numeric_limits< float >::infinity();
+  std::vector< float > a = {1.0f, nan, nan, 2.0f, inf, -0.0f, 1e-30f, 100.0f},
+                       b = {1.0f, nan, 3.0f, nan, inf, 0.0f, -1e-30f, 100.01f};
+  CheckOptions opts;
+  ok &= expect("exact, NaN equal", checkData(&pool, a.data(), b.data(),
+        a.size(), a.size(), 1, opts), 4);
+  opts.absTol = 1e-3;
+  ok &= expect("abs 1e-3", checkData(&pool, a.data(), b.data(), a.size(),
+        a.size(), 1, opts), 3);
+  opts.relTol = 1e-3;
+  ok &= expect("rel 1e-3", checkData(&pool, a.data(), b.data(), a.size(),
+        a.size(), 1, opts), 2);
+  opts.nans = CheckNanPolicy::Ignore;
+  ok &= expect("NaN ignore", checkData(&pool, a.data(), b.data(), a.size(),
+        a.size(), 1, opts), 0);
+  opts.nans = CheckNanPolicy::Mismatch;
+  ok &= expect("NaN mismatch", checkData(&pool, a.data(), b.data(), a.size(),
+        a.size(), 1, opts), 3);
+
+  // 1.0 and its neighbours: half 0x3C00/0x3C01, bf16 0x3F80/0x3F81
+  uint16_t h1[] = {0x3C00, 0x3C01, 0x7E00, 0x0001},
+           h2[] = {0x3C01, 0x3C01, 0x7E01, 0x8001};
+  opts = {};
+  opts.ulpTol = 1;
+  ok &= expect("half 1 ulp", checkDataHalf(&pool, h1, h2, 4, 4, 1, opts), 1);
+  opts.ulpTol = 2;
+  ok &= expect("half 2 ulps", checkDataHalf(&pool, h1, h2, 4, 4, 1, opts), 0);
+  uint16_t b1[] = {0x3F80, 0x3F81}, b2[] = {0x3F81, 0x3F83};
+  opts.ulpTol = 1;
+  ok &= expect("bf16 1 ulp", checkDataBf16(&pool, b1, b2, 2, 2, 1, opts), 1);
+
+  std::vector< int32_t > i1 = {5, -7, 100, 0, 0xDD}, i2 = {5, -5, 103, 0, 0};
+  opts = {};
+  opts.absTol = 2;
+  // the last element is a redzone of 4 bytes: one of them differs
+  opts.redzoneBytes = 4, opts.redzoneValue = 0xDD;
+  ok &= expect("int abs 2 + redzone", checkData(&pool, i1.data(), i2.data(),
+        2, 2, 2, opts), 1, 3);
+  return ok;
+}
+
+void benchmark(ThreadPool& pool, size_t rows, size_t cols) {
+  std::vector< float > a(rows * cols), b(rows * cols);
+  std::mt19937 gen(111);
+  std::uniform_real_distribution< float > dist(-1, 1);
+  for(size_t i = 0; i < a.size(); i++) {
+    a[i] = b[i] = dist(gen);
+  }
+  a[a.size() / 3] += 1.0f;
+
+  CPU_BEGIN_TIMING(CHECKME);
+  checkme(a.data(), b.data(), cols, cols, rows, 1e-5f, true, 10);
+  CPU_END_TIMING(CHECKME, 1, "checkme %zu x %zu", rows, cols);
+
+  CheckOptions opts;
+  opts.absTol = 1e-5;
+  CheckResult res;
+  CPU_BEGIN_TIMING(CHECKDATA);
+  res = checkData(&pool, a.data(), b.data(), cols, cols, rows, opts);
+  CPU_END_TIMING(CHECKDATA, 1, "checkData %zu x %zu", rows, cols);
+  res.print("checkData");
+}
+
+int main() try
+{
+  ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+  bool ok = test_policies(pool);
+  benchmark(pool, 1, 32 * 1024 * 1024);
+  benchmark(pool, 22220, 2211);
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
@@ -0,0 +1,229 @@
+
+// g++ -I.. -I../LibraryQCCL -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread collective_matmul.cc ../LibraryQCCL/qccl_lib.cc ../common/common.cc ../common/host_runtime.cc
+// Runs the chunked collective matmul of RCCL_bubbles/collective_matmul.hpp
+// on the host backend: CPU GEMMs (the RCCL_bubbles problem, A transposed)
+// on a compute stream per rank and QCCL reduce-scatters over the host
+// transport. Checks that chunked GEMMs give the same output as whole ones
+// and that every chunk is reduce-scattered correctly, for batch and N
+// splits; then autotunes the number of chunks and reports the speedup over
+// the serial schedule (GEMM, then reduce-scatter) with the bubble analysis
+// of the tuned schedule.
+// Usage: collective_matmul [nRanks] [batch]
+// Inputs are small integers: all sums are exact.
+
+#include <cstring>
+#include <vector>
+
+#include "common/cpu_gemm.hpp"
+#include "common/threading.hpp"
+#include "qccl_lib.h"
+#include "RCCL_bubbles/collective_matmul.hpp"
+#include "SmallTests/test_utils.hpp"
+
+using cmm::Chunk;
+using cmm::Shape;
+using cmm::Split;
+
+// D = A^T B for the batches or columns of 'c': A is K x M (lda = K), B is
+// K x N (ldb = K), D is M x N (ldd = M), all column-major
+void cpuGemm(const Shape& sh, Split split, const Chunk& c, const float *A,
+      const float *B, float *D) {
+  int64_t b0 = 0, b1 = sh.batch, n0 = 0, n1 = sh.N;
+  (split == Split::Batch ? b0 : n0) = c.begin;
+  (split == Split::Batch ? b1 : n1) = c.end;
+  for(int64_t b = b0; b < b1; b++) {
+    auto pA = A + b * sh.M * sh.K, pB = B + b * sh.K * sh.N + n0 * sh.K;
+    auto pD = D + b * sh.M * sh.N + n0 * sh.M;
+    gemmHost((ThreadPool *)nullptr, 1.0f, 0.0f, sh.M, n1 - n0, sh.K,
+          pA, sh.K, 1, pB, 1, sh.K, pD, 1, sh.M, pD, 1, sh.M);
+  }
+}
+
+struct Ranks {
+
+  struct Rank {
+    std::vector< float > A, B, D, recv;
+    cudaStream_t compute, comm;
+    cmm::Pipeline pipe;
+    timeline::EventRecorder rec;
+    double ms;
+  };
+
+  Ranks(uint32_t nRanks) : m_nRanks(nRanks), m_ranks(nRanks),
+        m_barrier(nRanks), m_pool(nRanks) {
+    CHKQCCL(qcclInit(nRanks, nullptr));
+    for(auto& r : m_ranks) {
+      CHK(cudaStreamCreate(&r.compute));
+      CHK(cudaStreamCreate(&r.comm));
+    }
+  }
+
+  ~Ranks() {
+    for(auto& r : m_ranks) {
+      (void)cudaStreamDestroy(r.compute);
+      (void)cudaStreamDestroy(r.comm);
+    }
+  }
+
+  void setup(const Shape& sh) {
+    m_shape = sh;
+    for(uint32_t id = 0; id < m_nRanks; id++) {
+      auto& r = m_ranks[id];
+      r.A.resize(sh.M * sh.K * sh.batch);
+      r.B.resize(sh.K * sh.N * sh.batch);
+      for(size_t i = 0; i < r.A.size(); i++) {
+        r.A[i] = (float)((i * 7 + id * 3) % 9) - 4;
+      }
+      for(size_t i = 0; i < r.B.size(); i++) {
+        r.B[i] = (float)((i * 5 + id) % 7) - 3;
+      }
+      r.D.assign(sh.outElems(), -1.0f);
+      r.recv.assign(sh.outElems() / m_nRanks, -1.0f);
+    }
+  }
+
+  // one step on all ranks: returns the time of the slowest one
+  double step(Split split, uint32_t nChunks, bool overlap,
+        bool record = false) {
+    auto chunks = cmm::makeChunks(m_shape, split, nChunks, m_nRanks);
+    m_pool.runJob([&](int id) {
+      auto& r = m_ranks[id];
+      auto gemm = [&](const Chunk& c, cudaStream_t s) {
+        CHK(hostrt::enqueue(s, [&r, c, split, sh = m_shape] {
+          cpuGemm(sh, split, c, r.A.data(), r.B.data(), r.D.data());
+        }));
+      };
+      auto coll = [&](const Chunk& c, cudaStream_t s) {
+        CHKQCCL(qcclReduceScatter(id, r.D.data() + c.ofs,
+              r.recv.data() + c.ofs / m_nRanks, c.count / m_nRanks,
+              QCCL_DataType::Float32, QCCL_RedOp::Sum, s));
+      };
+      if(record) r.rec.start(r.compute);
+      m_barrier.wait(id);
+      auto z1 = std::chrono::high_resolution_clock::now();
+      r.pipe.run(chunks, r.compute, r.comm, gemm, coll, overlap,
+            timeline::Op::ReduceScatter, record ? &r.rec : nullptr);
+      CHK(cudaStreamSynchronize(r.compute));
+      CHK(cudaStreamSynchronize(r.comm));
+      std::chrono::duration< double, std::milli > d =
+            std::chrono::high_resolution_clock::now() - z1;
+      r.ms = d.count();
+      m_barrier.wait(id);
+    });
+    double ms = 0;
+    for(const auto& r : m_ranks) ms = std::max(ms, r.ms);
+    return ms;
+  }
+
+  // D of every rank against the reference, and the received blocks
+  // against the sums over ranks of the D blocks
+  bool verify(Split split, uint32_t nChunks,
+        const std::vector< std::vector< float > >& refD) {
+    for(uint32_t id = 0; id < m_nRanks; id++) {
+      if(m_ranks[id].D != refD[id]) return false;
+    }
+    for(const auto& c : cmm::makeChunks(m_shape, split, nChunks, m_nRanks)) {
+      size_t blk = c.count / m_nRanks;
+      for(uint32_t id = 0; id < m_nRanks; id++) {
+        for(size_t j = 0; j < blk; j++) {
+          float sum = 0;
+          for(const auto& r : m_ranks) sum += r.D[c.ofs + id * blk + j];
+          if(m_ranks[id].recv[c.ofs / m_nRanks + j] != sum) return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  std::vector< std::vector< float > > outputs() const {
+    std::vector< std::vector< float > > res;
+    for(const auto& r : m_ranks) res.push_back(r.D);
+    return res;
+  }
+
+  timeline::Report analyze() {
+    std::vector< timeline::Interval > all;
+    for(uint32_t id = 0; id < m_nRanks; id++) {
+      m_ranks[id].rec.collect(id, all);
+    }
+    return timeline::analyze(all);
+  }
+
+  void clearOutputs() {
+    for(auto& r : m_ranks) {
+      std::fill(r.D.begin(), r.D.end(), -1.0f);
+      std::fill(r.recv.begin(), r.recv.end(), -1.0f);
+    }
+  }
+
+  uint32_t m_nRanks;
+  Shape m_shape{};
+  std::vector< Rank > m_ranks;
+  Barrier m_barrier;
+  ThreadPool m_pool;
+};
+
+// serial and overlapped runs with several chunk counts must agree
+bool checkSplit(Ranks& ranks, const Shape& sh, Split split) {
+  ranks.setup(sh);
+  ranks.step(split, 1, false);
+  auto refD = ranks.outputs();
+  bool ok = ranks.verify(split, 1, refD);
+  for(auto n : cmm::chunkCandidates(sh, split, ranks.m_nRanks, 8)) {
+    for(bool overlap : { false, true }) {
+      ranks.clearOutputs();
+      ranks.step(split, n, overlap);
+      ok &= ranks.verify(split, n, refD);
+    }
+  }
+  return ok;
+}
+
+int main(int argc, char **argv) try
+{
+  uint32_t nRanks = argc > 1 ? atoi(argv[1]) : 4;
+  int64_t batch = argc > 2 ? atoi(argv[2]) : 4;
+  Ranks ranks(nRanks);
+  bool ok = true;
+  ok &= expect("chunk layout", [&] {
+    Shape sh{ 600, 512, 300, 10 };
+    auto cs = cmm::makeChunks(sh, Split::Batch, 4, nRanks);
+    size_t ofs = 0;
+    for(const auto& c : cs) {
+      if(c.ofs != ofs || c.count % nRanks != 0 || c.end <= c.begin) return false;
+      ofs += c.count;
+    }
+    return ofs == sh.outElems() && cs.size() == 4 && cs.back().end == 10;
+  }());
+  ok &= expect("batch split", checkSplit(ranks, Shape{ 60, 48, 30, 8 },
+        Split::Batch));
+  ok &= expect("N split", checkSplit(ranks, Shape{ 60, 64, 30, 1 },
+        Split::N));
+
+  // the RCCL_bubbles GEMM with a smaller batch
+  Shape sh{ 600, 512, 300, batch };
+  ranks.setup(sh);
+  const int nReps = 2;
+  double serialMs = 1e30;
+  for(int i = 0; i < nReps + 1; i++) {
+    serialMs = std::min(serialMs, ranks.step(Split::Batch, 1, false));
+  }
+  auto tuned = cmm::autotune(cmm::chunkCandidates(sh, Split::Batch, nRanks, 16),
+        nReps, [&](uint32_t n) { return ranks.step(Split::Batch, n, true); });
+  char title[128];
+  snprintf(title, sizeof(title), "%u ranks, %ldx%ldx%ld GEMM x %ld batches",
+        nRanks, sh.M, sh.N, sh.K, sh.batch);
+  cmm::printTuning(title, tuned, serialMs);
+
+  ranks.step(Split::Batch, tuned.nChunks, true, true);
+  timeline::printReport("tuned collective matmul", ranks.analyze());
+  PRINTZ("speedup over the serial schedule: %.2fx (%u chunks; %zu threads)",
+        serialMs / tuned.ms, tuned.nChunks,
+        (size_t)std::thread::hardware_concurrency());
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
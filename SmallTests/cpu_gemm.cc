@@ -0,0 +1,217 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread cpu_gemm.cc ../common/common.cc ../common/host_runtime.cc
+// Checks the host GEMM engine (common/cpu_gemm.hpp) against a naive loop
+// (the former matMatMultMixPrec) for all transpose modes, ragged sizes,
+// depths over the K block, beta / bias / C aliasing D, half and bfloat16
+// inputs (also with half outputs), batched GEMMs and double precision.
+// Inputs are small integers: results are exact in any summation order.
+// Then compares the speed with the naive loop on the 600x512x300 GEMM of
+// RocBlas / RCCL_bubbles and times a batched GEMM on the thread pool.
+// Usage: cpu_gemm [nThreads] [batch]
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "common/check_data.hpp"
+#include "common/cpu_gemm.hpp"
+#include "SmallTests/test_utils.hpp"
+
+// conversions are exact for the small integers used here
+using BFloat16 = hip_bfloat16;
+
+template < typename T, typename U = T, typename V = U >
+void matMatMultNaive(T alpha, T beta, int M, int N, int K,
+    const U *A, int As1, int As2, const U *B, int Bs1, int Bs2,
+    const V *C, int Cs1, int Cs2, V *D, int Ds1, int Ds2,
+    const V *bias = nullptr) {
+  for(int i1 = 0; i1 < M; i1++) {
+    for(int i2 = 0; i2 < N; i2++) {
+      T t = T(0.0);
+      for(int i3 = 0; i3 < K; i3++) {
+        t += T(A[i1 * As1 + i3 * As2]) * T(B[i3 * Bs1 + i2 * Bs2]);
+      }
+      T v = beta * T(C[i1 * Cs1 + i2 * Cs2]) + alpha * t;
+      if(bias != nullptr) v += T(bias[i1]);
+      D[i1 * Ds1 + i2 * Ds2] = V(v);
+    }
+  }
+}
+
+template < class X >
+void fillInts(std::vector< X >& v, uint32_t seed, int range) {
+  for(size_t i = 0; i < v.size(); i++) {
+    v[i] = X((float)((i * 2654435761u + seed) % range) - range / 2);
+  }
+}
+
+// strides of an R x C operand stored column-major (or transposed)
+void strides(bool trans, int64_t rows, int64_t cols, int64_t *s1,
+      int64_t *s2) {
+  if(trans) *s1 = cols, *s2 = 1;
+  else *s1 = 1, *s2 = rows;
+}
+
+template < class T, class U, class V >
+bool checkCase(ThreadPool *pool, int M, int N, int K, bool transA,
+      bool transB, T alpha, T beta, bool bias, bool alias) {
+  std::vector< U > A(M * K), B(K * N);
+  std::vector< V > C(M * N), D(M * N), ref(M * N), vb(M);
+  fillInts(A, 1, 7);
+  fillInts(B, 5, 5);
+  fillInts(C, 3, 9);
+  fillInts(vb, 7, 11);
+  int64_t As1, As2, Bs1, Bs2;
+  strides(transA, M, K, &As1, &As2);
+  strides(transB, K, N, &Bs1, &Bs2);
+  // D is row-major when C aliases D, column-major otherwise
+  int64_t Ds1 = alias ? N : 1, Ds2 = alias ? 1 : M;
+  matMatMultNaive(alpha, beta, M, N, K, A.data(), As1, As2, B.data(), Bs1,
+        Bs2, C.data(), 1, M, ref.data(), Ds1, Ds2, bias ? vb.data() : nullptr);
+  const V *pC = C.data();
+  int64_t Cs1 = 1, Cs2 = M;
+  if(alias) {
+    for(int i = 0; i < M; i++)
+      for(int j = 0; j < N; j++) D[i * N + j] = C[i + j * M];
+    pC = D.data(), Cs1 = N, Cs2 = 1;
+  } else {
+    std::fill(D.begin(), D.end(), V(-99.0f));
+  }
+  gemmHost(pool, alpha, beta, M, N, K, A.data(), As1, As2, B.data(), Bs1,
+        Bs2, pC, Cs1, Cs2, D.data(), Ds1, Ds2, bias ? vb.data() : nullptr);
+  for(size_t i = 0; i < D.size(); i++) {
+    if((float)D[i] != (float)ref[i]) {
+      PRINTZ("%dx%dx%d transA %d transB %d: %zu: %f vs %f", M, N, K, transA,
+            transB, i, (float)D[i], (float)ref[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool allModes(ThreadPool *pool) {
+  const int sizes[][3] = { { 1, 1, 1 }, { 13, 7, 5 }, { 37, 33, 300 },
+        { 100, 260, 17 }, { 97, 45, 600 }, { 250, 300, 0 } };
+  bool ok = true;
+  for(const auto& s : sizes) {
+    for(int t = 0; t < 4; t++) {
+      ok &= checkCase< float, float, float >(pool, s[0], s[1], s[2], t & 1,
+            t & 2, 1.0f, 0.0f, false, false);
+      ok &= checkCase< float, float, float >(pool, s[0], s[1], s[2], t & 1,
+            t & 2, 0.5f, 2.0f, true, t == 3);
+    }
+  }
+  return ok;
+}
+
+bool mixedPrecision(ThreadPool *pool) {
+  bool ok = true;
+  for(int t = 0; t < 4; t++) {
+    ok &= checkCase< float, _Float16, float >(pool, 70, 90, 300, t & 1,
+          t & 2, 1.0f, 1.0f, false, false);
+    ok &= checkCase< float, BFloat16, float >(pool, 70, 90, 300, t & 1,
+          t & 2, 1.0f, 1.0f, true, false);
+    // no depth blocking with half outputs: one rounding per element
+    ok &= checkCase< float, _Float16, _Float16 >(pool, 45, 33, 20, t & 1,
+          t & 2, 1.0f, 0.5f, false, false);
+  }
+  return ok;
+}
+
+bool batched(ThreadPool *pool) {
+  const int M = 30, N = 20, K = 40, batch = 9;
+  std::vector< float > A(M * K * batch), B(K * N * batch), D(M * N * batch),
+        ref(M * N * batch);
+  fillInts(A, 2, 7);
+  fillInts(B, 4, 5);
+  for(int i = 0; i < batch; i++) {
+    matMatMultNaive(1.0f, 0.0f, M, N, K, A.data() + i * M * K, K, 1,
+          B.data() + i * K * N, 1, K, ref.data(), 1, M,
+          ref.data() + i * M * N, 1, M);
+  }
+  gemmHostBatched(pool, 1.0f, 0.0f, M, N, K, A.data(), K, 1, M * K,
+        B.data(), 1, K, K * N, D.data(), 1, M, M * N, D.data(), 1, M, M * N,
+        batch);
+  return D == ref;
+}
+
+bool doublePrecision(ThreadPool *pool) {
+  return checkCase< double, double, double >(pool, 50, 40, 300, true, false,
+        1.0, 1.0, true, false);
+}
+
+template < class F >
+double timeMs(F&& f) {
+  auto z1 = std::chrono::high_resolution_clock::now();
+  f();
+  std::chrono::duration< double, std::milli > d =
+        std::chrono::high_resolution_clock::now() - z1;
+  return d.count();
+}
+
+// the RocBlas test problem: A transposed, B and D column-major
+void benchmark(ThreadPool *pool, int batch) {
+  const int M = 600, N = 512, K = 300;
+  std::vector< float > A((size_t)M * K * batch), B((size_t)K * N * batch),
+        D((size_t)M * N * batch), ref(M * N);
+  fillInts(A, 1, 7);
+  fillInts(B, 2, 5);
+  double flop = 2.0 * M * N * K;
+  double naiveMs = timeMs([&] {
+    matMatMultNaive(1.0f, 0.0f, M, N, K, A.data(), K, 1, B.data(), 1, K,
+          ref.data(), 1, M, ref.data(), 1, M);
+  });
+  gemmHost((ThreadPool *)nullptr, 1.0f, 0.0f, M, N, K, A.data(), K, 1,
+        B.data(), 1, K, D.data(), 1, M, D.data(), 1, M);
+  double oneMs = 1e30, poolMs = 1e30;
+  for(int i = 0; i < 3; i++) {
+    oneMs = std::min(oneMs, timeMs([&] {
+      gemmHost((ThreadPool *)nullptr, 1.0f, 0.0f, M, N, K, A.data(), K, 1,
+            B.data(), 1, K, D.data(), 1, M, D.data(), 1, M);
+    }));
+    poolMs = std::min(poolMs, timeMs([&] {
+      gemmHost(pool, 1.0f, 0.0f, M, N, K, A.data(), K, 1,
+            B.data(), 1, K, D.data(), 1, M, D.data(), 1, M);
+    }));
+  }
+  auto res = checkData(pool, D.data(), ref.data(), M * N, M * N, 1);
+  res.print("600x512x300 vs naive");
+  PRINTZ("%dx%dx%d (%s kernel): naive %.2f ms (%.2f GFLOPS); packed %.2f ms "
+      "(%.2f GFLOPS); packed on %zu threads %.2f ms (%.2f GFLOPS); %.1fx",
+      M, N, K, gemmHostKernel< float >(), naiveMs, flop / naiveMs * 1e-6,
+      oneMs, flop / oneMs * 1e-6, pool->numThreads(), poolMs,
+      flop / poolMs * 1e-6, naiveMs / std::min(oneMs, poolMs));
+
+  double batchMs = timeMs([&] {
+    gemmHostBatched(pool, 1.0f, 0.0f, M, N, K, A.data(), K, 1, M * K,
+          B.data(), 1, K, K * N, D.data(), 1, M, M * N, D.data(), 1, M,
+          M * N, batch);
+  });
+  PRINTZ("batch of %d: %.2f ms (%.2f GFLOPS); the naive loop would take "
+      "about %.1f s", batch, batchMs, flop * batch / batchMs * 1e-6,
+      naiveMs * batch * 1e-3);
+}
+
+int main(int argc, char **argv) try
+{
+  uint32_t nThreads = argc > 1 ? atoi(argv[1]) :
+        std::max(1u, std::thread::hardware_concurrency());
+  int batch = argc > 2 ? atoi(argv[2]) : 100;
+  ThreadPool pool(nThreads);
+  bool ok = true;
+  for(auto p : { (ThreadPool *)nullptr, &pool }) {
+    const char *where = p ? "thread pool" : "calling thread";
+    PRINTZ("---- %s", where);
+    ok &= expect("transpose modes, sizes, beta, bias, aliasing", allModes(p));
+    ok &= expect("half / bfloat16 inputs", mixedPrecision(p));
+    ok &= expect("batched", batched(p));
+    ok &= expect("double", doublePrecision(p));
+  }
+  benchmark(&pool, batch);
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
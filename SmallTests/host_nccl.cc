@@ -0,0 +1,300 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread host_nccl.cc ../common/common.cc ../common/host_runtime.cc ../common/host_nccl.cc
+// Checks the host NCCL subset (common/host_nccl.h) with one thread and one
+// stream per rank: grouped send / receive in both ring directions, uneven
+// per-peer exchanges against ncclAllToAll, all-reduce (in place, bitwise
+// equal on all ranks), reduce-scatter, all-gather (in place), collectives
+// replayed from a captured graph and argument checks. Then times an
+// all-reduce and an all-to-all of 16 Mb per rank.
+// Usage: host_nccl [nRanks]
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "common/common_utils.hpp"
+#include "common/threading.hpp"
+#include "SmallTests/test_utils.hpp"
+
+#define CHKNCCL(cmd) \
+  if(auto res = (cmd); res != ncclSuccess) {           \
+    ThrowError<>("NCCL failure %s:%d '%s'",              \
+        __FILE__,__LINE__, ncclGetErrorString(res));     \
+  }
+
+struct NcclTest {
+
+  NcclTest(int nRanks) : m_nRanks(nRanks), m_comms(nRanks),
+        m_streams(nRanks), m_barrier(nRanks), m_pool(nRanks) {
+    ncclUniqueId id;
+    CHKNCCL(ncclGetUniqueId(&id));
+    m_pool.runJob([&](int r) {
+      CHK(cudaSetDevice(r));
+      CHK(cudaStreamCreateWithFlags(&m_streams[r], cudaStreamNonBlocking));
+      CHKNCCL(ncclCommInitRank(&m_comms[r], m_nRanks, id, r));
+    });
+  }
+
+  ~NcclTest() {
+    for(int r = 0; r < m_nRanks; r++) {
+      (void)ncclCommDestroy(m_comms[r]);
+      (void)cudaStreamDestroy(m_streams[r]);
+    }
+  }
+
+  // f(rank) on the threads of all ranks, each one ANDs its result to 'ok'
+  template < class F >
+  bool onRanks(F&& f) {
+    std::vector< char > res(m_nRanks);
+    m_pool.runJob([&](int r) {
+      res[r] = f(r);
+      CHK(cudaStreamSynchronize(m_streams[r]));
+    });
+    return std::all_of(res.begin(), res.end(), [](char x) { return x; });
+  }
+
+  int m_nRanks;
+  std::vector< ncclComm_t > m_comms;
+  std::vector< cudaStream_t > m_streams;
+  Barrier m_barrier;
+  ThreadPool m_pool;
+};
+
+float value(int rank, size_t i) {
+  return (float)((rank * 131 + i * 7) % 97) - 48;
+}
+
+bool sendRecvRing(NcclTest& t, size_t n) {
+  std::vector< std::vector< float > > send(t.m_nRanks), recv(t.m_nRanks);
+  return t.onRanks([&](int r) {
+    int N = t.m_nRanks, next = (r + 1) % N, prev = (r + N - 1) % N;
+    send[r].resize(2 * n);
+    recv[r].assign(2 * n, -1);
+    for(size_t i = 0; i < 2 * n; i++) send[r][i] = value(r, i);
+    auto s = t.m_streams[r];
+    CHKNCCL(ncclGroupStart());
+    CHKNCCL(ncclSend(send[r].data(), n, ncclFloat32, next, t.m_comms[r], s));
+    CHKNCCL(ncclSend(send[r].data() + n, n, ncclFloat32, prev,
+          t.m_comms[r], s));
+    CHKNCCL(ncclRecv(recv[r].data(), n, ncclFloat32, prev, t.m_comms[r], s));
+    CHKNCCL(ncclRecv(recv[r].data() + n, n, ncclFloat32, next,
+          t.m_comms[r], s));
+    CHKNCCL(ncclGroupEnd());
+    CHK(cudaStreamSynchronize(s));
+    for(size_t i = 0; i < n; i++) {
+      if(recv[r][i] != value(prev, i) || recv[r][n + i] != value(next, n + i))
+        return false;
+    }
+    return true;
+  });
+}
+
+// rank r sends r + p + 1 elements to rank p
+bool unevenExchange(NcclTest& t) {
+  int N = t.m_nRanks;
+  auto displ = [N](int r, int p) { // of the data for p in the buffer of r
+    size_t d = 0;
+    for(int i = 0; i < p; i++) d += r + i + 1;
+    return d;
+  };
+  return t.onRanks([&](int r) {
+    std::vector< uint64_t > send(displ(r, N)), recv(N * (N + 1) + N * N);
+    for(int p = 0; p < N; p++) {
+      for(int i = 0; i < r + p + 1; i++) {
+        send[displ(r, p) + i] = (uint64_t)r << 32 | p << 16 | i;
+      }
+    }
+    auto s = t.m_streams[r];
+    CHKNCCL(ncclGroupStart());
+    size_t ofs = 0;
+    for(int p = 0; p < N; p++) {
+      CHKNCCL(ncclSend(send.data() + displ(r, p), r + p + 1, ncclUint64, p,
+            t.m_comms[r], s));
+      CHKNCCL(ncclRecv(recv.data() + ofs, p + r + 1, ncclUint64, p,
+            t.m_comms[r], s));
+      ofs += p + r + 1;
+    }
+    CHKNCCL(ncclGroupEnd());
+    CHK(cudaStreamSynchronize(s));
+    ofs = 0;
+    for(int p = 0; p < N; p++) {
+      for(int i = 0; i < p + r + 1; i++) {
+        if(recv[ofs++] != ((uint64_t)p << 32 | r << 16 | i)) return false;
+      }
+    }
+    return true;
+  });
+}
+
+bool allToAll(NcclTest& t, size_t n) {
+  int N = t.m_nRanks;
+  return t.onRanks([&](int r) {
+    std::vector< int32_t > send(n * N), recv(n * N);
+    for(size_t i = 0; i < n * N; i++) send[i] = r * 1000000 + i;
+    CHKNCCL(ncclAllToAll(send.data(), recv.data(), n, ncclInt32,
+          t.m_comms[r], t.m_streams[r]));
+    CHK(cudaStreamSynchronize(t.m_streams[r]));
+    for(int p = 0; p < N; p++) {
+      for(size_t i = 0; i < n; i++) {
+        if(recv[p * n + i] != int32_t(p * 1000000 + r * n + i)) return false;
+      }
+    }
+    return true;
+  });
+}
+
+// in place: the result is bitwise equal on all ranks and exact for the
+// small integers used
+bool allReduce(NcclTest& t, size_t n) {
+  int N = t.m_nRanks;
+  std::vector< std::vector< float > > bufs(N);
+  std::vector< std::vector< int32_t > > maxs(N);
+  bool ok = t.onRanks([&](int r) {
+    bufs[r].resize(n);
+    maxs[r].resize(n);
+    for(size_t i = 0; i < n; i++) {
+      bufs[r][i] = value(r, i), maxs[r][i] = (int)value(r, i);
+    }
+    auto s = t.m_streams[r];
+    CHKNCCL(ncclAllReduce(bufs[r].data(), bufs[r].data(), n, ncclFloat32,
+          ncclSum, t.m_comms[r], s));
+    CHKNCCL(ncclAllReduce(maxs[r].data(), maxs[r].data(), n, ncclInt32,
+          ncclMax, t.m_comms[r], s));
+    CHK(cudaStreamSynchronize(s));
+    for(size_t i = 0; i < n; i++) {
+      float sum = 0;
+      int32_t mx = -1000;
+      for(int p = 0; p < N; p++) {
+        sum += value(p, i), mx = std::max(mx, (int32_t)value(p, i));
+      }
+      if(bufs[r][i] != sum || maxs[r][i] != mx) return false;
+    }
+    return true;
+  });
+  for(int r = 1; r < N; r++) {
+    ok &= std::memcmp(bufs[r].data(), bufs[0].data(), n * sizeof(float)) == 0;
+  }
+  return ok;
+}
+
+bool reduceScatterAllGather(NcclTest& t, size_t n) {
+  int N = t.m_nRanks;
+  return t.onRanks([&](int r) {
+    std::vector< double > send(n * N), part(n), all(n * N);
+    for(size_t i = 0; i < n * N; i++) send[i] = value(r, i);
+    auto s = t.m_streams[r];
+    CHKNCCL(ncclReduceScatter(send.data(), part.data(), n, ncclFloat64,
+          ncclSum, t.m_comms[r], s));
+    // the part of this rank at its place in 'all' for an in-place gather
+    CHKNCCL(ncclReduceScatter(send.data(), all.data() + r * n, n,
+          ncclFloat64, ncclSum, t.m_comms[r], s));
+    CHKNCCL(ncclAllGather(all.data() + r * n, all.data(), n, ncclFloat64,
+          t.m_comms[r], s));
+    CHK(cudaStreamSynchronize(s));
+    for(size_t i = 0; i < n * N; i++) {
+      double sum = 0;
+      for(int p = 0; p < N; p++) sum += value(p, i);
+      if(all[i] != sum || (i / n == (size_t)r && part[i - r * n] != sum))
+        return false;
+    }
+    return true;
+  });
+}
+
+// the collectives of a graph meet the ones of the other ranks anew on
+// every replay
+bool graphReplay(NcclTest& t, size_t n, int nLaunches) {
+  int N = t.m_nRanks;
+  return t.onRanks([&](int r) {
+    std::vector< int64_t > buf(n, 1), gathered(n * N);
+    auto s = t.m_streams[r];
+    cudaGraph_t graph;
+    cudaGraphExec_t exec;
+    CHK(cudaStreamBeginCapture(s, cudaStreamCaptureModeThreadLocal));
+    CHKNCCL(ncclAllReduce(buf.data(), buf.data(), n, ncclInt64, ncclSum,
+          t.m_comms[r], s));
+    CHKNCCL(ncclAllGather(buf.data(), gathered.data(), n, ncclInt64,
+          t.m_comms[r], s));
+    CHK(cudaStreamEndCapture(s, &graph));
+    CHK(cudaGraphInstantiate(&exec, graph, NULL, NULL, 0));
+    for(int i = 0; i < nLaunches; i++) {
+      CHK(cudaGraphLaunch(exec, s));
+    }
+    CHK(cudaStreamSynchronize(s));
+    CHK(cudaGraphExecDestroy(exec));
+    CHK(cudaGraphDestroy(graph));
+    int64_t expected = 1;
+    for(int i = 0; i < nLaunches; i++) expected *= N;
+    return std::all_of(gathered.begin(), gathered.end(),
+          [=](int64_t x) { return x == expected; });
+  });
+}
+
+bool arguments(NcclTest& t) {
+  float x = 0;
+  ncclComm_t comm;
+  ncclUniqueId id;
+  CHKNCCL(ncclGetUniqueId(&id));
+  return ncclSend(&x, 1, ncclFloat32, t.m_nRanks, t.m_comms[0],
+        t.m_streams[0]) == ncclInvalidArgument &&
+      ncclRecv(&x, 1, (ncclDataType_t)ncclNumTypes, 0, t.m_comms[0],
+        t.m_streams[0]) == ncclInvalidArgument &&
+      ncclCommInitRank(&comm, 2, id, 2) == ncclInvalidArgument &&
+      ncclGroupEnd() == ncclInvalidUsage;
+}
+
+template < class F >
+double timeMs(NcclTest& t, int nIters, F&& f) {
+  std::vector< double > ms(t.m_nRanks);
+  t.onRanks([&](int r) {
+    t.m_barrier.wait();
+    auto z1 = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < nIters; i++) f(r);
+    CHK(cudaStreamSynchronize(t.m_streams[r]));
+    std::chrono::duration< double, std::milli > d =
+          std::chrono::high_resolution_clock::now() - z1;
+    ms[r] = d.count() / nIters;
+    return true;
+  });
+  return *std::max_element(ms.begin(), ms.end());
+}
+
+int main(int argc, char **argv) try
+{
+  int nRanks = argc > 1 ? atoi(argv[1]) : 4;
+  if(nRanks < 2) {
+    ThrowError<>("At least 2 ranks are required");
+  }
+  NcclTest t(nRanks);
+  bool ok = true;
+  ok &= expect("send / recv ring", sendRecvRing(t, 100000));
+  ok &= expect("uneven grouped exchange", unevenExchange(t));
+  ok &= expect("all-to-all", allToAll(t, 3333));
+  ok &= expect("all-reduce", allReduce(t, 100001));
+  ok &= expect("reduce-scatter / all-gather", reduceScatterAllGather(t, 5000));
+  ok &= expect("graph replay", graphReplay(t, 1000, 5));
+  ok &= expect("arguments", arguments(t));
+
+  const size_t bytes = 16 << 20, n = bytes / sizeof(float);
+  std::vector< std::vector< float > > send(nRanks), recv(nRanks);
+  for(int r = 0; r < nRanks; r++) {
+    send[r].assign(n, 1.0f);
+    recv[r].resize(n);
+  }
+  double arMs = timeMs(t, 5, [&](int r) {
+    CHKNCCL(ncclAllReduce(send[r].data(), recv[r].data(), n, ncclFloat32,
+          ncclSum, t.m_comms[r], t.m_streams[r]));
+  });
+  double a2aMs = timeMs(t, 5, [&](int r) {
+    CHKNCCL(ncclAllToAll(send[r].data(), recv[r].data(), n / nRanks,
+          ncclFloat32, t.m_comms[r], t.m_streams[r]));
+  });
+  PRINTZ("%d ranks, 16 Mb per rank: all-reduce %.2f ms; all-to-all %.2f ms",
+      nRanks, arMs, a2aMs);
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
@@ -0,0 +1,282 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread host_runtime.cc ../common/simt_emulator.cc ../common/common.cc ../common/host_runtime.cc
+// Checks the host device runtime (common/host_runtime.h): stream ordering,
+// cross-stream event waits, event timing, async copies against memcpy,
+// stream capture (incl. capture-mode rules) and graph replay, emulated
+// kernels launched on a stream (also through a registered untyped address)
+// and the occupancy calls. Then prints the host-side cost of a stream
+// op, of an op replayed from a graph and of an empty graph launch.
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "common/common_utils.hpp"
+#include "common/threading.hpp"
+#include "SmallTests/test_utils.hpp"
+
+__global__ void axpyKernel(float a, const float *x, float *y, uint32_t n) {
+  uint32_t i = blockIdx.x * blockDim.x + threadIdx.x;
+  if(i < n) y[i] += a * x[i];
+}
+
+bool streamOrder() {
+  GPUStream s;
+  std::vector< int > seq;
+  for(int i = 0; i < 1000; i++) {
+    CHK(hostrt::enqueue(s.get(), [&seq, i] { seq.push_back(i); }));
+  }
+  CHK(cudaStreamSynchronize(s.get()));
+  for(int i = 0; i < 1000; i++) {
+    if(seq[i] != i) return false;
+  }
+  return cudaStreamQuery(s.get()) == cudaSuccess;
+}
+
+// stream b waits for a slow op of stream a
+bool eventWait() {
+  GPUStream a, b;
+  cudaEvent_t e;
+  CHK(cudaEventCreate(&e));
+  std::atomic< bool > aDone{false}, seen{false};
+  CHK(hostrt::enqueue(a.get(), [&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    aDone = true;
+  }));
+  CHK(cudaEventRecord(e, a.get()));
+  CHK(cudaStreamWaitEvent(b.get(), e, 0));
+  CHK(hostrt::enqueue(b.get(), [&] { seen = aDone.load(); }));
+  bool notReady = cudaEventQuery(e) == cudaErrorNotReady;
+  CHK(cudaStreamSynchronize(b.get()));
+  CHK(cudaEventDestroy(e));
+  return notReady && seen;
+}
+
+bool eventTiming() {
+  GpuTimer timer;
+  timer.Start();
+  CHK(hostrt::enqueue(nullptr, [] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  }));
+  timer.Stop();
+  float ms = timer.ElapsedMillis();
+  PRINTZ("30 ms sleep between events: %.3f ms", ms);
+  return ms >= 29.5f && ms < 300.f;
+}
+
+bool asyncCopy(size_t bytes) {
+  std::vector< uint8_t > src(bytes), dst(bytes), ref(bytes);
+  for(size_t i = 0; i < bytes; i++) src[i] = (uint8_t)(i * 7 + (i >> 16));
+  GPUStream s;
+  cudaEvent_t e1, e2;
+  CHK(cudaEventCreate(&e1));
+  CHK(cudaEventCreate(&e2));
+  const int nIters = 10;
+  double gbsAsync = 0, gbsMemcpy = 0;
+  for(int k = 0; k < nIters + 1; k++) {
+    CHK(cudaEventRecord(e1, s.get()));
+    CHK(cudaMemcpyAsync(dst.data(), src.data(), bytes,
+          cudaMemcpyDeviceToDevice, s.get()));
+    CHK(cudaEventRecord(e2, s.get()));
+    auto z1 = std::chrono::high_resolution_clock::now();
+    memcpy(ref.data(), src.data(), bytes);
+    std::chrono::duration< double, std::milli > d =
+          std::chrono::high_resolution_clock::now() - z1;
+    CHK(cudaEventSynchronize(e2));
+    float ms;
+    CHK(cudaEventElapsedTime(&ms, e1, e2));
+    if(k > 0) { // warm-up
+      gbsAsync += bytes / (ms * 1e6) / nIters;
+      gbsMemcpy += bytes / (d.count() * 1e6) / nIters;
+    }
+  }
+  CHK(cudaEventDestroy(e1));
+  CHK(cudaEventDestroy(e2));
+  PRINTZ("copy of %zu Mb: cudaMemcpyAsync %.2f GB/s; memcpy %.2f GB/s "
+      "(%zu pool threads)", bytes >> 20, gbsAsync, gbsMemcpy,
+      hostrt::pool()->numThreads());
+  return memcmp(dst.data(), src.data(), bytes) == 0;
+}
+
+// memset + copy + counter captured once and replayed
+bool captureReplay() {
+  const size_t n = 1 << 20;
+  std::vector< uint8_t > a(n), b(n);
+  GPUStream s;
+  std::atomic< int > counter{0};
+  cudaGraph_t graph;
+  cudaGraphExec_t exec;
+  CHK(cudaStreamBeginCapture(s.get(), cudaStreamCaptureModeThreadLocal));
+  CHK(cudaMemsetAsync(a.data(), 0x5A, n, s.get()));
+  CHK(cudaMemcpyAsync(b.data(), a.data(), n, cudaMemcpyDeviceToDevice, s.get()));
+  CHK(hostrt::enqueue(s.get(), [&] { counter++; }));
+  // nothing runs while capturing
+  CHK(cudaStreamEndCapture(s.get(), &graph));
+  bool ok = counter == 0 && b[0] == 0;
+  CHK(cudaGraphInstantiate(&exec, graph, NULL, NULL, 0));
+  CHK(cudaGraphDestroy(graph));
+  for(int i = 0; i < 100; i++) {
+    CHK(cudaGraphLaunch(exec, s.get()));
+  }
+  CHK(cudaStreamSynchronize(s.get()));
+  CHK(cudaGraphExecDestroy(exec));
+  return ok && counter == 100 && b[0] == 0x5A && b[n - 1] == 0x5A;
+}
+
+// synchronous calls fail during capture: from the capturing thread only
+// in thread-local mode, from any thread in global mode
+bool captureModes() {
+  GPUStream s;
+  cudaGraph_t graph;
+  bool ok = true;
+  for(auto mode : { cudaStreamCaptureModeThreadLocal,
+                    cudaStreamCaptureModeGlobal }) {
+    CHK(cudaStreamBeginCapture(s.get(), mode));
+    cudaError_t other;
+    std::thread([&] {
+      void *p = nullptr;
+      other = cudaMalloc(&p, 1024);
+      if(other == cudaSuccess) (void)cudaFree(p);
+    }).join();
+    bool global = mode == cudaStreamCaptureModeGlobal;
+    ok &= (other == cudaSuccess) != global;
+    auto end = cudaStreamEndCapture(s.get(), &graph);
+    // the other thread's call invalidated the global capture
+    ok &= global ? end == cudaErrorStreamCaptureInvalidated : end == cudaSuccess;
+    if(end == cudaSuccess) CHK(cudaGraphDestroy(graph));
+  }
+  CHK(cudaStreamBeginCapture(s.get(), cudaStreamCaptureModeThreadLocal));
+  void *p;
+  ok &= cudaMalloc(&p, 1024) == cudaErrorStreamCaptureUnsupported;
+  ok &= cudaStreamEndCapture(s.get(), &graph) == cudaErrorStreamCaptureInvalidated;
+  ok &= graph == nullptr;
+  (void)cudaGetLastError();
+  return ok;
+}
+
+bool kernelOnStream() {
+  const uint32_t n = 10000;
+  HVector< float > x(n), y(n);
+  for(uint32_t i = 0; i < n; i++) x[i] = i, y[i] = 1;
+  x.copyHToD();
+  y.copyHToD();
+  GPUStream s;
+  dim3 grid((n + 255) / 256), block(256);
+  CHK(hostLaunchKernel(axpyKernel, grid, block, 0, s.get(), 2.0f,
+        x.devPtr, y.devPtr, n));
+  float a = 0.5f;
+  uint32_t nn = n;
+  void *args[] = { &a, &x.devPtr, &y.devPtr, &nn };
+  CHK(cudaLaunchKernel(axpyKernel, grid, block, args, 0, s.get()));
+  CHK(cudaStreamSynchronize(s.get()));
+  y.copyDToH();
+  for(uint32_t i = 0; i < n; i++) {
+    if(y[i] != 1 + 2.5f * i) return false;
+  }
+  return true;
+}
+
+// kernels launched by address like in TopK; the occupancy model is one
+// block per pool thread
+bool untypedLaunch() {
+  const uint32_t n = 1000;
+  HVector< float > x(n), y(n);
+  for(uint32_t i = 0; i < n; i++) x[i] = i, y[i] = 1;
+  x.copyHToD();
+  y.copyHToD();
+  GPUStream s;
+  const void *func = hostrt::registerKernel(axpyKernel);
+  float a = 2.0f;
+  uint32_t nn = n;
+  void *args[] = { &a, &x.devPtr, &y.devPtr, &nn };
+  CHK(cudaLaunchKernel(func, dim3((n + 127) / 128), dim3(128), args, 0,
+        s.get()));
+  bool ok = cudaLaunchKernel((const void *)&nn, dim3(1), dim3(1), args, 0,
+        s.get()) == cudaErrorInvalidDeviceFunction;
+  (void)cudaGetLastError();
+  CHK(cudaStreamSynchronize(s.get()));
+  y.copyDToH();
+  for(uint32_t i = 0; i < n; i++) {
+    ok &= y[i] == 1 + 2.0f * i;
+  }
+  cudaDeviceProp props;
+  CHK(cudaGetDeviceProperties(&props, 0));
+  int numBlocks = 0, minGrid = 0, blockSize = 0;
+  size_t dynSmem = 0;
+  CHK(cudaOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, func, 512,
+        24 * 1024));
+  ok &= numBlocks == 1;
+  CHK(cudaOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, func, 512,
+        props.sharedMemPerBlock + 1));
+  ok &= numBlocks == 0;
+  CHK(cudaOccupancyMaxPotentialBlockSize(&minGrid, &blockSize, func,
+        32 * 1024, 512));
+  ok &= blockSize == 512 && minGrid == props.multiProcessorCount &&
+        blockSize <= props.maxThreadsPerMultiProcessor;
+  CHK(cudaOccupancyAvailableDynamicSMemPerBlock(&dynSmem, func, 1, 512));
+  ok &= dynSmem == props.sharedMemPerBlock;
+  CHK(cudaOccupancyAvailableDynamicSMemPerBlock(&dynSmem, func, 4, 512));
+  return ok && dynSmem == 0;
+}
+
+// host-side cost of queueing and running empty ops
+void overheads() {
+  GPUStream s;
+  auto nop = [](void *) { };
+  const int nOps = 100000, nPerGraph = 100, nLaunches = 1000;
+  auto z1 = std::chrono::high_resolution_clock::now();
+  for(int i = 0; i < nOps; i++) {
+    CHK(cudaLaunchHostFunc(s.get(), nop, nullptr));
+  }
+  CHK(cudaStreamSynchronize(s.get()));
+  std::chrono::duration< double, std::micro > opUs =
+        std::chrono::high_resolution_clock::now() - z1;
+
+  auto replay = [&](int nNodes) {
+    cudaGraph_t graph;
+    cudaGraphExec_t exec;
+    CHK(cudaStreamBeginCapture(s.get(), cudaStreamCaptureModeThreadLocal));
+    for(int i = 0; i < nNodes; i++) {
+      CHK(cudaLaunchHostFunc(s.get(), nop, nullptr));
+    }
+    CHK(cudaStreamEndCapture(s.get(), &graph));
+    CHK(cudaGraphInstantiate(&exec, graph, NULL, NULL, 0));
+    auto z1 = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < nLaunches; i++) {
+      CHK(cudaGraphLaunch(exec, s.get()));
+    }
+    CHK(cudaStreamSynchronize(s.get()));
+    std::chrono::duration< double, std::micro > d =
+          std::chrono::high_resolution_clock::now() - z1;
+    CHK(cudaGraphExecDestroy(exec));
+    CHK(cudaGraphDestroy(graph));
+    return d.count();
+  };
+  double graphUs = replay(nPerGraph), emptyUs = replay(0);
+  PRINTZ("stream op: %.3f us; op replayed from a graph of %d: %.3f us; "
+      "empty graph launch: %.3f us", opUs.count() / nOps, nPerGraph,
+      graphUs / (nLaunches * nPerGraph), emptyUs / nLaunches);
+}
+
+int main() try
+{
+  DeviceInit(0);
+  bool ok = true;
+  ok &= expect("stream order", streamOrder());
+  ok &= expect("cross-stream event wait", eventWait());
+  ok &= expect("event timing", eventTiming());
+  ok &= expect("async copy", asyncCopy(64 << 20));
+  ok &= expect("capture and replay", captureReplay());
+  ok &= expect("capture modes", captureModes());
+  ok &= expect("kernel on a stream", kernelOnStream());
+  ok &= expect("untyped launch and occupancy", untypedLaunch());
+  overheads();
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
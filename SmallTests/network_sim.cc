@@ -0,0 +1,115 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread network_sim.cc ../common/common.cc ../common/host_runtime.cc
+// Checks the network simulator (RCCL/network_sim.hpp) against closed-form
+// times of single transfers, compares gateway pipelining and staging, the
+// route plans for 8 GPUs over message sizes and runs a collective permute
+// over thousands of simulated GPUs.
+
+#include <chrono>
+#include <cstdio>
+
+#include "common/common.h"
+#include "RCCL/network_sim.hpp"
+#include "SmallTests/test_utils.hpp"
+
+using namespace netsim;
+
+bool near(double x, double y, double relTol) {
+  return std::abs(x - y) <= relTol * std::abs(y);
+}
+
+int main() try
+{
+  bool ok = true;
+  const double bw = 50, lat = 2, B = 64 << 20;
+  const auto topo = route::Topology::uniform(8, bw, lat);
+  Config cfg;
+  const double startUs = cfg.launchUs + lat + cfg.spinUs,
+        chunkUs = cfg.chunkBytes / (bw * 1e3), directUs = B / (bw * 1e3);
+
+  { // one direct transfer: chunks back to back after the handshake
+    Simulator sim(topo, cfg);
+    auto res = sim.run({ { 0, route::s_direct, 1, B } });
+    PRINTZ("direct 64 Mb: %.1f us (%.2f GB/s)", res.timeUs, B / res.timeUs / 1e3);
+    ok &= expect("direct transfer", near(res.timeUs, startUs + directUs + lat,
+          1e-6));
+  }
+  { // one gateway: pipelining costs one chunk, store-and-forward twice all
+    Simulator sim(topo, cfg);
+    auto pipe = sim.run({ { 0, 2, 1, B } });
+    auto c2 = cfg;
+    c2.pipelined = false;
+    auto staged = Simulator(topo, c2).run({ { 0, 2, 1, B } });
+    c2 = cfg, c2.ringChunks = 1;
+    auto ring1 = Simulator(topo, c2).run({ { 0, 2, 1, B } });
+    c2.ringChunks = 4;
+    auto ring4 = Simulator(topo, c2).run({ { 0, 2, 1, B } });
+    PRINTZ("gateway 64 Mb: pipelined %.1f us; store-and-forward %.1f us; "
+        "ring of 1 chunk %.1f us; 4 chunks %.1f us", pipe.timeUs,
+        staged.timeUs, ring1.timeUs, ring4.timeUs);
+    ok &= expect("pipelined gateway", near(pipe.timeUs,
+          startUs + directUs + chunkUs + 2*lat, 1e-6));
+    ok &= expect("store-and-forward gateway", near(staged.timeUs,
+          startUs + 2*(directUs + lat), 1e-6));
+    // one slot: every chunk waits for the previous one to reach the target
+    ok &= expect("gateway credits", ring1.timeUs > 1.9 * pipe.timeUs &&
+          near(ring4.timeUs, pipe.timeUs, 1e-6));
+  }
+  { // route plans for 8 GPUs: gateways double the bandwidth unless the copy
+    // engines are the bottleneck
+    std::vector< uint32_t > target(8);
+    for(uint32_t i = 0; i < 8; i++) target[i] = (i + 1) % 8;
+    auto direct = route::planPermutation(topo, target, B, 0),
+         gw1 = route::planPermutation(topo, target, B, 1),
+         gw2 = route::planPermutation(topo, target, B, 2);
+    Simulator sim(topo, cfg);
+    for(double bytes = 64 * 1024; bytes <= B; bytes *= 4) {
+      double t0 = sim.run(Simulator::fromPlan(direct, bytes)).timeUs,
+             t1 = sim.run(Simulator::fromPlan(gw1, bytes)).timeUs,
+             t2 = sim.run(Simulator::fromPlan(gw2, bytes)).timeUs;
+      PRINTZ("%8.2f Mb: direct %8.1f us (%5.1f GB/s); 1 gateway %8.1f us "
+          "(%5.1f GB/s); 2 gateways %8.1f us (%5.1f GB/s)", bytes / (1 << 20),
+          t0, bytes / t0 / 1e3, t1, bytes / t1 / 1e3, t2, bytes / t2 / 1e3);
+    }
+    auto r0 = sim.run(Simulator::fromPlan(direct, B)),
+         r1 = sim.run(Simulator::fromPlan(gw1, B));
+    ok &= expect("1 gateway speedup", r0.timeUs / r1.timeUs > 1.9 &&
+          near(r1.timeUs - startUs, gw1.sol.linkUs, 0.05));
+    auto c2 = cfg;
+    c2.enginesPerGpu = 1, c2.engineGBs = bw;
+    auto r1e = Simulator(topo, c2).run(Simulator::fromPlan(gw1, B));
+    PRINTZ("1 gateway, one copy engine per GPU: %.1f us", r1e.timeUs);
+    ok &= expect("copy engine bound", r1e.timeUs > 0.95 * r0.timeUs);
+  }
+  { // collective permute on 4096 GPUs: i -> i+1 directly and via i+2, i+3
+    const uint32_t n = 4096, nSlots = 3;
+    const double bytes = 16 << 20;
+    std::vector< route::SlotPlan::Slot > graph(n * nSlots);
+    std::vector< size_t > sizes(n * nSlots);
+    for(uint32_t j = 0; j < n; j++) {
+      graph[j*nSlots] = { (j + n - 1) % n, (j + 1) % n };
+      graph[j*nSlots + 1] = { (j + n - 2) % n, (j + n - 1) % n };
+      graph[j*nSlots + 2] = { (j + n - 3) % n, (j + n - 2) % n };
+      sizes[j*nSlots] = sizes[j*nSlots + 1] = (size_t)bytes / 3 & ~15;
+      sizes[j*nSlots + 2] = (size_t)bytes - 2 * sizes[j*nSlots];
+    }
+    Simulator sim(n, [=](uint32_t, uint32_t) { return LinkInfo{ bw, lat }; },
+          cfg);
+    auto xs = Simulator::fromCommGraph(graph.data(), n, nSlots, sizes.data());
+    auto z1 = std::chrono::high_resolution_clock::now();
+    auto res = sim.run(xs);
+    std::chrono::duration< double, std::milli > ms =
+          std::chrono::high_resolution_clock::now() - z1;
+    PRINTZ("4096 GPUs, 2 gateways, 16 Mb: %.1f us simulated (direct only "
+        "%.1f us); %lu events in %.1f ms (%.1f M events/s)", res.timeUs,
+        bytes / (bw * 1e3), res.nEvents, ms.count(),
+        res.nEvents / ms.count() * 1e-3);
+    ok &= expect("4096 GPUs", res.timeUs < bytes / (bw * 1e3) / 3 * 1.3);
+  }
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
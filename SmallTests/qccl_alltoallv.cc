@@ -0,0 +1,167 @@
+
+// g++ -I.. -I../LibraryQCCL -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread qccl_alltoallv.cc ../LibraryQCCL/qccl_lib.cc ../common/common.cc ../common/host_runtime.cc
+// Checks qcclAllToAllv over the host transport for balanced, Zipf and
+// hot-expert counts (RCCL/alltoallv_dist.hpp), random counts with empty
+// transfers and odd sizes, then compares its bandwidth over the
+// distributions against one qcclSendRecv work item per peer.
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "common/threading.hpp"
+#include "qccl_lib.h"
+#include "RCCL/alltoallv_dist.hpp"
+#include "SmallTests/test_utils.hpp"
+
+struct AllToAllvTest {
+
+  AllToAllvTest(uint32_t nGpus, size_t maxElems) : m_nGpus(nGpus),
+        m_send(nGpus), m_recv(nGpus), m_barrier(nGpus), m_pool(nGpus) {
+    CHKQCCL(qcclInit(nGpus, nullptr));
+    for(uint32_t i = 0; i < nGpus; i++) {
+      m_send[i].resize(maxElems * 4);
+      m_recv[i].resize(maxElems * 4);
+      for(size_t j = 0; j < m_send[i].size(); j++) {
+        m_send[i][j] = (uint8_t)(i * 37 + j * 11 + (j >> 12));
+      }
+    }
+  }
+
+  // 'perPeer': one qcclSendRecv per peer instead of qcclAllToAllv;
+  // returns ms per call
+  double run(const a2av::Layout& L, QCCL_DataType t, int nIters,
+        bool perPeer = false) {
+    const size_t esz = t == QCCL_DataType::Float32 ? 4 : 2;
+    std::vector< double > ms(m_nGpus);
+    m_pool.runJob([&](int id) {
+      auto s = m_send[id].data(), r = m_recv[id].data();
+      m_barrier.wait(id);
+      auto z1 = std::chrono::high_resolution_clock::now();
+      for(int k = 0; k < nIters; k++) {
+        if(!perPeer) {
+          CHKQCCL(qcclAllToAllv(id, s, L.sendCountsOf(id), L.sendDisplsOf(id),
+                r, L.recvCountsOf(id), L.recvDisplsOf(id), t, nullptr));
+          continue;
+        }
+        for(uint32_t i = 0; i < m_nGpus; i++) {
+          CHKQCCL(qcclSendRecv(id, 1, i, r + L.recvDisplsOf(id)[i] * esz,
+                L.recvCountsOf(id)[i] * esz, i, s + L.sendDisplsOf(id)[i] * esz,
+                L.sendCountsOf(id)[i] * esz));
+        }
+        CHKQCCL(qcclRun(id, nullptr));
+      }
+      std::chrono::duration< double, std::milli > d =
+            std::chrono::high_resolution_clock::now() - z1;
+      ms[id] = d.count() / nIters;
+      m_barrier.wait(id);
+    });
+    double maxMs = 0;
+    for(auto m : ms) maxMs = std::max(maxMs, m);
+    return maxMs;
+  }
+
+  bool check(const a2av::Layout& L, QCCL_DataType t) {
+    const size_t esz = t == QCCL_DataType::Float32 ? 4 : 2;
+    for(auto& v : m_recv) std::fill(v.begin(), v.end(), 0xAA);
+    run(L, t, 1);
+    for(uint32_t j = 0; j < m_nGpus; j++) {
+      for(uint32_t i = 0; i < m_nGpus; i++) {
+        // block i of GPU j comes from block j of GPU i
+        auto got = m_recv[j].data() + L.recvDisplsOf(j)[i] * esz,
+             want = m_send[i].data() + L.sendDisplsOf(i)[j] * esz;
+        if(memcmp(got, want, L.recvCountsOf(j)[i] * esz) != 0) {
+          PRINTZ("GPU %u: wrong data from GPU %u (%zu elements)", j, i,
+                L.recvCountsOf(j)[i]);
+          return false;
+        }
+      }
+      // nothing is written past the received elements
+      auto end = m_recv[j].begin() + L.recvTotal(j) * esz;
+      if(std::any_of(end, end + std::min< size_t >(64,
+            m_recv[j].end() - end), [](uint8_t x) { return x != 0xAA; })) {
+        PRINTZ("GPU %u: out of bounds write", j);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  uint32_t m_nGpus;
+  std::vector< std::vector< uint8_t > > m_send, m_recv;
+  Barrier m_barrier;
+  ThreadPool m_pool;
+};
+
+// random counts in [0, maxCount], about a quarter of them empty
+a2av::Layout randomLayout(uint32_t n, size_t maxCount, uint64_t seed) {
+  auto L = a2av::makeLayout(a2av::Dist::Balanced, n, 0);
+  std::mt19937_64 gen(seed);
+  for(auto& c : L.counts) {
+    c = gen() % 4 == 0 ? 0 : gen() % (maxCount + 1);
+  }
+  for(uint32_t i = 0; i < n; i++) {
+    size_t sofs = 0, rofs = 0;
+    for(uint32_t j = 0; j < n; j++) {
+      L.sendDispls[i*n + j] = sofs, sofs += L.counts[i*n + j];
+      L.recvCounts[i*n + j] = L.counts[j*n + i];
+      L.recvDispls[i*n + j] = rofs, rofs += L.counts[j*n + i];
+    }
+  }
+  return L;
+}
+
+int main(int argc, char **argv) try
+{
+  uint32_t nGpus = argc > 1 ? atoi(argv[1]) : 4;
+  if(nGpus < 2) {
+    ThrowError<>("At least 2 GPUs are required");
+  }
+  const size_t maxElems = 8 << 20;
+  AllToAllvTest test(nGpus, maxElems);
+  const a2av::Dist dists[] = { a2av::Dist::Balanced, a2av::Dist::Zipf,
+        a2av::Dist::HotExpert };
+  bool ok = true;
+
+  for(auto d : dists) { // pieces of several work items per link
+    for(size_t elems : { 1000ul, 3ul << 20 }) {
+      auto L = a2av::makeLayout(d, nGpus, elems, 7);
+      char name[64];
+      snprintf(name, sizeof(name), "%s, %zu elements", a2av::distName(d),
+            elems);
+      ok &= expect(name, test.check(L, QCCL_DataType::Float32));
+    }
+  }
+  for(uint64_t seed = 1; seed <= 4; seed++) {
+    // odd sizes: pieces of 16-byte multiples plus a tail
+    auto L = randomLayout(nGpus, (QCCL_A2AV_PIECE_BYTES * 3 + 6) / 2, seed);
+    char name[64];
+    snprintf(name, sizeof(name), "random counts %lu", seed);
+    ok &= expect(name, test.check(L, QCCL_DataType::Float16));
+  }
+
+  double baseGBs = 0;
+  for(auto d : dists) {
+    auto L = a2av::makeLayout(d, nGpus, maxElems, 7);
+    double bytes = (double)L.crossTotal() * sizeof(float);
+    test.run(L, QCCL_DataType::Float32, 2);
+    double ms = test.run(L, QCCL_DataType::Float32, 10),
+           peerMs = test.run(L, QCCL_DataType::Float32, 10, true),
+           gbs = bytes / (ms * 1e6);
+    if(d == a2av::Dist::Balanced) baseGBs = gbs;
+    size_t maxRecv = 0;
+    for(uint32_t i = 0; i < nGpus; i++) {
+      maxRecv = std::max(maxRecv, L.recvTotal(i));
+    }
+    PRINTZ("%-10s: %.1f Mb moved, max %.1f Mb per receiver; all-to-allv "
+        "%.3f ms (%.2f GB/s, %.2fx of balanced); one item per peer %.3f ms",
+        a2av::distName(d), bytes / (1 << 20), maxRecv * 4.0 / (1 << 20),
+        ms, gbs, gbs / baseGBs, peerMs);
+  }
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
@@ -0,0 +1,191 @@
+
+// g++ -I.. -I../LibraryQCCL -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread qccl_collectives.cc ../LibraryQCCL/qccl_lib.cc ../common/common.cc ../common/host_runtime.cc
+// Checks QCCL collectives (all-reduce, reduce-scatter, all-gather) over the
+// host transport against a CPU reference for all data types, reduction ops
+// and schedules, then compares ring and recursive halving / doubling
+// all-reduce timings over message sizes.
+// Inputs are small integers: sums are exact in every type and in any order,
+// hence results must match the reference bit by bit.
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "common/threading.hpp"
+#include "qccl_lib.h"
+#include "qccl_reduce.hpp"
+
+using namespace qccl_reduce;
+
+size_t typeSize(QCCL_DataType t) {
+  return t == QCCL_DataType::Float32 || t == QCCL_DataType::Int32 ? 4 : 2;
+}
+
+const char *typeName(QCCL_DataType t) {
+  const char *names[] = { "float32", "float16", "bfloat16", "int32" };
+  return names[(uint32_t)t];
+}
+
+// integer value of element i on GPU g
+float value(uint32_t g, size_t i) {
+  return (float)((g * 7 + i * 13) % 17) - 8.0f;
+}
+
+void storeValue(QCCL_DataType t, void *buf, size_t i, float v) {
+  switch(t) {
+  case QCCL_DataType::Float32: ((float *)buf)[i] = v; break;
+  case QCCL_DataType::Float16: ((Half16 *)buf)[i] = toHalf(v); break;
+  case QCCL_DataType::BFloat16: ((BFloat16 *)buf)[i] = toBFloat16(v); break;
+  case QCCL_DataType::Int32: ((int32_t *)buf)[i] = (int32_t)v; break;
+  }
+}
+
+enum class Coll { AllReduce, ReduceScatter, AllGather };
+
+struct CollTest {
+
+  using Bytes = std::vector< uint8_t >;
+
+  CollTest(uint32_t nGpus) : m_nGpus(nGpus), m_send(nGpus), m_recv(nGpus),
+        m_barrier(nGpus), m_pool(nGpus) {
+    CHKQCCL(qcclInit(nGpus, nullptr));
+  }
+
+  // 'count' is the number of elements of the full vector (all-reduce)
+  // or of one block (reduce-scatter, all-gather)
+  bool check(Coll coll, QCCL_DataType t, QCCL_RedOp op, QCCL_Algo algo,
+        size_t count) {
+    const size_t esz = typeSize(t), n = m_nGpus,
+          nSend = coll == Coll::ReduceScatter ? count * n : count,
+          nRecv = coll == Coll::AllReduce ? count :
+                  coll == Coll::ReduceScatter ? count : count * n;
+    for(uint32_t g = 0; g < n; g++) {
+      m_send[g].resize(nSend * esz);
+      m_recv[g].assign(nRecv * esz, 0xAA);
+      for(size_t i = 0; i < nSend; i++) {
+        storeValue(t, m_send[g].data(), i, value(g, i));
+      }
+    }
+    m_pool.runJob([&](int id) {
+      auto s = m_send[id].data();
+      auto r = m_recv[id].data();
+      switch(coll) {
+      case Coll::AllReduce:
+        CHKQCCL(qcclAllReduce(id, s, r, count, t, op, nullptr, algo)); break;
+      case Coll::ReduceScatter:
+        CHKQCCL(qcclReduceScatter(id, s, r, count, t, op, nullptr, algo)); break;
+      case Coll::AllGather:
+        CHKQCCL(qcclAllGather(id, s, r, count, t, nullptr, algo)); break;
+      }
+    });
+    Bytes truth(nRecv * esz);
+    size_t nBad = 0;
+    for(uint32_t g = 0; g < n; g++) {
+      for(size_t i = 0; i < nRecv; i++) {
+        float v;
+        if(coll == Coll::AllGather) {
+          v = value(i / count, i % count);
+        } else {
+          size_t j = coll == Coll::ReduceScatter ? g * count + i : i;
+          v = value(0, j);
+          for(uint32_t k = 1; k < n; k++) {
+            v = op == QCCL_RedOp::Sum ? v + value(k, j) :
+                                        std::max(v, value(k, j));
+          }
+        }
+        storeValue(t, truth.data(), i, v);
+      }
+      nBad += std::memcmp(truth.data(), m_recv[g].data(), truth.size()) != 0;
+    }
+    const char *names[] = { "all-reduce", "reduce-scatter", "all-gather" };
+    if(nBad != 0) {
+      PRINTZ("%s %s %s %s count %zu: FAILED on %zu GPUs", names[(int)coll],
+          typeName(t), op == QCCL_RedOp::Sum ? "sum" : "max",
+          algo == QCCL_Algo::Ring ? "ring" : "halving-doubling", count, nBad);
+    }
+    return nBad == 0;
+  }
+
+  double timeAllReduce(QCCL_Algo algo, size_t count, int nIters) {
+    std::vector< double > ms(m_nGpus);
+    for(uint32_t g = 0; g < m_nGpus; g++) {
+      m_send[g].assign(count * sizeof(float), 0);
+      m_recv[g].resize(count * sizeof(float));
+    }
+    m_pool.runJob([&](int id) {
+      m_barrier.wait(id);
+      auto z1 = std::chrono::high_resolution_clock::now();
+      for(int i = 0; i < nIters; i++) {
+        CHKQCCL(qcclAllReduce(id, m_send[id].data(), m_recv[id].data(), count,
+              QCCL_DataType::Float32, QCCL_RedOp::Sum, nullptr, algo));
+      }
+      std::chrono::duration< double, std::milli > d =
+            std::chrono::high_resolution_clock::now() - z1;
+      ms[id] = d.count() / nIters;
+      m_barrier.wait(id);
+    });
+    double avgMs = 0;
+    for(auto m : ms) avgMs += m / m_nGpus;
+    return avgMs;
+  }
+
+  uint32_t m_nGpus;
+  std::vector< Bytes > m_send, m_recv;
+  Barrier m_barrier;
+  ThreadPool m_pool;
+};
+
+int main(int argc, char **argv) try
+{
+  uint32_t nGpus = argc > 1 ? atoi(argv[1]) : 4;
+  if(nGpus < 2) {
+    ThrowError<>("At least 2 GPUs are required");
+  }
+  CollTest test(nGpus);
+  bool pow2 = (nGpus & (nGpus - 1)) == 0;
+  std::vector< QCCL_Algo > algos{ QCCL_Algo::Ring };
+  if(pow2) algos.push_back(QCCL_Algo::HalvingDoubling);
+
+  bool ok = true;
+  size_t nChecks = 0;
+  for(auto t : { QCCL_DataType::Float32, QCCL_DataType::Float16,
+                 QCCL_DataType::BFloat16, QCCL_DataType::Int32 }) {
+    for(auto op : { QCCL_RedOp::Sum, QCCL_RedOp::Max }) {
+      for(auto algo : algos) {
+        // sizes not divisible by nGpus and smaller than nGpus included
+        for(size_t count : { (size_t)nGpus - 1, (size_t)37, (size_t)100003 }) {
+          ok &= test.check(Coll::AllReduce, t, op, algo, count);
+          ok &= test.check(Coll::ReduceScatter, t, op, algo, count);
+          nChecks += 2;
+        }
+      }
+    }
+    for(auto algo : algos) {
+      for(size_t count : { (size_t)1, (size_t)1025 }) {
+        ok &= test.check(Coll::AllGather, t, QCCL_RedOp::Sum, algo, count);
+        nChecks++;
+      }
+    }
+  }
+  PRINTZ("%zu collective checks on %u GPUs: %s", nChecks, nGpus,
+        ok ? "OK" : "FAILED");
+
+  for(size_t bytes = 16 * 1024; bytes <= 16 * 1024 * 1024; bytes *= 4) {
+    size_t count = bytes / sizeof(float);
+    int nIters = bytes < 1024 * 1024 ? 100 : 5;
+    double ring = test.timeAllReduce(QCCL_Algo::Ring, count, nIters);
+    if(pow2) {
+      double hd = test.timeAllReduce(QCCL_Algo::HalvingDoubling, count, nIters);
+      PRINTZ("all-reduce %.2f Mb: ring %.3f ms; halving-doubling %.3f ms",
+          bytes / (1024.0*1024), ring, hd);
+    } else {
+      PRINTZ("all-reduce %.2f Mb: ring %.3f ms", bytes / (1024.0*1024), ring);
+    }
+  }
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
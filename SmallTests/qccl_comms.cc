@@ -0,0 +1,148 @@
+
+// g++ -I.. -I../LibraryQCCL -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread qccl_comms.cc ../LibraryQCCL/qccl_lib.cc ../common/common.cc ../common/host_runtime.cc
+// Checks QCCL communicators over the host transport: several threads
+// enqueueing the send-recv primitives of one ID at once (the lock-free
+// submission queue), then 1, 2 and 4 communicators over the same GPUs
+// running all-reduce concurrently: results are verified and the aggregate
+// throughput is compared against a single communicator.
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "common/threading.hpp"
+#include "qccl_lib.h"
+#include "SmallTests/test_utils.hpp"
+
+// all-to-all where the items of each ID are enqueued by 'nProducers' threads
+bool multiProducer(uint32_t nGpus, uint32_t nProducers, size_t size,
+      int nRounds) {
+  QcclComm *comm;
+  CHKQCCL(qcclCommInit(&comm, nGpus, nullptr));
+  std::vector< std::vector< uint8_t > > send(nGpus), recv(nGpus);
+  for(uint32_t i = 0; i < nGpus; i++) {
+    send[i].resize(size * nGpus);
+    for(size_t j = 0; j < send[i].size(); j++) {
+      send[i][j] = (uint8_t)(i * 31 + j / size * 7 + j);
+    }
+  }
+  ThreadPool pool(nGpus);
+  bool ok = true;
+  for(int r = 0; r < nRounds && ok; r++) {
+    for(auto& v : recv) v.assign(size * nGpus, 0);
+    pool.runJob([&](int id) {
+      std::vector< std::thread > producers;
+      for(uint32_t p = 0; p < nProducers; p++) {
+        producers.emplace_back([&, p] {
+          for(uint32_t i = p; i < nGpus; i += nProducers) {
+            CHKQCCL(qcclSendRecv(comm, id, 1, i, recv[id].data() + i*size,
+                  size, i, send[id].data() + i*size, size));
+          }
+        });
+      }
+      for(auto& t : producers) t.join();
+      CHKQCCL(qcclRun(comm, id, nullptr));
+    });
+    for(uint32_t i = 0; i < nGpus && ok; i++) {
+      for(uint32_t j = 0; j < nGpus && ok; j++) {
+        // block j of GPU i comes from block i of GPU j
+        ok = memcmp(recv[i].data() + j*size, send[j].data() + i*size,
+              size) == 0;
+      }
+    }
+  }
+  CHKQCCL(qcclCommDestroy(comm));
+  return ok;
+}
+
+// 'nComms' communicators over the same 'nGpus' GPUs, each running 'nRounds'
+// all-reduce of 'count' floats: returns the aggregate GB/s of the inputs
+double concurrentAllReduce(uint32_t nComms, uint32_t nGpus, size_t count,
+      int nRounds, bool *ok) {
+  const uint32_t nThreads = nComms * nGpus;
+  std::vector< QcclComm * > comms(nComms);
+  for(auto& c : comms) {
+    CHKQCCL(qcclCommInit(&c, nGpus, nullptr));
+  }
+  std::vector< std::vector< float > > send(nThreads), recv(nThreads);
+  for(uint32_t t = 0; t < nThreads; t++) {
+    send[t].resize(count);
+    recv[t].resize(count);
+    for(size_t i = 0; i < count; i++) {
+      // communicator c sums c + 1 times the GPU ID
+      send[t][i] = (float)((t / nGpus + 1) * (t % nGpus) + i % 5);
+    }
+  }
+  Barrier barrier(nThreads);
+  ThreadPool pool(nThreads);
+  std::vector< double > ms(nThreads);
+  pool.runJob([&](int t) {
+    auto comm = comms[t / nGpus];
+    uint32_t id = t % nGpus;
+    // warm-up: exchange buffers and temporaries
+    CHKQCCL(qcclAllReduce(comm, id, send[t].data(), recv[t].data(), count,
+          QCCL_DataType::Float32, QCCL_RedOp::Sum, nullptr));
+    barrier.wait(t);
+    auto z1 = std::chrono::high_resolution_clock::now();
+    for(int r = 0; r < nRounds; r++) {
+      CHKQCCL(qcclAllReduce(comm, id, send[t].data(), recv[t].data(), count,
+            QCCL_DataType::Float32, QCCL_RedOp::Sum, nullptr));
+    }
+    std::chrono::duration< double, std::milli > d =
+          std::chrono::high_resolution_clock::now() - z1;
+    ms[t] = d.count();
+    barrier.wait(t);
+  });
+  for(uint32_t t = 0; t < nThreads && *ok; t++) {
+    float n = nGpus, c = t / nGpus + 1;
+    for(size_t i = 0; i < count; i++) {
+      float expected = c * n * (n - 1) / 2 + n * (i % 5);
+      if(recv[t][i] != expected) {
+        PRINTZ("communicator %u GPU %u: element %zu = %f, expected %f",
+              t / nGpus, t % nGpus, i, recv[t][i], expected);
+        *ok = false;
+        break;
+      }
+    }
+  }
+  for(auto c : comms) {
+    CHKQCCL(qcclCommDestroy(c));
+  }
+  double maxMs = 0;
+  for(auto m : ms) maxMs = std::max(maxMs, m);
+  return (double)nComms * nRounds * count * sizeof(float) / (maxMs * 1e6);
+}
+
+int main(int argc, char **argv) try
+{
+  uint32_t nGpus = argc > 1 ? atoi(argv[1]) : 4;
+  if(nGpus < 2) {
+    ThrowError<>("At least 2 GPUs are required");
+  }
+  bool ok = true;
+  ok &= expect("multiple producers per ID", multiProducer(nGpus, 4, 4096, 20));
+  ok &= expect("multiple producers, large items",
+        multiProducer(nGpus, 3, 1 << 20, 3));
+
+  const size_t count = 1 << 20;
+  const int nRounds = 20;
+  double base = 0;
+  for(uint32_t nComms = 1; nComms <= 4; nComms *= 2) {
+    bool good = true;
+    double gbs = concurrentAllReduce(nComms, nGpus, count, nRounds, &good);
+    if(nComms == 1) base = gbs;
+    PRINTZ("%u communicator(s) x %u GPUs, all-reduce of %zu Kb: aggregate "
+        "%.2f GB/s (%.2fx of one communicator)", nComms, nGpus,
+        count * sizeof(float) / 1024, gbs, gbs / base);
+    char name[64];
+    snprintf(name, sizeof(name), "%u concurrent communicator(s)", nComms);
+    ok &= expect(name, good);
+  }
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
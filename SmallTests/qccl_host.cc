@@ -0,0 +1,336 @@
+
+// g++ -I.. -I../LibraryQCCL -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread qccl_host.cc ../LibraryQCCL/qccl_lib.cc ../common/common.cc ../common/host_runtime.cc
+// Runs QCCL over the host transport (LibraryQCCL/host_transport.hpp):
+// every "GPU" is a thread of the pool. Checks all-to-all and pairwise
+// exchange with one gateway peer (via qcclRun and persistent plans) and a
+// relay chain 0 -> 2 -> 1 (store-and-forward vs chunked pipelining) and
+// all-to-all over registered buffers, reports the bandwidth as 
+// RCCL/test_main.cc does and measures the per-call host overhead of qcclRun
+// vs qcclPlanExecute and the all-to-all latency with the pointer handshake
+// vs registered buffers (as the USE_REGISTERED_BUFFERS loop of the RCCL
+// harness does).
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "common/threading.hpp"
+#include "qccl_lib.h"
+
+using T = uint32_t;
+
+T getElement(int device, size_t idx) {
+  uint32_t ii = idx + 1;
+  return static_cast< T >((device + 11111) ^ (ii*ii*ii));
+}
+
+struct HostTest {
+
+  HostTest(uint32_t nGpus, size_t maxElems) : m_nGpus(nGpus),
+        m_send(nGpus), m_recv(nGpus), m_barrier(nGpus), m_pool(nGpus) {
+    CHKQCCL(qcclInit(nGpus, nullptr));
+    for(uint32_t i = 0; i < nGpus; i++) {
+      m_send[i].resize(maxElems);
+      m_recv[i].resize(maxElems);
+      for(size_t j = 0; j < maxElems; j++) {
+        m_send[i][j] = getElement(i, j);
+      }
+    }
+  }
+
+  // every GPU sends its ith chunk to GPU i
+  void allToAll(int id, size_t nElems, bool run = true) {
+    size_t size = nElems / m_nGpus * sizeof(T), ofs = 0;
+    auto recvBuf = (uint8_t *)m_recv[id].data(),
+         sendBuf = (uint8_t *)m_send[id].data();
+    for(uint32_t i = 0; i < m_nGpus; i++, ofs += size) {
+      CHKQCCL(qcclSendRecv(id, 1, i, recvBuf + ofs, size,
+            i, sendBuf + ofs, size));
+    }
+    if(run) CHKQCCL(qcclRun(id, nullptr));
+  }
+
+  // registers (or deregisters) the receive chunks of allToAll(nElems)
+  void registerAllToAll(int id, size_t nElems, bool enable) {
+    size_t size = nElems / m_nGpus * sizeof(T);
+    auto recvBuf = (uint8_t *)m_recv[id].data();
+    for(uint32_t i = 0; i < m_nGpus; i++) {
+      if(i == (uint32_t)id) continue;
+      CHKQCCL(enable ? qcclRegisterBuffer(id, i, recvBuf + i*size, size) :
+                       qcclDeregisterBuffer(id, i));
+    }
+  }
+
+  // every GPU sends to itself: no waiting for peers
+  void selfCopy(int id, size_t nElems, bool run = true) {
+    size_t size = nElems * sizeof(T);
+    CHKQCCL(qcclSendRecv(id, 1, id, m_recv[id].data(), size,
+            id, m_send[id].data(), size));
+    if(run) CHKQCCL(qcclRun(id, nullptr));
+  }
+
+  // pairs of GPUs (2k, 2k+1) exchange data: the tail of the buffer goes 
+  // via the gateway GPU i+2 (gateways need a bidirectional link)
+  void exchange(int id, size_t nElems, bool run = true) {
+    uint32_t peer = id ^ 1;
+    size_t total = nElems * sizeof(T), direct = (total * 7 / 10) & ~15;
+    CHKQCCL(qcclSendRecv(id, 2, peer, m_recv[id].data(), direct,
+          peer, m_send[id].data(), direct));
+    // this node forwards from (id - 2) to its pair
+    uint32_t start = (id + m_nGpus - 2) % m_nGpus;
+    CHKQCCL(qcclGatewaySend(id, 2, start, start ^ 1, direct, total - direct));
+    if(run) CHKQCCL(qcclRun(id, nullptr));
+  }
+
+  // GPU 0 sends to GPU 1 through GPU 2: either GPU 2 receives the whole 
+  // message before forwarding it (two rounds) or it relays chunk by chunk
+  // via a ring of 'ringBytes'
+  void relay(int id, size_t nElems, size_t ringBytes) {
+    size_t size = nElems * sizeof(T);
+    if(id == 0) {
+      CHKQCCL(qcclSendRecv(0, 1, 0, nullptr, 0, 2, m_send[0].data(), size));
+    } else if(id == 1) {
+      CHKQCCL(qcclSendRecv(1, 1, 2, m_recv[1].data(), size, 1, nullptr, 0));
+    } else if(id == 2 && ringBytes == 0) {
+      CHKQCCL(qcclSendRecv(2, 1, 0, m_recv[2].data(), size, 2, nullptr, 0));
+      CHKQCCL(qcclRun(2, nullptr));
+      CHKQCCL(qcclSendRecv(2, 1, 2, nullptr, 0, 1, m_recv[2].data(), size));
+    } else if(id == 2) {
+      m_stage.resize(ringBytes / sizeof(T));
+      CHKQCCL(qcclRelaySend(2, 0, 1, m_stage.data(), ringBytes, size));
+    }
+    CHKQCCL(qcclRun(id, nullptr));
+  }
+
+  // the same as allToAll or exchange but replayed from a plan
+  template < class F >
+  void createPlans(F&& enqueue, size_t nElems) {
+    m_plans.resize(m_nGpus);
+    m_pool.runJob([&](int id) {
+      enqueue(id, nElems, false);
+      CHKQCCL(qcclPlanCreate(id, &m_plans[id]));
+    });
+  }
+
+  void destroyPlans() {
+    for(auto p : m_plans) CHKQCCL(qcclPlanDestroy(p));
+    m_plans.clear();
+  }
+
+  // NOTE: a gateway does not wait for its receiver, so it could subscribe
+  // to the next round before the direct sender finished the current one:
+  // 'syncIters' separates iterations by a barrier
+  template < class F >
+  double run(const char *name, size_t nElems, int nIters, F&& op,
+        bool syncIters = false) {
+    std::vector< double > ms(m_nGpus);
+    m_pool.runJob([&](int id) {
+      m_barrier.wait(id);
+      auto z1 = std::chrono::high_resolution_clock::now();
+      for(int i = 0; i < nIters; i++) {
+        op(id, nElems);
+        if(syncIters) m_barrier.wait();
+      }
+      std::chrono::duration< double, std::milli > d =
+            std::chrono::high_resolution_clock::now() - z1;
+      ms[id] = d.count() / nIters;
+      m_barrier.wait(id);
+    });
+    double avgMs = 0;
+    for(auto m : ms) avgMs += m / m_nGpus;
+    double bytes = nElems * sizeof(T);
+    PRINTZ("%s: data size: %.2f Mb; time elapsed: %.3f ms, bandwidth: %.3f Gb/s",
+        name, bytes / (1024*1024), avgMs, bytes / 1.0E6 / avgMs);
+    return avgMs;
+  }
+
+  bool verifyRelay(const char *name, size_t nElems) {
+    size_t nBad = 0;
+    for(size_t j = 0; j < nElems; j++) {
+      nBad += m_recv[1][j] != getElement(0, j);
+    }
+    PRINTZ("%s verify %zu elems: %s (%zu mismatches)", name, nElems,
+          nBad == 0 ? "OK" : "FAILED", nBad);
+    return nBad == 0;
+  }
+
+  bool verify(const char *name, size_t nElems, bool allToAll) {
+    size_t nBad = 0;
+    for(uint32_t id = 0; id < m_nGpus; id++) {
+      size_t chunk = nElems / m_nGpus, n = allToAll ? chunk * m_nGpus : nElems;
+      uint32_t in = id ^ 1;
+      for(size_t j = 0; j < n; j++) {
+        auto truth = allToAll ? getElement(j / chunk, id*chunk + j % chunk) :
+                                getElement(in, j);
+        nBad += m_recv[id][j] != truth;
+      }
+    }
+    PRINTZ("%s verify %zu elems: %s (%zu mismatches)", name, nElems,
+          nBad == 0 ? "OK" : "FAILED", nBad);
+    return nBad == 0;
+  }
+
+  void clear() {
+    for(auto& r : m_recv) std::fill(r.begin(), r.end(), 0xAAAAAAAAu);
+  }
+
+  uint32_t m_nGpus;
+  std::vector< std::vector< T > > m_send, m_recv;
+  std::vector< T > m_stage;           // relay ring
+  std::vector< QcclPlan * > m_plans;
+  Barrier m_barrier;
+  ThreadPool m_pool;
+};
+
+int main(int argc, char **argv) try
+{
+  uint32_t nGpus = argc > 1 ? atoi(argv[1]) : 4;
+  if(nGpus < 4 || nGpus % 2 != 0) {
+    ThrowError<>("The number of GPUs must be even and at least 4");
+  }
+  size_t elemsMin = 1024*1024, elemsMax = 1024*1024*8;
+  HostTest test(nGpus, elemsMax);
+  auto a2a = [&](int id, size_t n) { test.allToAll(id, n); };
+  auto pairs = [&](int id, size_t n) { test.exchange(id, n); };
+
+  // NOTE: slot counters persist between runs, hence a link shared by 2 peers
+  // must not be used by a single peer before: run pairs+gateway first
+  bool ok = true;
+  for(size_t n : {(size_t)4096*nGpus, elemsMin + 4*nGpus, elemsMax}) {
+    test.clear();
+    test.run("pairs+gateway", n, 1, pairs);
+    ok &= test.verify("pairs+gateway", n, false);
+  }
+  for(size_t sz = elemsMin; sz <= elemsMax; sz *= 2) {
+    test.run("pairs+gateway", sz, 10, pairs, true);
+  }
+  auto planRun = [&](int id, size_t) { 
+    CHKQCCL(qcclPlanExecute(test.m_plans[id], nullptr)); 
+  };
+  size_t n = elemsMin + 4*nGpus;
+  test.createPlans([&](int id, size_t n, bool) { test.exchange(id, n, false); }, n);
+  for(int i = 0; i < 3; i++) {
+    test.clear();
+    test.run("plan pairs+gateway", n, 1, planRun);
+    ok &= test.verify("plan pairs+gateway", n, false);
+  }
+  // plan rounds are synchronized: no barrier between iterations is needed
+  test.run("plan pairs+gateway", n, 20, planRun);
+  test.destroyPlans();
+  for(size_t n : {(size_t)4096*nGpus, elemsMin + 4*nGpus, elemsMax}) {
+    test.clear();
+    test.run("all-to-all", n, 1, a2a);
+    ok &= test.verify("all-to-all", n, true);
+  }
+  for(size_t sz = elemsMin; sz <= elemsMax; sz *= 2) {
+    test.run("all-to-all", sz, 10, a2a);
+  }
+
+  test.createPlans([&](int id, size_t n, bool) { test.allToAll(id, n, false); }, n);
+  for(int i = 0; i < 3; i++) {
+    test.clear();
+    test.run("plan all-to-all", n, 1, planRun);
+    ok &= test.verify("plan all-to-all", n, true);
+  }
+  test.destroyPlans();
+
+  // relay chain: links are used by a single peer, as in all-to-all
+  const size_t ringBytes = 4 * QCCL_CHUNK_BYTES;
+  auto storeFwd = [&](int id, size_t n) { test.relay(id, n, 0); };
+  auto pipelined = [&](int id, size_t n) { test.relay(id, n, ringBytes); };
+  for(size_t n : {(size_t)4096, elemsMin + 4*nGpus, elemsMax}) {
+    test.clear();
+    test.run("relay store-and-forward", n, 1, storeFwd);
+    ok &= test.verifyRelay("relay store-and-forward", n);
+    test.clear();
+    test.run("relay pipelined", n, 1, pipelined);
+    ok &= test.verifyRelay("relay pipelined", n);
+  }
+  // one iteration ends when GPU 1 has the data: hence no barrier is needed
+  auto sfMs = test.run("relay store-and-forward", elemsMax, 10, storeFwd),
+       pipeMs = test.run("relay pipelined", elemsMax, 10, pipelined);
+  PRINTZ("relay latency (%zu bytes, ring of %zu chunks): store-and-forward %.3f ms; "
+        "pipelined %.3f ms", elemsMax * sizeof(T), ringBytes / QCCL_CHUNK_BYTES,
+        sfMs, pipeMs);
+
+  // per-call host overhead for tiny messages: with and without peers
+  const int nCalls = 2000;
+  size_t tiny = 64 * nGpus;
+  auto self = [&](int id, size_t n) { test.selfCopy(id, n); };
+  auto runMs = test.run("run self", tiny, nCalls, self);
+  test.createPlans([&](int id, size_t n, bool) { test.selfCopy(id, n, false); }, tiny);
+  auto planMs = test.run("plan self", tiny, nCalls, planRun);
+  test.destroyPlans();
+  PRINTZ("per-call overhead self (%zu bytes): qcclRun %.3f us; qcclPlanExecute %.3f us",
+        tiny * sizeof(T), runMs * 1e3, planMs * 1e3);
+
+  runMs = test.run("run all-to-all", tiny, nCalls, a2a);
+  test.createPlans([&](int id, size_t n, bool) { test.allToAll(id, n, false); }, tiny);
+  planMs = test.run("plan all-to-all", tiny, nCalls, planRun);
+  test.destroyPlans();
+  PRINTZ("per-call overhead all-to-all (%zu bytes): qcclRun %.3f us; qcclPlanExecute %.3f us",
+        tiny * sizeof(T), runMs * 1e3, planMs * 1e3);
+
+  // registered buffers: chunk addresses change with the size, hence the
+  // buffers are registered again (and plans made before are invalidated)
+  auto regAll = [&](size_t n, bool enable) {
+    test.m_pool.runJob([&](int id) { test.registerAllToAll(id, n, enable); });
+  };
+  for(size_t n : {(size_t)4096*nGpus, elemsMin + 4*nGpus, elemsMax}) {
+    regAll(n, true);
+    for(int i = 0; i < 2; i++) {
+      test.clear();
+      test.run("registered all-to-all", n, 1, a2a);
+      ok &= test.verify("registered all-to-all", n, true);
+    }
+    regAll(n, false);
+  }
+  // the USE_REGISTERED_BUFFERS loop of RCCL/test_main.cc: all-to-all
+  // latency with the per-call pointer exchange vs registered buffers,
+  // interleaved and best of 5
+  for(size_t sz = 1024; sz <= 64*1024; sz *= 4) {
+    double hsMs = 1e30, regMs = 1e30;
+    for(int i = 0; i < 5; i++) {
+      hsMs = std::min(hsMs, test.run("all-to-all", sz, nCalls / 4, a2a));
+      regAll(sz, true);
+      regMs = std::min(regMs, test.run("registered all-to-all", sz,
+            nCalls / 4, a2a));
+      regAll(sz, false);
+    }
+    PRINTZ("Data size: %.2f Kb; latency: %.2f us; registered buffers: "
+          "%.2f us (%.1f%% less)", sz * sizeof(T) / 1024.0, hsMs * 1e3,
+          regMs * 1e3, (1 - regMs / hsMs) * 100);
+  }
+  regAll(tiny, true);
+  auto regMs = test.run("registered all-to-all", tiny, nCalls, a2a);
+  test.createPlans([&](int id, size_t n, bool) { test.allToAll(id, n, false); }, tiny);
+  auto regPlanMs = test.run("plan registered all-to-all", tiny, nCalls, planRun);
+  PRINTZ("all-to-all latency (%zu bytes): handshake %.3f us; registered %.3f us; "
+        "registered plan %.3f us", tiny * sizeof(T), runMs * 1e3, regMs * 1e3,
+        regPlanMs * 1e3);
+  { // receiving elsewhere on a registered link is refused, and so is a plan
+    // whose links were deregistered since
+    bool refused = qcclSendRecv(0, 1, 1, test.m_send[0].data(), 64, 0, 
+          nullptr, 0) == QCCL_Result::InvalidParams;
+    CHKQCCL(qcclDeregisterBuffer(1, 0));
+    refused &= qcclPlanExecute(test.m_plans[1], nullptr) == 
+          QCCL_Result::InvalidParams;
+    CHKQCCL(qcclRegisterBuffer(1, 0, (uint8_t *)test.m_recv[1].data(), 
+          tiny / nGpus * sizeof(T)));
+    test.clear();
+    test.run("plan registered all-to-all", tiny, 1, planRun);
+    refused &= test.verify("plan re-registered all-to-all", tiny, true);
+    PRINTZ("registered buffer checks: %s", refused ? "OK" : "FAILED");
+    ok &= refused;
+  }
+  test.destroyPlans();
+  regAll(tiny, false);
+
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
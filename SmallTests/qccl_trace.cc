@@ -0,0 +1,160 @@
+
+// g++ -I.. -I../LibraryQCCL -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread qccl_trace.cc ../LibraryQCCL/qccl_lib.cc ../common/common.cc ../common/host_runtime.cc
+// Checks QCCL timeline tracing (LibraryQCCL/qccl_trace.hpp) over the host
+// transport: event counts of all-to-all rounds, the Chrome trace export, ring
+// overflow keeping the newest events, prints per-phase statistics and
+// measures the tracing overhead per qcclRun. Build with -DQCCL_TRACE_PHASES=1
+// to check per-phase events instead of one event per work item.
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "common/threading.hpp"
+#include "qccl_lib.h"
+#include "SmallTests/test_utils.hpp"
+
+struct TraceTest {
+
+  TraceTest(uint32_t nGpus, size_t maxBytes) : m_nGpus(nGpus),
+        m_send(nGpus), m_recv(nGpus), m_barrier(nGpus), m_pool(nGpus) {
+    CHKQCCL(qcclInit(nGpus, nullptr));
+    for(uint32_t i = 0; i < nGpus; i++) {
+      m_send[i].assign(maxBytes, (uint8_t)i);
+      m_recv[i].resize(maxBytes);
+    }
+  }
+
+  // 'nRounds' all-to-all exchanges of 'bytes' per GPU; returns ms per round
+  double allToAll(size_t bytes, int nRounds) {
+    std::vector< double > ms(m_nGpus);
+    m_pool.runJob([&](int id) {
+      size_t size = bytes / m_nGpus & ~15;
+      auto recvBuf = m_recv[id].data(), sendBuf = m_send[id].data();
+      m_barrier.wait(id);
+      auto z1 = std::chrono::high_resolution_clock::now();
+      for(int r = 0; r < nRounds; r++) {
+        for(uint32_t i = 0; i < m_nGpus; i++) {
+          CHKQCCL(qcclSendRecv(id, 1, i, recvBuf + i*size, size,
+                i, sendBuf + i*size, size));
+        }
+        CHKQCCL(qcclRun(id, nullptr));
+      }
+      std::chrono::duration< double, std::milli > d =
+            std::chrono::high_resolution_clock::now() - z1;
+      ms[id] = d.count() / nRounds;
+      m_barrier.wait(id);
+    });
+    double avgMs = 0;
+    for(auto m : ms) avgMs += m / m_nGpus;
+    return avgMs;
+  }
+
+  uint32_t m_nGpus;
+  std::vector< std::vector< uint8_t > > m_send, m_recv;
+  Barrier m_barrier;
+  ThreadPool m_pool;
+};
+
+uint64_t totalEvents(const QCCL_PhaseStats *stats) {
+  uint64_t n = 0;
+  for(uint32_t p = 0; p < (uint32_t)QCCL_Phase::Count; p++) {
+    n += stats[p].count;
+  }
+  return n;
+}
+
+size_t countOccurrences(const std::string& s, const char *what) {
+  size_t n = 0;
+  for(auto pos = s.find(what); pos != std::string::npos;
+        pos = s.find(what, pos + 1)) n++;
+  return n;
+}
+
+int main(int argc, char **argv) try
+{
+  uint32_t nGpus = argc > 1 ? atoi(argv[1]) : 4;
+  if(nGpus < 2) {
+    ThrowError<>("At least 2 GPUs are required");
+  }
+  const size_t maxBytes = 16 << 20;
+  TraceTest test(nGpus, maxBytes);
+  QCCL_PhaseStats stats[(uint32_t)QCCL_Phase::Count];
+  const char *path = "qccl_trace_test.json";
+  bool ok = true;
+
+  // host transport: InPtrs, OutPtrs, MainLoop and Finalize per work item,
+  // or a single Item event
+  const uint32_t eventsPerItem = QCCL_TRACE_PHASES ? 4 : 1, nRounds = 5;
+  const auto copyPhase = QCCL_TRACE_PHASES ? QCCL_Phase::MainLoop :
+        QCCL_Phase::Item;
+  { // all events fit: every round of every work item is there
+    CHKQCCL(qcclTraceEnable(1024));
+    test.allToAll(1 << 20, nRounds);
+    CHKQCCL(qcclTraceStats(stats));
+    uint64_t expected = (uint64_t)nGpus * nGpus * nRounds;
+    ok &= expect("event counts", totalEvents(stats) == expected * eventsPerItem
+          && stats[(uint32_t)copyPhase].count == expected &&
+          stats[(uint32_t)QCCL_Phase::TailCopy].count == 0);
+    CHKQCCL(qcclTraceExport(path));
+    std::ifstream ifs(path);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    std::string json = ss.str();
+    std::remove(path);
+    ok &= expect("chrome export", json.rfind("{\"displayTimeUnit\"", 0) == 0 &&
+          countOccurrences(json, "\"ph\":\"X\"") == expected * eventsPerItem &&
+          countOccurrences(json, "\"ph\":\"M\"") == nGpus &&
+          countOccurrences(json, "\"round\":4,") == nGpus * nGpus *
+                  eventsPerItem);
+  }
+  { // the ring keeps only its capacity (rounded up to a power of two)
+    CHKQCCL(qcclTraceEnable(6));
+    test.allToAll(1 << 20, nRounds);
+    CHKQCCL(qcclTraceStats(stats));
+    ok &= expect("ring overflow", totalEvents(stats) == 8ull * nGpus);
+    CHKQCCL(qcclTraceClear());
+    CHKQCCL(qcclTraceStats(stats));
+    ok &= expect("trace clear", totalEvents(stats) == 0);
+  }
+  { // latency distribution of the phases for larger messages
+    CHKQCCL(qcclTraceEnable(1 << 16));
+    test.allToAll(maxBytes, 20);
+    CHKQCCL(qcclTraceStats(stats));
+    for(uint32_t p = 0; p < (uint32_t)QCCL_Phase::Count; p++) {
+      const auto& s = stats[p];
+      if(s.count == 0) continue;
+      char hist[QCCL_TRACE_BUCKETS * 8] = {}, *ph = hist;
+      for(uint32_t b = 0; b < QCCL_TRACE_BUCKETS; b++) {
+        if(s.buckets[b] == 0) continue;
+        ph += sprintf(ph, " <%u:%lu", 1u << b, s.buckets[b]);
+      }
+      PRINTZ("%-8s %6lu events: min %8.1f us; p50 %8.1f us; p99 %8.1f us; "
+          "max %8.1f us; buckets (us:count)%s",
+          p == 0 ? "InPtrs" : p == 1 ? "OutPtrs" : p == 2 ? "MainLoop" :
+          p == 3 ? "TailCopy" : p == 4 ? "Finalize" : "Item", s.count,
+          s.minUs, s.p50Us, s.p99Us, s.maxUs, hist);
+    }
+  }
+  { // overhead: small messages where the per-call cost shows
+    CHKQCCL(qcclTraceEnable(0));
+    double off = 1e30, on = 1e30;
+    for(int i = 0; i < 7; i++) { // interleaved: the best of each counts
+      CHKQCCL(qcclTraceEnable(0));
+      off = std::min(off, test.allToAll(4096, 2000));
+      CHKQCCL(qcclTraceEnable(1 << 16));
+      on = std::min(on, test.allToAll(4096, 2000));
+    }
+    CHKQCCL(qcclTraceEnable(0));
+    PRINTZ("all-to-all of 4 Kb: %.2f us per round without tracing, %.2f us "
+        "with tracing (%+.1f%%)", off * 1e3, on * 1e3, (on / off - 1) * 100);
+  }
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
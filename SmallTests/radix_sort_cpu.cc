@@ -0,0 +1,187 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread radix_sort_cpu.cc ../common/common.cc ../common/host_runtime.cc
+// Checks the host radix sort (RadixSort/radix_sort_cpu.hpp) against
+// std::stable_sort for all key types, both orders, bit ranges, key-value
+// pairs and skewed inputs, and compares its speed with std::sort.
+
+#include <cmath>
+#include <thread>
+
+#include "common/common_utils.hpp"
+#include "common/float16.hpp"
+#include "common/random.hpp"
+#include "RadixSort/radix_sort_cpu.hpp"
+
+using fp16::Half16;
+
+template < class KeyT >
+auto toValue(const KeyT& k) {
+  if constexpr(std::is_same_v< KeyT, Half16 >) return fp16::toFloat(k);
+  else return k;
+}
+
+// the bits of 'k' as an unsigned number with its sign bit cleared
+template < class KeyT >
+uint64_t magnitude(const KeyT& k) {
+  uint64_t u = 0;
+  std::memcpy(&u, &k, sizeof(KeyT));
+  return u & ((1ull << (sizeof(KeyT) * 8 - 1)) - 1);
+}
+
+// ascending order of full-width keys by value. Floats which compare equal
+// or unordered keep the order of their bit patterns: -0 comes before +0,
+// NaNs with the sign bit set come before -inf and the others after +inf,
+// and the larger the payload the further a NaN is from zero
+template < class KeyT >
+bool valueLess(const KeyT& a, const KeyT& b) {
+  auto x = toValue(a), y = toValue(b);
+  if constexpr(std::is_integral_v< KeyT >) {
+    return x < y;
+  } else {
+    // -1: negative NaN, 0: a number, 1: positive NaN
+    auto cls = [](auto v) { 
+      return std::isnan(v) ? (std::signbit(v) ? -1 : 1) : 0; 
+    };
+    int cx = cls(x), cy = cls(y);
+    if(cx != cy) return cx < cy;
+    if(cx == 0) {
+      return x < y || (x == y && std::signbit(x) && !std::signbit(y));
+    }
+    return cx > 0 ? magnitude(a) < magnitude(b) : magnitude(a) > magnitude(b);
+  }
+}
+
+// a partial bit range [begin_bit, end_bit) sorts by the bits of the key 
+// mapped to an unsigned number of the same order: the sign bit of signed
+// integers is flipped, negative floats have all bits flipped, the others
+// only their sign bit
+template < class KeyT >
+uint64_t rangeKey(const KeyT& k, int begin_bit, int end_bit) {
+  const uint64_t sign = 1ull << (sizeof(KeyT) * 8 - 1), 
+                 all = sign | (sign - 1);
+  uint64_t u = 0;
+  std::memcpy(&u, &k, sizeof(KeyT));
+  if constexpr(std::is_integral_v< KeyT >) {
+    if(std::is_signed_v< KeyT >) u ^= sign;
+  } else {
+    u = u & sign ? ~u & all : u | sign;
+  }
+  u >>= begin_bit;
+  int nbits = end_bit - begin_bit;
+  return nbits >= 64 ? u : u & ((1ull << nbits) - 1);
+}
+
+template < class KeyT >
+bool test_sort(ThreadPool& pool, const char *name, size_t n, bool descending,
+      int skew, int begin_bit = 0, int end_bit = sizeof(KeyT) * 8) {
+
+  std::vector< KeyT > keys(n), out(n), truth(n);
+  std::vector< uint32_t > vals(n), vout(n), vtruth(n);
+  RandomBits(&pool, keys.data(), n, n + skew);
+  if(skew > 0) {
+    // Zipf-like: a third of keys equal, another third from 16 values
+    PhiloxStream s(skew);
+    for(size_t i = 0; i < n; i++) {
+      auto r = s.next() % 3;
+      if(r == 0) keys[i] = keys[0];
+      else if(r == 1) keys[i] = keys[1 + s.next() % 16];
+    }
+  }
+  for(size_t i = 0; i < n; i++) vals[i] = i;
+
+  // reference: stable sort of indices by value (or by the bit range),
+  // descending order swaps the arguments hence equal keys stay stable
+  std::vector< uint32_t > idx(vals);
+  bool full = begin_bit == 0 && end_bit == (int)sizeof(KeyT) * 8;
+  auto less = [&](uint32_t a, uint32_t b) {
+    if(full) return valueLess(keys[a], keys[b]);
+    return rangeKey(keys[a], begin_bit, end_bit) < 
+           rangeKey(keys[b], begin_bit, end_bit);
+  };
+  std::stable_sort(idx.begin(), idx.end(), [&](uint32_t a, uint32_t b) {
+    return descending ? less(b, a) : less(a, b);
+  });
+  for(size_t i = 0; i < n; i++) {
+    truth[i] = keys[idx[i]], vtruth[i] = idx[i];
+  }
+
+  size_t temp_bytes = 0;
+  CHK(CpuSortPairs< KeyT >(pool, nullptr, temp_bytes, keys.data(), out.data(),
+        vals.data(), vout.data(), n, descending, begin_bit, end_bit));
+  std::vector< uint8_t > temp(temp_bytes);
+  CHK(CpuSortPairs< KeyT >(pool, temp.data(), temp_bytes, keys.data(),
+        out.data(), vals.data(), vout.data(), n, descending, begin_bit, end_bit));
+  bool ok = std::memcmp(out.data(), truth.data(), n * sizeof(KeyT)) == 0 &&
+            vout == vtruth;
+
+  std::fill(out.begin(), out.end(), KeyT{});
+  CHK(CpuSortKeys< KeyT >(pool, nullptr, temp_bytes, keys.data(), out.data(),
+        n, descending, begin_bit, end_bit));
+  temp.resize(temp_bytes);
+  CHK(CpuSortKeys< KeyT >(pool, temp.data(), temp_bytes, keys.data(),
+        out.data(), n, descending, begin_bit, end_bit));
+  ok &= std::memcmp(out.data(), truth.data(), n * sizeof(KeyT)) == 0;
+
+  PRINTZ("%-8s n = %-8zu %s skew: %d bits [%d; %d): %s", name, n,
+        descending ? "desc" : "asc ", skew, begin_bit, end_bit,
+        ok ? "OK" : "FAILED");
+  return ok;
+}
+
+template < class KeyT >
+bool test_type(ThreadPool& pool, const char *name) {
+  bool ok = true;
+  for(size_t n : {0, 1, 100, 5000, 300000}) {
+    for(bool desc : {false, true}) {
+      ok &= test_sort< KeyT >(pool, name, n, desc, 0);
+      if(n >= 5000) ok &= test_sort< KeyT >(pool, name, n, desc, 7);
+    }
+  }
+  ok &= test_sort< KeyT >(pool, name, 200000, false, 0, 3, sizeof(KeyT) * 6);
+  ok &= test_sort< KeyT >(pool, name, 200000, true, 5, 0, 5);
+  return ok;
+}
+
+template < class KeyT >
+void benchmark(ThreadPool& pool, const char *name, size_t n, int skew) {
+  std::vector< KeyT > keys(n), out(n);
+  RandomBits(&pool, keys.data(), n, 111);
+  if(skew > 0) {
+    for(size_t i = 0; i < n; i += 2) keys[i] = keys[1];
+  }
+  size_t temp_bytes = 0;
+  CHK(CpuSortKeys< KeyT >(pool, nullptr, temp_bytes, keys.data(), out.data(),
+        n, false));
+  std::vector< uint8_t > temp(temp_bytes);
+  CPU_BEGIN_TIMING(RADIX);
+  CHK(CpuSortKeys< KeyT >(pool, temp.data(), temp_bytes, keys.data(),
+        out.data(), n, false));
+  CPU_END_TIMING(RADIX, 1, "CpuSortKeys<%s> %zu keys skew %d", name, n, skew);
+  out = keys;
+  CPU_BEGIN_TIMING(STD);
+  std::sort(out.begin(), out.end());
+  CPU_END_TIMING(STD, 1, "std::sort<%s> %zu keys skew %d", name, n, skew);
+}
+
+int main(int argc, char **argv) try
+{
+  ThreadPool pool(std::max(4u, std::thread::hardware_concurrency()));
+  bool ok = true;
+  ok &= test_type< int16_t >(pool, "int16");
+  ok &= test_type< int32_t >(pool, "int32");
+  ok &= test_type< uint64_t >(pool, "uint64");
+  ok &= test_type< float >(pool, "float");
+  ok &= test_type< double >(pool, "double");
+  ok &= test_type< Half16 >(pool, "half");
+
+  size_t n = argc > 1 ? atol(argv[1]) : 20'000'000;
+  benchmark< uint32_t >(pool, "uint32", n, 0);
+  benchmark< uint32_t >(pool, "uint32", n, 1);
+  benchmark< double >(pool, "double", n, 0);
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
@@ -0,0 +1,124 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread random_bench.cc ../common/common.cc ../common/host_runtime.cc ../common/mersenne.cc
+// Checks Philox4x32-10 against known answers, verifies that bulk RandomBits
+// (common/random.hpp) does not depend on the number of threads and keeps the
+// entropy_reduction / begin_bit / end_bit semantics, and compares its
+// throughput with the per-key mersenne RandomBits.
+
+#include <bit>
+#include <thread>
+
+#include "common/common_utils.hpp"
+#include "common/random.hpp"
+
+bool test_known_answers() {
+  // Random123 known-answer vectors for philox4x32_10
+  struct { uint32_t ctr[4], key[2], out[4]; } kat[] = {
+    {{0, 0, 0, 0}, {0, 0}, {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+    {{~0u, ~0u, ~0u, ~0u}, {~0u, ~0u},
+        {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+    {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0},
+        {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}},
+  };
+  bool ok = true;
+  for(auto& t : kat) {
+    uint32_t a[4];
+    std::copy(t.ctr, t.ctr + 4, a);
+    philox::block(a, t.key[0], t.key[1]);
+    // the same through the lane-wise block generator
+    uint32_t b[4];
+    philox::generateBlocks(t.key[0] | (uint64_t)t.key[1] << 32,
+        t.ctr[2] | (uint64_t)t.ctr[3] << 32,
+        t.ctr[0] | (uint64_t)t.ctr[1] << 32, 1, b);
+    ok &= std::equal(a, a + 4, t.out) && std::equal(b, b + 4, t.out);
+  }
+  PRINTZ("known answers: %s", ok ? "OK" : "FAILED");
+
+  // unaligned ranges and the stream interface match the bulk generator
+  std::vector< uint32_t > ref(10000), x(10000);
+  philox::generate(123, 5, 0, ref.size(), ref.data());
+  philox::generate(123, 5, 7, 3333, x.data() + 7);
+  bool ok2 = std::equal(x.begin() + 7, x.begin() + 3340, ref.begin() + 7);
+  PhiloxStream s1(77, 3), s2(77, 3);
+  s2.discard(1001);
+  for(size_t i = 0; i < 1001; i++) s1.next();
+  s1.fill(x.data(), 5000);
+  for(size_t i = 0; i < 5000; i++) {
+    ok2 &= x[i] == s2.next();
+  }
+  PRINTZ("ranges and streams: %s", ok2 ? "OK" : "FAILED");
+  return ok && ok2;
+}
+
+template < class K >
+bool test_random_bits(ThreadPool& pool1, ThreadPool& poolN, size_t num,
+      int entropy_reduction, int begin_bit, int end_bit) {
+
+  std::vector< K > a(num), b(num);
+  RandomBits(&pool1, a.data(), num, 1234, entropy_reduction, begin_bit, end_bit);
+  RandomBits(&poolN, b.data(), num, 1234, entropy_reduction, begin_bit, end_bit);
+  bool ok = std::memcmp(a.data(), b.data(), num * sizeof(K)) == 0;
+
+  // bits outside of [begin_bit, end_bit) are zero and the density of set
+  // bits is 1 / 2^(entropy_reduction + 1)
+  size_t ones = 0, outside = 0, nans = 0;
+  const int nbits = std::max(0, std::min< int >(end_bit, sizeof(K)*8) - begin_bit);
+  for(const auto& k : a) {
+    uint8_t bytes[sizeof(K)];
+    std::memcpy(bytes, &k, sizeof(K));
+    for(int i = 0; i < (int)sizeof(K)*8; i++) {
+      bool bit = (bytes[i / 8] >> (i % 8)) & 1;
+      bool inside = i >= begin_bit && i < end_bit;
+      ones += bit && inside, outside += bit && !inside;
+    }
+    if constexpr(std::is_floating_point_v< K >) {
+      nans += std::isnan(k);
+    }
+  }
+  double density = nbits > 0 ? (double)ones / (num * nbits) : 0,
+         expected = nbits > 0 && entropy_reduction >= 0 ? 1.0 / (2 << entropy_reduction) : 0;
+  // floats reject NaNs which biases the exponent bits a little
+  ok &= outside == 0 && nans == 0 && std::abs(density - expected) < 0.01;
+  PRINTZ("RandomBits<%zu bytes> E = %d bits [%d; %d): density %.4f "
+      "(expected %.4f): %s", sizeof(K), entropy_reduction, begin_bit, end_bit,
+      density, expected, ok ? "OK" : "FAILED");
+  return ok;
+}
+
+void benchmark(ThreadPool& pool, size_t num) {
+  std::vector< uint32_t > keys(num);
+  mersenne::init_genrand(1234);
+  CPU_BEGIN_TIMING(MERSENNE);
+  for(auto& k : keys) {
+    RandomBits(k);
+  }
+  CPU_END_TIMING(MERSENNE, 1, "mersenne RandomBits: %zu keys", num);
+
+  CPU_BEGIN_TIMING(PHILOX);
+  RandomBits(&pool, keys.data(), num, 1234);
+  CPU_END_TIMING(PHILOX, 1, "bulk RandomBits (%zu threads): %zu keys", 
+        pool.numThreads(), num);
+}
+
+int main(int argc, char **argv) try
+{
+  ThreadPool pool1(1), 
+        poolN(std::max(4u, std::thread::hardware_concurrency()));
+  bool ok = test_known_answers();
+  ok &= test_random_bits< uint32_t >(pool1, poolN, 100003, 0, 0, 32);
+  ok &= test_random_bits< uint32_t >(pool1, poolN, 100003, 2, 0, 32);
+  ok &= test_random_bits< uint64_t >(pool1, poolN, 100003, 1, 5, 50);
+  ok &= test_random_bits< uint16_t >(pool1, poolN, 100003, 0, 3, 11);
+  ok &= test_random_bits< uint64_t >(pool1, poolN, 100003, -1, 0, 64);
+  ok &= test_random_bits< double >(pool1, poolN, 100003, 0, 0, 52);
+  ok &= test_random_bits< float >(pool1, poolN, 100003, 0, 0, 32);
+
+  benchmark(pool1, argc > 1 ? atol(argv[1]) : 100000000);
+  benchmark(poolN, argc > 1 ? atol(argv[1]) : 100'000'000);
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
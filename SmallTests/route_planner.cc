@@ -0,0 +1,165 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread route_planner.cc ../common/common.cc ../common/host_runtime.cc
+// Checks the route planner (RCCL/route_planner.hpp) on CPU: known optima for
+// uniform topologies, rerouting around slow links, the m_commGraph slot
+// layout produced for permutations and the planning time for 64 GPUs.
+
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+
+#include "common/common.h"
+#include "RCCL/route_planner.hpp"
+#include "SmallTests/test_utils.hpp"
+
+using namespace route;
+
+std::vector< uint32_t > cyclic(uint32_t n, uint32_t shift = 1) {
+  std::vector< uint32_t > t(n);
+  for(uint32_t i = 0; i < n; i++) t[i] = (i + shift) % n;
+  return t;
+}
+
+template < class F >
+double timeMs(F&& f) {
+  auto z1 = std::chrono::high_resolution_clock::now();
+  f();
+  std::chrono::duration< double, std::milli > d =
+        std::chrono::high_resolution_clock::now() - z1;
+  return d.count();
+}
+
+// every gateway slot is used once, no GPU forwards to or from itself and
+// the pieces of each GPU cover its message exactly
+bool checkLayout(const SlotPlan& sp, const std::vector< uint32_t >& target,
+      size_t bytes) {
+  const uint32_t n = sp.n, k = sp.nSlots - 1;
+  std::vector< uint32_t > used(n, 0);
+  for(uint32_t j = 0; j < n; j++) {
+    auto row = sp.row(j);
+    if(row[0].out != target[j] || target[row[0].in] != j) return false;
+    for(uint32_t z = 1; z <= k; z++) {
+      auto s = row[z];
+      if(s.in == j || s.out == j || s.in >= n || target[s.in] != s.out) {
+        return false;
+      }
+      used[s.in]++;
+      for(uint32_t y = 1; y < z; y++) {
+        if(row[y].in == s.in) return false; // the same source twice
+      }
+    }
+  }
+  std::vector< size_t > ofs(sp.nSlots), sizes(sp.nSlots);
+  for(uint32_t i = 0; i < n; i++) {
+    if(used[i] != k) return false;
+    sp.pieces(i, bytes, ofs.data(), sizes.data());
+    size_t sum = 0;
+    for(uint32_t z = 0; z < sp.nSlots; z++) {
+      if(ofs[z] != sum || (z + 1 < sp.nSlots && sizes[z] % 16 != 0)) {
+        return false;
+      }
+      sum += sizes[z];
+    }
+    if(sum != bytes) return false;
+  }
+  return true;
+}
+
+int main() try
+{
+  bool ok = true;
+  const double B = 64 << 20, bw = 50, lat = 2;
+  const double directUs = B / (bw * 1e3);
+
+  { // one gateway: the direct link and the two gateway links carry half each
+    auto topo = Topology::uniform(8, bw, lat);
+    auto target = cyclic(8);
+    auto sp = planPermutation(topo, target, B, 1);
+    double f = sp.splits[0];
+    PRINTZ("8 GPUs, 1 gateway: direct split %.3f; link time %.1f us "
+        "(bound %.1f, direct only %.1f) in %u iterations", f, sp.sol.linkUs,
+        sp.sol.boundUs, directUs, sp.sol.iters);
+    ok &= expect("uniform 1 gateway split", std::abs(f - 0.5) < 0.02 &&
+          sp.sol.linkUs < directUs * 0.52);
+    ok &= expect("uniform 1 gateway layout", checkLayout(sp, target, B));
+  }
+  { // k gateways: direct gets 1/(k+1), the lower bound agrees
+    auto topo = Topology::uniform(8, bw, lat);
+    auto target = cyclic(8, 3);
+    auto sp = planPermutation(topo, target, B, 3);
+    PRINTZ("8 GPUs, 3 gateways: splits %.3f %.3f %.3f %.3f; link time %.1f us "
+        "(bound %.1f)", sp.splits[0], sp.splits[1], sp.splits[2], sp.splits[3],
+        sp.sol.linkUs, sp.sol.boundUs);
+    ok &= expect("uniform 3 gateways",
+          sp.sol.linkUs < directUs / 4 * 1.03 && checkLayout(sp, target, B));
+  }
+  { // slow direct links: most of the traffic goes around them
+    auto topo = Topology::uniform(8, bw, lat);
+    auto target = cyclic(8);
+    for(uint32_t i = 0; i < 8; i++) topo.bw[i*8 + target[i]] = 10;
+    auto sp = planPermutation(topo, target, B, 2);
+    PRINTZ("slow direct links, 2 gateways: direct split %.3f; link time %.1f us",
+        sp.splits[0], sp.sol.linkUs);
+    // optimum: f/10 == (1 - f)/2/50 -> f = 1/11
+    ok &= expect("slow direct links", std::abs(sp.splits[0] - 1.0/11) < 0.02);
+  }
+  { // tiny messages: gateways do not pay off their extra latency
+    auto topo = Topology::uniform(8, bw, lat);
+    auto target = cyclic(8);
+    auto sp = planPermutation(topo, target, 64 * 1024, 1);
+    ok &= expect("latency-bound message stays direct", sp.splits[0] == 1.0 &&
+          checkLayout(sp, target, 64 * 1024));
+  }
+  { // all-to-all over uniform links: direct routing is already optimal
+    auto topo = Topology::uniform(8, bw, lat);
+    auto sol = plan(topo, Demand::allToAll(8, B / 8));
+    ok &= expect("uniform all-to-all",
+          sol.linkUs < B / 8 / (bw * 1e3) * 1.02);
+  }
+  { // topology file: ring of fast links plus slow cross links
+    const char *path = "route_planner_test.dot";
+    FILE *f = fopen(path, "w");
+    fprintf(f, "graph G {\n");
+    for(uint32_t i = 0; i < 4; i++) {
+      fprintf(f, "%u -- %u [bw=100, lat=1];\n", i, (i + 1) % 4);
+    }
+    fprintf(f, "0 -> 2 [bw=10];\n2 -> 0 [bw=10];\n1 -- 3 [bw=10];\n}\n");
+    fclose(f);
+    auto topo = Topology::load(path, 4, 50, 3);
+    std::remove(path);
+    auto sol = plan(topo, Demand::permutation({ 2, 3, 0, 1 }, B));
+    double direct = 0;
+    for(const auto& c : sol.flows) direct += c.frac[0] / sol.flows.size();
+    PRINTZ("ring + slow diagonals: direct share %.3f; link time %.1f us "
+        "(direct only %.1f us)", direct, sol.linkUs, B / 10e3);
+    ok &= expect("topology file", topo.bandwidth(1, 0) == 100 &&
+          topo.latency(0, 2) == 3 && sol.linkUs < B / 10e3 / 4);
+  }
+  { // planning time for 64 GPUs
+    auto topo = Topology::uniform(64, bw, lat);
+    for(uint32_t i = 0; i < 64; i++) { // a few slow links
+      topo.bw[i*64 + (i * 7 + 3) % 64] = 20;
+    }
+    auto target = cyclic(64, 5);
+    SlotPlan sp;
+    double ms = timeMs([&]{ sp = planPermutation(topo, target, B, 2); });
+    PRINTZ("64 GPUs permutation, 2 gateways: %.2f ms; link time %.1f us "
+        "(bound %.1f us, %u iterations)", ms, sp.sol.linkUs, sp.sol.boundUs,
+        sp.sol.iters);
+    ok &= expect("64 GPUs permutation layout", checkLayout(sp, target, B));
+    // both plans take some 20 and 80 ms on a single core: the bounds leave
+    // room for slow or loaded machines
+    ok &= expect("64 GPUs permutation time", ms < 50);
+    Solution sol;
+    ms = timeMs([&]{ sol = plan(topo, Demand::allToAll(64, B / 64)); });
+    PRINTZ("64 GPUs all-to-all: %.2f ms; link time %.1f us (bound %.1f us, "
+        "%u iterations)", ms, sol.linkUs, sol.boundUs, sol.iters);
+    ok &= expect("64 GPUs all-to-all time", ms < 150);
+  }
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
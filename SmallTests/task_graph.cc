@@ -0,0 +1,169 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread task_graph.cc ../common/common.cc ../common/host_runtime.cc
+// Checks common/task_graph.hpp: dependencies of a random DAG over several
+// replays, lane (stream) dependencies with copies, parameter updates of an
+// instantiated graph, cycle and exception handling. Then compares the
+// makespan of a long chain plus independent work with and without
+// critical-path priorities, and prints the replay overhead per node.
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "common/task_graph.hpp"
+#include "SmallTests/test_utils.hpp"
+
+void spinUs(double us) {
+  auto end = std::chrono::steady_clock::now() +
+        std::chrono::nanoseconds((int64_t)(us * 1000));
+  while(std::chrono::steady_clock::now() < end) cpuRelax();
+}
+
+// every node checks that its dependencies ran in this iteration
+bool randomDag(ThreadPool *pool, uint32_t n, uint32_t nIters) {
+  TaskGraph g;
+  std::vector< std::atomic< uint32_t > > runs(n);
+  std::vector< std::vector< uint32_t > > deps(n);
+  std::atomic< bool > ok{true};
+  std::mt19937 gen(11);
+  for(uint32_t i = 0; i < n; i++) {
+    for(uint32_t k = 0; i > 0 && k < gen() % 4; k++) {
+      deps[i].push_back(gen() % i);
+    }
+    std::sort(deps[i].begin(), deps[i].end());
+    deps[i].erase(std::unique(deps[i].begin(), deps[i].end()), deps[i].end());
+    g.add(OpKind::Host, [&, i] {
+      auto r = runs[i].load();
+      for(auto d : deps[i]) {
+        if(runs[d].load() != r + 1) ok = false;
+      }
+      runs[i]++;
+    }, deps[i], 1 + gen() % 10);
+  }
+  auto x = g.instantiate();
+  x->launch(pool, nIters);
+  for(auto& r : runs) {
+    if(r != nIters) return false;
+  }
+  return ok;
+}
+
+// a -> b on lane 1, then lane 2 waits for lane 1 and copies b -> c while
+// lane 1 copies a -> d
+bool lanesAndUpdates(ThreadPool *pool) {
+  const size_t n = 3 << 20;
+  std::vector< uint8_t > a(n, 1), b(n), c(n), d(n), e(n);
+  TaskGraph g;
+  auto l1 = g.lane(), l2 = g.lane();
+  l1.memcpy(b.data(), a.data(), n);
+  l2.wait(l1);
+  auto cp = l2.memcpy(c.data(), b.data(), n);
+  l1.memcpy(d.data(), a.data(), n);
+  int sum = 0;
+  auto h = l2.host([&] { sum += c[n - 1]; });
+  auto x = g.instantiate();
+  x->launch(pool);
+  bool ok = c[0] == 1 && c[n - 1] == 1 && d[n / 2] == 1 && sum == 1;
+  // re-target the copy and change the host op: no re-instantiation
+  std::fill(b.begin(), b.end(), 0);
+  x->setMemcpy(cp, e.data(), a.data(), n);
+  x->setFunc(h, [&] { sum += 10 * e[n - 1]; });
+  x->launch(pool, 2);
+  return ok && e[0] == 1 && e[n - 1] == 1 && b[0] == 1 && sum == 21;
+}
+
+bool cycleAndErrors(ThreadPool *pool) {
+  TaskGraph g;
+  auto a = g.add(OpKind::Host, [] { }), b = g.add(OpKind::Host, [] { }, {a});
+  g.addDependency(b, a);
+  bool cycle = false;
+  try {
+    g.instantiate();
+  } catch(std::exception&) {
+    cycle = true;
+  }
+  TaskGraph g2;
+  int ran = 0;
+  auto l = g2.lane();
+  l.host([] { throw std::runtime_error("node failed"); });
+  l.host([&] { ran++; });
+  auto x = g2.instantiate();
+  bool thrown = false;
+  try {
+    x->launch(pool, 3);
+  } catch(std::runtime_error&) {
+    thrown = true;
+  }
+  // still usable
+  x->setFunc(0, [] { });
+  x->launch(pool, 2);
+  return cycle && thrown && ran == 2;
+}
+
+// 'chain' nodes in a chain plus 'nFree' independent nodes, all 'us' long
+double makespanMs(ThreadPool *pool, uint32_t chain, uint32_t nFree,
+      double us, bool priorities) {
+  TaskGraph g;
+  auto l = g.lane();
+  for(uint32_t i = 0; i < nFree; i++) g.add(OpKind::Host, [=] { spinUs(us); });
+  for(uint32_t i = 0; i < chain; i++) l.host([=] { spinUs(us); });
+  auto x = g.instantiate();
+  if(!priorities) {
+    for(uint32_t i = 0; i < x->size(); i++) x->setCost(i, 0);
+  }
+  x->launch(pool);
+  auto z1 = std::chrono::high_resolution_clock::now();
+  x->launch(pool, 5);
+  std::chrono::duration< double, std::milli > d =
+        std::chrono::high_resolution_clock::now() - z1;
+  return d.count() / 5;
+}
+
+// empty nodes: a chain and a fan-out of 'n' nodes
+void overhead(ThreadPool *pool, const char *name, uint32_t n) {
+  for(int wide = 0; wide < 2; wide++) {
+    TaskGraph g;
+    auto l = g.lane();
+    auto root = g.add(OpKind::Host, [] { });
+    for(uint32_t i = 0; i < n; i++) {
+      if(wide) g.add(OpKind::Host, [] { }, {root});
+      else l.host([] { });
+    }
+    auto x = g.instantiate();
+    x->launch(pool);
+    const uint32_t nIters = 50;
+    auto z1 = std::chrono::high_resolution_clock::now();
+    x->launch(pool, nIters);
+    std::chrono::duration< double, std::nano > d =
+          std::chrono::high_resolution_clock::now() - z1;
+    PRINTZ("%s, %s of %u empty nodes: %.1f ns per node", name,
+          wide ? "fan-out" : "chain", n, d.count() / (nIters * (n + 1.0)));
+  }
+}
+
+int main(int argc, char **argv) try
+{
+  uint32_t nThreads = argc > 1 ? atoi(argv[1]) : 4;
+  ThreadPool pool(nThreads);
+  bool ok = true;
+  ok &= expect("random DAG, calling thread", randomDag(nullptr, 2000, 3));
+  ok &= expect("random DAG, thread pool", randomDag(&pool, 2000, 5));
+  ok &= expect("lanes and parameter updates", lanesAndUpdates(&pool));
+  ok &= expect("cycles and exceptions", cycleAndErrors(&pool));
+
+  double prio = makespanMs(&pool, 20, 20 * nThreads, 200, true),
+         flat = makespanMs(&pool, 20, 20 * nThreads, 200, false);
+  PRINTZ("chain of 20 + %u independent 200us nodes on %u threads: "
+      "critical path first %.2f ms, without priorities %.2f ms "
+      "(lower bound %.2f ms)", 20 * nThreads, nThreads, prio, flat,
+      std::max(4.0, 0.2 * (20 + 20 * nThreads) / nThreads));
+  overhead(nullptr, "calling thread", 10000);
+  overhead(&pool, "thread pool", 10000);
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
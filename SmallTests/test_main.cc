@@ -1,5 +1,6 @@
 
 // hipcc -I.. -DCOMPILE_FOR_ROCM=1 -std=c++17 --offload-arch=gfx90a test_main.cc
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -pthread test_main.cc ../common/common.cc ../common/host_runtime.cc
 
 #include <algorithm>
 #include <iomanip>
@@ -0,0 +1,14 @@
+#ifndef SMALLTESTS_TEST_UTILS_HPP
+#define SMALLTESTS_TEST_UTILS_HPP 1
+
+// Helpers shared by the standalone tests in SmallTests.
+
+#include "common/common.h"
+
+// prints "<name>: OK" or "<name>: FAILED" and passes 'ok' through
+inline bool expect(const char *name, bool ok) {
+  PRINTZ("%s: %s", name, ok ? "OK" : "FAILED");
+  return ok;
+}
+
+#endif // SMALLTESTS_TEST_UTILS_HPP
@@ -0,0 +1,218 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -pthread threading_bench.cc ../common/common.cc ../common/host_runtime.cc
+// Compares dispatch latency and task throughput of the work-stealing ThreadPool
+// from common/threading.hpp against the previous broadcast-only pool, and
+// the spin-then-park Barrier against the previous condition variable one.
+
+#include <algorithm>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <thread>
+
+#include "common/threading.hpp"
+#include "common/common_utils.hpp"
+
+// previous ThreadPool implementation: one std::function broadcast to all threads,
+// single mutex/condition_variable pair for wake-up
+struct BroadcastThreadPool {
+
+  using JobFunc = std::function<void(int)>;
+  explicit BroadcastThreadPool(size_t nThreads) : m_threads(nThreads) {
+    for(size_t i = 0; i < nThreads; i++) {
+      m_threads[i] = std::thread{&BroadcastThreadPool::threadFunc, this, i};
+    }
+  }
+
+  void runJob(JobFunc f) {
+    {
+      std::lock_guard _(m_jobMtx);
+      m_func = f;
+      m_currentJobID += m_threads.size();
+    }
+    m_jobCv.notify_all();
+    std::unique_lock lock(m_finishedMtx);
+    m_finishedCv.wait(lock, [this](){
+      return m_arrived == m_currentJobID;
+    });
+  }
+
+  ~BroadcastThreadPool() {
+    {
+      std::lock_guard _(m_jobMtx);
+      m_isRunning = false;
+    }
+    m_jobCv.notify_all();
+    for(auto& th: m_threads) {
+      th.join();
+    }
+  }
+
+private:
+  void threadFunc(int id) {
+    uint32_t localJobId = 0;
+    while(true) {
+      {
+        std::unique_lock lock(m_jobMtx);
+        m_jobCv.wait(lock, [this, &localJobId]()
+            { return !m_isRunning || localJobId < m_currentJobID; });
+        if(!m_isRunning)
+          return;
+      }
+      m_func(id);
+      localJobId += m_threads.size();
+      std::lock_guard _(m_finishedMtx);
+      if(++m_arrived == m_currentJobID) {
+        m_finishedCv.notify_one();
+      }
+    }
+  }
+
+  uint32_t m_currentJobID = 0, m_arrived = 0;
+  bool m_isRunning = true;
+  JobFunc m_func;
+  std::mutex m_jobMtx, m_finishedMtx;
+  std::condition_variable m_jobCv, m_finishedCv;
+  std::vector< std::thread > m_threads;
+};
+
+// previous Barrier implementation: mutex + condition variable
+class CvBarrier {
+ public:
+  explicit CvBarrier(std::size_t num) : num_threads(num), wait_count(0),
+        instance(0) { }
+
+  void wait() {
+    std::unique_lock< std::mutex > lock(mut);
+    std::size_t inst = instance;
+    if(++wait_count == num_threads) {
+      wait_count = 0;
+      instance++;
+      cv.notify_all();
+    } else {
+      cv.wait(lock, [this, &inst]() { return instance != inst; });
+    }
+  }
+
+ private:
+  std::size_t num_threads, wait_count, instance;
+  std::mutex mut;
+  std::condition_variable cv;
+};
+
+using Clock = std::chrono::high_resolution_clock;
+
+template < class F >
+double measureUs(size_t nIters, F&& f) {
+  f(); // warm-up
+  auto t1 = Clock::now();
+  for(size_t i = 0; i < nIters; i++) {
+    f();
+  }
+  std::chrono::duration<double, std::micro> us = Clock::now() - t1;
+  return us.count() / nIters;
+}
+
+// some work per task to keep the compiler from removing the loop
+static void taskBody(size_t i, std::atomic< size_t >& sink) {
+  size_t x = i;
+  for(int j = 0; j < 16; j++) {
+    x = x * 6364136223846793005ull + 1442695040888963407ull;
+  }
+  if(x == 0) sink++;
+}
+
+void benchmark_pools(size_t nThreads) {
+
+  constexpr size_t nDispatch = 2000, nTasks = 1 << 18;
+  std::atomic< size_t > sink{0};
+
+  BroadcastThreadPool oldPool(nThreads);
+  ThreadPool newPool(nThreads);
+
+  // 1. dispatch latency: empty broadcast job
+  auto oldUs = measureUs(nDispatch, [&]() { oldPool.runJob([](int) {}); });
+  auto newUs = measureUs(nDispatch, [&]() { newPool.runJob([](int) {}); });
+  PRINTZ("%zu threads: runJob dispatch latency: broadcast pool: %.3f us; "
+         "work-stealing pool: %.3f us", nThreads, oldUs, newUs);
+
+  // 2. fine-grained tasks: the broadcast pool can only run nThreads tasks per
+  // dispatch, hence we emulate fine tasks by repeated runJob calls
+  auto oldTasksUs = measureUs(1, [&]() {
+    for(size_t i = 0; i < nTasks; i += nThreads) {
+      oldPool.runJob([&](int id) { taskBody(i + id, sink); });
+    }
+  });
+  // work-stealing pool: recursive splitting down to single tasks
+  auto newTasksUs = measureUs(1, [&]() {
+    newPool.parallelFor(0, nTasks, 1, [&](size_t b, size_t e) {
+      for(auto i = b; i < e; i++) taskBody(i, sink);
+    });
+  });
+  // same but issued from inside a broadcast job by every thread (RCCL verify path)
+  auto nestedUs = measureUs(1, [&]() {
+    newPool.runJob([&](int) {
+      newPool.parallelFor(0, nTasks / nThreads, 1, [&](size_t b, size_t e) {
+        for(auto i = b; i < e; i++) taskBody(i, sink);
+      });
+    });
+  });
+  auto mtasks = [](double us) { return (double)nTasks / us; };
+  PRINTZ("%zu threads: %zu tasks: broadcast pool: %.3f Mtasks/s; "
+         "work-stealing pool: %.3f Mtasks/s; nested in runJob: %.3f Mtasks/s",
+         nThreads, nTasks, mtasks(oldTasksUs), mtasks(newTasksUs),
+         mtasks(nestedUs));
+}
+
+void benchmark_barriers(size_t nThreads) {
+
+  constexpr size_t nPhases = 20000;
+  ThreadPool pool(nThreads);
+
+  auto run = [&](auto& barrier) {
+    return measureUs(1, [&]() {
+      pool.runJob([&](int) {
+        for(size_t i = 0; i < nPhases; i++) barrier.wait();
+      });
+    }) / nPhases;
+  };
+  CvBarrier cvBarrier(nThreads);
+  Barrier spinBarrier(nThreads), parkBarrier(nThreads, 0);
+  auto cvUs = run(cvBarrier), spinUs = run(spinBarrier), 
+       parkUs = run(parkBarrier);
+  PRINTZ("%zu threads: barrier phase: condition variable: %.3f us; "
+         "spin-then-park: %.3f us; park only: %.3f us", 
+         nThreads, cvUs, spinUs, parkUs);
+}
+
+// forkJoin from a non-worker thread: inline on an empty pool, and many short
+// waits whose stack Task is gone right after the worker signals it
+static bool check_external_fork(size_t nThreads) {
+  ThreadPool pool(nThreads);
+  std::atomic< size_t > sum{0};
+  for(size_t i = 0; i < 10000; i++) {
+    pool.forkJoin([&]() { sum += 1; }, [&]() { sum += 2; });
+  }
+  return sum == 30000;
+}
+
+int main() try
+{
+  for(size_t n : {0, 1, 4}) {
+    if(!check_external_fork(n)) {
+      PRINTZ("external forkJoin on %zu threads: FAILED", n);
+      return 1;
+    }
+  }
+  size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  for(size_t n = 1; n <= maxThreads; n *= 2) {
+    benchmark_pools(n);
+    benchmark_barriers(n);
+  }
+  return 0;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
@@ -0,0 +1,242 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread timeline.cc ../common/common.cc ../common/host_runtime.cc
+// Checks the bubble analysis of RCCL_bubbles/timeline.hpp on a hand-made
+// timeline and on a synthetic serial schedule with one slow rank, then
+// records ranks on the host runtime (sleeping "GEMMs" and
+// barrier-synchronized "collectives" on streams, one rank computing
+// slower) with EventRecorder: the straggler must be found and the critical
+// path must mostly go through it; a schedule overlapping the collectives with the
+// next GEMM on a second stream is compared against the serial one.
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "common/common_utils.hpp"
+#include "common/threading.hpp"
+#include "RCCL_bubbles/timeline.hpp"
+#include "SmallTests/test_utils.hpp"
+
+using timeline::Op;
+
+bool near(double a, double b) {
+  return std::abs(a - b) < 1e-6;
+}
+
+// rank 0: gemm [0, 10], all-reduce [10, 20]
+// rank 1: gemm [0, 14], all-reduce [14, 20] on stream 0, and a gemm
+//         [15, 18] on stream 1 overlapping with it
+bool synthetic() {
+  std::vector< timeline::Interval > ivs = {
+    { 0, 0, Op::Gemm, 0, 0, 10 }, { 0, 0, Op::AllReduce, 0, 10, 20 },
+    { 1, 0, Op::Gemm, 0, 0, 14 }, { 1, 0, Op::AllReduce, 0, 14, 20 },
+    { 1, 1, Op::Gemm, 1, 15, 18 }, { 0, 0, Op::Gemm, 1, 22, 25 },
+  };
+  auto rep = timeline::analyze(ivs);
+  const auto &r0 = rep.ranks[0], &r1 = rep.ranks[1];
+  bool ok = near(rep.stepUs, 25) && near(r0.windowUs, 25) &&
+        near(r0.idleUs, 2) && r0.numGaps == 1 && near(r0.maxGapUs, 2) &&
+        near(r0.waitUs, 4) && r0.numStraggler == 0 &&
+        near(r1.stragglerUs, 4) && r1.numStraggler == 1 &&
+        near(r1.overlapUs, 3) && near(r1.overlapRatio(), 0.5) &&
+        near(r1.idleUs, 0);
+  // rank 0's last gemm <- the all-reduce of the straggler <- its gemm
+  ok &= rep.criticalPath.size() == 3 && rep.criticalPath[0].rank == 1 &&
+        rep.criticalPath[0].op == Op::Gemm &&
+        rep.criticalPath[1].rank == 1 && rep.criticalPath[2].rank == 0 &&
+        near(rep.pathComputeUs, 17) && near(rep.pathCommUs, 6) &&
+        near(rep.pathIdleUs, 2);
+  return ok;
+}
+
+size_t countOccurrences(const std::string& s, const char *what) {
+  size_t n = 0;
+  for(auto pos = s.find(what); pos != std::string::npos;
+        pos = s.find(what, pos + 1)) n++;
+  return n;
+}
+
+// the serial schedule of HostRanks::run as a synthetic timeline: 'nIters'
+// of gemm + all-reduce + gemm + reduce-scatter, every collective ends
+// 'commUs' after the last rank arrived. Rank r computes a bit longer than
+// rank r - 1, rank 'slow' takes 'slowGemmUs'
+std::vector< timeline::Interval > serialTimeline(uint32_t nRanks, int nIters,
+      uint32_t slow, double gemmUs, double slowGemmUs, double commUs) {
+  std::vector< timeline::Interval > ivs;
+  std::vector< double > arrive(nRanks);
+  double t = 0;
+  for(int i = 0; i < nIters; i++) {
+    for(auto op : { Op::AllReduce, Op::ReduceScatter }) {
+      for(uint32_t r = 0; r < nRanks; r++) {
+        arrive[r] = t + (r == slow ? slowGemmUs : gemmUs + 10 * r);
+        ivs.push_back({ r, 0, Op::Gemm, 2 * (uint32_t)i +
+              (op == Op::ReduceScatter), t, arrive[r] });
+      }
+      double end = *std::max_element(arrive.begin(), arrive.end()) + commUs;
+      for(uint32_t r = 0; r < nRanks; r++) {
+        ivs.push_back({ r, 0, op, (uint32_t)i, arrive[r], end });
+      }
+      t = end;
+    }
+  }
+  return ivs;
+}
+
+// straggler attribution, the critical path and its trace export for the
+// serial schedule
+bool syntheticSerial(uint32_t nRanks) {
+  const int nIters = 3;
+  const uint32_t slow = nRanks - 1;
+  auto all = serialTimeline(nRanks, nIters, slow, 4000, 6000, 3000);
+  auto rep = timeline::analyze(all);
+  const auto& rs = rep.ranks[slow];
+  bool ok = rs.numStraggler == 2 * nIters &&
+        near(rs.stragglerUs, 2 * nIters * 2000) &&
+        near(rep.ranks[0].waitUs, 2 * nIters * 2000) &&
+        rep.criticalPath.size() == 4 * nIters &&
+        near(rep.pathComputeUs, 2 * nIters * 6000) &&
+        near(rep.pathCommUs, 2 * nIters * 3000) && near(rep.pathIdleUs, 0);
+  for(const auto& iv : rep.criticalPath) {
+    ok &= iv.rank == slow;
+  }
+
+  const char *path = "timeline_test.json";
+  ok &= timeline::writeChrome(path, all, &rep);
+  std::ifstream ifs(path);
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  std::string json = ss.str();
+  std::remove(path);
+  ok &= json.rfind("{\"displayTimeUnit\"", 0) == 0 &&
+        countOccurrences(json, "\"ph\":\"X\"") == all.size() &&
+        countOccurrences(json, "\"ph\":\"M\"") == nRanks &&
+        countOccurrences(json, "\"cat\":\"critical\"") == 4 * nIters;
+  return ok;
+}
+
+struct HostRanks {
+
+  HostRanks(uint32_t nRanks) : m_nRanks(nRanks), m_barrier(nRanks),
+        m_pool(nRanks), m_recs(nRanks), m_streams(2 * nRanks) {
+    for(auto& s : m_streams) CHK(cudaStreamCreate(&s));
+  }
+
+  ~HostRanks() {
+    m_recs.clear();
+    for(auto s : m_streams) (void)cudaStreamDestroy(s);
+  }
+
+  void sleepOp(uint32_t rank, uint32_t sidx, Op op, double ms, bool sync) {
+    auto s = m_streams[2 * rank + sidx];
+    auto token = m_recs[rank].begin(op, s, sidx);
+    CHK(hostrt::enqueue(s, [this, ms, sync] {
+      if(sync) m_collBarrier->wait();
+      std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(ms * 1e3)));
+    }));
+    m_recs[rank].end(token, s);
+  }
+
+  // 'nIters' of gemm + all-reduce + gemm + reduce-scatter; rank 'slow'
+  // computes 'slowdown' times longer. Overlapped: the collectives run on a
+  // second stream after the GEMM they follow, concurrently with the next
+  timeline::Report run(int nIters, bool overlap, uint32_t slow,
+        double slowdown, std::vector< timeline::Interval > *all) {
+    const double gemmMs = 4, commMs = 3;
+    Barrier collBarrier(m_nRanks);
+    m_collBarrier = &collBarrier;
+    std::vector< std::vector< timeline::Interval > > ivs(m_nRanks);
+    m_pool.runJob([&](int r) {
+      auto s0 = m_streams[2 * r], s1 = m_streams[2 * r + 1];
+      m_recs[r].start(s0);
+      m_barrier.wait(r);
+      double g = gemmMs * (r == (int)slow ? slowdown : 1);
+      cudaEvent_t ev;
+      CHK(cudaEventCreate(&ev));
+      for(int i = 0; i < nIters; i++) {
+        for(auto op : { Op::AllReduce, Op::ReduceScatter }) {
+          sleepOp(r, 0, Op::Gemm, g, false);
+          if(overlap) {
+            CHK(cudaEventRecord(ev, s0));
+            CHK(cudaStreamWaitEvent(s1, ev, 0));
+          }
+          sleepOp(r, overlap, op, commMs, true);
+        }
+      }
+      CHK(cudaStreamSynchronize(s0));
+      CHK(cudaStreamSynchronize(s1));
+      CHK(cudaEventDestroy(ev));
+      m_recs[r].collect(r, ivs[r]);
+    });
+    all->clear();
+    for(auto& v : ivs) all->insert(all->end(), v.begin(), v.end());
+    return timeline::analyze(*all);
+  }
+
+  uint32_t m_nRanks;
+  Barrier m_barrier, *m_collBarrier = nullptr;
+  ThreadPool m_pool;
+  std::vector< timeline::EventRecorder > m_recs;
+  std::vector< cudaStream_t > m_streams;
+};
+
+int main(int argc, char **argv) try
+{
+  uint32_t nRanks = argc > 1 ? atoi(argv[1]) : 4;
+  bool ok = expect("synthetic timeline", synthetic());
+
+  ok &= expect("synthetic serial schedule", syntheticSerial(nRanks));
+
+  // recorded sleeps overrun by a few ms under load: the slow rank computes
+  // 3x longer so that noise cannot reorder the arrivals, and only the
+  // majority of collectives and critical-path GEMMs must be on it
+  HostRanks ranks(nRanks);
+  std::vector< timeline::Interval > all;
+  const uint32_t slow = nRanks - 1;
+  const int nIters = 3;
+  auto serial = ranks.run(nIters, false, slow, 3, &all);
+  timeline::printReport("serial", serial);
+  uint32_t worst = 0;
+  for(uint32_t r = 0; r < nRanks; r++) {
+    if(serial.ranks[r].stragglerUs > serial.ranks[worst].stragglerUs) worst = r;
+  }
+  size_t pathGemms = 0, slowGemms = 0;
+  for(const auto& iv : serial.criticalPath) {
+    if(iv.op != Op::Gemm) continue;
+    pathGemms++;
+    slowGemms += iv.rank == slow;
+  }
+  ok &= expect("straggler attribution", worst == slow &&
+        serial.ranks[slow].numStraggler > nIters &&
+        serial.ranks[0].waitUs > 1e3 * nIters);
+  ok &= expect("critical path through the straggler", pathGemms > 0 &&
+        2 * slowGemms > pathGemms);
+  ok &= expect("no overlap when serial", serial.ranks[0].overlapRatio() < 0.05);
+
+  const char *path = "timeline_test.json";
+  ok &= expect("chrome export", timeline::writeChrome(path, all, &serial));
+  std::ifstream ifs(path);
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  std::string json = ss.str();
+  std::remove(path);
+  ok &= expect("trace contents", json.rfind("{\"displayTimeUnit\"", 0) == 0 &&
+        countOccurrences(json, "\"ph\":\"X\"") == all.size() &&
+        countOccurrences(json, "\"ph\":\"M\"") == nRanks &&
+        countOccurrences(json, "\"cat\":\"critical\"") ==
+              serial.criticalPath.size());
+
+  auto over = ranks.run(nIters, true, slow, 1.5, &all);
+  timeline::printReport("overlapped", over);
+  PRINTZ("overlapped / serial step time: %.3f / %.3f ms (%.2fx); overlap "
+      "of rank 0: %.1f%%", over.stepUs * 1e-3, serial.stepUs * 1e-3,
+      serial.stepUs / over.stepUs, over.ranks[0].overlapRatio() * 100);
+  ok &= expect("overlapped schedule", over.stepUs < serial.stepUs &&
+        over.ranks[0].overlapRatio() > 0.3);
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
@@ -0,0 +1,201 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O2 -march=native -pthread topk_emu.cc ../common/simt_emulator.cc ../common/common.cc ../common/host_runtime.cc
+// add -DHOST_WAVEFRONT_SIZE=64 to emulate AMD wavefronts
+// Runs TopK kernels from TopK/topk_kernel.cu.h on the host SIMT emulator,
+// checks the results against the host TopK and prints operation counts.
+// Radix-select results are also checked against a full sort, unsupported
+// k must get no kernel.
+// Pass 'subranges' to also run the experimental RunTopK_subranges kernel.
+
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <tuple>
+
+#include "TopK/topk_kernel.cu.h"
+#include "TopK/topk_cpu.hpp"
+
+SIMT_DEFINE_DYNAMIC_SHARED(int32_t, g_shared_mem);
+
+void printCounters(const char *name, uint32_t K, size_t batch, size_t n,
+        const simt::Counters& c) {
+  PRINTZ("%s<%u> batch: %zu; N: %zu: %lu instructions: %lu shuffles "
+         "(%lu warp-wide); %lu bfe; %lu compares; %lu barriers; "
+         "%lu inactive lane reads", name, K, batch, n, c.instructions(),
+         c.shuffles, c.warpShuffles, c.bitExtracts, c.compares, c.barriers,
+         c.inactiveReads);
+}
+
+template < class KT >
+bool compareTopK(const char *name, size_t batch, size_t k, const KT *vals,
+        const uint32_t *idxs, const KT *truth_vals, const uint32_t *truth_idxs) {
+  for(size_t i = 0; i < batch * k; i++) {
+    if(vals[i] != truth_vals[i] || idxs[i] != truth_idxs[i]) {
+      PRINTZ("%s: mismatch at row %zu pos %zu: (%f, %u) vs truth (%f, %u)",
+          name, i / k, i % k, (double)vals[i], idxs[i],
+          (double)truth_vals[i], truth_idxs[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+template < class KT >
+void fillData(std::vector< KT >& data, size_t seed, uint32_t distinct) {
+  std::mt19937 gen(seed);
+  for(auto& x : data) {
+    if constexpr(std::is_floating_point_v< KT >) {
+      x = std::uniform_real_distribution< KT >(-1000, 1000)(gen);
+    } else {
+      x = (KT)gen();
+    }
+    // few distinct keys: many ties at the threshold
+    if(distinct != 0) x = (KT)((uint32_t)gen() % distinct);
+  }
+}
+
+// reference: full sort of each row by (key, index), larger index first
+template < class KT >
+void sortTopK(const KT *data, size_t n, KT *vals, uint32_t *idxs, size_t k,
+        size_t batch) {
+  std::vector< uint32_t > perm(n);
+  for(size_t b = 0; b < batch; b++) {
+    auto in = data + b*n;
+    std::iota(perm.begin(), perm.end(), 0);
+    std::sort(perm.begin(), perm.end(), [in](uint32_t x, uint32_t y) {
+      auto ox = topk_cpu::orderedBits(in[x]), oy = topk_cpu::orderedBits(in[y]);
+      return ox != oy ? ox > oy : x > y;
+    });
+    for(size_t i = 0; i < k; i++) {
+      vals[b*k + i] = in[perm[i]], idxs[b*k + i] = perm[i];
+    }
+  }
+}
+
+template < class KT >
+bool test_radix(ThreadPool& pool, size_t batch, size_t n, size_t k,
+        uint32_t blockSz, uint32_t distinct = 0) {
+
+  std::vector< KT > data(batch * n), vals(batch * k), truth_vals(batch * k),
+        ref_vals(batch * k);
+  std::vector< uint32_t > idxs(batch * k), truth_idxs(batch * k),
+        ref_idxs(batch * k);
+  fillData(data, n * 33 + k, distinct);
+  TopKCpu(pool, data.data(), n, truth_vals.data(), truth_idxs.data(), k, batch);
+  sortTopK(data.data(), n, ref_vals.data(), ref_idxs.data(), k, batch);
+
+  auto cnt = simt::launch(&pool, RunTopK_radix< KT >, dim3(batch),
+        dim3(blockSz), sizeof(TopKRadixShared), data.data(), (uint32_t)n,
+        vals.data(), idxs.data(), (uint32_t)k);
+  printCounters("RunTopK_radix", k, batch, n, cnt);
+  return compareTopK("TopKCpu", batch, k, truth_vals.data(), truth_idxs.data(),
+        ref_vals.data(), ref_idxs.data()) &&
+         compareTopK("RunTopK_radix", batch, k, vals.data(), idxs.data(),
+        truth_vals.data(), truth_idxs.data());
+}
+
+template < uint32_t K, class KT >
+bool test_topk(ThreadPool& pool, size_t batch, size_t n, size_t k,
+        uint32_t blockSz, bool isDefault) {
+
+  std::vector< KT > data(batch * n), vals(batch * k), truth_vals(batch * k);
+  std::vector< uint32_t > idxs(batch * k), truth_idxs(batch * k);
+  fillData(data, n * 33 + k, 0);
+  TopKCpu(pool, data.data(), n, truth_vals.data(), truth_idxs.data(), k, batch);
+
+  simt::Counters cnt;
+  const char *name;
+  if(isDefault) {
+    name = "RunTopK_default";
+    size_t shmem = K * WAVEFRONT_SIZE * sizeof(typename TopK< K, KT >::KVT);
+    cnt = simt::launch(&pool, RunTopK_default< K, KT >, dim3(batch),
+        dim3(blockSz), shmem, data.data(), (int)n, vals.data(), idxs.data(),
+        (int)k);
+  } else {
+    name = "RunTopK_bitonik_shuffle";
+    size_t shmem = blockSz / 2 * sizeof(typename BitonicTopK< KT, K >::KVT);
+    cnt = simt::launch(&pool, RunTopK_bitonik_shuffle< K, KT >, dim3(batch),
+        dim3(blockSz), shmem, data.data(), (uint32_t)n, vals.data(),
+        idxs.data(), (uint32_t)k);
+  }
+  printCounters(name, K, batch, n, cnt);
+  return compareTopK(name, batch, k, vals.data(), idxs.data(),
+        truth_vals.data(), truth_idxs.data());
+}
+
+template < uint32_t K, class KT >
+bool test_all(ThreadPool& pool) {
+  bool ok = true;
+  for(size_t n : {K * 256, 1000u, 4096u, 7889u}) {
+    for(uint32_t blockSz : {WAVEFRONT_SIZE, 256}) {
+      // the last warp might be partially filled
+      ok &= test_topk< K, KT >(pool, 10, n, K, blockSz, false);
+      ok &= test_topk< K, KT >(pool, 10, n, (K + 1) / 2, blockSz, false);
+    }
+    // RunTopK_default needs at least K elements per thread
+    uint32_t blockSz = std::min< size_t >(256, std::bit_floor(n / K));
+    if(blockSz >= WAVEFRONT_SIZE) {
+      ok &= test_topk< K, KT >(pool, 10, n, K, blockSz, true);
+    }
+  }
+  return ok;
+}
+
+// the cost model and GetKernel reject k == 0, k > n and k > kTopKMaxRadixK
+bool test_dispatch() {
+  bool ok = true;
+  for(auto [n, k, supported] : std::initializer_list<
+        std::tuple< size_t, size_t, bool > >{ {1000, 1, true},
+        {1000, 16, true}, {1000, 256, true}, {1000, 0, false},
+        {1000, 257, false}, {100, 101, false} }) {
+    auto cfg = SelectTopKConfig< float >(n, k, 64, 80 * 2048);
+    if((GetKernel< float >(cfg) != nullptr) != supported) {
+      PRINTZ("GetKernel: N = %zu; K = %zu must be %s", n, k,
+          supported ? "supported" : "rejected");
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+int main(int argc, char **argv) try
+{
+  ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+  PRINTZ("Wavefront size: %u", WAVEFRONT_SIZE);
+
+  bool ok = true;
+  ok &= test_all< 1, float >(pool);
+  ok &= test_all< 2, uint32_t >(pool);
+  ok &= test_all< 4, float >(pool);
+  ok &= test_all< 8, uint32_t >(pool);
+  ok &= test_all< 16, float >(pool);
+
+  for(size_t k : {1, 17, 64, 100, 256}) {
+    ok &= test_radix< float >(pool, 5, 7889, k, 256);
+    ok &= test_radix< uint32_t >(pool, 5, 4096, k, WAVEFRONT_SIZE, 3);
+    ok &= test_radix< int32_t >(pool, 5, k, k, 128);
+  }
+  for(size_t n : {1000, 100000, 1000000}) {
+    for(size_t k : {1, 16, 64, 256}) {
+      auto cfg = SelectTopKConfig< float >(n, k, 64, 80 * 2048);
+      PRINTZ("cost model: N = %zu; K = %zu; batch 64: %s with %u threads",
+          n, k, cfg.algo == TopKAlgo::Bitonic ? "bitonic" : "radix",
+          cfg.num_threads);
+    }
+  }
+  ok &= test_dispatch();
+
+  if(argc > 1 && !strcmp(argv[1], "subranges")) {
+    auto cnt = simt::launch(&pool, RunTopK_subranges< 16, uint32_t >, dim3(1),
+        dim3(64), 64 * sizeof(uint32_t), (const uint32_t *)nullptr, 0u,
+        (uint32_t *)nullptr, (uint32_t *)nullptr, 16u);
+    printCounters("RunTopK_subranges", 16, 1, 0, cnt);
+  }
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
@@ -0,0 +1,108 @@
+
+// g++ -I.. -DCOMPILE_FOR_HOST=1 -DCOMPILE_FOR_ROCM=0 -std=c++20 -O3 -march=native -pthread topk_stream.cc ../common/common.cc ../common/host_runtime.cc
+// Checks streaming TopK (TopK/topk_stream.hpp) from a generator, a file and
+// mmap against TopKCpu on the materialized input. Pass the number of GB to
+// also run over a generated row which is never materialized, e.g.: ./a.out 4
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include "TopK/topk_stream.hpp"
+
+// counter-based generator: element i does not depend on the chunking
+void generate(size_t ofs, float *out, size_t num) {
+  for(size_t i = 0; i < num; i++) {
+    uint64_t z = (ofs + i + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z ^= z >> 31;
+    // few distinct values produce ties at the threshold
+    out[i] = (float)(int32_t)(z % 100003) - 50000.0f;
+  }
+}
+
+bool check(const char *name, const std::vector< float >& vals,
+        const std::vector< uint32_t >& idxs,
+        const std::vector< float >& truth_vals,
+        const std::vector< uint32_t >& truth_idxs) {
+  for(size_t i = 0; i < vals.size(); i++) {
+    if(vals[i] != truth_vals[i] || idxs[i] != truth_idxs[i]) {
+      PRINTZ("%s: mismatch at %zu: (%f, %u) vs truth (%f, %u)", name, i,
+          vals[i], idxs[i], truth_vals[i], truth_idxs[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool test_stream(ThreadPool& pool, size_t batch, size_t n, size_t k,
+        size_t chunkElems, const char *fname) {
+
+  std::vector< float > data(batch * n), vals(batch * k), truth_vals(batch * k);
+  std::vector< uint32_t > idxs(batch * k), truth_idxs(batch * k);
+  generate(0, data.data(), data.size());
+  TopKCpu(pool, data.data(), n, truth_vals.data(), truth_idxs.data(), k, batch);
+
+  FILE *f = fopen(fname, "wb");
+  if(f == nullptr || fwrite(data.data(), sizeof(float), data.size(), f) !=
+        data.size()) {
+    ThrowError< >("Unable to write %s", fname);
+  }
+  fclose(f);
+
+  bool ok = true;
+  for(int mode = 0; mode < 3; mode++) {
+    std::unique_ptr< TopKChunkSource< float > > src;
+    const char *name = "generator";
+    if(mode == 0) {
+      src.reset(new GeneratorChunkSource< float >(generate, data.size()));
+    } else if(mode == 1) {
+      src.reset(new FileChunkSource< float >(fname)), name = "file";
+    } else {
+      src.reset(new MmapChunkSource< float >(fname)), name = "mmap";
+    }
+    // small slices to have many of them per chunk
+    StreamingTopK< float > topk(pool, n, k, batch, chunkElems, 10000);
+    topk.run(*src);
+    topk.finish(vals.data(), idxs.data());
+    bool res = check(name, vals, idxs, truth_vals, truth_idxs);
+    PRINTZ("batch: %zu; N: %zu; K: %zu; chunk: %zu; %s: %s", batch, n, k,
+          chunkElems, name, res ? "OK" : "FAILED");
+    ok &= res;
+  }
+  remove(fname);
+  return ok;
+}
+
+int main(int argc, char **argv) try
+{
+  ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+  const char *fname = "topk_stream.bin";
+
+  bool ok = true;
+  for(size_t k : {1, 5, 16, 100}) {
+    // chunks span row boundaries and slices are shorter than k at row ends
+    ok &= test_stream(pool, 3, 1000003, k, 333331, fname);
+    ok &= test_stream(pool, 50, 1000, k, 4096, fname);
+  }
+
+  if(argc > 1) {
+    size_t n = (size_t)(atof(argv[1]) * (1ull << 30) / sizeof(float)), k = 16;
+    std::vector< float > vals(k);
+    std::vector< uint32_t > idxs(k);
+    GeneratorChunkSource< float > src(generate, n);
+    StreamingTopK< float > topk(pool, n, k, 1);
+    auto t1 = std::chrono::steady_clock::now();
+    topk.run(src);
+    topk.finish(vals.data(), idxs.data());
+    std::chrono::duration< double > s = std::chrono::steady_clock::now() - t1;
+    PRINTZ("streamed %zu elements (%.2f GB) in %.3f s; top: %f at %u", n,
+          n * sizeof(float) / 1e9, s.count(), vals[0], idxs[0]);
+  }
+  PRINTZ("%s", ok ? "All tests passed" : "Some tests FAILED");
+  return ok ? 0 : 1;
+}
+catch(std::exception& ex) {
+  VLOG(0) << "Exception: " << ex.what();
+  return 1;
+}
@@ -5,7 +5,26 @@
 #include <math.h>
 #include "common/common.h"
 
-#if !COMPILE_FOR_ROCM
+#if COMPILE_FOR_HOST
+#define GPU_COUNT_COMPARE() simt::countCompare()
+#else
+#define GPU_COUNT_COMPARE()
+#endif
+
+#if COMPILE_FOR_HOST
+FORCEINLINE float divApprox(float a, float b) {
+    return a / b;
+}
+
+FORCEINLINE double divApprox(double a, double b) {
+    return a / b;
+}
+
+FORCEINLINE uint32_t bfe(uint32_t src, uint32_t startIdx, uint32_t width)
+{
+    return simt::bfe(src, startIdx, width);
+}
+#elif !COMPILE_FOR_ROCM
 __device__ FORCEINLINE float divApprox(float a, float b) {
     float res;
     asm volatile(R"( {
@@ -41,7 +60,9 @@ enum class ShflType {
 
 __device__ FORCEINLINE uint32_t gpuGetBit(uint32_t src, uint32_t idx)
 {
-#if !COMPILE_FOR_ROCM    
+#if COMPILE_FOR_HOST
+    return simt::bfe(src, idx, 1);
+#elif !COMPILE_FOR_ROCM    
     uint32_t bit;
     asm volatile("bfe.u32 %0, %1, %2, %3;" : "=r"(bit) : "r"(src), "r"(idx), "r"(1));
     return bit;
@@ -97,6 +118,9 @@ __device__ FORCEINLINE  NT shflUpPred(NT val, uint32_t ofs, int32_t& pred,
         uint32_t d[SZ];
     } in{val}, res;
 
+#if COMPILE_FOR_HOST
+    res.d[0] = simt::shuffle(simt::ShflOp::Up, in.d[0], ofs, shfl_c + 1, &pred);
+#else
      asm(R"({
         .reg .pred p;
         .reg .u32 res, pred;
@@ -105,6 +129,7 @@ __device__ FORCEINLINE  NT shflUpPred(NT val, uint32_t ofs, int32_t& pred,
         mov.u32 %0, res;
         mov.u32 %1, pred;
         })" : "=r"(res.d[0]), "=r"(pred) : "r"(in.d[0]), "r"(ofs), "r"(shfl_c), "r"(allmsk));
+#endif
 
     #pragma unroll
     for(uint32_t i = 1; i < SZ; i++) {
@@ -123,6 +148,9 @@ __device__ FORCEINLINE  NT shflDownPred(NT val, uint32_t ofs, int32_t& pred,
         uint32_t d[SZ];
     } in{val}, res;
 
+#if COMPILE_FOR_HOST
+    res.d[0] = simt::shuffle(simt::ShflOp::Down, in.d[0], ofs, shfl_c + 1, &pred);
+#else
      asm(R"({
         .reg .pred p;
         .reg .u32 res, pred;
@@ -131,6 +159,7 @@ __device__ FORCEINLINE  NT shflDownPred(NT val, uint32_t ofs, int32_t& pred,
         mov.u32 %0, res;
         mov.u32 %1, pred;
         })" : "=r"(res.d[0]), "=r"(pred) : "r"(in.d[0]), "r"(ofs), "r"(shfl_c), "r"(allmsk));
+#endif
 
     #pragma unroll
     for(uint32_t i = 1; i < SZ; i++) {
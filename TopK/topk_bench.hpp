@@ -0,0 +1,276 @@
+
+#ifndef TOPK_BENCH_HPP_
+#define TOPK_BENCH_HPP_
+
+// Benchmark suite for batched TopK in the style of Google Benchmark: sweeps
+// the same shapes as BM_SmallTopk<K>/batch_size/n in original_benchmark.txt
+// and reports bytes_per_second / items_per_second counters for every
+// registered backend. Results can also be written as JSON in the format of
+// --benchmark_out of Google Benchmark for regression comparison.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "topk_cpu.hpp"
+
+// one implementation of batched TopK: all shapes are run against each backend
+template < class NT >
+struct TopKBackend {
+
+  virtual ~TopKBackend() = default;
+  // backend name as written to "backend" field of JSON output
+  virtual const char *name() const = 0;
+  virtual bool supports(size_t n, size_t k, size_t batch_size) const = 0;
+  // prepares input data of shape [batch_size, n] for subsequent runs
+  virtual void setup(const NT *data, size_t n, size_t k, size_t batch_size) = 0;
+  // runs TopK 'iters' times and returns elapsed time in seconds as measured
+  // by the backend ("manual time")
+  virtual double run(size_t iters) = 0;
+  // releases memory allocated in setup
+  virtual void teardown() = 0;
+};
+
+// host version of BitonicTopK from topk_cpu.hpp
+template < class NT >
+struct CpuTopKBackend : TopKBackend< NT > {
+
+  explicit CpuTopKBackend(ThreadPool& pool) : m_pool(pool) { }
+
+  const char *name() const override {
+    return "cpu";
+  }
+  bool supports(size_t n, size_t k, size_t) const override {
+    return k <= n;
+  }
+  void setup(const NT *data, size_t n, size_t k, size_t batch_size) override {
+    m_data = data, m_n = n, m_k = k, m_batch = batch_size;
+    m_vals.resize(k * batch_size);
+    m_idxs.resize(k * batch_size);
+  }
+  double run(size_t iters) override {
+    auto t1 = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < iters; i++) {
+      TopKCpu(m_pool, m_data, m_n, m_vals.data(), m_idxs.data(), m_k, m_batch);
+    }
+    std::chrono::duration< double > s = std::chrono::steady_clock::now() - t1;
+    return s.count();
+  }
+  void teardown() override {
+    m_vals = {}, m_idxs = {};
+  }
+
+private:
+  ThreadPool& m_pool;
+  const NT *m_data = nullptr;
+  size_t m_n = 0, m_k = 0, m_batch = 0;
+  std::vector< NT > m_vals;
+  std::vector< uint32_t > m_idxs;
+};
+
+struct TopKBenchOptions {
+  double minTime = 0.5;         // minimal measured time per benchmark (s)
+  std::string filter = ".";     // regex applied to benchmark names
+  std::string outFile;          // JSON output file (empty: none)
+};
+
+struct TopKBenchResult {
+  std::string name;
+  std::string backend;
+  size_t iterations;
+  double realTime, cpuTime;     // per iteration in ms
+  double bytesPerSecond, itemsPerSecond;
+  size_t n, k, batch_size;
+};
+
+namespace topk_bench {
+
+// formats a value with SI suffixes like Google Benchmark counters
+inline std::string humanReadable(double v, bool is1024) {
+  const char *si[] = {"", "k", "M", "G", "T", "P"};
+  const double base = is1024 ? 1024.0 : 1000.0;
+  uint32_t i = 0;
+  for(; std::abs(v) >= base && i < 5; i++) {
+    v /= base;
+  }
+  char buf[64];
+  // NOTE: 1024-based values (bytes_per_second) also use SI suffixes
+  snprintf(buf, sizeof(buf), "%g%s", v, si[i]);
+  return buf;
+}
+
+inline std::string formatSize(size_t n) {
+  char buf[64];
+  if(n >= 1024 && n % 1024 == 0) {
+    snprintf(buf, sizeof(buf), "%zuKi", n / 1024);
+  } else {
+    snprintf(buf, sizeof(buf), "%zu", n);
+  }
+  return buf;
+}
+
+inline std::string formatTime(double ms) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), ms < 1 ? "%.3f ms" : ms < 10 ? "%.2f ms" :
+          ms < 100 ? "%.1f ms" : "%.0f ms", ms);
+  return buf;
+}
+
+inline double processCpuTime() {
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+inline void writeJson(const std::string& fname,
+        const std::vector< TopKBenchResult >& results) {
+
+  FILE *f = fopen(fname.c_str(), "w");
+  if(f == nullptr) {
+    ThrowError< >("Unable to open %s for writing", fname.c_str());
+  }
+  char host[256] = {}, date[64] = {};
+  gethostname(host, sizeof(host) - 1);
+  auto now = time(nullptr);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+  fprintf(f, "{\n  \"context\": {\n    \"date\": \"%s\",\n"
+      "    \"host_name\": \"%s\",\n    \"num_cpus\": %u,\n"
+      "    \"cpu_isa\": \"%s\",\n    \"library_build_type\": \"%s\"\n  },\n"
+      "  \"benchmarks\": [", date, host, std::thread::hardware_concurrency(),
+      TopKCpuIsa(),
+#ifdef NDEBUG
+      "release"
+#else
+      "debug"
+#endif
+      );
+  for(size_t i = 0; i < results.size(); i++) {
+    const auto& r = results[i];
+    fprintf(f, "%s\n    {\n      \"name\": \"%s\",\n"
+      "      \"run_name\": \"%s\",\n      \"run_type\": \"iteration\",\n"
+      "      \"backend\": \"%s\",\n"
+      "      \"iterations\": %zu,\n      \"real_time\": %.9g,\n"
+      "      \"cpu_time\": %.9g,\n      \"time_unit\": \"ms\",\n"
+      "      \"bytes_per_second\": %.9g,\n      \"items_per_second\": %.9g,\n"
+      "      \"n\": %zu,\n      \"k\": %zu,\n      \"batch_size\": %zu\n    }",
+      i == 0 ? "" : ",", r.name.c_str(), r.name.c_str(), r.backend.c_str(),
+      r.iterations,
+      r.realTime, r.cpuTime, r.bytesPerSecond, r.itemsPerSecond, r.n, r.k,
+      r.batch_size);
+  }
+  fprintf(f, "\n  ]\n}\n");
+  fclose(f);
+}
+
+// fills data with random bits: the result does not depend on the number of
+// threads used
+template < class NT >
+void fillRandom(ThreadPool& pool, NT *data, size_t total, uint64_t seed) {
+  pool.parallelFor(0, total, [=](size_t b, size_t e) {
+    for(size_t i = b; i < e; i++) {
+      // splitmix64 of the element index
+      uint64_t z = seed + (i + 1) * 0x9E3779B97F4A7C15ull;
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+      z ^= z >> 31;
+      if constexpr(std::is_floating_point_v< NT >) {
+        data[i] = (NT)((double)(z >> 11) * 0x1.0p-53 * 2.0 - 1.0);
+      } else {
+        data[i] = (NT)z;
+      }
+    }
+  });
+}
+
+} // namespace topk_bench
+
+namespace topk_bench {
+
+// runs all shapes of BM_SmallTopk matching the filter for one backend
+template < class NT >
+void runShapes(ThreadPool& pool, TopKBackend< NT > *backend,
+        const std::regex& filter, double minTime, std::vector< NT >& data,
+        std::vector< TopKBenchResult >& results) {
+
+  for(size_t k : {1, 2, 4, 8, 16}) {
+    auto batches = k < 16 ? std::vector< size_t >{1, 8, 64, 512} :
+                            std::vector< size_t >{16, 64, 512, 1024};
+    for(size_t n : {16*1024, 64*1024, 512*1024, 1024*1024})
+    for(size_t batch_size : batches) {
+
+      char name[128];
+      // same names as in original_benchmark.txt for all backends
+      snprintf(name, sizeof(name), "BM_SmallTopk<%zu>/%zu/%zu/manual_time",
+          k, batch_size, n / 1024);
+      if(!std::regex_search(name, filter) ||
+            !backend->supports(n, k, batch_size))
+        continue;
+
+      size_t total = n * batch_size;
+      data.resize(total);
+      fillRandom(pool, data.data(), total, n * 131 + batch_size);
+      backend->setup(data.data(), n, k, batch_size);
+      backend->run(1); // warm-up
+
+      // grow the number of iterations until the measured time is large enough
+      size_t iters = 1;
+      double secs = 0, cpu = 0;
+      while(true) {
+        auto cpu1 = processCpuTime();
+        secs = backend->run(iters);
+        cpu = processCpuTime() - cpu1;
+        if(secs >= minTime || iters >= 1000000)
+          break;
+        double mult = secs > 0 ? minTime * 1.4 / secs : 10.0;
+        iters = std::max(iters + 1,
+                (size_t)(iters * std::min(10.0, std::max(mult, 2.0))));
+      }
+      backend->teardown();
+
+      TopKBenchResult r{name, backend->name(), iters, secs * 1e3 / iters,
+          cpu * 1e3 / iters, total * sizeof(NT) * iters / secs,
+          total * iters / secs, n, k, batch_size};
+      PRINTZ("%-40s%17s%17s%13zu bytes_per_second=%s/s "
+             "items_per_second=%s/s n=%s k=%zu batch_size=%zu", name,
+             formatTime(r.realTime).c_str(), formatTime(r.cpuTime).c_str(),
+             iters, humanReadable(r.bytesPerSecond, true).c_str(),
+             humanReadable(r.itemsPerSecond, false).c_str(),
+             formatSize(n).c_str(), k, batch_size);
+      results.push_back(std::move(r));
+    } // for n, batch_size
+  } // for k
+}
+
+} // namespace topk_bench
+
+// runs all shapes of BM_SmallTopk for every backend: returns the results and
+// writes them to opts.outFile if given
+template < class NT >
+std::vector< TopKBenchResult > RunTopKBenchmarks(ThreadPool& pool,
+        const std::vector< TopKBackend< NT > *>& backends,
+        const TopKBenchOptions& opts) {
+
+  std::regex filter(opts.filter);
+  std::vector< TopKBenchResult > results;
+  std::vector< NT > data;
+
+  const char *line = "-------------------------------------------------------"
+        "------------------------------------------";
+  for(auto backend : backends) {
+    PRINTZ("Backend: %s\n%s\n%-40s%17s%17s%13s UserCounters...\n%s",
+        backend->name(), line, "Benchmark", "Time", "CPU", "Iterations", line);
+    topk_bench::runShapes(pool, backend, filter, opts.minTime, data, results);
+  }
+  if(!opts.outFile.empty()) {
+    topk_bench::writeJson(opts.outFile, results);
+  }
+  return results;
+}
+
+#endif // TOPK_BENCH_HPP_
@@ -0,0 +1,369 @@
+
+#ifndef TOPK_CPU_HPP_
+#define TOPK_CPU_HPP_
+
+// Host-side implementation of BitonicTopK from topk_kernel.cu.h: used as a
+// fast verifier for GPU results and as a CPU path for small shapes.
+//
+// The GPU version keeps one K-sequence distributed over K lanes of a warp
+// and uses shuffles to compare-exchange elements. Here each SIMD lane keeps
+// its own K-sequence stored in K vector registers (same as the *_regs
+// variants of BitonicTopK), hence all bitonic networks reduce to per-lane
+// min/max and no cross-lane permutes are required. Keys and indices are
+// packed into one 64-bit integer so that a single signed compare matches
+// BitonicTopK::KVT::operator< (equal keys are ordered by index).
+//
+// For k > kTopKMaxBitonicK, RadixTopKCpu performs the same passes as
+// RunTopK_radix and hence returns bit-exact results of the device kernel.
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "common/common.h"
+#include "common/threading.hpp"
+#include "topk_kernel.h"
+
+namespace topk_cpu {
+
+#if defined(__AVX512F__)
+struct SimdI64 {
+  static constexpr uint32_t Width = 8;
+  static constexpr const char *s_name = "AVX-512";
+  __m512i v;
+
+  static SimdI64 load(const int64_t *p) { return {_mm512_loadu_si512(p)}; }
+  void store(int64_t *p) const { _mm512_storeu_si512(p, v); }
+  static SimdI64 set1(int64_t x) { return {_mm512_set1_epi64(x)}; }
+  static SimdI64 min(SimdI64 a, SimdI64 b) { return {_mm512_min_epi64(a.v, b.v)}; }
+  static SimdI64 max(SimdI64 a, SimdI64 b) { return {_mm512_max_epi64(a.v, b.v)}; }
+  // true if a > b for at least one lane
+  static bool anyGreater(SimdI64 a, SimdI64 b) {
+    return _mm512_cmpgt_epi64_mask(a.v, b.v) != 0;
+  }
+};
+#elif defined(__AVX2__)
+struct SimdI64 {
+  static constexpr uint32_t Width = 4;
+  static constexpr const char *s_name = "AVX2";
+  __m256i v;
+
+  static SimdI64 load(const int64_t *p) {
+    return {_mm256_loadu_si256((const __m256i *)p)};
+  }
+  void store(int64_t *p) const { _mm256_storeu_si256((__m256i *)p, v); }
+  static SimdI64 set1(int64_t x) { return {_mm256_set1_epi64x(x)}; }
+  // there is no 64-bit min/max in AVX2: use compare + blend
+  static SimdI64 min(SimdI64 a, SimdI64 b) {
+    return {_mm256_blendv_epi8(a.v, b.v, _mm256_cmpgt_epi64(a.v, b.v))};
+  }
+  static SimdI64 max(SimdI64 a, SimdI64 b) {
+    return {_mm256_blendv_epi8(b.v, a.v, _mm256_cmpgt_epi64(a.v, b.v))};
+  }
+  static bool anyGreater(SimdI64 a, SimdI64 b) {
+    return !_mm256_testz_si256(_mm256_cmpgt_epi64(a.v, b.v),
+                               _mm256_set1_epi64x(-1));
+  }
+};
+#else
+struct SimdI64 { // scalar fallback
+  static constexpr uint32_t Width = 1;
+  static constexpr const char *s_name = "scalar";
+  int64_t v;
+
+  static SimdI64 load(const int64_t *p) { return {*p}; }
+  void store(int64_t *p) const { *p = v; }
+  static SimdI64 set1(int64_t x) { return {x}; }
+  static SimdI64 min(SimdI64 a, SimdI64 b) { return {std::min(a.v, b.v)}; }
+  static SimdI64 max(SimdI64 a, SimdI64 b) { return {std::max(a.v, b.v)}; }
+  static bool anyGreater(SimdI64 a, SimdI64 b) { return a.v > b.v; }
+};
+#endif
+
+// maps keys to unsigned integers preserving the order of KT
+template < class KT >
+FORCEINLINE uint32_t orderedBits(KT key) {
+  static_assert(sizeof(KT) <= sizeof(uint32_t), "Only keys up to 32 bits are supported!");
+  if constexpr(std::is_floating_point_v< KT >) {
+    uint32_t u;
+    std::memcpy(&u, &key, sizeof(u));
+    // flip all bits of negative numbers, only the sign bit otherwise
+    return u ^ ((uint32_t)((int32_t)u >> 31) | 0x80000000u);
+  } else if constexpr(std::is_signed_v< KT >) {
+    return (uint32_t)(int32_t)key ^ 0x80000000u;
+  } else {
+    return key;
+  }
+}
+
+template < class KT >
+FORCEINLINE KT fromOrderedBits(uint32_t u) {
+  if constexpr(std::is_floating_point_v< KT >) {
+    u = (u & 0x80000000u) ? u & 0x7FFFFFFFu : ~u;
+    KT key;
+    std::memcpy(&key, &u, sizeof(u));
+    return key;
+  } else if constexpr(std::is_signed_v< KT >) {
+    return (KT)(int32_t)(u ^ 0x80000000u);
+  } else {
+    return (KT)u;
+  }
+}
+
+// packed key-index pair: comparing packed values as signed integers is the
+// same as comparing BitonicTopK::KVT
+template < class KT >
+FORCEINLINE int64_t packKV(KT key, uint32_t idx) {
+  return (int64_t)((((uint64_t)orderedBits(key) << 32) | idx) ^ (1ull << 63));
+}
+
+template < class KT >
+FORCEINLINE void unpackKV(int64_t x, KT& key, uint32_t& idx) {
+  auto u = (uint64_t)x ^ (1ull << 63);
+  key = fromOrderedBits< KT >((uint32_t)(u >> 32));
+  idx = (uint32_t)u;
+}
+
+template < class KT, uint32_t K >
+struct BitonicTopKCpu {
+
+  static_assert(std::has_single_bit(K), "K must be a power of two!");
+
+  using Vec = SimdI64;
+  constexpr static uint32_t Width = Vec::Width;
+  // the smallest possible packed value, plays the role of 'minVal'
+  constexpr static int64_t s_minVal = std::numeric_limits< int64_t >::min();
+
+  static FORCEINLINE void cmpSwap(Vec& a, Vec& b, bool ascending) {
+    auto lo = Vec::min(a, b), hi = Vec::max(a, b);
+    a = ascending ? lo : hi;
+    b = ascending ? hi : lo;
+  }
+
+  // sorts K-sequences of each lane in ascending order (local_sort_regs)
+  static FORCEINLINE void local_sort(Vec (&A)[K]) {
+    for(uint32_t i = 2; i <= K; i *= 2) {
+      for(uint32_t j = i / 2; j >= 1; j /= 2) {
+        for(uint32_t n = 0; n < K; n++) {
+          if((n & j) == 0) {
+            cmpSwap(A[n], A[n ^ j], (n & i) == 0);
+          }
+        }
+      } // for j
+    } // for i
+  }
+
+  // keeps K greater elements out of two ascending K-sequences:
+  // the result is a bitonic sequence (merge_regs)
+  static FORCEINLINE void merge(Vec (&A)[K], const Vec (&B)[K]) {
+    for(uint32_t n = 0; n < K; n++) {
+      A[n] = Vec::max(A[n], B[K - 1 - n]);
+    }
+  }
+
+  // rebuilds a bitonic K-sequence to an ascending one (rebuild_regs)
+  static FORCEINLINE void rebuild(Vec (&A)[K]) {
+    for(uint32_t j = K / 2; j >= 1; j /= 2) {
+      for(uint32_t n = 0; n < K; n++) {
+        if((n & j) == 0) {
+          cmpSwap(A[n], A[n ^ j], true);
+        }
+      }
+    } // for j
+  }
+
+  // computes top-k elements of one row: vals and idxs are written in
+  // descending order, k <= K and k <= n
+  static void run(const KT *in, uint32_t n, KT *vals, uint32_t *idxs,
+          uint32_t k) {
+
+    constexpr uint32_t ChunkSz = K * Width;
+    alignas(64) int64_t buf[ChunkSz];
+
+    Vec A[K], B[K];
+    for(auto& a : A) {
+      a = Vec::set1(s_minVal);
+    }
+    // each lane keeps K elements not smaller than its A[0], hence keys
+    // smaller than max(A[0]) over all lanes can never get to the final top-K:
+    // such chunks are discarded before packing (common case for large n)
+    uint32_t thKey = 0;
+    for(uint32_t base = 0; base < n; base += ChunkSz) {
+      // element base + r*Width + lane goes to the K-sequence of 'lane'
+      uint32_t num = std::min(ChunkSz, n - base);
+      uint32_t maxKey = 0;
+      for(uint32_t i = 0; i < num; i++) {
+        maxKey = std::max(maxKey, orderedBits(in[base + i]));
+      }
+      // equal keys cannot be skipped since new indices are larger
+      if(maxKey < thKey)
+        continue;
+      for(uint32_t i = 0; i < num; i++) {
+        buf[i] = packKV(in[base + i], base + i);
+      }
+      for(uint32_t i = num; i < ChunkSz; i++) {
+        buf[i] = s_minVal;
+      }
+      auto maxB = B[0] = Vec::load(buf);
+      for(uint32_t r = 1; r < K; r++) {
+        B[r] = Vec::load(buf + r*Width);
+        maxB = Vec::max(maxB, B[r]);
+      }
+      // A[0] is the smallest element kept so far: skip the chunk if
+      // no lane has anything to contribute
+      if(!Vec::anyGreater(maxB, A[0]))
+        continue;
+
+      local_sort(B);
+      merge(A, B);
+      rebuild(A);
+      A[0].store(buf);
+      auto maxA = *std::max_element(buf, buf + Width);
+      thKey = (uint32_t)(((uint64_t)maxA ^ (1ull << 63)) >> 32);
+    }
+    // final reduce: merge ascending K-sequences from all lanes
+    alignas(64) int64_t res[K][Width];
+    for(uint32_t r = 0; r < K; r++) {
+      A[r].store(res[r]);
+    }
+    int32_t pos[Width];
+    std::fill(pos, pos + Width, (int32_t)K - 1);
+    for(uint32_t i = 0; i < k; i++) {
+      uint32_t best = 0;
+      for(uint32_t l = 1; l < Width; l++) {
+        if(pos[l] >= 0 && (pos[best] < 0 || res[pos[l]][l] > res[pos[best]][best]))
+          best = l;
+      }
+      unpackKV(res[pos[best]][best], vals[i], idxs[i]);
+      pos[best]--;
+    }
+  }
+}; // BitonicTopKCpu
+
+template < class KT, uint32_t K >
+void runBatch(ThreadPool& pool, const KT *data, size_t n, KT *vals,
+        uint32_t *idxs, size_t k, size_t batch_size) {
+
+  pool.parallelFor(0, batch_size, 1, [=](size_t b, size_t e) {
+    for(size_t i = b; i < e; i++) {
+      BitonicTopKCpu< KT, K >::run(data + i*n, n, vals + i*k, idxs + i*k, k);
+    }
+  });
+}
+
+// host version of RunTopK_radix: selects top-k composite keys (ordered key
+// bits and index) digit by digit and sorts them. Outputs are in descending
+// order, any k <= n is supported
+template < class KT >
+struct RadixTopKCpu {
+
+  constexpr static uint32_t Bins = 1u << kTopKRadixBits;
+
+  static FORCEINLINE uint64_t composite(const KT *in, uint32_t i) {
+    return ((uint64_t)orderedBits(in[i]) << 32) | i;
+  }
+
+  // 'top' is a scratch buffer reused between rows
+  static void run(const KT *in, uint32_t n, KT *vals, uint32_t *idxs,
+          uint32_t k, std::vector< uint64_t >& top) {
+
+    uint32_t hist[Bins], rem = k, shift = 64 - kTopKRadixBits;
+    uint64_t prefix = 0;
+    for(;; shift -= kTopKRadixBits) {
+      std::fill(hist, hist + Bins, 0);
+      const uint32_t hi = shift + kTopKRadixBits;
+      if(hi == 64) { // the first pass only needs the key bits
+        for(uint32_t i = 0; i < n; i++) {
+          hist[orderedBits(in[i]) >> (32 - kTopKRadixBits)]++;
+        }
+      } else {
+        for(uint32_t i = 0; i < n; i++) {
+          auto c = composite(in, i);
+          if((c >> hi) == (prefix >> hi)) {
+            hist[(c >> shift) & (Bins - 1)]++;
+          }
+        }
+      }
+      uint32_t d = Bins - 1;
+      for(; hist[d] < rem; d--) {
+        rem -= hist[d];
+      }
+      prefix |= (uint64_t)d << shift;
+      if(hist[d] == rem)
+        break;
+    } // for shift
+
+    top.clear();
+    for(uint32_t i = 0; i < n; i++) {
+      auto c = composite(in, i);
+      if((c >> shift) >= (prefix >> shift)) {
+        top.push_back(c);
+      }
+    }
+    std::sort(top.begin(), top.end(), std::greater< uint64_t >());
+    for(uint32_t i = 0; i < k; i++) {
+      vals[i] = fromOrderedBits< KT >((uint32_t)(top[i] >> 32));
+      idxs[i] = (uint32_t)top[i];
+    }
+  }
+}; // RadixTopKCpu
+
+template < class KT >
+void runRadixBatch(ThreadPool& pool, const KT *data, size_t n, KT *vals,
+        uint32_t *idxs, size_t k, size_t batch_size) {
+
+  pool.parallelFor(0, batch_size, 1, [=](size_t b, size_t e) {
+    std::vector< uint64_t > top;
+    top.reserve(k);
+    for(size_t i = b; i < e; i++) {
+      RadixTopKCpu< KT >::run(data + i*n, n, vals + i*k, idxs + i*k, k, top);
+    }
+  });
+}
+
+// computes top-k of one row with k <= n: 'scratch' is used by RadixTopKCpu
+template < class KT >
+void runRow(const KT *in, uint32_t n, KT *vals, uint32_t *idxs, uint32_t k,
+        std::vector< uint64_t >& scratch) {
+  if (k <= 1) return BitonicTopKCpu< KT, 1 >::run(in, n, vals, idxs, k);
+  if (k <= 2) return BitonicTopKCpu< KT, 2 >::run(in, n, vals, idxs, k);
+  if (k <= 4) return BitonicTopKCpu< KT, 4 >::run(in, n, vals, idxs, k);
+  if (k <= 8) return BitonicTopKCpu< KT, 8 >::run(in, n, vals, idxs, k);
+  if (k <= 16) return BitonicTopKCpu< KT, 16 >::run(in, n, vals, idxs, k);
+  RadixTopKCpu< KT >::run(in, n, vals, idxs, k, scratch);
+}
+
+} // namespace topk_cpu
+
+inline const char *TopKCpuIsa() {
+  return topk_cpu::SimdI64::s_name;
+}
+
+// computes top-k elements for each of 'batch_size' rows of size n: same
+// parameters as TypedTopK. Outputs are written in descending order.
+// k <= 16 uses BitonicTopKCpu, larger k - RadixTopKCpu
+template < class KT >
+void TopKCpu(ThreadPool& pool, const KT *data, size_t n, KT *vals,
+        uint32_t *idxs, size_t k, size_t batch_size) {
+
+  if(k == 0 || k > n || n > std::numeric_limits< uint32_t >::max()) {
+    ThrowError< >("TopKCpu: invalid parameters: N = %zu; K = %zu", n, k);
+  }
+  using namespace topk_cpu;
+  if (k <= 1) return runBatch< KT, 1 >(pool, data, n, vals, idxs, k, batch_size);
+  if (k <= 2) return runBatch< KT, 2 >(pool, data, n, vals, idxs, k, batch_size);
+  if (k <= 4) return runBatch< KT, 4 >(pool, data, n, vals, idxs, k, batch_size);
+  if (k <= 8) return runBatch< KT, 8 >(pool, data, n, vals, idxs, k, batch_size);
+  if (k <= 16) return runBatch< KT, 16 >(pool, data, n, vals, idxs, k, batch_size);
+  runRadixBatch< KT >(pool, data, n, vals, idxs, k, batch_size);
+}
+
+#endif // TOPK_CPU_HPP_
@@ -11,7 +11,9 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <limits>
+#include <type_traits>
 
 /*
 /opt/rocm/include/hip/amd_detail/amd_warp_functions.h:
@@ -44,6 +46,7 @@ struct TopK {
     KT key;
     uint32_t idx;
     __device__ FORCEINLINE bool operator >(const KVT& rhs) {
+      GPU_COUNT_COMPARE();
       return key == rhs.key ? idx < rhs.idx : key > rhs.key;
     }
   };
@@ -204,6 +207,7 @@ struct BitonicTopK {
     KT key;
     uint32_t idx;
     __device__ FORCEINLINE bool operator <(const KVT& rhs) {
+      GPU_COUNT_COMPARE();
       return key == rhs.key ? idx < rhs.idx : key < rhs.key;
     }
   };
@@ -458,16 +462,16 @@ __global__ void RunTopK_bitonik_shuffle(const KT * __restrict__ data, uint32_t n
   TopK topk;
    
   constexpr uint32_t WarpSize = WAVEFRONT_SIZE;
-  constexpr auto minVal = std::numeric_limits< KT >::min();
+  constexpr auto minVal = std::numeric_limits< KT >::lowest();
 
   const uint32_t bidx = blockIdx.x, blockSz = blockDim.x;
   auto in = data + n * bidx;
   const uint32_t thid = threadIdx.x, lane = thid % WarpSize;
   uint32_t idx = thid;
 
-  KVT A{idx < n ? in[idx] : minVal, idx};
+  KVT A[1] = {{idx < n ? in[idx] : minVal, idx}};
   //LOUTZ("original: %d", A);
-  topk.template local_sort<1>(A);
+  topk.local_sort(A, 1);
     
   uint32_t i = 0;
   for(idx += blockSz; ; idx += blockSz, i++) {
@@ -479,13 +483,13 @@ __global__ void RunTopK_bitonik_shuffle(const KT * __restrict__ data, uint32_t n
      //__builtin_amdgcn_update_dpp();
     //__builtin_amdgcn_ds_sizzle();
 
-    KVT B{idx < n ? in[idx] : minVal, idx};
+    KVT B[1] = {{idx < n ? in[idx] : minVal, idx}};
     // if(thid == 1023)
     // LOUTZ("loaded B: %d = %d", idx, B.key);
-    local_sort(B);
-    merge(A, B);
+    topk.local_sort(B, 1);
+    topk.merge(A[0], B[0]);
     //OUTZ("%d: idx: %d: xA = %d, A = %d; xB = %d, B = %d", thid, idx, xA, A, xB, B);
-    rebuild(A);
+    topk.rebuild(A);
     
     // if(idx < n)
     // if(lane == 0) {
@@ -495,23 +499,151 @@ __global__ void RunTopK_bitonik_shuffle(const KT * __restrict__ data, uint32_t n
     // __syncthreads();
   } // for idx
 
-  topk.merge_warps(thid, blockSz, A, (KVT *)g_shared_mem);
+  topk.merge_warps(thid, blockSz, A[0], (KVT *)g_shared_mem);
   if(thid < WarpSize) {
 
-    topk.final_reduce(A, KVT{minVal, 0});
+    topk.template final_reduce< true >(A[0], KVT{minVal, 0});
  
     //LOUTZ("final: %d", A.key);
-    auto vals_out = result + k * bidx + thid;
-    auto idxs_out = result_idxs + k * bidx + thid;
+    // lanes [K - k, K) keep top-k elements in ascending order:
+    // write them out in descending order
+    auto vals_out = result + k * bidx;
+    auto idxs_out = result_idxs + k * bidx;
 
     uint32_t diff = thid - (K - k);
     if(diff < k) { // use unsigned compare ! 
-      vals_out[0] = A.key;
-      idxs_out[0] = A.idx;
+      vals_out[k - 1 - diff] = A[0].key;
+      idxs_out[k - 1 - diff] = A[0].idx;
     }
   } // if(warpId)  
 } // RunTopK_bitonik_shuffle
 
+// maps keys to unsigned integers preserving the order of KT
+// (same as topk_cpu::orderedBits)
+template <typename KT>
+__device__ FORCEINLINE uint32_t radixOrderedBits(KT key) {
+  static_assert(sizeof(KT) == sizeof(uint32_t), "Only 32-bit keys supported!");
+  uint32_t u;
+  memcpy(&u, &key, sizeof(u));
+  if constexpr(std::is_floating_point_v< KT >) {
+    // flip all bits of negative numbers, only the sign bit otherwise
+    return u ^ ((uint32_t)((int32_t)u >> 31) | 0x80000000u);
+  } else if constexpr(std::is_signed_v< KT >) {
+    return u ^ 0x80000000u;
+  }
+  return u;
+}
+
+template <typename KT>
+__device__ FORCEINLINE KT radixFromOrderedBits(uint32_t u) {
+  if constexpr(std::is_floating_point_v< KT >) {
+    u = (u & 0x80000000u) ? u & 0x7FFFFFFFu : ~u;
+  } else if constexpr(std::is_signed_v< KT >) {
+    u ^= 0x80000000u;
+  }
+  KT key;
+  memcpy(&key, &u, sizeof(u));
+  return key;
+}
+
+// composite keys are unique within a row and are ordered the same way 
+// as BitonicTopK::KVT (equal keys are ordered by index)
+template <typename KT>
+__device__ FORCEINLINE uint64_t radixComposite(const KT *in, uint32_t i) {
+  return ((uint64_t)radixOrderedBits(in[i]) << 32) | i;
+}
+
+// Radix-select TopK for k <= kTopKMaxRadixK: one block processes one row.
+// Each pass builds a histogram of the next digit of composite keys which
+// share the prefix found so far: the digit containing the k-th greatest
+// element extends the prefix. As soon as all elements with the current prefix
+// are needed, elements whose composite keys are not below the prefix are
+// exactly the top-k: these are collected in shared memory and sorted in
+// descending order with a block-wide bitonic sort.
+// Shared memory requirements: sizeof(TopKRadixShared)
+template <typename KT>
+__launch_bounds__(1024, 1)
+__global__ void RunTopK_radix(const KT * __restrict__ data, uint32_t n, 
+    KT * __restrict__ result, uint32_t * __restrict__ result_idxs, uint32_t k) 
+{
+  constexpr uint32_t Bins = 1u << kTopKRadixBits;
+  auto& sh = *(TopKRadixShared *)g_shared_mem;
+  const uint32_t thid = threadIdx.x, blockSz = blockDim.x;
+  auto in = data + (size_t)n * blockIdx.x;
+
+  if(thid == 0) {
+    sh.prefix = 0, sh.remaining = k, sh.numTop = 0;
+  }
+  uint32_t shift = 64 - kTopKRadixBits;
+  for(;; shift -= kTopKRadixBits) {
+    for(uint32_t i = thid; i < Bins; i += blockSz) {
+      sh.hist[i] = 0;
+    }
+    __syncthreads();
+    // digits above 'hi' are already decided
+    const uint32_t hi = shift + kTopKRadixBits;
+    const uint64_t prefix = sh.prefix;
+    for(uint32_t i = thid; i < n; i += blockSz) {
+      auto c = radixComposite(in, i);
+      if(hi == 64 || (c >> hi) == (prefix >> hi)) {
+        atomicAdd(&sh.hist[(c >> shift) & (Bins - 1)], 1u);
+      }
+    }
+    __syncthreads();
+    if(thid == 0) {
+      // find the digit of the 'remaining'-th greatest element
+      uint32_t d = Bins - 1, rem = sh.remaining;
+      for(; sh.hist[d] < rem; d--) {
+        rem -= sh.hist[d];
+      }
+      sh.prefix = prefix | ((uint64_t)d << shift);
+      sh.remaining = rem;
+      // composite keys are unique: this always holds for the last digit
+      sh.done = sh.hist[d] == rem;
+    }
+    __syncthreads();
+    if(sh.done) 
+      break;
+  } // for shift
+
+  const uint64_t prefix = sh.prefix >> shift;
+  for(uint32_t i = thid; i < n; i += blockSz) {
+    auto c = radixComposite(in, i);
+    if((c >> shift) >= prefix) {
+      sh.top[atomicAdd(&sh.numTop, 1u)] = c;
+    }
+  }
+  // pad to the power of two: zeros are sorted to the end
+  uint32_t S = 1;
+  while(S < k) S *= 2;
+  for(uint32_t i = k + thid; i < S; i += blockSz) {
+    sh.top[i] = 0;
+  }
+  __syncthreads();
+
+  for(uint32_t size = 2; size <= S; size *= 2) {
+    for(uint32_t stride = size / 2; stride > 0; stride /= 2) {
+      for(uint32_t i = thid; i < S / 2; i += blockSz) {
+        uint32_t lo = 2 * stride * (i / stride) + i % stride, hi = lo + stride;
+        bool descending = (lo & size) == 0;
+        auto a = sh.top[lo], b = sh.top[hi];
+        if((a < b) == descending) {
+          sh.top[lo] = b, sh.top[hi] = a;
+        }
+      }
+      __syncthreads();
+    } // for stride
+  } // for size
+
+  auto vals_out = result + k * blockIdx.x;
+  auto idxs_out = result_idxs + k * blockIdx.x;
+  for(uint32_t i = thid; i < k; i += blockSz) {
+    auto c = sh.top[i];
+    vals_out[i] = radixFromOrderedBits< KT >((uint32_t)(c >> 32));
+    idxs_out[i] = (uint32_t)c;
+  }
+} // RunTopK_radix
+
 
 // B - number of top elements which are searched for each subrange [1,2,3,4]
 // this also defines the minimal number of registers per thread
@@ -711,15 +843,27 @@ __global__ void RunTopK_test(KT* data, uint32_t n, KT* result, uint32_t* result_
   OUTZ("%d: squashed: %d", lane, A);
 }
 
+#if COMPILE_FOR_HOST
+// untyped kernels are launched through the host runtime registry
+#define TOPK_KERNEL_PTR(...) hostrt::registerKernel(__VA_ARGS__)
+#else
+#define TOPK_KERNEL_PTR(...) reinterpret_cast<void*>(__VA_ARGS__)
+#endif
+
 template <typename T, size_t K>
 void* GetTopKKernelForK(size_t n_threads) {
 #if USE_TOPK_DEFAULT
-  return reinterpret_cast<void*>(RunTopK_default<K, T>);
+  return TOPK_KERNEL_PTR(RunTopK_default<K, T>);
 #else  
-  return reinterpret_cast<void*>(RunTopK_subranges<K, T>);
-  //return reinterpret_cast<void*>(RunTopK_new<K, T>);
+  return TOPK_KERNEL_PTR(RunTopK_bitonik_shuffle<K, T>);
+  //return reinterpret_cast<void*>(RunTopK_subranges<K, T>);
           //RunTopK_test<T>);
 #endif
 }
 
+template <typename T>
+void* GetRadixTopKKernel() {
+  return TOPK_KERNEL_PTR(RunTopK_radix<T>);
+}
+
 #endif  // TOPK_KERNEL_CU_H_
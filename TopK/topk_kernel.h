@@ -18,6 +18,9 @@ limitations under the License.
 
 #include <stddef.h>
 #include <stdint.h>
+#include <algorithm>
+#include <bit>
+#include <limits>
 
 #if COMPILE_FOR_ROCM  // warp size is 64 for ROCM
 #ifndef __AMDGCN_WAVEFRONT_SIZE
@@ -25,6 +28,9 @@ limitations under the License.
 #else
 #define WAVEFRONT_SIZE __AMDGCN_WAVEFRONT_SIZE
 #endif
+#elif COMPILE_FOR_HOST // SIMT emulation, see common/simt_emulator.hpp
+#include "common/simt_emulator.hpp"
+#define WAVEFRONT_SIZE HOST_WAVEFRONT_SIZE
 #else // NVIDIA
 #define WAVEFRONT_SIZE 32 
 #endif
@@ -32,17 +38,114 @@ limitations under the License.
 #define USE_TOPK_DEFAULT 0
 
 constexpr size_t kTopKMaxThreadsPerBlock = 1024;
+// largest k handled by the bitonic kernels (one K-sequence per warp)
+constexpr size_t kTopKMaxBitonicK = 16;
+// largest k handled by the radix-select kernel (limited by shared memory)
+constexpr size_t kTopKMaxRadixK = 256;
+// digit size of radix-select passes
+constexpr uint32_t kTopKRadixBits = 8;
+
+// shared memory layout of RunTopK_radix
+struct TopKRadixShared {
+  uint64_t top[kTopKMaxRadixK];          // selected composite keys
+  uint32_t hist[1u << kTopKRadixBits];   // digit histogram of the current pass
+  uint64_t prefix;                       // digits of the k-th element found so far
+  uint32_t remaining;                    // # of elements left to select within prefix
+  uint32_t done;                         // all elements with prefix are selected
+  uint32_t numTop;                       // # of selected elements
+};
+
+enum class TopKAlgo {
+  Bitonic,      // RunTopK_bitonik_shuffle: k <= kTopKMaxBitonicK
+  RadixSelect,  // RunTopK_radix: k <= kTopKMaxRadixK
+};
+
+struct TopKConfig {
+  TopKAlgo algo;
+  uint32_t K;             // k rounded up to a power of two (Bitonic only)
+  uint32_t num_threads;   // block size
+  uint32_t shmem_size;    // dynamic shared memory per block
+  double cost;            // estimated cost (see SelectTopKConfig)
+};
+
+// Analytic cost model used to select the TopK kernel and its block size.
+// Costs are counted in warp-synchronous steps of one thread (load, shuffle +
+// compare, shared atomic), each block processes one row and 
+// 'resident_threads' is the number of threads the device runs concurrently
+// (SMs x max threads per SM). The total cost is the cost of one block times
+// the number of waves needed for the batch.
+template <typename T>
+TopKConfig SelectTopKConfig(size_t n, size_t k, size_t batch_size, 
+        size_t resident_threads) {
+
+  constexpr double cLoad = 1, cAtomic = 4, cSync = 2;
+  struct KVT { T key; uint32_t idx; }; // same size as BitonicTopK::KVT
+  auto log2 = [](size_t x) { return (double)std::bit_width(x) - 1; };
+  auto waves = [=](size_t threads) {
+    return (double)((batch_size * threads + resident_threads - 1) / 
+            std::max< size_t >(resident_threads, 1));
+  };
+
+  TopKConfig best{TopKAlgo::Bitonic, 0, 0, 0, 
+        std::numeric_limits< double >::infinity()};
+  if (k == 0 || k > n || k > kTopKMaxRadixK) {
+    return best;
+  }
+  for (size_t B = WAVEFRONT_SIZE; B <= kTopKMaxThreadsPerBlock; B *= 2) {
+    const double iters = (double)((n + B - 1) / B);
+    if (k <= kTopKMaxBitonicK) {
+      // local_sort + merge + rebuild for each loaded element, then
+      // merge_warps over log2(B / W) levels and final_reduce
+      const size_t K = std::bit_ceil(k);
+      const double logK = log2(K), 
+            step = logK * (logK + 1) / 2 + 1 + logK,
+            block = iters * (cLoad + step) + 
+                  log2(B / WAVEFRONT_SIZE) * (logK + 1 + cSync) + 
+                  log2(WAVEFRONT_SIZE / K) * (logK + 2),
+            cost = waves(B) * block;
+#if USE_TOPK_DEFAULT
+      const uint32_t shmem = K * sizeof(uint64_t) * WAVEFRONT_SIZE;
+#else
+      const uint32_t shmem = B / 2 * sizeof(KVT);
+#endif
+      if (cost < best.cost) {
+        best = {TopKAlgo::Bitonic, (uint32_t)K, (uint32_t)B, shmem, cost};
+      }
+    }
+    // one histogram pass per 8-bit digit of the key (ties at the threshold
+    // need further passes over index digits which are not modeled), a
+    // selection pass and a bitonic sort of the selected elements
+    const size_t S = std::bit_ceil(k);
+    const double logS = log2(S), 
+          passes = 8.0 * sizeof(T) / kTopKRadixBits,
+          hist = iters * (cLoad + cAtomic) + (1u << kTopKRadixBits) + 3 * cSync,
+          sort = logS * (logS + 1) / 2 * ((S / 2 + B - 1) / B + cSync),
+          block = passes * hist + iters * (cLoad + cAtomic) + sort,
+          cost = waves(B) * block;
+    if (cost < best.cost) {
+      best = {TopKAlgo::RadixSelect, 0, (uint32_t)B, 
+              (uint32_t)sizeof(TopKRadixShared), cost};
+    }
+  }
+  return best;
+}
 
 template <typename T, size_t K>
 void* GetTopKKernelForK(size_t n_threads);
 
 template <typename T>
-void* GetKernel(size_t n_threads, size_t k) {
-  // if (k <= 1) return GetTopKKernelForK<T, 1>(n_threads);
-  // if (k <= 2) return GetTopKKernelForK<T, 2>(n_threads);
-  // if (k <= 4) return GetTopKKernelForK<T, 4>(n_threads);
-  //if (k <= 8) return GetTopKKernelForK<T, 8>(n_threads);
-  if (k <= 16) return GetTopKKernelForK<T, 16>(n_threads);
+void* GetRadixTopKKernel();
+
+template <typename T>
+void* GetKernel(const TopKConfig& cfg) {
+  // k the cost model rejected (k == 0, k > n or k > kTopKMaxRadixK)
+  if (cfg.num_threads == 0) return nullptr;
+  if (cfg.algo == TopKAlgo::RadixSelect) return GetRadixTopKKernel<T>();
+  if (cfg.K <= 1) return GetTopKKernelForK<T, 1>(cfg.num_threads);
+  if (cfg.K <= 2) return GetTopKKernelForK<T, 2>(cfg.num_threads);
+  if (cfg.K <= 4) return GetTopKKernelForK<T, 4>(cfg.num_threads);
+  if (cfg.K <= 8) return GetTopKKernelForK<T, 8>(cfg.num_threads);
+  if (cfg.K <= 16) return GetTopKKernelForK<T, 16>(cfg.num_threads);
   return nullptr;
 }
 
@@ -15,12 +15,20 @@ limitations under the License.
 
 #include "topk_kernel.cu.h"
 
+#if COMPILE_FOR_HOST
+SIMT_DEFINE_DYNAMIC_SHARED(int32_t, g_shared_mem);
+#endif
 
-// template void* GetTopKKernelForK<float, 1>(size_t n_threads);
-// template void* GetTopKKernelForK<float, 2>(size_t n_threads);
-// template void* GetTopKKernelForK<float, 4>(size_t n_threads);
-// template void* GetTopKKernelForK<float, 8>(size_t n_threads);
-//template void* GetTopKKernelForK<float, 16>(size_t n_threads);
+template void* GetTopKKernelForK<float, 1>(size_t n_threads);
+template void* GetTopKKernelForK<float, 2>(size_t n_threads);
+template void* GetTopKKernelForK<float, 4>(size_t n_threads);
+template void* GetTopKKernelForK<float, 8>(size_t n_threads);
+template void* GetTopKKernelForK<float, 16>(size_t n_threads);
+template void* GetRadixTopKKernel<float>();
 
-//template void* GetTopKKernelForK<uint32_t, 8>(size_t n_threads);
+template void* GetTopKKernelForK<uint32_t, 1>(size_t n_threads);
+template void* GetTopKKernelForK<uint32_t, 2>(size_t n_threads);
+template void* GetTopKKernelForK<uint32_t, 4>(size_t n_threads);
+template void* GetTopKKernelForK<uint32_t, 8>(size_t n_threads);
 template void* GetTopKKernelForK<uint32_t, 16>(size_t n_threads);
+template void* GetRadixTopKKernel<uint32_t>();
@@ -1,37 +1,28 @@
 
 #include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include <bit>
 #include <numeric>
 #include <iostream>
 #include <random>
 #include "topk_kernel.h"
+#include "topk_cpu.hpp"
+#include "topk_bench.hpp"
 #include "common/common_utils.hpp"
+#include "common/check_data.hpp"
+#include "common/random.hpp"
 
-size_t NumThreadsNew(size_t n, size_t k, size_t batch_size) 
-{
-  size_t warp_size = COMPILE_FOR_ROCM ? 64 : 32;
-  size_t n_threads = (n / k), n_threads_warp = 
-        ((n_threads + warp_size - 1) / warp_size) * warp_size;
-
-  // for large k, reduce maximal block size to reduce register pressure
-  size_t max_threads = (k > 8 ? 512 : 1024);
-  n_threads_warp = std::min(n_threads_warp, max_threads);
-  
-  VLOG("n: " << n << "; k: " << k << " n_threads: " << n_threads 
-      << "; n_threads_warp: " << n_threads_warp);
-  return 0;
-}
-
-size_t NumThreads(size_t n, size_t k, size_t batch_size) {
-  // Estimate number of threads per block that can run concurrently given the
-  // register footprint.
-  size_t threads_per_block =
-      std::min(512 * (16 / k), kTopKMaxThreadsPerBlock);
-  // Minimum amount of data that each thread needs to receive for the algorithm.
-  size_t min_slice = std::bit_floor(n / std::bit_ceil(k));
-  VLOG(0) << "threads_per_block, min_slice: " << threads_per_block << ',' << min_slice;
-  return std::min(threads_per_block, min_slice);
+// number of threads the device runs concurrently: used by the cost model
+size_t ResidentThreads() {
+  static size_t threads = [] {
+    int dev = 0;
+    cudaDeviceProp props;
+    CHK(cudaGetDevice(&dev));
+    CHK(cudaGetDeviceProperties(&props, dev));
+    return (size_t)props.multiProcessorCount * props.maxThreadsPerMultiProcessor;
+  }();
+  return threads;
 }
 
 // Helper type for converting the untyped arguments of RunTopk to TypedTopk
@@ -61,41 +52,42 @@ void calcOccupancy(const void *kernel) {
   VLOG(0) << "minGridSize: " << minGridSize << " potential BlockSize: " << blockSize;
 }
 
+// launches TopK kernel selected by the cost model on the given stream 
+// without synchronization
 template <typename T>
-void TypedTopK(TopkArgs<T> args) 
+void LaunchTopK(TopkArgs<T> args, cudaStream_t stream = 0, bool verbose = false)
 {
-  uint32_t num_threads = NumThreads(args.num_elements, args.k, args.batch_size);
-  if (num_threads == 0) {
-    throw std::runtime_error(
-        "Invalid kernel parameters. This is likely a bug in the "
-        "TopkSpecializer.");
+  auto cfg = SelectTopKConfig<T>(args.num_elements, args.k, args.batch_size,
+          ResidentThreads());
+  void* kernel = GetKernel<T>(cfg);
+  if (kernel == nullptr || args.num_elements > 
+        std::numeric_limits< uint32_t >::max()) {
+    ThrowError< >("TopK: unsupported parameters: N = %zu; K = %zu", 
+          args.num_elements, args.k);
   }
-  void* kernel = GetKernel<T>(num_threads, args.k);
-
   uint32_t blocks_per_grid = args.batch_size;
-  constexpr size_t max_kv_size = sizeof(uint64_t);
-  // Allocate shmem assuming we have a full reduction.
-#if USE_TOPK_DEFAULT  
-  uint32_t shmem_size = std::bit_ceil(args.k) * max_kv_size * WAVEFRONT_SIZE;
-#else
-  //num_threads = args.num_elements / std::bit_ceil(args.k);
-  num_threads = 64;
-  num_threads = (num_threads + WAVEFRONT_SIZE - 1) & ~(WAVEFRONT_SIZE - 1);
-  // 16Kb per block => 4096 words of mem; 512 threads => 16 elements per thread
-  uint32_t shmem_size = num_threads * sizeof(uint32_t) / 2;
-#endif
-  VLOG("Testing N = " << args.num_elements << "; K = " << args.k <<
+  if(verbose) {
+    VLOG(0) << "Testing N = " << args.num_elements << "; K = " << args.k <<
           "; batch_size: " << args.batch_size << 
-          "; n_blocks: " << blocks_per_grid << "; shmem_size: " << shmem_size
-        << " num_threads: " << num_threads);
-
-  void* kernel_args[] = {&args.data, &args.num_elements, &args.top_elements,
-                         &args.top_indices, &args.k};
+          (cfg.algo == TopKAlgo::Bitonic ? "; bitonic" : "; radix") <<
+          "; n_blocks: " << blocks_per_grid << "; shmem_size: " << 
+          cfg.shmem_size << " num_threads: " << cfg.num_threads;
+  }
+  // kernels take 32-bit sizes
+  uint32_t n = args.num_elements, k = args.k;
+  void* kernel_args[] = {&args.data, &n, &args.top_elements,
+                         &args.top_indices, &k};
 
   //calcOccupancy(kernel);
+  (void)cudaLaunchKernel(kernel, blocks_per_grid, cfg.num_threads, 
+                       kernel_args, cfg.shmem_size, stream);
+}
+
+template <typename T>
+void TypedTopK(TopkArgs<T> args) 
+{
   CU_BEGIN_TIMING(0)
-  (void)cudaLaunchKernel(kernel, blocks_per_grid, num_threads, kernel_args,
-                       shmem_size, 0);
+  LaunchTopK(args, 0, i == 0);
   CU_END_TIMING("TopK N = %zu; K = %zu; batch_size: %zu", 
       args.num_elements, args.k, args.batch_size);
 
@@ -103,8 +95,55 @@ void TypedTopK(TopkArgs<T> args)
   (void)cudaDeviceSynchronize();                       
 }
 
+// TopK kernels timed with GPU events
+template < class NT >
+struct DeviceTopKBackend : TopKBackend< NT > {
+
+  ~DeviceTopKBackend() override {
+    teardown();
+  }
+  const char *name() const override {
+    return "device";
+  }
+  bool supports(size_t n, size_t k, size_t batch_size) const override {
+    return GetKernel<NT>(SelectTopKConfig<NT>(n, k, batch_size, 
+          ResidentThreads())) != nullptr;
+  }
+  void setup(const NT *data, size_t n, size_t k, size_t batch_size) override {
+    teardown();
+    m_args = {nullptr, n, nullptr, nullptr, k, batch_size};
+    CHK(cudaMalloc((void**)&m_args.data, n * batch_size * sizeof(NT)));
+    CHK(cudaMalloc((void**)&m_args.top_elements, k * batch_size * sizeof(NT)));
+    CHK(cudaMalloc((void**)&m_args.top_indices, 
+          k * batch_size * sizeof(uint32_t)));
+    CHK(cudaMemcpy(m_args.data, data, n * batch_size * sizeof(NT),
+          cudaMemcpyHostToDevice));
+  }
+  double run(size_t iters) override {
+    GpuTimer timer;
+    timer.Start();
+    for(size_t i = 0; i < iters; i++) {
+      LaunchTopK(m_args);
+    }
+    timer.Stop();
+    CHK(cudaPeekAtLastError());
+    return timer.ElapsedMillis() * 1e-3;
+  }
+  void teardown() override {
+    for(void *ptr : {(void *)m_args.data, (void *)m_args.top_elements,
+          (void *)m_args.top_indices}) {
+      if(ptr != nullptr) (void)cudaFree(ptr);
+    }
+    m_args = {};
+  }
+
+private:
+  TopkArgs< NT > m_args{};
+};
+
 template < class NT >
-void benchmark_topk(size_t batch_size, size_t N, size_t K, bool verify = true) 
+void benchmark_topk(ThreadPool& pool, size_t batch_size, size_t N, size_t K, 
+        bool verify = true) 
 {
   const size_t in_total = batch_size * N,
          out_total = batch_size * K;
@@ -112,12 +151,7 @@ void benchmark_topk(size_t batch_size, size_t N, size_t K, bool verify = true)
   HVector< int32_t > indices(out_total);
 
   std::random_device rd;
-  int seed = rd();  
-  mersenne::init_genrand(seed);
-  for(size_t i = 0; i < in_total; i++) {
-    RandomBits(values[i]);
-    //values[i] = i+1;
-  }
+  RandomBits(&pool, values.data(), in_total, rd());
   values.copyHToD();
   TypedTopK< NT >({values.devPtr, N, top_elems.devPtr, 
          (uint32_t *)indices.devPtr, K, batch_size});
@@ -129,57 +163,108 @@ void benchmark_topk(size_t batch_size, size_t N, size_t K, bool verify = true)
   top_elems.copyDToH();
   indices.copyDToH();
 
-  auto vptr = values.data();  // original CPU data (unsorted)
-  auto gpu_iptr = indices.data();
-  auto gpu_vptr = top_elems.data();
+  // truth values are computed by the host version of BitonicTopK
+  std::vector< NT > truth_vals(out_total);
+  std::vector< uint32_t > truth_idxs(out_total);
+  CPU_BEGIN_TIMING(CPU);
+  TopKCpu(pool, values.data(), N, truth_vals.data(), truth_idxs.data(), 
+          K, batch_size);
+  CPU_END_TIMING(CPU, 1, "TopKCpu (%s) N = %zu; K = %zu; batch_size: %zu", 
+          TopKCpuIsa(), N, K, batch_size);
 
-  std::vector< NT > truth_vals(K), gpu_vals(K);
-  std::vector< int32_t > idxs(N);
-  for(size_t i = 0; i < batch_size; i++, gpu_iptr += K, gpu_vptr += K, vptr += N) {
-    
-    std::iota(idxs.begin(), idxs.end(), 0);
-    std::sort(idxs.begin(), idxs.end(), [vptr](const auto& a, const auto& b) {
-      return vptr[a] > vptr[b];
-    });
-    // save truth values before sorting idxs to keep it consistent with gpu_vptr
-    for(size_t j = 0; j < K; j++) {
-      truth_vals[j] = vptr[idxs[j]];
+  auto gpu_iptr = (uint32_t *)indices.data();
+  auto gpu_vptr = top_elems.data();
+  auto vptr = truth_vals.data();
+  auto iptr = truth_idxs.data();
+  // rows are compared as sets: sort indices ascending and values descending
+  pool.parallelFor(0, batch_size, [&](size_t b, size_t e) {
+    for(size_t i = b * K; i < e * K; i += K) {
+      std::sort(iptr + i, iptr + i + K);
+      std::sort(gpu_iptr + i, gpu_iptr + i + K);
+      std::sort(gpu_vptr + i, gpu_vptr + i + K, std::greater<NT>());
     }
-
-    bool print_if_differs = true;
-    int32_t eps = 0;
-    std::sort(idxs.begin(), idxs.begin() + K);
-    std::sort(gpu_iptr, gpu_iptr + K);
-    // descending sort !! 
-    std::sort(gpu_vptr, gpu_vptr + K, std::greater<NT>());
-
-    checkme(gpu_iptr, idxs.data(), K, K, 1, eps, print_if_differs);
-    //VLOG("------------------------------------------------------")
-    checkme(gpu_vptr, truth_vals.data(), K, K, 1, (NT)1e-5, print_if_differs);
+  });
+  auto ires = checkData(&pool, gpu_iptr, iptr, K, K, batch_size);
+  CheckOptions opts;
+  opts.absTol = 1e-5;
+  auto vres = checkData(&pool, gpu_vptr, vptr, K, K, batch_size, opts);
+  if(!ires.ok() || !vres.ok()) {
+    ires.print("TopK indices");
+    vres.print("TopK values");
   }
-    
 }
 
-int main() try 
+// runs the verification sweep
+void verify_topk(ThreadPool& pool) 
 {
-  DeviceInit();
-
-  benchmark_topk< uint32_t >(1, 1024*2, 16, false);
-  return 0;
-
   //size_t batch_size, size_t N, size_t K
   for(size_t batch_size: {10, 20, 100, 200, 1000}) 
   {
     for(size_t N: {100, 200, 300, 999, 1050, 2000, 6333, 7889, 12312})
     //for(size_t N: {1024, 2048, 4096, 8192}) 
     {
-      for(size_t K: {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16})
+      for(size_t K: {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+                     17, 32, 50, 64, 100, 128, 200, 256})
       {  
-        //benchmark_topk< float >(batch_size, N, K);
+        if(K <= N) benchmark_topk< uint32_t >(pool, batch_size, N, K);
       }
     }
   }
 }
+
+// usage: topk [--verify] [--backend=device|cpu|all] [--benchmark_filter=<regex>]
+//             [--benchmark_min_time=<sec>] [--benchmark_out=<file.json>]
+int main(int argc, char **argv) try 
+{
+  TopKBenchOptions opts;
+  std::string backend = "device";
+  bool verify = false;
+  for(int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&arg](const char *prefix) -> const char * {
+      auto len = strlen(prefix);
+      return arg.compare(0, len, prefix) == 0 ? arg.c_str() + len : nullptr;
+    };
+    if(arg == "--verify") {
+      verify = true;
+    } else if(auto v = value("--backend=")) {
+      backend = v;
+    } else if(auto v = value("--benchmark_filter=")) {
+      opts.filter = v;
+    } else if(auto v = value("--benchmark_min_time=")) {
+      opts.minTime = std::stod(v);
+    } else if(auto v = value("--benchmark_out=")) {
+      opts.outFile = v;
+    } else {
+      ThrowError< >("Unknown argument: %s", arg.c_str());
+    }
+  }
+  ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+  CpuTopKBackend< uint32_t > cpu(pool);
+  std::unique_ptr< DeviceTopKBackend< uint32_t > > device;
+  std::vector< TopKBackend< uint32_t > *> backends;
+
+  if(verify || backend == "device" || backend == "all") {
+    DeviceInit();
+    device = std::make_unique< DeviceTopKBackend< uint32_t > >();
+  }
+  if(verify) {
+    verify_topk(pool);
+    return 0;
+  }
+  if(backend == "device" || backend == "all") {
+    backends.push_back(device.get());
+  }
+  if(backend == "cpu" || backend == "all") {
+    backends.push_back(&cpu);
+  }
+  if(backends.empty()) {
+    ThrowError< >("Unknown backend: %s", backend.c_str());
+  }
+  RunTopKBenchmarks(pool, backends, opts);
+  return 0;
+}
 catch(std::exception& ex) {
   VLOG(0) << "Exception: " << ex.what();
+  return 1;
 }
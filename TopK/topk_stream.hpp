@@ -0,0 +1,288 @@
+
+#ifndef TOPK_STREAM_HPP_
+#define TOPK_STREAM_HPP_
+
+// Streaming TopK on the host: the row-major [batch_size, n] input is consumed
+// in chunks (from a file, mmap or a generator) and never materialized.
+// Each chunk is split into slices which are reduced to top-k in parallel by
+// the host engine (topk_cpu.hpp); slice results are folded into a running
+// K-element state per row using the Push semantics of TopK<K,KT>: the state is
+// kept in descending order and a new element replaces the smallest one.
+// Loading of the next chunk runs on a separate thread while the current one
+// is processed (double buffering).
+//
+// Equal keys are ordered by index the same way as in TopKCpu, hence results
+// are bit-exact with TopKCpu run on the materialized input.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "topk_cpu.hpp"
+
+// source of a row-major [batch_size, n] input consumed in chunks
+template < class KT >
+struct TopKChunkSource {
+
+  virtual ~TopKChunkSource() = default;
+  // reads up to 'max' next elements either into 'buf' or returns a pointer to
+  // memory owned by the source in 'data'. Returns 0 at the end of input.
+  // Called from the loader thread
+  virtual size_t read(KT *buf, size_t max, const KT *& data) = 0;
+};
+
+// raw binary file read with stdio
+template < class KT >
+class FileChunkSource : public TopKChunkSource< KT > {
+public:
+  explicit FileChunkSource(const std::string& fname) {
+    m_file = fopen(fname.c_str(), "rb");
+    if(m_file == nullptr) {
+      ThrowError< >("Unable to open %s", fname.c_str());
+    }
+  }
+  ~FileChunkSource() override {
+    fclose(m_file);
+  }
+  size_t read(KT *buf, size_t max, const KT *& data) override {
+    data = buf;
+    auto num = fread(buf, sizeof(KT), max, m_file);
+    if(num < max && ferror(m_file)) {
+      ThrowError< >("FileChunkSource: read error");
+    }
+    return num;
+  }
+
+private:
+  FILE *m_file;
+};
+
+// raw binary file mapped to memory: chunks are returned in place, the loader
+// thread only faults in pages of the next chunk
+template < class KT >
+class MmapChunkSource : public TopKChunkSource< KT > {
+public:
+  explicit MmapChunkSource(const std::string& fname) {
+    int fd = open(fname.c_str(), O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0) {
+      if(fd >= 0) close(fd);
+      ThrowError< >("Unable to open %s", fname.c_str());
+    }
+    m_bytes = st.st_size, m_size = m_bytes / sizeof(KT);
+    if(m_bytes > 0) {
+      m_base = mmap(nullptr, m_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(m_base == MAP_FAILED) {
+      ThrowError< >("Unable to map %s", fname.c_str());
+    }
+    if(m_bytes > 0) {
+      madvise(m_base, m_bytes, MADV_SEQUENTIAL);
+    }
+  }
+  ~MmapChunkSource() override {
+    if(m_bytes > 0) munmap(m_base, m_bytes);
+  }
+  size_t read(KT *, size_t max, const KT *& data) override {
+    auto num = std::min(max, m_size - m_pos);
+    data = (const KT *)m_base + m_pos;
+    m_pos += num;
+    // touch one byte per page to load the chunk on this thread
+    const size_t page = sysconf(_SC_PAGESIZE);
+    auto ptr = (const volatile char *)data;
+    for(size_t ofs = 0; ofs < num * sizeof(KT); ofs += page) {
+      (void)ptr[ofs];
+    }
+    return num;
+  }
+
+private:
+  void *m_base = nullptr;
+  size_t m_bytes = 0, m_size = 0, m_pos = 0;
+};
+
+// elements are produced by 'gen(ofs, out, num)' which writes elements
+// [ofs, ofs + num) of the stream
+template < class KT >
+class GeneratorChunkSource : public TopKChunkSource< KT > {
+public:
+  using Generator = std::function< void(size_t, KT *, size_t) >;
+
+  GeneratorChunkSource(Generator gen, size_t total) :
+        m_gen(std::move(gen)), m_total(total) { }
+
+  size_t read(KT *buf, size_t max, const KT *& data) override {
+    auto num = std::min(max, m_total - m_pos);
+    m_gen(m_pos, buf, num);
+    m_pos += num;
+    data = buf;
+    return num;
+  }
+
+private:
+  Generator m_gen;
+  size_t m_total, m_pos = 0;
+};
+
+template < class KT >
+class StreamingTopK {
+
+  constexpr static int64_t s_minVal = std::numeric_limits< int64_t >::min();
+
+  struct Slice {
+    size_t row;
+    uint32_t col;         // column of the first element within the row
+    uint32_t num;
+    const KT *data;
+  };
+
+public:
+  constexpr static size_t s_defChunkElems = 4 * 1024 * 1024;
+  constexpr static size_t s_defSliceElems = 64 * 1024;
+
+  StreamingTopK(ThreadPool& pool, size_t n, size_t k, size_t batch_size,
+        size_t chunkElems = s_defChunkElems,
+        size_t sliceElems = s_defSliceElems) : m_pool(pool),
+        m_n(n), m_k(k), m_batch(batch_size), m_total(n * batch_size),
+        m_chunkElems(chunkElems), m_sliceElems(sliceElems),
+        m_state(k * batch_size, s_minVal) {
+
+    if(k == 0 || k > n || n > std::numeric_limits< uint32_t >::max() ||
+          chunkElems == 0 || sliceElems == 0) {
+      ThrowError< >("StreamingTopK: invalid parameters: N = %zu; K = %zu", n, k);
+    }
+  }
+
+  // number of elements consumed so far
+  size_t consumed() const {
+    return m_pos;
+  }
+
+  // folds the next 'num' elements of the input into the running state
+  void push(const KT *data, size_t num) {
+
+    if(num > m_total - m_pos) {
+      ThrowError< >("StreamingTopK: input exceeds %zu elements", m_total);
+    }
+    // split the chunk at row boundaries and then into slices
+    m_slices.clear();
+    for(size_t ofs = 0; ofs < num; ) {
+      size_t row = (m_pos + ofs) / m_n, col = (m_pos + ofs) % m_n,
+             len = std::min(num - ofs, m_n - col);
+      for(size_t s = 0; s < len; s += m_sliceElems) {
+        m_slices.push_back({row, (uint32_t)(col + s),
+            (uint32_t)std::min(m_sliceElems, len - s), data + ofs + s});
+      }
+      ofs += len;
+    }
+    const uint32_t k = m_k;
+    m_slotVals.resize(m_slices.size() * k);
+    m_slotIdxs.resize(m_slices.size() * k);
+    m_pool.parallelFor(0, m_slices.size(), 1, [this, k](size_t b, size_t e) {
+      std::vector< uint64_t > scratch;
+      for(size_t i = b; i < e; i++) {
+        const auto& s = m_slices[i];
+        // short slices are pushed element-wise in fold()
+        if(s.num >= k) {
+          topk_cpu::runRow(s.data, s.num, m_slotVals.data() + i*k,
+                m_slotIdxs.data() + i*k, k, scratch);
+        }
+      }
+    });
+    for(size_t i = 0; i < m_slices.size(); i++) {
+      fold(i);
+    }
+    m_pos += num;
+  }
+
+  // consumes the whole input from 'src': loading of the next chunk is
+  // overlapped with processing of the current one
+  void run(TopKChunkSource< KT >& src) {
+
+    std::vector< KT > bufs[2];
+    bufs[0].resize(std::min(m_chunkElems, m_total));
+    bufs[1].resize(bufs[0].size());
+
+    size_t loaded = 0;
+    auto load = [&src, &bufs, this](uint32_t b, size_t ofs, const KT *& data) {
+      return src.read(bufs[b].data(), std::min(m_chunkElems, m_total - ofs),
+                      data);
+    };
+    const KT *data = nullptr;
+    auto num = m_total > 0 ? load(0, 0, data) : 0;
+    for(uint32_t cur = 0; num > 0; cur ^= 1) {
+      loaded += num;
+      const KT *next = nullptr;
+      auto future = std::async(std::launch::async, [&, cur, loaded]() -> size_t {
+        return loaded < m_total ? load(cur ^ 1, loaded, next) : 0;
+      });
+      push(data, num);
+      num = future.get();
+      data = next;
+    }
+    if(m_pos != m_total) {
+      ThrowError< >("StreamingTopK: input ended after %zu of %zu elements",
+            m_pos, m_total);
+    }
+  }
+
+  // writes top-k elements of each row in descending order: [batch_size, k]
+  void finish(KT *vals, uint32_t *idxs) const {
+    if(m_pos != m_total) {
+      ThrowError< >("StreamingTopK: only %zu of %zu elements consumed",
+            m_pos, m_total);
+    }
+    for(size_t i = 0; i < m_state.size(); i++) {
+      topk_cpu::unpackKV(m_state[i], vals[i], idxs[i]);
+    }
+  }
+
+private:
+  // TopK<K,KT>::Push for packed values: 'top' is in descending order;
+  // returns false if kv is not greater than the smallest element
+  static FORCEINLINE bool pushKV(int64_t *top, uint32_t k, int64_t kv) {
+    if(top[k - 1] >= kv) return false;
+    top[k - 1] = kv;
+    for(int32_t i = (int32_t)k - 2; i >= 0 && top[i] < kv; i--) {
+      std::swap(top[i], top[i + 1]);
+    }
+    return true;
+  }
+
+  // merges results of slice i into the state of its row (TopK::Reduce)
+  void fold(size_t i) {
+    const auto& s = m_slices[i];
+    auto top = m_state.data() + s.row * m_k;
+    if(s.num < m_k) {
+      for(uint32_t j = 0; j < s.num; j++) {
+        pushKV(top, m_k, topk_cpu::packKV(s.data[j], s.col + j));
+      }
+      return;
+    }
+    // slice results are sorted: stop at the first element not pushed
+    auto vals = m_slotVals.data() + i*m_k;
+    auto idxs = m_slotIdxs.data() + i*m_k;
+    for(uint32_t j = 0; j < m_k; j++) {
+      if(!pushKV(top, m_k, topk_cpu::packKV(vals[j], s.col + idxs[j])))
+        break;
+    }
+  }
+
+  ThreadPool& m_pool;
+  const size_t m_n, m_k, m_batch, m_total, m_chunkElems, m_sliceElems;
+  size_t m_pos = 0;
+  std::vector< int64_t > m_state;   // packed top-k of each row: descending
+  std::vector< Slice > m_slices;
+  std::vector< KT > m_slotVals;      // per-slice top-k
+  std::vector< uint32_t > m_slotIdxs;
+};
+
+#endif // TOPK_STREAM_HPP_
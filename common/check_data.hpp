@@ -0,0 +1,345 @@
+
+#ifndef COMMON_CHECK_DATA_HPP
+#define COMMON_CHECK_DATA_HPP 1
+
+// Vectorized and multithreaded comparison of host buffers: replaces checkme
+// for large outputs. Elements are compared in blocks by a branch-free loop
+// (vectorized by the compiler) which only counts mismatches and tracks the
+// maximal errors; blocks with mismatches are rescanned to collect details.
+// An element matches if ANY of the enabled tolerances holds:
+//   |check - truth| <= absTol, |check - truth| <= relTol * |truth| or
+//   ulps(check, truth) <= ulpTol (distance in units in the last place of NT;
+//   for integers - the difference of values).
+// Identical values always match since their ULP distance is zero.
+// Instead of printing, checkData returns a CheckResult summary.
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "common/common.h"
+#include "common/float16.hpp"
+#include "common/threading.hpp"
+
+enum class CheckNanPolicy {
+  Equal,     // NaN matches NaN (any payload), NaN vs. a number is a mismatch
+  Mismatch,  // any NaN is a mismatch
+  Ignore,    // positions with NaN in check or truth are skipped
+};
+
+struct CheckOptions {
+  double absTol = 0;
+  double relTol = 0;
+  uint64_t ulpTol = 0;
+  CheckNanPolicy nans = CheckNanPolicy::Equal;
+  size_t maxReport = 16;      // number of first mismatches to keep
+  // redzone: bytes right after the last element of 'check' must be equal
+  // to 'redzoneValue'
+  size_t redzoneBytes = 0;
+  uint8_t redzoneValue = 0;
+};
+
+struct CheckMismatch {
+  size_t row, col;
+  double check, truth;
+  double absErr;
+  uint64_t ulps;
+};
+
+struct CheckResult {
+  constexpr static uint32_t s_histBins = 24;
+
+  size_t numElems = 0;        // number of compared elements
+  size_t numMismatches = 0;
+  size_t numNaNs = 0;         // positions with NaN in check or truth
+  // maximal errors over all non-NaN elements (not only mismatches);
+  // relative error is infinite if truth is zero and check is not
+  double maxAbsErr = 0, maxRelErr = 0;
+  uint64_t maxUlps = 0;
+  // first 'maxReport' mismatches in (row, col) order
+  std::vector< CheckMismatch > mismatches;
+  // mismatches by ULP distance: bin i counts distances in [2^(i-1), 2^i),
+  // the last bin counts all larger ones
+  size_t ulpHist[s_histBins] = {};
+  size_t redzoneErrors = 0;   // number of modified redzone bytes
+  size_t firstRedzoneOfs = 0;
+
+  bool ok() const {
+    return numMismatches == 0 && redzoneErrors == 0;
+  }
+
+  // accumulates results of another range
+  void merge(const CheckResult& rhs, size_t maxReport) {
+    numElems += rhs.numElems, numMismatches += rhs.numMismatches;
+    numNaNs += rhs.numNaNs;
+    maxAbsErr = std::max(maxAbsErr, rhs.maxAbsErr);
+    maxRelErr = std::max(maxRelErr, rhs.maxRelErr);
+    maxUlps = std::max(maxUlps, rhs.maxUlps);
+    for(uint32_t i = 0; i < s_histBins; i++) {
+      ulpHist[i] += rhs.ulpHist[i];
+    }
+    mismatches.insert(mismatches.end(), rhs.mismatches.begin(),
+          rhs.mismatches.end());
+    std::sort(mismatches.begin(), mismatches.end(),
+        [](const auto& a, const auto& b) {
+      return a.row != b.row ? a.row < b.row : a.col < b.col;
+    });
+    if(mismatches.size() > maxReport) {
+      mismatches.resize(maxReport);
+    }
+  }
+
+  // prints the summary and collected mismatches
+  void print(const char *name) const {
+    PRINTZ("%s: %s: %zu of %zu elements differ; NaNs: %zu; max abs err: %g; "
+        "max rel err: %g; max ulps: %lu", name, ok() ? "OK" : "FAILED",
+        numMismatches, numElems, numNaNs, maxAbsErr, maxRelErr, maxUlps);
+    for(const auto& m : mismatches) {
+      PRINTZ("%zu(%zu) (check, truth): %.10g and %.10g; diff: %g; ulps: %lu",
+          m.row, m.col, m.check, m.truth, m.absErr, m.ulps);
+    }
+    if(numMismatches > 0) {
+      for(uint32_t i = 0; i < s_histBins; i++) {
+        if(ulpHist[i] == 0) continue;
+        PRINTZ("ulps in [%lu; %s): %zu", i == 0 ? 0ul : 1ul << (i - 1),
+            i + 1 == s_histBins ? "inf" : std::to_string(1ul << i).c_str(),
+            ulpHist[i]);
+      }
+    }
+    if(redzoneErrors > 0) {
+      PRINTZ("%zu redzone bytes modified, first at offset %zu", redzoneErrors,
+            firstRedzoneOfs);
+    }
+  }
+};
+
+// storage of 16-bit floats, e.g. __half / hip_bfloat16 buffers
+using CheckHalf = fp16::Half16;
+using CheckBFloat16 = fp16::BFloat16;
+
+namespace check_detail {
+
+// maps sign and magnitude of a float to an unsigned key with the same order:
+// branch-free and +0 / -0 map to the same key
+template < class U >
+FORCEINLINE U orderedKey(U mag, U neg) {
+  const U mask = (U)0 - neg, bias = (U)1 << (sizeof(U)*8 - 1);
+  return ((mag ^ mask) - mask) + bias;
+}
+
+template < class NT, class = void >
+struct Traits;
+
+template < class NT >
+struct Traits< NT, std::enable_if_t< std::is_floating_point_v< NT > > > {
+  using W = NT;
+  using U = std::conditional_t< sizeof(NT) == 4, uint32_t, uint64_t >;
+  static FORCEINLINE W wide(NT x) { return x; }
+  static FORCEINLINE U ordered(NT x) {
+    U u;
+    std::memcpy(&u, &x, sizeof(u));
+    constexpr uint32_t shift = sizeof(U)*8 - 1;
+    return orderedKey< U >(u & ~((U)1 << shift), u >> shift);
+  }
+  static FORCEINLINE bool isNaN(NT x) { return x != x; }
+};
+
+template < class NT >
+struct Traits< NT, std::enable_if_t< std::is_integral_v< NT > > > {
+  using W = double;
+  using U = std::conditional_t< sizeof(NT) <= 4, uint32_t, uint64_t >;
+  static FORCEINLINE W wide(NT x) { return (W)x; }
+  static FORCEINLINE U ordered(NT x) {
+    // sign-extended value with flipped sign bit
+    constexpr U bias = std::is_signed_v< NT > ? (U)1 << (sizeof(U)*8 - 1) : 0;
+    return (U)x ^ bias;
+  }
+  static FORCEINLINE bool isNaN(NT) { return false; }
+};
+
+template < >
+struct Traits< CheckHalf > {
+  using W = float;
+  using U = uint32_t;
+  static FORCEINLINE W wide(CheckHalf x) { return fp16::toFloat(x); }
+  static FORCEINLINE U ordered(CheckHalf x) {
+    return orderedKey< U >(x.bits & 0x7FFFu, x.bits >> 15);
+  }
+  static FORCEINLINE bool isNaN(CheckHalf x) { return fp16::isNaN(x); }
+};
+
+template < >
+struct Traits< CheckBFloat16 > {
+  using W = float;
+  using U = uint32_t;
+  static FORCEINLINE W wide(CheckBFloat16 x) { return fp16::toFloat(x); }
+  static FORCEINLINE U ordered(CheckBFloat16 x) {
+    return orderedKey< U >(x.bits & 0x7FFFu, x.bits >> 15);
+  }
+  static FORCEINLINE bool isNaN(CheckBFloat16 x) { return fp16::isNaN(x); }
+};
+
+template < class W >
+using UBits = std::conditional_t< sizeof(W) == 4, uint32_t, uint64_t >;
+
+// bits of a non-negative float or 0 if it is NaN: non-negative floats compare
+// the same as their bit patterns which allows vectorized max reductions
+template < class W >
+FORCEINLINE UBits< W > absBits(W x) {
+  using UW = UBits< W >;
+  const UW inf = std::bit_cast< UW >(std::numeric_limits< W >::infinity());
+  UW u;
+  std::memcpy(&u, &x, sizeof(u));
+  return u & ((UW)0 - (UW)(u <= inf));
+}
+
+template < class W >
+FORCEINLINE W fromBits(UBits< W > u) {
+  W x;
+  std::memcpy(&x, &u, sizeof(u));
+  return x;
+}
+
+// compares 'num' consecutive elements of one row
+template < class NT >
+void checkRange(const NT *check, const NT *truth, size_t num, size_t row,
+      size_t col0, const CheckOptions& opts, CheckResult& res) {
+
+  using Tr = Traits< NT >;
+  using W = typename Tr::W;
+  using U = typename Tr::U;
+  constexpr size_t BlockSz = 1024;
+  const W absTol = (W)opts.absTol, relTol = (W)opts.relTol;
+  const U ulpTol = (U)std::min< uint64_t >(opts.ulpTol,
+        std::numeric_limits< U >::max());
+  const uint32_t nanEqual = opts.nans == CheckNanPolicy::Equal,
+             nanIgnore = opts.nans == CheckNanPolicy::Ignore;
+
+  UBits< W > maxAbs = 0, maxRel = 0;
+  for(size_t b = 0; b < num; b += BlockSz) {
+    const size_t nb = std::min(BlockSz, num - b);
+    auto pc = check + b, pt = truth + b;
+    uint32_t nBad = 0, nNaN = 0;
+    U maxU = 0;
+    // fast path: no branches, no stores. Conditions are turned to masks
+    // explicitly since the compiler does not if-convert all of them
+    for(size_t i = 0; i < nb; i++) {
+      W x = Tr::wide(pc[i]), y = Tr::wide(pt[i]), ay = std::abs(y),
+        d = std::abs(x - y), r = d / ay;
+      U a = Tr::ordered(pc[i]), c = Tr::ordered(pt[i]),
+        neg = (U)0 - (U)(a < c), u = ((a - c) ^ neg) - neg;
+      uint32_t n1 = Tr::isNaN(pc[i]), n2 = Tr::isNaN(pt[i]), anyNaN = n1 | n2,
+           good = (d <= absTol) | (d <= relTol * ay) | (u <= ulpTol),
+           nanGood = nanIgnore | (nanEqual & n1 & n2);
+      nBad += ((good & ~anyNaN) | (nanGood & anyNaN)) ^ 1;
+      nNaN += anyNaN;
+      maxU = std::max(maxU, u & ((U)anyNaN - 1));
+      // d and r are NaN for inf - inf and 0 / 0
+      maxAbs = std::max(maxAbs, absBits(d));
+      maxRel = std::max(maxRel, absBits(r));
+    }
+    res.numNaNs += nNaN;
+    res.maxUlps = std::max< uint64_t >(res.maxUlps, maxU);
+    if(nBad == 0)
+      continue;
+    // slow path: collect mismatches of this block
+    for(size_t i = 0; i < nb; i++) {
+      W x = Tr::wide(pc[i]), y = Tr::wide(pt[i]), d = std::abs(x - y);
+      U a = Tr::ordered(pc[i]), c = Tr::ordered(pt[i]),
+        u = a > c ? a - c : c - a;
+      bool n1 = Tr::isNaN(pc[i]), n2 = Tr::isNaN(pt[i]);
+      bool good = d <= absTol || d <= relTol * std::abs(y) || u <= ulpTol;
+      if(n1 || n2) {
+        good = nanIgnore || (nanEqual && n1 && n2);
+      }
+      if(good) continue;
+      res.numMismatches++;
+      res.ulpHist[std::min< uint32_t >(std::bit_width(u),
+            CheckResult::s_histBins - 1)]++;
+      if(res.mismatches.size() < opts.maxReport) {
+        res.mismatches.push_back({row, col0 + b + i, (double)x, (double)y,
+              (double)d, u});
+      }
+    }
+  } // for b
+  res.numElems += num;
+  res.maxAbsErr = std::max(res.maxAbsErr, (double)fromBits< W >(maxAbs));
+  res.maxRelErr = std::max(res.maxRelErr, (double)fromBits< W >(maxRel));
+}
+
+// counts bytes of the redzone which differ from 'value'
+inline void checkRedzone(const uint8_t *ptr, size_t bytes, uint8_t value,
+      CheckResult& res) {
+  for(size_t i = 0; i < bytes; i++) {
+    if(ptr[i] != value && res.redzoneErrors++ == 0) {
+      res.firstRedzoneOfs = i;
+    }
+  }
+}
+
+} // namespace check_detail
+
+//! compares 2D arrays of data, \c width elements per row stored with
+//! \c stride; number of rows given by \c n_batches. Work is split between
+//! threads of \c pool (if not null)
+template < class NT >
+CheckResult checkData(ThreadPool *pool, const NT *check, const NT *truth,
+      size_t width, size_t stride, size_t n_batches,
+      const CheckOptions& opts = {}) {
+
+  static_assert(!(std::is_class_v< NT > && sizeof(NT) == 2) ||
+        std::is_same_v< NT, CheckHalf > || std::is_same_v< NT, CheckBFloat16 >,
+        "Use checkDataHalf / checkDataBf16 for 16-bit floating point types!");
+
+  CheckResult res;
+  std::mutex mtx;
+  const size_t total = width * n_batches;
+  auto f = [&](size_t begin, size_t end) {
+    CheckResult local;
+    // the range of flattened indices may span several rows
+    for(size_t ofs = begin; ofs < end; ) {
+      size_t row = ofs / width, col = ofs % width,
+             num = std::min(end - ofs, width - col);
+      check_detail::checkRange(check + row*stride + col,
+            truth + row*stride + col, num, row, col, opts, local);
+      ofs += num;
+    }
+    std::lock_guard _(mtx);
+    res.merge(local, opts.maxReport);
+  };
+  constexpr size_t s_grain = 256 * 1024;
+  if(pool != nullptr && total > s_grain) {
+    pool->parallelFor(0, total, s_grain, f);
+  } else if(total > 0) {
+    f(0, total);
+  }
+  if(opts.redzoneBytes > 0 && n_batches > 0) {
+    auto end = (const uint8_t *)(check + (n_batches - 1)*stride + width);
+    check_detail::checkRedzone(end, opts.redzoneBytes, opts.redzoneValue, res);
+  }
+  return res;
+}
+
+// 'check' and 'truth' are buffers of IEEE half floats (e.g. __half)
+inline CheckResult checkDataHalf(ThreadPool *pool, const void *check,
+      const void *truth, size_t width, size_t stride, size_t n_batches,
+      const CheckOptions& opts = {}) {
+  return checkData(pool, (const CheckHalf *)check, (const CheckHalf *)truth,
+      width, stride, n_batches, opts);
+}
+
+// 'check' and 'truth' are buffers of bfloat16 (e.g. hip_bfloat16)
+inline CheckResult checkDataBf16(ThreadPool *pool, const void *check,
+      const void *truth, size_t width, size_t stride, size_t n_batches,
+      const CheckOptions& opts = {}) {
+  return checkData(pool, (const CheckBFloat16 *)check,
+      (const CheckBFloat16 *)truth, width, stride, n_batches, opts);
+}
+
+#endif // COMMON_CHECK_DATA_HPP
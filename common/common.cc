@@ -89,4 +89,4 @@ void DeviceInit(int dev)
                     (deviceProp.ECCEnabled) ? "on" : "off");
         fflush(stdout);
     }
-}
\ No newline at end of file
+}
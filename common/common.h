@@ -34,6 +34,9 @@
 #define cudaMemcpyDeviceToHost hipMemcpyDeviceToHost
 #define cudaMemcpyDeviceToDevice hipMemcpyDeviceToDevice
 #define cudaSuccess hipSuccess
+#define cudaError_t hipError_t
+#define cudaErrorInvalidValue hipErrorInvalidValue
+#define cudaErrorPeerAccessAlreadyEnabled hipErrorPeerAccessAlreadyEnabled
 #define cudaGetLastError hipGetLastError
 #define cudaGetErrorName hipGetErrorName
 #define cudaGetErrorString hipGetErrorString
@@ -75,6 +78,12 @@
 // #include <hipcub/util_allocator.hpp>
 // #include <hipcub/iterator/discard_output_iterator.hpp>
 
+#elif COMPILE_FOR_HOST // device code is emulated on the host
+#include "common/simt_emulator.hpp"
+#include "common/host_runtime.h"
+#include "common/host_nccl.h"
+#define FORCEINLINE inline
+
 #else
 #include <cuda_runtime.h>
 #define FORCEINLINE __forceinline__
@@ -155,7 +164,9 @@ void initRandomFloat(T *ptr, double dmin, double dmax, size_t n, size_t seed) {
 
 __device__ FORCEINLINE uint32_t gpuLaneId() {
   uint32_t lane_id;
-#if !COMPILE_FOR_ROCM
+#if COMPILE_FOR_HOST
+  lane_id = simt::laneId();
+#elif !COMPILE_FOR_ROCM
 #if 0 // __clang__
   return __nvvm_read_ptx_sreg_laneid();
 #else   // __clang__
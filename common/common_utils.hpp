@@ -175,6 +175,7 @@ private:
 //! number of rows given by \c n_batches
 //! \c print_when_differs :  indicates whether print elements only if they differ (default)
 //! \c print_max : maximal # of entries to print
+//! NOTE: for large buffers use checkData from common/check_data.hpp instead
 template < bool Reverse = false, class NT >
 bool checkme(const NT *checkit, const NT *truth, size_t width, size_t stride,
         size_t n_batches, const NT& eps, bool print_when_differs = true,
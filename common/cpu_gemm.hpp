@@ -0,0 +1,312 @@
+#ifndef COMMON_CPU_GEMM_HPP
+#define COMMON_CPU_GEMM_HPP 1
+
+// Host GEMM engine (BLIS-style) used to verify device GEMMs:
+//   D(i, j) = alpha * sum_k A(i, k) * B(k, j) + beta * C(i, j) [+ bias(i)]
+// with the element strides of matMatMultMixPrec: A(i, k) = A[i*As1 + k*As2],
+// B(k, j) = B[k*Bs1 + j*Bs2], and so on; transposed operands simply swap
+// their strides. Loops:
+//  - columns in panels of NC, depth in blocks of KC: the B panel is packed
+//    into slivers of NR columns, rows of A into slivers of MR rows;
+//  - tiles of MC rows x NT columns run in parallel on the thread pool;
+//  - an MR x NR micro-kernel keeps the accumulators in registers: 12 x 32
+//    with AVX-512, 6 x 16 with AVX2 + FMA, 4 x 4 scalar otherwise (and for
+//    compute types other than float).
+// Packing converts to the compute type T (the type of alpha): 16-bit
+// inputs (__half, hip_bfloat16, ...) are widened once and accumulated in
+// float. If D is not of type T, the depth is not blocked so that partial
+// sums are never rounded to the output type. beta == 0 does not read C.
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "common/common.h"
+#include "common/threading.hpp"
+
+namespace gemm_detail {
+
+#if defined(__AVX512F__)
+struct SimdF32 {
+  static constexpr uint32_t Width = 16, MR = 12, NV = 2;
+  static constexpr const char *s_name = "AVX-512";
+  __m512 v;
+
+  static FORCEINLINE SimdF32 zero() { return {_mm512_setzero_ps()}; }
+  static FORCEINLINE SimdF32 load(const float *p) { return {_mm512_loadu_ps(p)}; }
+  static FORCEINLINE SimdF32 set1(float x) { return {_mm512_set1_ps(x)}; }
+  FORCEINLINE void fma(SimdF32 a, SimdF32 b) { v = _mm512_fmadd_ps(a.v, b.v, v); }
+  FORCEINLINE void store(float *p) const { _mm512_storeu_ps(p, v); }
+};
+#define GEMM_HOST_SIMD 1
+#elif defined(__AVX2__) && defined(__FMA__)
+struct SimdF32 {
+  static constexpr uint32_t Width = 8, MR = 6, NV = 2;
+  static constexpr const char *s_name = "AVX2";
+  __m256 v;
+
+  static FORCEINLINE SimdF32 zero() { return {_mm256_setzero_ps()}; }
+  static FORCEINLINE SimdF32 load(const float *p) { return {_mm256_loadu_ps(p)}; }
+  static FORCEINLINE SimdF32 set1(float x) { return {_mm256_set1_ps(x)}; }
+  FORCEINLINE void fma(SimdF32 a, SimdF32 b) { v = _mm256_fmadd_ps(a.v, b.v, v); }
+  FORCEINLINE void store(float *p) const { _mm256_storeu_ps(p, v); }
+};
+#define GEMM_HOST_SIMD 1
+#else
+#define GEMM_HOST_SIMD 0
+#endif
+
+template < class T >
+struct SimdScalar {
+  static constexpr uint32_t Width = 1, MR = 4, NV = 4;
+  static constexpr const char *s_name = "scalar";
+  T v;
+
+  static FORCEINLINE SimdScalar zero() { return {T(0)}; }
+  static FORCEINLINE SimdScalar load(const T *p) { return {*p}; }
+  static FORCEINLINE SimdScalar set1(T x) { return {x}; }
+  FORCEINLINE void fma(SimdScalar a, SimdScalar b) { v += a.v * b.v; }
+  FORCEINLINE void store(T *p) const { *p = v; }
+};
+
+template < class T >
+struct SimdFor {
+  using type = SimdScalar< T >;
+};
+
+#if GEMM_HOST_SIMD
+template < >
+struct SimdFor< float > {
+  using type = SimdF32;
+};
+#endif
+
+template < class S >
+struct Blocking {
+  static constexpr int64_t MR = S::MR, NR = S::NV * S::Width,
+        MC = 96,     // rows of a tile (multiple of MR)
+        NT = 256,    // columns of a tile (multiple of NR)
+        KC = 256,    // depth of packed slivers
+        NC = 4096,   // columns of a packed B panel
+        MB = 1536;   // rows of A packed at once (multiple of MC)
+};
+
+template < class T, class U, class V >
+struct Args {
+  T alpha, beta;
+  int64_t M, N, K;
+  const U *A; int64_t As1, As2;
+  const U *B; int64_t Bs1, Bs2;
+  const V *C; int64_t Cs1, Cs2;
+  V *D; int64_t Ds1, Ds2;
+  const V *bias;
+};
+
+// 'num' x 'kc' elements of src(x, k) = src[x*s1 + k*s2] (rows or columns
+// x >= 'valid' are zero) -> dst[k * num + x]
+template < class T, class U >
+void packSliver(const U *src, int64_t s1, int64_t s2, int64_t num,
+      int64_t valid, int64_t kc, T *dst) {
+  if(std::abs(s1) <= std::abs(s2)) {
+    for(int64_t k = 0; k < kc; k++) {
+      for(int64_t x = 0; x < num; x++) {
+        dst[k * num + x] = x < valid ? static_cast< T >(src[x*s1 + k*s2]) : T(0);
+      }
+    }
+    return;
+  }
+  for(int64_t x = 0; x < num; x++) {
+    if(x >= valid) {
+      for(int64_t k = 0; k < kc; k++) dst[k * num + x] = T(0);
+      continue;
+    }
+    auto p = src + x*s1;
+    for(int64_t k = 0; k < kc; k++) {
+      dst[k * num + x] = static_cast< T >(p[k*s2]);
+    }
+  }
+}
+
+// acc (MR x NR, row-major) = sum over kc of the packed slivers
+template < class S, class T >
+FORCEINLINE void microKernel(int64_t kc, const T *Ap, const T *Bp, T *acc) {
+  constexpr uint32_t MR = S::MR, NV = S::NV, W = S::Width;
+  S c[MR][NV];
+#pragma GCC unroll 16
+  for(uint32_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+    for(uint32_t j = 0; j < NV; j++) c[i][j] = S::zero();
+  }
+  for(int64_t k = 0; k < kc; k++, Ap += MR, Bp += NV * W) {
+    S b[NV];
+#pragma GCC unroll 4
+    for(uint32_t j = 0; j < NV; j++) b[j] = S::load(Bp + j * W);
+#pragma GCC unroll 16
+    for(uint32_t i = 0; i < MR; i++) {
+      auto a = S::set1(Ap[i]);
+#pragma GCC unroll 4
+      for(uint32_t j = 0; j < NV; j++) c[i][j].fma(a, b[j]);
+    }
+  }
+#pragma GCC unroll 16
+  for(uint32_t i = 0; i < MR; i++) {
+#pragma GCC unroll 4
+    for(uint32_t j = 0; j < NV; j++) c[i][j].store(acc + (i * NV + j) * W);
+  }
+}
+
+// writes the mr x nr corner of the accumulators to D at (i0, j0); the
+// first depth block applies beta * C and the bias, later ones accumulate
+template < class T, class U, class V >
+void storeTile(const Args< T, U, V >& g, const T *acc, int64_t NR,
+      int64_t i0, int64_t j0, int64_t mr, int64_t nr, bool first) {
+  auto one = [&](int64_t i, int64_t j) {
+    T v = g.alpha * acc[i * NR + j];
+    int64_t r = i0 + i, c = j0 + j;
+    V& d = g.D[r*g.Ds1 + c*g.Ds2];
+    if(!first) {
+      v += static_cast< T >(d);
+    } else {
+      if(g.beta != T(0)) v += g.beta * static_cast< T >(g.C[r*g.Cs1 + c*g.Cs2]);
+      if(g.bias != nullptr) v += static_cast< T >(g.bias[r]);
+    }
+    d = static_cast< V >(v);
+  };
+  if(std::abs(g.Ds1) <= std::abs(g.Ds2)) {
+    for(int64_t j = 0; j < nr; j++)
+      for(int64_t i = 0; i < mr; i++) one(i, j);
+  } else {
+    for(int64_t i = 0; i < mr; i++)
+      for(int64_t j = 0; j < nr; j++) one(i, j);
+  }
+}
+
+// f(begin, end) over [0, n) on the pool or on the calling thread
+template < class F >
+void forRange(ThreadPool *pool, size_t n, size_t grain, F&& f) {
+  if(pool != nullptr && n > grain) {
+    pool->parallelFor(0, n, grain, f);
+  } else if(n > 0) {
+    f(0, n);
+  }
+}
+
+template < class T, class U, class V >
+void gemm(ThreadPool *pool, const Args< T, U, V >& g) {
+
+  using S = typename SimdFor< T >::type;
+  using Blk = Blocking< S >;
+  constexpr int64_t MR = Blk::MR, NR = Blk::NR;
+  if(g.M <= 0 || g.N <= 0) return;
+
+  const int64_t KC = std::is_same_v< V, T > ? Blk::KC :
+                     std::max< int64_t >(g.K, 1),
+        kcMax = std::min(KC, std::max< int64_t >(g.K, 1)),
+        ncMax = std::min(Blk::NC, g.N), mbMax = std::min(Blk::MB, g.M);
+  size_t bSize = (ncMax + NR - 1) / NR * NR * kcMax,
+         aSize = (mbMax + MR - 1) / MR * MR * kcMax;
+  // serial calls reuse buffers of the thread; parallel ones may interleave
+  // with other work stolen by this thread while it waits
+  thread_local std::vector< T > s_bufA, s_bufB;
+  std::vector< T > ownA, ownB;
+  auto& bufA = pool != nullptr ? ownA : s_bufA;
+  auto& bufB = pool != nullptr ? ownB : s_bufB;
+  if(bufA.size() < aSize) bufA.resize(aSize);
+  if(bufB.size() < bSize) bufB.resize(bSize);
+  T *Ap = bufA.data(), *Bp = bufB.data();
+
+  for(int64_t jc = 0; jc < g.N; jc += Blk::NC) {
+    const int64_t nc = std::min(Blk::NC, g.N - jc), nbs = (nc + NR - 1) / NR;
+    // K == 0 still needs one pass to apply beta and the bias
+    for(int64_t pc = 0; pc == 0 || pc < g.K; pc += KC) {
+      const int64_t kc = std::min(KC, g.K - pc);
+      forRange(pool, nbs, 4, [&](size_t b, size_t e) {
+        for(size_t s = b; s < e; s++) {
+          int64_t j0 = jc + s * NR;
+          packSliver(g.B + j0*g.Bs2 + pc*g.Bs1, g.Bs2, g.Bs1, NR,
+                std::min(NR, g.N - j0), kc, Bp + s * NR * kc);
+        }
+      });
+      for(int64_t ib = 0; ib < g.M; ib += Blk::MB) {
+        const int64_t mb = std::min(Blk::MB, g.M - ib),
+              nas = (mb + MR - 1) / MR;
+        forRange(pool, nas, 4, [&](size_t b, size_t e) {
+          for(size_t s = b; s < e; s++) {
+            int64_t i0 = ib + s * MR;
+            packSliver(g.A + i0*g.As1 + pc*g.As2, g.As1, g.As2, MR,
+                  std::min(MR, g.M - i0), kc, Ap + s * MR * kc);
+          }
+        });
+        const int64_t ntm = (mb + Blk::MC - 1) / Blk::MC,
+              ntn = (nc + Blk::NT - 1) / Blk::NT;
+        forRange(pool, ntm * ntn, 1, [&](size_t b, size_t e) {
+          alignas(64) T acc[MR * NR];
+          for(size_t t = b; t < e; t++) {
+            int64_t tm = t % ntm, tn = t / ntm,
+                    iEnd = std::min(mb, (tm + 1) * Blk::MC),
+                    jEnd = std::min(nc, (tn + 1) * Blk::NT);
+            // a sliver of B stays in L1 while the slivers of A stream by
+            for(int64_t jr = tn * Blk::NT; jr < jEnd; jr += NR) {
+              for(int64_t ir = tm * Blk::MC; ir < iEnd; ir += MR) {
+                microKernel< S >(kc, Ap + ir * kc, Bp + jr * kc, acc);
+                storeTile(g, acc, NR, ib + ir, jc + jr, std::min(MR, mb - ir),
+                      std::min(NR, nc - jr), pc == 0);
+              }
+            }
+          }
+        });
+      }
+    }
+  }
+}
+
+} // namespace gemm_detail
+
+// name of the micro-kernel used for compute type T
+template < class T >
+constexpr const char *gemmHostKernel() {
+  return gemm_detail::SimdFor< T >::type::s_name;
+}
+
+//! D = alpha * A * B + beta * C (+ bias per row, if not null) for an
+//! M x N x K problem with the element strides described above. T is the
+//! compute type, U the type of A and B, V that of C, D and the bias. Work
+//! is split between threads of \c pool (if not null). C may alias D
+template < class T, class U, class V >
+void gemmHost(ThreadPool *pool, T alpha, T beta, int64_t M, int64_t N,
+      int64_t K, const U *A, int64_t As1, int64_t As2,
+      const U *B, int64_t Bs1, int64_t Bs2,
+      const V *C, int64_t Cs1, int64_t Cs2,
+      V *D, int64_t Ds1, int64_t Ds2, const V *bias = nullptr) {
+  gemm_detail::gemm(pool, gemm_detail::Args< T, U, V >{ alpha, beta, M, N, K,
+        A, As1, As2, B, Bs1, Bs2, C, Cs1, Cs2, D, Ds1, Ds2, bias });
+}
+
+//! strided batched version: batch i uses A + i * strideA and so on. With at
+//! least as many batches as threads, every thread runs whole GEMMs
+template < class T, class U, class V >
+void gemmHostBatched(ThreadPool *pool, T alpha, T beta, int64_t M, int64_t N,
+      int64_t K, const U *A, int64_t As1, int64_t As2, int64_t strideA,
+      const U *B, int64_t Bs1, int64_t Bs2, int64_t strideB,
+      const V *C, int64_t Cs1, int64_t Cs2, int64_t strideC,
+      V *D, int64_t Ds1, int64_t Ds2, int64_t strideD, int64_t batch,
+      const V *bias = nullptr) {
+  auto run = [&](ThreadPool *p, int64_t i) {
+    gemmHost(p, alpha, beta, M, N, K, A + i * strideA, As1, As2,
+          B + i * strideB, Bs1, Bs2, C + i * strideC, Cs1, Cs2,
+          D + i * strideD, Ds1, Ds2, bias);
+  };
+  if(pool != nullptr && batch >= (int64_t)pool->numThreads()) {
+    pool->parallelFor(0, batch, 1, [&](size_t b, size_t e) {
+      for(size_t i = b; i < e; i++) run(nullptr, i);
+    });
+    return;
+  }
+  for(int64_t i = 0; i < batch; i++) run(pool, i);
+}
+
+#endif // COMMON_CPU_GEMM_HPP
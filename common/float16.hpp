@@ -0,0 +1,74 @@
+
+#ifndef COMMON_FLOAT16_HPP
+#define COMMON_FLOAT16_HPP 1
+
+// Storage of 16-bit floats (__half / hip_bfloat16 buffers) on the host and
+// their conversions to and from float: widening is exact, narrowing rounds
+// to nearest even, overflows go to inf and NaNs stay quiet NaNs.
+// Used by the data checks, the QCCL reductions and the host runtime types.
+
+#include <cstdint>
+#include <cstring>
+
+namespace fp16 {
+
+struct Half16 { uint16_t bits; };
+struct BFloat16 { uint16_t bits; };
+
+// branch-free conversion: subnormals are scaled by the float multiply
+inline float toFloat(Half16 x) {
+  uint32_t em = x.bits & 0x7FFFu, u = em << 13;
+  float f;
+  std::memcpy(&f, &u, sizeof(f));
+  f *= 0x1p112f;
+  std::memcpy(&u, &f, sizeof(u));
+  u |= em >= 0x7C00u ? 0x7F800000u : 0; // inf / NaN
+  u |= (uint32_t)(x.bits & 0x8000u) << 16;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+inline float toFloat(BFloat16 x) {
+  uint32_t u = (uint32_t)x.bits << 16;
+  float f;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+inline Half16 toHalf(float f) {
+  uint32_t u;
+  std::memcpy(&u, &f, sizeof(u));
+  uint16_t sign = (u >> 16) & 0x8000u;
+  u &= 0x7FFFFFFFu;
+  if(u > 0x7F800000u) return { (uint16_t)(sign | 0x7E00u) };
+  if(u >= 0x477FF000u) return { (uint16_t)(sign | 0x7C00u) };
+  if(u < 0x38800000u) { // subnormal half: let the FPU round the fraction
+    float a;
+    std::memcpy(&a, &u, sizeof(a));
+    a += 0.5f; // ulp(0.5) == 2^-24 == smallest half subnormal
+    std::memcpy(&u, &a, sizeof(u));
+    return { (uint16_t)(sign | (u - 0x3F000000u)) };
+  }
+  u += 0xC8000FFFu + ((u >> 13) & 1); // rebias exponent and round
+  return { (uint16_t)(sign | (u >> 13)) };
+}
+
+inline BFloat16 toBFloat16(float f) {
+  uint32_t u;
+  std::memcpy(&u, &f, sizeof(u));
+  if((u & 0x7FFFFFFFu) > 0x7F800000u) return { (uint16_t)((u >> 16) | 0x40u) };
+  u += 0x7FFFu + ((u >> 16) & 1);
+  return { (uint16_t)(u >> 16) };
+}
+
+inline bool isNaN(Half16 x) {
+  return (x.bits & 0x7FFFu) > 0x7C00u;
+}
+
+inline bool isNaN(BFloat16 x) {
+  return (x.bits & 0x7FFFu) > 0x7F80u;
+}
+
+} // namespace fp16
+
+#endif // COMMON_FLOAT16_HPP
@@ -3,7 +3,81 @@
 
 //#include "tsl/platform/bfloat16.h"
 
-#if !COMPILE_FOR_ROCM
+#if COMPILE_FOR_HOST
+// host stand-ins with the hipcub temp storage API: the work is enqueued on
+// the host runtime stream, sorting runs on its thread pool
+#include "common/common.h"
+#include "RadixSort/radix_sort_cpu.hpp"
+
+namespace gpuprim {
+
+// device memory is host memory: there is nothing to cache
+struct CachingDeviceAllocator { };
+
+struct DeviceRadixSort {
+  template < typename KeyT >
+  static cudaError_t SortKeys(void *d_temp_storage, size_t& temp_bytes,
+        const KeyT *d_keys_in, KeyT *d_keys_out, size_t num_items,
+        int begin_bit = 0, int end_bit = sizeof(KeyT) * 8,
+        cudaStream_t stream = nullptr) {
+    return sort(d_temp_storage, temp_bytes, d_keys_in, d_keys_out,
+          num_items, false, begin_bit, end_bit, stream);
+  }
+
+  template < typename KeyT >
+  static cudaError_t SortKeysDescending(void *d_temp_storage,
+        size_t& temp_bytes, const KeyT *d_keys_in, KeyT *d_keys_out,
+        size_t num_items, int begin_bit = 0, int end_bit = sizeof(KeyT) * 8,
+        cudaStream_t stream = nullptr) {
+    return sort(d_temp_storage, temp_bytes, d_keys_in, d_keys_out,
+          num_items, true, begin_bit, end_bit, stream);
+  }
+
+private:
+  template < typename KeyT >
+  static cudaError_t sort(void *d_temp_storage, size_t& temp_bytes,
+        const KeyT *d_keys_in, KeyT *d_keys_out, size_t num_items,
+        bool descending, int begin_bit, int end_bit, cudaStream_t stream) {
+    auto& pool = *hostrt::pool();
+    size_t bytes = 0;
+    if(auto err = CpuSortKeys< KeyT >(pool, nullptr, bytes, d_keys_in,
+          d_keys_out, num_items, descending, begin_bit, end_bit);
+          err != cudaSuccess || d_temp_storage == nullptr) {
+      temp_bytes = bytes;
+      return err;
+    }
+    if(temp_bytes < bytes) return cudaErrorInvalidValue;
+    return hostrt::enqueue(stream, [=, &pool]() mutable {
+      (void)CpuSortKeys< KeyT >(pool, d_temp_storage, bytes, d_keys_in,
+            d_keys_out, num_items, descending, begin_bit, end_bit);
+    });
+  }
+};
+
+struct DeviceReduce {
+  // sequential fold: the same order of operations for every run
+  template < typename InputIt, typename OutputIt, typename ReductionOp,
+        typename T >
+  static cudaError_t Reduce(void *d_temp_storage, size_t& temp_bytes,
+        InputIt d_in, OutputIt d_out, size_t num_items, ReductionOp op,
+        T init, cudaStream_t stream = nullptr) {
+    if(d_temp_storage == nullptr) {
+      temp_bytes = 1;
+      return cudaSuccess;
+    }
+    return hostrt::enqueue(stream, [=] {
+      T acc = init;
+      for(size_t i = 0; i < num_items; i++) {
+        acc = op(acc, d_in[i]);
+      }
+      *d_out = acc;
+    });
+  }
+};
+
+} // namespace gpuprim
+
+#elif !COMPILE_FOR_ROCM
 #include "cub/block/block_load.cuh"
 #include "cub/block/block_scan.cuh"
 #include "cub/block/block_store.cuh"
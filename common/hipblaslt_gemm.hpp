@@ -24,6 +24,7 @@
 #include <optional>
 
 #include "common/common.h"
+#include "common/cpu_gemm.hpp"
 
 #include <hipblas/hipblas.h> // hipblasStatusToString
 #include <hipblaslt/hipblaslt.h>
@@ -374,30 +375,18 @@ struct BlasLtGemm {
   hipblasLtHandle_t blas_lt_;
 };
 
+// host reference for the GEMMs above: see common/cpu_gemm.hpp for the
+// stride conventions; runs on the threads of 'pool' if not null
 template <typename T, typename U = T, typename V = U>
 void matMatMultMixPrec(T alpha, T beta, int M, int N, int K,
     U*  A, int As1, int As2,
     U*  B, int Bs1, int Bs2,
     V*  C, int Cs1, int Cs2,
     V*  D, int Ds1, int Ds2,
-    V *bias = nullptr)
+    V *bias = nullptr, ThreadPool *pool = nullptr)
 {
-  for(int i1 = 0; i1 < M; i1++)
-  {
-    for(int i2 = 0; i2 < N; i2++)
-    {
-      T t = T(0.0);
-      for(int i3 = 0; i3 < K; i3++)
-      {
-        t += T(A[i1 * As1 + i3 * As2]) * T(B[i3 * Bs1 + i2 * Bs2]);
-      }
-      V v(beta * T(C[i1 * Cs1 + i2 * Cs2]) + alpha * t);
-      if(bias != nullptr) {
-        v += bias[i1];
-      }
-      D[i1 * Ds1 + i2 * Ds2] = v;
-    }
-  }
+  gemmHost(pool, alpha, beta, M, N, K, A, As1, As2, B, Bs1, Bs2,
+        C, Cs1, Cs2, D, Ds1, Ds2, bias);
 }
 
 #endif // HIPBLASLT_GEMM_HPP
@@ -0,0 +1,92 @@
+
+#ifndef COMMON_HOST_MEMCPY_HPP
+#define COMMON_HOST_MEMCPY_HPP 1
+
+// Bulk memory copies on the host: large buffers are split between the
+// threads of a pool and written with non-temporal (streaming) stores, so
+// that the destination does not evict the source (and everything else)
+// from the caches. Small copies go to plain memcpy.
+
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "common/threading.hpp"
+
+namespace hostcpy {
+
+// copies below this size are cache-resident: streaming stores do not pay off
+constexpr size_t s_streamThreshold = 1 << 20;
+// bytes per parallel task
+constexpr size_t s_chunk = 1 << 18;
+
+// single-threaded copy with non-temporal stores: the destination is aligned
+// to the vector size, the source is read with unaligned loads
+inline void streamCopy(void *dst, const void *src, size_t bytes) {
+#if defined(__AVX__) || defined(__SSE2__)
+#if defined(__AVX__)
+  using Vec = __m256i;
+#define HOSTCPY_LOAD(p) _mm256_loadu_si256((const Vec *)(p))
+#define HOSTCPY_STORE(p, x) _mm256_stream_si256((Vec *)(p), (x))
+#else
+  using Vec = __m128i;
+#define HOSTCPY_LOAD(p) _mm_loadu_si128((const Vec *)(p))
+#define HOSTCPY_STORE(p, x) _mm_stream_si128((Vec *)(p), (x))
+#endif
+  constexpr size_t V = sizeof(Vec);
+  auto d = (uint8_t *)dst;
+  auto s = (const uint8_t *)src;
+  size_t head = std::min(bytes, (V - (uintptr_t)d % V) % V);
+  std::memcpy(d, s, head);
+  d += head, s += head, bytes -= head;
+  for(; bytes >= 4*V; d += 4*V, s += 4*V, bytes -= 4*V) {
+    auto x0 = HOSTCPY_LOAD(s), x1 = HOSTCPY_LOAD(s + V),
+         x2 = HOSTCPY_LOAD(s + 2*V), x3 = HOSTCPY_LOAD(s + 3*V);
+    HOSTCPY_STORE(d, x0);
+    HOSTCPY_STORE(d + V, x1);
+    HOSTCPY_STORE(d + 2*V, x2);
+    HOSTCPY_STORE(d + 3*V, x3);
+  }
+  for(; bytes >= V; d += V, s += V, bytes -= V) {
+    HOSTCPY_STORE(d, HOSTCPY_LOAD(s));
+  }
+  std::memcpy(d, s, bytes);
+  // streaming stores are weakly ordered: make them visible before any
+  // subsequent store of this thread (e.g. a completion flag)
+  _mm_sfence();
+#undef HOSTCPY_LOAD
+#undef HOSTCPY_STORE
+#else
+  std::memcpy(dst, src, bytes);
+#endif
+}
+
+} // namespace hostcpy
+
+//! copies \c bytes from \c src to \c dst using the threads of \c pool (which
+//! may be null); the buffers must not overlap. All stores are visible to
+//! the calling thread when the function returns.
+inline void parallelCopy(ThreadPool *pool, void *dst, const void *src,
+      size_t bytes) {
+
+  using namespace hostcpy;
+  if(bytes < s_streamThreshold) {
+    std::memcpy(dst, src, bytes);
+    return;
+  }
+  const size_t nChunks = (bytes + s_chunk - 1) / s_chunk;
+  if(pool == nullptr || pool->numThreads() < 2) {
+    streamCopy(dst, src, bytes);
+    return;
+  }
+  auto d = (uint8_t *)dst;
+  auto s = (const uint8_t *)src;
+  pool->parallelFor(0, nChunks, 1, [=](size_t b, size_t e) {
+    size_t ofs = b * s_chunk, end = std::min(e * s_chunk, bytes);
+    streamCopy(d + ofs, s + ofs, end - ofs);
+  });
+}
+
+#endif // COMMON_HOST_MEMCPY_HPP
@@ -0,0 +1,393 @@
+#if COMPILE_FOR_HOST
+
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "common/common.h"
+#include "common/host_memcpy.hpp"
+
+namespace {
+
+struct Clique;
+
+// buffer of a send in flight: the matching receive copies from it
+struct PostedSend {
+  Clique *clique;
+  const void *buf;
+  size_t bytes;
+  bool received;
+};
+
+// ranks of one communicator
+struct Clique {
+  // the ranks' part in collective number 'seq' (counted per rank)
+  struct Meeting {
+    std::vector< const void * > bufs;
+    int posted = 0, read = 0, left = 0;
+  };
+
+  explicit Clique(int n) : nRanks(n), sends((size_t)n * n) { }
+
+  const int nRanks;
+  std::mutex mtx;
+  std::condition_variable changed;
+  std::vector< std::deque< PostedSend * > > sends;  // [src * nRanks + dst]
+  std::map< uint64_t, Meeting > meetings;
+};
+
+} // namespace
+
+struct HostNcclComm {
+  HostNcclComm(std::shared_ptr< Clique > c, int r, int dev) :
+        clique(std::move(c)), rank(r), device(dev) { }
+
+  std::shared_ptr< Clique > clique;
+  int rank, device;
+  std::atomic< uint64_t > numColls{0};  // collectives run by this rank
+};
+
+namespace {
+
+// part of a group: collectives are closures run by the stream
+struct Task {
+  enum Kind { Send, Recv, Coll };
+  Kind kind;
+  HostNcclComm *comm;
+  cudaStream_t stream;
+  int peer;
+  const void *src;
+  void *dst;
+  size_t bytes;
+  std::function< void() > coll;
+};
+
+thread_local int t_groupDepth = 0;
+thread_local std::vector< Task > t_tasks;
+
+std::mutex g_cliquesMtx;
+std::map< std::string, std::weak_ptr< Clique > > g_cliques;
+
+// calls f(T{}) with the element type of 'type'
+template < class F >
+bool withType(ncclDataType_t type, F&& f) {
+  switch(type) {
+  case ncclInt8: f(int8_t{}); break;
+  case ncclUint8: f(uint8_t{}); break;
+  case ncclInt32: f(int32_t{}); break;
+  case ncclUint32: f(uint32_t{}); break;
+  case ncclInt64: f(int64_t{}); break;
+  case ncclUint64: f(uint64_t{}); break;
+  case ncclFloat16: f(__half{}); break;
+  case ncclFloat32: f(float{}); break;
+  case ncclFloat64: f(double{}); break;
+  case ncclBfloat16: f(hip_bfloat16{}); break;
+  default: return false;
+  }
+  return true;
+}
+
+size_t typeSize(ncclDataType_t type) {
+  size_t size = 0;
+  withType(type, [&](auto x) { size = sizeof(x); });
+  return size;
+}
+
+bool valid(HostNcclComm *comm, int peer) {
+  return comm != nullptr && peer >= 0 && peer < comm->clique->nRanks;
+}
+
+// ops of a group on one stream: sends are posted before waiting for
+// anything, then receives and collectives run in issue order
+void runGroup(const std::vector< Task >& tasks) {
+  std::deque< PostedSend > posted;
+  for(const auto& t : tasks) {
+    if(t.kind != Task::Send) continue;
+    auto& c = *t.comm->clique;
+    auto& s = posted.emplace_back(PostedSend{ &c, t.src, t.bytes, false });
+    std::lock_guard _(c.mtx);
+    c.sends[t.comm->rank * c.nRanks + t.peer].push_back(&s);
+    c.changed.notify_all();
+  }
+  for(const auto& t : tasks) {
+    if(t.kind == Task::Coll) {
+      t.coll();
+      continue;
+    }
+    if(t.kind != Task::Recv) continue;
+    auto& c = *t.comm->clique;
+    auto& q = c.sends[t.peer * c.nRanks + t.comm->rank];
+    std::unique_lock lk(c.mtx);
+    c.changed.wait(lk, [&q] { return !q.empty(); });
+    auto s = q.front();
+    q.pop_front();
+    lk.unlock();
+    if(s->bytes > t.bytes) {
+      ThrowError< >("ncclRecv: %zu bytes sent by rank %d to a buffer of %zu",
+            s->bytes, t.peer, t.bytes);
+    }
+    if(s->bytes != 0) {
+      parallelCopy(hostrt::pool(), t.dst, s->buf, s->bytes);
+    }
+    lk.lock();
+    s->received = true;
+    c.changed.notify_all();
+  }
+  // the send buffers are reused once the op completes
+  for(auto& s : posted) {
+    std::unique_lock lk(s.clique->mtx);
+    s.clique->changed.wait(lk, [&s] { return s.received; });
+  }
+}
+
+// one stream op per stream of the group, in the order the streams appear
+ncclResult_t flushGroup() {
+  auto tasks = std::move(t_tasks);
+  t_tasks.clear();
+  std::vector< cudaStream_t > streams;
+  for(const auto& t : tasks) {
+    if(std::find(streams.begin(), streams.end(), t.stream) == streams.end()) {
+      streams.push_back(t.stream);
+    }
+  }
+  for(auto stream : streams) {
+    std::vector< Task > ops;
+    for(auto& t : tasks) {
+      if(t.stream == stream) ops.push_back(std::move(t));
+    }
+    if(hostrt::enqueue(stream, [ops = std::move(ops)] { runGroup(ops); })
+          != cudaSuccess) {
+      return ncclUnhandledCudaError;
+    }
+  }
+  return ncclSuccess;
+}
+
+ncclResult_t addTask(Task&& t) {
+  t_tasks.push_back(std::move(t));
+  return t_groupDepth == 0 ? flushGroup() : ncclSuccess;
+}
+
+// collective of this rank: read(bufs, out) is called once the send buffers
+// of all ranks are known and writes to 'out' which is 'recvBuf' or, if it
+// overlaps 'sendBuf' which the other ranks read, a temporary copied to
+// 'recvBuf' once every rank has read
+ncclResult_t addColl(HostNcclComm *comm, cudaStream_t stream,
+      const void *sendBuf, size_t sendBytes, void *recvBuf,
+      size_t recvBytes, std::function< void(const void *const *, void *) > read) {
+  if(comm == nullptr) return ncclInvalidArgument;
+  auto coll = [=] {
+    auto& c = *comm->clique;
+    auto seq = comm->numColls.fetch_add(1, std::memory_order_relaxed);
+    auto sb = (const char *)sendBuf, rb = (const char *)recvBuf;
+    bool overlap = rb < sb + sendBytes && sb < rb + recvBytes;
+    std::vector< char > tmp(overlap ? recvBytes : 0);
+    void *out = overlap ? (void *)tmp.data() : recvBuf;
+
+    std::unique_lock lk(c.mtx);
+    auto& m = c.meetings[seq];
+    m.bufs.resize(c.nRanks);
+    m.bufs[comm->rank] = sendBuf;
+    if(++m.posted == c.nRanks) c.changed.notify_all();
+    c.changed.wait(lk, [&] { return m.posted == c.nRanks; });
+    lk.unlock();
+    read(m.bufs.data(), out);  // 'bufs' do not change any more
+    lk.lock();
+    if(++m.read == c.nRanks) c.changed.notify_all();
+    c.changed.wait(lk, [&] { return m.read == c.nRanks; });
+    if(overlap) {
+      lk.unlock();
+      parallelCopy(hostrt::pool(), recvBuf, tmp.data(), recvBytes);
+      lk.lock();
+    }
+    if(++m.left == c.nRanks) c.meetings.erase(seq);
+  };
+  return addTask(Task{ Task::Coll, comm, stream, 0, nullptr, nullptr, 0,
+        coll });
+}
+
+// out[i] = bufs[0][ofs + i] op .. op bufs[n - 1][ofs + i] for i < count
+template < class T >
+void reduce(ncclRedOp_t op, int n, const void *const *bufs, size_t ofs,
+      size_t count, T *out) {
+  auto f = [&](size_t begin, size_t end) {
+    std::copy((const T *)bufs[0] + ofs + begin,
+          (const T *)bufs[0] + ofs + end, out + begin);
+    for(int r = 1; r < n; r++) {
+      auto in = (const T *)bufs[r] + ofs;
+      for(size_t i = begin; i < end; i++) {
+        switch(op) {
+        case ncclProd: out[i] = out[i] * in[i]; break;
+        case ncclMax: out[i] = in[i] > out[i] ? in[i] : out[i]; break;
+        case ncclMin: out[i] = in[i] < out[i] ? in[i] : out[i]; break;
+        default: out[i] = out[i] + in[i];
+        }
+      }
+    }
+    if(op == ncclAvg) {
+      for(size_t i = begin; i < end; i++) out[i] = T((double)out[i] / n);
+    }
+  };
+  hostrt::pool()->parallelFor(0, count, 16384, f);
+}
+
+} // namespace
+
+const char *ncclGetErrorString(ncclResult_t res) {
+  switch(res) {
+  case ncclSuccess: return "no error";
+  case ncclUnhandledCudaError: return "unhandled cuda error";
+  case ncclSystemError: return "unhandled system error";
+  case ncclInternalError: return "internal error";
+  case ncclInvalidArgument: return "invalid argument";
+  case ncclInvalidUsage: return "invalid usage";
+  default: return "unknown result code";
+  }
+}
+
+ncclResult_t ncclGetUniqueId(ncclUniqueId *id) {
+  static std::atomic< uint64_t > counter{0};
+  *id = ncclUniqueId{};
+  snprintf(id->internal, sizeof(id->internal), "host-nccl-%d-%lu",
+        (int)getpid(), counter.fetch_add(1));
+  return ncclSuccess;
+}
+
+ncclResult_t ncclCommInitRank(ncclComm_t *comm, int nRanks, ncclUniqueId id,
+      int rank) {
+  if(nRanks <= 0 || rank < 0 || rank >= nRanks) return ncclInvalidArgument;
+  std::string key(id.internal, strnlen(id.internal, sizeof(id.internal)));
+  std::shared_ptr< Clique > clique;
+  {
+    std::lock_guard _(g_cliquesMtx);
+    auto& w = g_cliques[key];
+    clique = w.lock();
+    if(!clique) w = clique = std::make_shared< Clique >(nRanks);
+  }
+  if(clique->nRanks != nRanks) return ncclInvalidUsage;
+  int dev = 0;
+  (void)cudaGetDevice(&dev);
+  *comm = new HostNcclComm(std::move(clique), rank, dev);
+  return ncclSuccess;
+}
+
+ncclResult_t ncclCommDestroy(ncclComm_t comm) {
+  delete comm;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclCommCount(const ncclComm_t comm, int *count) {
+  if(comm == nullptr) return ncclInvalidArgument;
+  *count = comm->clique->nRanks;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclCommCuDevice(const ncclComm_t comm, int *device) {
+  if(comm == nullptr) return ncclInvalidArgument;
+  *device = comm->device;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclCommUserRank(const ncclComm_t comm, int *rank) {
+  if(comm == nullptr) return ncclInvalidArgument;
+  *rank = comm->rank;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclGroupStart() {
+  t_groupDepth++;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclGroupEnd() {
+  if(t_groupDepth == 0) return ncclInvalidUsage;
+  return --t_groupDepth == 0 ? flushGroup() : ncclSuccess;
+}
+
+ncclResult_t ncclSend(const void *sendBuf, size_t count,
+      ncclDataType_t type, int peer, ncclComm_t comm, cudaStream_t stream) {
+  size_t size = typeSize(type);
+  if(size == 0 || !valid(comm, peer)) return ncclInvalidArgument;
+  return addTask(Task{ Task::Send, comm, stream, peer, sendBuf, nullptr,
+        count * size, nullptr });
+}
+
+ncclResult_t ncclRecv(void *recvBuf, size_t count, ncclDataType_t type,
+      int peer, ncclComm_t comm, cudaStream_t stream) {
+  size_t size = typeSize(type);
+  if(size == 0 || !valid(comm, peer)) return ncclInvalidArgument;
+  return addTask(Task{ Task::Recv, comm, stream, peer, nullptr, recvBuf,
+        count * size, nullptr });
+}
+
+ncclResult_t ncclAllReduce(const void *sendBuf, void *recvBuf, size_t count,
+      ncclDataType_t type, ncclRedOp_t op, ncclComm_t comm,
+      cudaStream_t stream) {
+  size_t size = typeSize(type);
+  if(size == 0 || comm == nullptr || op < 0 || op >= ncclNumOps) {
+    return ncclInvalidArgument;
+  }
+  int n = comm->clique->nRanks;
+  return addColl(comm, stream, sendBuf, count * size, recvBuf, count * size,
+        [=](const void *const *bufs, void *out) {
+    withType(type, [&](auto x) {
+      reduce(op, n, bufs, 0, count, (decltype(x) *)out);
+    });
+  });
+}
+
+ncclResult_t ncclReduceScatter(const void *sendBuf, void *recvBuf,
+      size_t recvCount, ncclDataType_t type, ncclRedOp_t op,
+      ncclComm_t comm, cudaStream_t stream) {
+  size_t size = typeSize(type);
+  if(size == 0 || comm == nullptr || op < 0 || op >= ncclNumOps) {
+    return ncclInvalidArgument;
+  }
+  int n = comm->clique->nRanks, rank = comm->rank;
+  return addColl(comm, stream, sendBuf, recvCount * size * n, recvBuf,
+        recvCount * size, [=](const void *const *bufs, void *out) {
+    withType(type, [&](auto x) {
+      reduce(op, n, bufs, rank * recvCount, recvCount, (decltype(x) *)out);
+    });
+  });
+}
+
+ncclResult_t ncclAllGather(const void *sendBuf, void *recvBuf,
+      size_t sendCount, ncclDataType_t type, ncclComm_t comm,
+      cudaStream_t stream) {
+  size_t size = typeSize(type);
+  if(size == 0 || comm == nullptr) return ncclInvalidArgument;
+  int n = comm->clique->nRanks;
+  size_t bytes = sendCount * size;
+  return addColl(comm, stream, sendBuf, bytes, recvBuf, bytes * n,
+        [=](const void *const *bufs, void *out) {
+    for(int r = 0; r < n; r++) {
+      parallelCopy(hostrt::pool(), (char *)out + r * bytes, bufs[r], bytes);
+    }
+  });
+}
+
+ncclResult_t ncclAllToAll(const void *sendBuf, void *recvBuf, size_t count,
+      ncclDataType_t type, ncclComm_t comm, cudaStream_t stream) {
+  size_t size = typeSize(type);
+  if(size == 0 || comm == nullptr) return ncclInvalidArgument;
+  int n = comm->clique->nRanks, rank = comm->rank;
+  size_t bytes = count * size;
+  return addColl(comm, stream, sendBuf, bytes * n, recvBuf, bytes * n,
+        [=](const void *const *bufs, void *out) {
+    for(int r = 0; r < n; r++) {
+      parallelCopy(hostrt::pool(), (char *)out + r * bytes,
+            (const char *)bufs[r] + rank * bytes, bytes);
+    }
+  });
+}
+
+#endif // COMPILE_FOR_HOST
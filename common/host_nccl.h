@@ -0,0 +1,90 @@
+#ifndef COMMON_HOST_NCCL_H
+#define COMMON_HOST_NCCL_H 1
+
+// CPU implementation of the NCCL / RCCL subset used by the RCCL harnesses
+// (COMPILE_FOR_HOST=1, see common/host_nccl.cc) on top of the host runtime:
+//  - all ranks of a communicator live in this process, a unique id names
+//    the communicator the ranks join with ncclCommInitRank;
+//  - operations are enqueued on the stream; ops between ncclGroupStart and
+//    ncclGroupEnd become one stream op per stream which posts its sends
+//    first, so that the sends and receives of a group never deadlock;
+//  - ncclSend posts the buffer, the matching ncclRecv (in posting order per
+//    pair of ranks) copies from it; the sending op completes once all its
+//    sends were received;
+//  - collectives meet the other ranks in their issue order, read the send
+//    buffers of all ranks and write the result once every rank has read
+//    (in-place calls are fine). Reductions sum in rank order: all ranks get
+//    bitwise equal results.
+
+#include <cstddef>
+
+typedef struct HostNcclComm *ncclComm_t;
+
+struct ncclUniqueId {
+  char internal[128];
+};
+
+enum ncclResult_t : int {
+  ncclSuccess = 0,
+  ncclUnhandledCudaError = 1,
+  ncclSystemError = 2,
+  ncclInternalError = 3,
+  ncclInvalidArgument = 4,
+  ncclInvalidUsage = 5,
+};
+
+enum ncclDataType_t : int {
+  ncclInt8 = 0, ncclChar = 0,
+  ncclUint8 = 1,
+  ncclInt32 = 2, ncclInt = 2,
+  ncclUint32 = 3,
+  ncclInt64 = 4,
+  ncclUint64 = 5,
+  ncclFloat16 = 6, ncclHalf = 6,
+  ncclFloat32 = 7, ncclFloat = 7,
+  ncclFloat64 = 8, ncclDouble = 8,
+  ncclBfloat16 = 9,
+  ncclNumTypes = 10,
+};
+
+enum ncclRedOp_t : int {
+  ncclSum = 0,
+  ncclProd = 1,
+  ncclMax = 2,
+  ncclMin = 3,
+  ncclAvg = 4,
+  ncclNumOps = 5,
+};
+
+const char *ncclGetErrorString(ncclResult_t res);
+
+ncclResult_t ncclGetUniqueId(ncclUniqueId *id);
+ncclResult_t ncclCommInitRank(ncclComm_t *comm, int nRanks, ncclUniqueId id,
+      int rank);
+ncclResult_t ncclCommDestroy(ncclComm_t comm);
+ncclResult_t ncclCommCount(const ncclComm_t comm, int *count);
+ncclResult_t ncclCommCuDevice(const ncclComm_t comm, int *device);
+ncclResult_t ncclCommUserRank(const ncclComm_t comm, int *rank);
+
+ncclResult_t ncclGroupStart();
+ncclResult_t ncclGroupEnd();
+
+ncclResult_t ncclSend(const void *sendBuf, size_t count,
+      ncclDataType_t type, int peer, ncclComm_t comm, cudaStream_t stream);
+ncclResult_t ncclRecv(void *recvBuf, size_t count, ncclDataType_t type,
+      int peer, ncclComm_t comm, cudaStream_t stream);
+
+ncclResult_t ncclAllReduce(const void *sendBuf, void *recvBuf, size_t count,
+      ncclDataType_t type, ncclRedOp_t op, ncclComm_t comm,
+      cudaStream_t stream);
+ncclResult_t ncclReduceScatter(const void *sendBuf, void *recvBuf,
+      size_t recvCount, ncclDataType_t type, ncclRedOp_t op,
+      ncclComm_t comm, cudaStream_t stream);
+ncclResult_t ncclAllGather(const void *sendBuf, void *recvBuf,
+      size_t sendCount, ncclDataType_t type, ncclComm_t comm,
+      cudaStream_t stream);
+// RCCL extension: 'count' elements to and from every rank
+ncclResult_t ncclAllToAll(const void *sendBuf, void *recvBuf, size_t count,
+      ncclDataType_t type, ncclComm_t comm, cudaStream_t stream);
+
+#endif // COMMON_HOST_NCCL_H
@@ -0,0 +1,241 @@
+#ifndef COMMON_HOST_ROCBLAS_HPP
+#define COMMON_HOST_ROCBLAS_HPP 1
+
+// CPU implementation of the rocBLAS subset used by the RocBlas and
+// RCCL_bubbles harnesses (COMPILE_FOR_HOST=1): GEMMs are enqueued on the
+// stream of the handle and run on the host runtime thread pool with the
+// host GEMM engine (common/cpu_gemm.hpp). Supported types: float and double
+// with the same compute type, __half / hip_bfloat16 inputs with float
+// compute and outputs of the input type or float. There is one solution
+// (index 0) per type combination.
+
+#include "common/common.h"
+#include "common/cpu_gemm.hpp"
+
+typedef int32_t rocblas_int;
+typedef int64_t rocblas_stride;
+
+struct hipFloatComplex {
+  float x, y;
+};
+
+struct hipDoubleComplex {
+  double x, y;
+};
+
+enum rocblas_status : int {
+  rocblas_status_success = 0,
+  rocblas_status_invalid_handle = 1,
+  rocblas_status_not_implemented = 2,
+  rocblas_status_invalid_pointer = 3,
+  rocblas_status_invalid_size = 4,
+  rocblas_status_internal_error = 6,
+  rocblas_status_invalid_value = 11,
+};
+
+enum rocblas_operation : int {
+  rocblas_operation_none = 111,
+  rocblas_operation_transpose = 112,
+  rocblas_operation_conjugate_transpose = 113,
+};
+
+enum rocblas_datatype : int {
+  rocblas_datatype_f16_r = 150,
+  rocblas_datatype_f32_r = 151,
+  rocblas_datatype_f64_r = 152,
+  rocblas_datatype_f16_c = 153,
+  rocblas_datatype_f32_c = 154,
+  rocblas_datatype_f64_c = 155,
+  rocblas_datatype_i8_r = 160,
+  rocblas_datatype_u8_r = 161,
+  rocblas_datatype_i32_r = 162,
+  rocblas_datatype_u32_r = 163,
+  rocblas_datatype_bf16_r = 168,
+  rocblas_datatype_bf16_c = 169,
+};
+
+enum rocblas_gemm_algo : int {
+  rocblas_gemm_algo_standard = 0,
+  rocblas_gemm_algo_solution_index = 1,
+};
+
+enum rocblas_pointer_mode : int {
+  rocblas_pointer_mode_host = 0,
+  rocblas_pointer_mode_device = 1,
+};
+
+struct HostBlasHandle {
+  cudaStream_t stream = nullptr;
+  rocblas_pointer_mode pointerMode = rocblas_pointer_mode_host;
+};
+typedef HostBlasHandle *rocblas_handle;
+
+inline const char *rocblas_status_to_string(rocblas_status status) {
+  switch(status) {
+  case rocblas_status_success: return "rocblas_status_success";
+  case rocblas_status_invalid_handle: return "rocblas_status_invalid_handle";
+  case rocblas_status_not_implemented: return "rocblas_status_not_implemented";
+  case rocblas_status_invalid_pointer: return "rocblas_status_invalid_pointer";
+  case rocblas_status_invalid_size: return "rocblas_status_invalid_size";
+  case rocblas_status_internal_error: return "rocblas_status_internal_error";
+  case rocblas_status_invalid_value: return "rocblas_status_invalid_value";
+  default: return "<undefined rocblas_status>";
+  }
+}
+
+inline rocblas_status rocblas_create_handle(rocblas_handle *handle) {
+  *handle = new HostBlasHandle;
+  return rocblas_status_success;
+}
+
+inline rocblas_status rocblas_destroy_handle(rocblas_handle handle) {
+  delete handle;
+  return rocblas_status_success;
+}
+
+inline rocblas_status rocblas_set_stream(rocblas_handle handle,
+      cudaStream_t stream) {
+  if(handle == nullptr) return rocblas_status_invalid_handle;
+  handle->stream = stream;
+  return rocblas_status_success;
+}
+
+inline rocblas_status rocblas_set_pointer_mode(rocblas_handle handle,
+      rocblas_pointer_mode mode) {
+  if(handle == nullptr) return rocblas_status_invalid_handle;
+  handle->pointerMode = mode;
+  return rocblas_status_success;
+}
+
+namespace host_blas {
+
+// calls f(U{}, V{}, T{}) for the types of A / B, C / D and the compute type
+template < class F >
+bool withTypes(rocblas_datatype ab, rocblas_datatype cd,
+      rocblas_datatype compute, F&& f) {
+  if(compute == rocblas_datatype_f64_r) {
+    if(ab != compute || cd != compute) return false;
+    f(double{}, double{}, double{});
+    return true;
+  }
+  if(compute != rocblas_datatype_f32_r) return false;
+  auto out = [&](auto u) {
+    if(cd == rocblas_datatype_f32_r) {
+      f(u, float{}, float{});
+    } else if(cd == ab) {
+      f(u, u, float{});
+    } else {
+      return false;
+    }
+    return true;
+  };
+  switch(ab) {
+  case rocblas_datatype_f32_r: return cd == ab && out(float{});
+  case rocblas_datatype_f16_r: return out(__half{});
+  case rocblas_datatype_bf16_r: return out(hip_bfloat16{});
+  default: return false;
+  }
+}
+
+// D[i] = alpha * op(A[i]) * op(B[i]) + beta * C[i] for 'batch' column-major
+// matrices (strides in elements between them)
+inline rocblas_status gemm(rocblas_handle handle, rocblas_operation transA,
+      rocblas_operation transB, rocblas_int m, rocblas_int n, rocblas_int k,
+      const void *alpha, const void *a, rocblas_datatype aType,
+      rocblas_int lda, rocblas_stride strideA, const void *b,
+      rocblas_datatype bType, rocblas_int ldb, rocblas_stride strideB,
+      const void *beta, const void *c, rocblas_datatype cType,
+      rocblas_int ldc, rocblas_stride strideC, void *d,
+      rocblas_datatype dType, rocblas_int ldd, rocblas_stride strideD,
+      rocblas_int batch, rocblas_datatype computeType) {
+  if(handle == nullptr) return rocblas_status_invalid_handle;
+  if(m < 0 || n < 0 || k < 0 || batch < 0 ||
+        ldc < std::max(1, m) || ldd < std::max(1, m) ||
+        lda < std::max(1, transA == rocblas_operation_none ? m : k) ||
+        ldb < std::max(1, transB == rocblas_operation_none ? k : n)) {
+    return rocblas_status_invalid_size;
+  }
+  if(alpha == nullptr || beta == nullptr) {
+    return rocblas_status_invalid_pointer;
+  }
+  if(aType != bType || cType != dType) {
+    return rocblas_status_not_implemented;
+  }
+  auto stream = handle->stream;
+  bool hostScalars = handle->pointerMode == rocblas_pointer_mode_host;
+  cudaError_t err = cudaSuccess;
+  bool supported = withTypes(aType, dType, computeType,
+        [&](auto u, auto v, auto t) {
+    using U = decltype(u);
+    using V = decltype(v);
+    using T = decltype(t);
+    // scalars in host memory are read now, device ones when the GEMM runs
+    T al = hostScalars ? *(const T *)alpha : T{},
+      be = hostScalars ? *(const T *)beta : T{};
+    int64_t As1 = 1, As2 = lda, Bs1 = 1, Bs2 = ldb;
+    if(transA != rocblas_operation_none) std::swap(As1, As2);
+    if(transB != rocblas_operation_none) std::swap(Bs1, Bs2);
+    err = hostrt::enqueue(stream, [=] {
+      gemmHostBatched(hostrt::pool(), hostScalars ? al : *(const T *)alpha,
+            hostScalars ? be : *(const T *)beta, m, n, k,
+            (const U *)a, As1, As2, strideA, (const U *)b, Bs1, Bs2, strideB,
+            (const V *)c, 1, ldc, strideC, (V *)d, 1, ldd, strideD, batch);
+    });
+  });
+  if(!supported) return rocblas_status_not_implemented;
+  return err == cudaSuccess ? rocblas_status_success :
+        rocblas_status_internal_error;
+}
+
+} // namespace host_blas
+
+inline rocblas_status rocblas_gemm_ex(rocblas_handle handle,
+      rocblas_operation transA, rocblas_operation transB, rocblas_int m,
+      rocblas_int n, rocblas_int k, const void *alpha, const void *a,
+      rocblas_datatype aType, rocblas_int lda, const void *b,
+      rocblas_datatype bType, rocblas_int ldb, const void *beta,
+      const void *c, rocblas_datatype cType, rocblas_int ldc, void *d,
+      rocblas_datatype dType, rocblas_int ldd, rocblas_datatype computeType,
+      rocblas_gemm_algo algo, int32_t solutionIndex, uint32_t flags) {
+  if(algo == rocblas_gemm_algo_solution_index && solutionIndex > 0) {
+    return rocblas_status_invalid_value;
+  }
+  return host_blas::gemm(handle, transA, transB, m, n, k, alpha, a, aType,
+        lda, 0, b, bType, ldb, 0, beta, c, cType, ldc, 0, d, dType, ldd, 0, 1,
+        computeType);
+}
+
+inline rocblas_status rocblas_gemm_strided_batched_ex(rocblas_handle handle,
+      rocblas_operation transA, rocblas_operation transB, rocblas_int m,
+      rocblas_int n, rocblas_int k, const void *alpha, const void *a,
+      rocblas_datatype aType, rocblas_int lda, rocblas_stride strideA,
+      const void *b, rocblas_datatype bType, rocblas_int ldb,
+      rocblas_stride strideB, const void *beta, const void *c,
+      rocblas_datatype cType, rocblas_int ldc, rocblas_stride strideC,
+      void *d, rocblas_datatype dType, rocblas_int ldd,
+      rocblas_stride strideD, rocblas_int batchCount,
+      rocblas_datatype computeType, rocblas_gemm_algo algo,
+      int32_t solutionIndex, uint32_t flags) {
+  if(algo == rocblas_gemm_algo_solution_index && solutionIndex > 0) {
+    return rocblas_status_invalid_value;
+  }
+  return host_blas::gemm(handle, transA, transB, m, n, k, alpha, a, aType,
+        lda, strideA, b, bType, ldb, strideB, beta, c, cType, ldc, strideC,
+        d, dType, ldd, strideD, batchCount, computeType);
+}
+
+// one solution (index 0) for the supported type combinations
+inline rocblas_status rocblas_gemm_ex_get_solutions_by_type(
+      rocblas_handle handle, rocblas_datatype inputType,
+      rocblas_datatype outputType, rocblas_datatype computeType,
+      uint32_t flags, rocblas_int *list, rocblas_int *size) {
+  if(handle == nullptr) return rocblas_status_invalid_handle;
+  if(size == nullptr) return rocblas_status_invalid_pointer;
+  bool supported = host_blas::withTypes(inputType, outputType, computeType,
+        [](auto, auto, auto) { });
+  if(list != nullptr && supported && *size > 0) list[0] = 0;
+  *size = supported ? 1 : 0;
+  return rocblas_status_success;
+}
+
+#endif // COMMON_HOST_ROCBLAS_HPP
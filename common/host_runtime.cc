@@ -0,0 +1,716 @@
+#if COMPILE_FOR_HOST
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "common/common.h"
+#include "common/host_memcpy.hpp"
+
+namespace {
+
+// one entry of a stream queue or of a graph
+struct Op {
+  enum Kind { Call, Record, Wait };
+  Kind kind = Call;
+  void (*fn)(void *) = nullptr;
+  std::shared_ptr< void > arg;  // shared by the copies of an instantiated graph
+  HostEvent *event = nullptr;   // Record and Wait
+  uint64_t ticket = 0;          // Record: number of the record of 'event'
+};
+
+} // namespace
+
+// records are numbered by the event itself: waiting on it does not touch
+// the stream it was recorded on, which may be destroyed before the event
+struct HostEvent {
+  std::mutex mtx;
+  std::condition_variable reached;
+  HostStream *stream = nullptr;  // recorded last on this stream
+  uint64_t recorded = 0,         // records enqueued ..
+           completed = 0;        // .. and the latest one which ran
+  std::atomic< int64_t > ns{0};  // steady_clock time when it ran
+
+  bool done() {  // with 'mtx' held
+    return completed >= recorded;
+  }
+
+  void wait(uint64_t ticket) {
+    std::unique_lock lk(mtx);
+    reached.wait(lk, [&] { return completed >= ticket; });
+  }
+};
+
+struct HostGraph {
+  std::vector< Op > ops;
+};
+
+struct HostGraphExec {
+  std::vector< Op > ops;
+};
+
+struct HostStream {
+  std::mutex mtx;
+  std::condition_variable hasWork, hasDone;
+  std::deque< Op > queue;
+  uint64_t submitted = 0, completed = 0;
+  std::exception_ptr ex;    // first failure since the last sync
+  bool stop = false;
+  // stream capture
+  HostGraph *graph = nullptr;
+  bool ownsGraph = false, invalid = false;
+  cudaStreamCaptureMode mode = cudaStreamCaptureModeGlobal;
+  std::thread::id captureThread;
+  std::thread worker;
+
+  HostStream() : worker(&HostStream::run, this) { }
+
+  ~HostStream() {
+    {
+      std::lock_guard _(mtx);
+      stop = true;
+    }
+    hasWork.notify_one();
+    worker.join();
+  }
+
+  void run() {
+    std::unique_lock lk(mtx);
+    while(true) {
+      hasWork.wait(lk, [this] { return stop || !queue.empty(); });
+      if(queue.empty()) break;
+      auto op = std::move(queue.front());
+      queue.pop_front();
+      lk.unlock();
+      try {
+        exec(op);
+      } catch(...) {
+        std::lock_guard _(mtx);
+        if(!ex) ex = std::current_exception();
+      }
+      op = Op{};  // release the argument outside of the lock
+      lk.lock();
+      completed++;
+      hasDone.notify_all();
+    }
+  }
+
+  void exec(const Op& op) {
+    if(op.kind == Op::Record) {
+      auto e = op.event;
+      e->ns.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+            std::memory_order_release);
+      {
+        std::lock_guard _(e->mtx);
+        e->completed = std::max(e->completed, op.ticket);
+      }
+      e->reached.notify_all();
+    } else {
+      op.fn(op.arg.get());
+    }
+  }
+
+  // appends ops to the queue (or to the graph being captured): numbers
+  // event records and resolves waits to the record enqueued last. Returns
+  // the number of the last op
+  uint64_t push(const Op *ops, size_t n);
+
+  cudaError_t wait(uint64_t ticket) {
+    std::unique_lock lk(mtx);
+    hasDone.wait(lk, [&] { return completed >= ticket; });
+    if(auto e = std::exchange(ex, nullptr)) {
+      lk.unlock();
+      try {
+        std::rethrow_exception(e);
+      } catch(std::exception& x) {
+        VLOG(0) << "Stream op failed: " << x.what();
+      } catch(...) {
+        VLOG(0) << "Stream op failed";
+      }
+      return cudaErrorLaunchFailure;
+    }
+    return cudaSuccess;
+  }
+
+  cudaError_t sync() {
+    uint64_t ticket;
+    {
+      std::lock_guard _(mtx);
+      ticket = submitted;
+    }
+    return wait(ticket);
+  }
+};
+
+namespace {
+
+thread_local cudaError_t t_lastError = cudaSuccess;
+thread_local int t_device = 0;
+
+struct Registry {
+  std::mutex mtx;
+  std::set< HostStream * > streams;
+  std::set< std::pair< int, int > > peers;  // (device, peer) with access on
+  std::unordered_map< const void *, hostrt::KernelLauncher > kernels;
+
+  static Registry& get() {
+    static Registry *r = new Registry;  // lives until exit like the streams
+    return *r;
+  }
+};
+
+// the legacy null stream is one more stream (without implicit
+// synchronization with the others)
+HostStream *nullStream() {
+  static HostStream *s = [] {
+    auto s = new HostStream;
+    auto& r = Registry::get();
+    std::lock_guard _(r.mtx);
+    r.streams.insert(s);
+    return s;
+  }();
+  return s;
+}
+
+inline HostStream *toStream(cudaStream_t s) {
+  return s != nullptr ? s : nullStream();
+}
+
+inline cudaError_t ret(cudaError_t err) {
+  if(err != cudaSuccess) t_lastError = err;
+  return err;
+}
+
+// calls which synchronize with the device are not allowed while this
+// thread captures a stream (or any thread does so in global mode): they
+// fail and invalidate the offending captures
+cudaError_t checkCapture() {
+  auto& r = Registry::get();
+  std::lock_guard _(r.mtx);
+  bool illegal = false;
+  auto self = std::this_thread::get_id();
+  for(auto s : r.streams) {
+    std::lock_guard _(s->mtx);
+    if(s->graph == nullptr || s->mode == cudaStreamCaptureModeRelaxed) {
+      continue;
+    }
+    if(s->captureThread == self || s->mode == cudaStreamCaptureModeGlobal) {
+      s->invalid = illegal = true;
+    }
+  }
+  return illegal ? cudaErrorStreamCaptureUnsupported : cudaSuccess;
+}
+
+uint64_t physBytes(int name) {
+  return (uint64_t)sysconf(name) * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+int numDevices() {
+  static int n = [] {
+    auto s = getenv("HOST_NUM_DEVICES");
+    return s != nullptr ? std::max(atoi(s), 1) : 8;
+  }();
+  return n;
+}
+
+void *alignedAlloc(size_t size) {
+  constexpr size_t align = 256;
+  return aligned_alloc(align, (std::max< size_t >(size, 1) + align - 1) & ~(align - 1));
+}
+
+cudaError_t enqueueOps(cudaStream_t stream, const Op *ops, size_t n) {
+  toStream(stream)->push(ops, n);
+  return cudaSuccess;
+}
+
+} // namespace
+
+uint64_t HostStream::push(const Op *ops, size_t n) {
+  uint64_t ticket;
+  {
+    std::lock_guard _(mtx);
+    if(graph != nullptr) {  // capturing
+      graph->ops.insert(graph->ops.end(), ops, ops + n);
+      return submitted;
+    }
+    for(size_t i = 0; i < n; i++) {
+      auto op = ops[i];
+      if(op.kind == Op::Record) {
+        std::lock_guard _(op.event->mtx);
+        op.event->stream = this;
+        op.ticket = ++op.event->recorded;
+      } else if(op.kind == Op::Wait) {
+        // waits for the record enqueued last, not for later ones
+        HostStream *es;
+        uint64_t et;
+        {
+          std::lock_guard _(op.event->mtx);
+          es = op.event->stream, et = op.event->recorded;
+        }
+        if(es == nullptr || es == this) continue;  // in order anyway
+        op = Op{};
+        op.fn = [](void *p) {
+          auto w = (std::pair< HostEvent *, uint64_t > *)p;
+          w->first->wait(w->second);
+        };
+        op.arg = std::make_shared< std::pair< HostEvent *, uint64_t > >(
+              ops[i].event, et);
+      }
+      queue.push_back(std::move(op));
+      submitted++;
+    }
+    ticket = submitted;
+  }
+  hasWork.notify_one();
+  return ticket;
+}
+
+namespace hostrt {
+
+ThreadPool *pool() {
+  static ThreadPool *p = new ThreadPool(
+        std::max(std::thread::hardware_concurrency(), 1u));
+  return p;
+}
+
+cudaError_t enqueue(cudaStream_t stream, void (*fn)(void *), void *arg,
+      void (*release)(void *)) {
+  Op op;
+  op.fn = fn;
+  op.arg = std::shared_ptr< void >(arg, release != nullptr ? release :
+        [](void *) { });
+  return ret(enqueueOps(stream, &op, 1));
+}
+
+} // namespace hostrt
+
+const char *cudaGetErrorName(cudaError_t err) {
+  switch(err) {
+#define X(e) case e: return #e;
+  X(cudaSuccess) X(cudaErrorInvalidValue) X(cudaErrorMemoryAllocation)
+  X(cudaErrorInvalidDeviceFunction) X(cudaErrorInvalidDevice)
+  X(cudaErrorInvalidResourceHandle)
+  X(cudaErrorNotReady) X(cudaErrorPeerAccessAlreadyEnabled)
+  X(cudaErrorPeerAccessNotEnabled) X(cudaErrorLaunchFailure)
+  X(cudaErrorStreamCaptureUnsupported) X(cudaErrorStreamCaptureInvalidated)
+  X(cudaErrorStreamCaptureWrongThread) X(cudaErrorUnknown)
+#undef X
+  }
+  return "unrecognized error code";
+}
+
+const char *cudaGetErrorString(cudaError_t err) {
+  switch(err) {
+  case cudaSuccess: return "no error";
+  case cudaErrorInvalidValue: return "invalid argument";
+  case cudaErrorMemoryAllocation: return "out of memory";
+  case cudaErrorInvalidDeviceFunction: return "invalid device function";
+  case cudaErrorInvalidDevice: return "invalid device ordinal";
+  case cudaErrorInvalidResourceHandle: return "invalid resource handle";
+  case cudaErrorNotReady: return "device not ready";
+  case cudaErrorPeerAccessAlreadyEnabled: return "peer access is already enabled";
+  case cudaErrorPeerAccessNotEnabled: return "peer access has not been enabled";
+  case cudaErrorLaunchFailure: return "unspecified launch failure";
+  case cudaErrorStreamCaptureUnsupported: return "operation not permitted when stream is capturing";
+  case cudaErrorStreamCaptureInvalidated: return "operation failed due to a previous error during capture";
+  case cudaErrorStreamCaptureWrongThread: return "attempt to terminate a thread-local capture sequence from another thread";
+  default: return "unknown error";
+  }
+}
+
+cudaError_t cudaGetLastError() {
+  return std::exchange(t_lastError, cudaSuccess);
+}
+
+cudaError_t cudaPeekAtLastError() {
+  return t_lastError;
+}
+
+cudaError_t cudaGetDeviceCount(int *count) {
+  *count = numDevices();
+  return cudaSuccess;
+}
+
+cudaError_t cudaSetDevice(int dev) {
+  if(dev < 0 || dev >= numDevices()) return ret(cudaErrorInvalidDevice);
+  t_device = dev;
+  return cudaSuccess;
+}
+
+cudaError_t cudaGetDevice(int *dev) {
+  *dev = t_device;
+  return cudaSuccess;
+}
+
+cudaError_t cudaGetDeviceProperties(cudaDeviceProp *prop, int dev) {
+  if(dev < 0 || dev >= numDevices()) return ret(cudaErrorInvalidDevice);
+  *prop = cudaDeviceProp{};
+  snprintf(prop->name, sizeof(prop->name), "Host CPU (emulated device %d)", dev);
+  prop->totalGlobalMem = physBytes(_SC_PHYS_PAGES);
+  prop->sharedMemPerBlock = simt::s_maxDynSharedBytes;
+  prop->warpSize = simt::WaveSize;
+  prop->maxThreadsPerBlock = simt::s_maxBlockSize;
+  prop->maxThreadsPerMultiProcessor = simt::s_maxBlockSize;
+  prop->multiProcessorCount = hostrt::pool()->numThreads();
+  prop->major = 1;
+  return cudaSuccess;
+}
+
+cudaError_t cudaMemGetInfo(size_t *free, size_t *total) {
+  *free = physBytes(_SC_AVPHYS_PAGES);
+  *total = physBytes(_SC_PHYS_PAGES);
+  return cudaSuccess;
+}
+
+cudaError_t cudaDeviceSynchronize() {
+  if(auto err = checkCapture(); err != cudaSuccess) return ret(err);
+  std::vector< HostStream * > streams;
+  {
+    auto& r = Registry::get();
+    std::lock_guard _(r.mtx);
+    streams.assign(r.streams.begin(), r.streams.end());
+  }
+  cudaError_t res = cudaSuccess;
+  for(auto s : streams) {
+    if(auto err = s->sync(); err != cudaSuccess) res = err;
+  }
+  return ret(res);
+}
+
+cudaError_t cudaDeviceCanAccessPeer(int *canAccess, int dev, int peer) {
+  int n = numDevices();
+  if(dev < 0 || dev >= n || peer < 0 || peer >= n) {
+    return ret(cudaErrorInvalidDevice);
+  }
+  *canAccess = dev != peer;
+  return cudaSuccess;
+}
+
+cudaError_t cudaDeviceEnablePeerAccess(int peer, unsigned) {
+  if(peer < 0 || peer >= numDevices() || peer == t_device) {
+    return ret(cudaErrorInvalidDevice);
+  }
+  auto& r = Registry::get();
+  std::lock_guard _(r.mtx);
+  return ret(r.peers.emplace(t_device, peer).second ? cudaSuccess :
+        cudaErrorPeerAccessAlreadyEnabled);
+}
+
+cudaError_t cudaDeviceDisablePeerAccess(int peer) {
+  auto& r = Registry::get();
+  std::lock_guard _(r.mtx);
+  return ret(r.peers.erase({t_device, peer}) != 0 ? cudaSuccess :
+        cudaErrorPeerAccessNotEnabled);
+}
+
+cudaError_t cudaMalloc(void **ptr, size_t size) {
+  if(auto err = checkCapture(); err != cudaSuccess) return ret(err);
+  *ptr = alignedAlloc(size);
+  return ret(*ptr != nullptr ? cudaSuccess : cudaErrorMemoryAllocation);
+}
+
+cudaError_t cudaFree(void *ptr) {
+  if(auto err = checkCapture(); err != cudaSuccess) return ret(err);
+  // like the device runtime: memory may be in use by queued ops
+  if(ptr != nullptr) {
+    if(auto err = cudaDeviceSynchronize(); err != cudaSuccess) return err;
+  }
+  free(ptr);
+  return cudaSuccess;
+}
+
+cudaError_t cudaHostAlloc(void **ptr, size_t size, unsigned) {
+  *ptr = alignedAlloc(size);
+  return ret(*ptr != nullptr ? cudaSuccess : cudaErrorMemoryAllocation);
+}
+
+cudaError_t cudaFreeHost(void *ptr) {
+  return cudaFree(ptr);
+}
+
+cudaError_t hipExtMallocWithFlags(void **ptr, size_t size, unsigned) {
+  return cudaMalloc(ptr, size);
+}
+
+cudaError_t cudaMemcpy(void *dst, const void *src, size_t size,
+      cudaMemcpyKind) {
+  if(auto err = checkCapture(); err != cudaSuccess) return ret(err);
+  // ordered after the work of the null stream
+  if(auto err = nullStream()->sync(); err != cudaSuccess) return ret(err);
+  parallelCopy(hostrt::pool(), dst, src, size);
+  return cudaSuccess;
+}
+
+cudaError_t cudaMemcpyAsync(void *dst, const void *src, size_t size,
+      cudaMemcpyKind, cudaStream_t stream) {
+  struct Args { void *dst; const void *src; size_t size; };
+  return hostrt::enqueue(stream, [](void *p) {
+    auto a = (Args *)p;
+    parallelCopy(hostrt::pool(), a->dst, a->src, a->size);
+  }, new Args{dst, src, size}, [](void *p) { delete (Args *)p; });
+}
+
+cudaError_t cudaMemcpyPeer(void *dst, int, const void *src, int,
+      size_t size) {
+  return cudaMemcpy(dst, src, size, cudaMemcpyDeviceToDevice);
+}
+
+cudaError_t cudaMemcpyPeerAsync(void *dst, int, const void *src, int,
+      size_t size, cudaStream_t stream) {
+  return cudaMemcpyAsync(dst, src, size, cudaMemcpyDeviceToDevice, stream);
+}
+
+cudaError_t cudaMemset(void *ptr, int value, size_t size) {
+  if(auto err = checkCapture(); err != cudaSuccess) return ret(err);
+  if(auto err = nullStream()->sync(); err != cudaSuccess) return ret(err);
+  memset(ptr, value, size);
+  return cudaSuccess;
+}
+
+cudaError_t cudaMemsetAsync(void *ptr, int value, size_t size,
+      cudaStream_t stream) {
+  return hostrt::enqueue(stream, [=] { memset(ptr, value, size); });
+}
+
+cudaError_t cudaStreamCreate(cudaStream_t *stream) {
+  return cudaStreamCreateWithFlags(stream, cudaStreamDefault);
+}
+
+cudaError_t cudaStreamCreateWithFlags(cudaStream_t *stream, unsigned) {
+  auto s = new HostStream;
+  auto& r = Registry::get();
+  std::lock_guard _(r.mtx);
+  r.streams.insert(s);
+  *stream = s;
+  return cudaSuccess;
+}
+
+// priorities are left to the OS scheduler
+cudaError_t cudaStreamCreateWithPriority(cudaStream_t *stream,
+      unsigned flags, int) {
+  return cudaStreamCreateWithFlags(stream, flags);
+}
+
+cudaError_t cudaStreamDestroy(cudaStream_t stream) {
+  if(stream == nullptr) return ret(cudaErrorInvalidResourceHandle);
+  {
+    auto& r = Registry::get();
+    std::lock_guard _(r.mtx);
+    if(r.streams.erase(stream) == 0) return ret(cudaErrorInvalidResourceHandle);
+  }
+  (void)stream->sync();
+  delete stream;  // finishes the queued ops
+  return cudaSuccess;
+}
+
+cudaError_t cudaStreamSynchronize(cudaStream_t stream) {
+  if(auto err = checkCapture(); err != cudaSuccess) return ret(err);
+  return ret(toStream(stream)->sync());
+}
+
+cudaError_t cudaStreamQuery(cudaStream_t stream) {
+  auto s = toStream(stream);
+  std::lock_guard _(s->mtx);
+  return s->completed >= s->submitted ? cudaSuccess : cudaErrorNotReady;
+}
+
+cudaError_t cudaStreamWaitEvent(cudaStream_t stream, cudaEvent_t event,
+      unsigned) {
+  Op op;
+  op.kind = Op::Wait;
+  op.event = event;
+  return ret(enqueueOps(stream, &op, 1));
+}
+
+cudaError_t cudaLaunchHostFunc(cudaStream_t stream, cudaHostFn_t fn,
+      void *userData) {
+  return hostrt::enqueue(stream, fn, userData, nullptr);
+}
+
+cudaError_t cudaEventCreate(cudaEvent_t *event) {
+  *event = new HostEvent;
+  return cudaSuccess;
+}
+
+// pending records still refer to the event
+cudaError_t cudaEventDestroy(cudaEvent_t event) {
+  if(event == nullptr) return ret(cudaErrorInvalidResourceHandle);
+  (void)cudaEventSynchronize(event);
+  delete event;
+  return cudaSuccess;
+}
+
+cudaError_t cudaEventRecord(cudaEvent_t event, cudaStream_t stream) {
+  if(event == nullptr) return ret(cudaErrorInvalidResourceHandle);
+  Op op;
+  op.kind = Op::Record;
+  op.event = event;
+  return ret(enqueueOps(stream, &op, 1));
+}
+
+cudaError_t cudaEventQuery(cudaEvent_t event) {
+  std::lock_guard _(event->mtx);
+  return event->done() ? cudaSuccess : cudaErrorNotReady;
+}
+
+cudaError_t cudaEventSynchronize(cudaEvent_t event) {
+  uint64_t ticket;
+  {
+    std::lock_guard _(event->mtx);
+    ticket = event->recorded;
+  }
+  event->wait(ticket);
+  return cudaSuccess;
+}
+
+cudaError_t cudaEventElapsedTime(float *ms, cudaEvent_t start,
+      cudaEvent_t stop) {
+  for(auto e : { start, stop }) {
+    if(auto err = cudaEventQuery(e); err != cudaSuccess) return ret(err);
+    std::lock_guard _(e->mtx);
+    if(e->recorded == 0) return ret(cudaErrorInvalidResourceHandle);
+  }
+  *ms = (float)((stop->ns.load(std::memory_order_acquire) -
+        start->ns.load(std::memory_order_acquire)) * 1e-6);
+  return cudaSuccess;
+}
+
+cudaError_t cudaStreamBeginCapture(cudaStream_t stream,
+      cudaStreamCaptureMode mode) {
+  return cudaStreamBeginCaptureToGraph(stream, nullptr, nullptr, nullptr, 0,
+        mode);
+}
+
+cudaError_t cudaStreamBeginCaptureToGraph(cudaStream_t stream,
+      cudaGraph_t graph, const cudaGraphNode_t *, const void *, size_t,
+      cudaStreamCaptureMode mode) {
+  if(stream == nullptr) return ret(cudaErrorStreamCaptureUnsupported);
+  std::lock_guard _(stream->mtx);
+  if(stream->graph != nullptr) return ret(cudaErrorInvalidValue);
+  stream->ownsGraph = graph == nullptr;
+  stream->graph = graph != nullptr ? graph : new HostGraph;
+  stream->invalid = false;
+  stream->mode = mode;
+  stream->captureThread = std::this_thread::get_id();
+  return cudaSuccess;
+}
+
+cudaError_t cudaStreamEndCapture(cudaStream_t stream, cudaGraph_t *graph) {
+  if(stream == nullptr) return ret(cudaErrorInvalidResourceHandle);
+  std::lock_guard _(stream->mtx);
+  if(stream->graph == nullptr) return ret(cudaErrorInvalidValue);
+  if(stream->mode == cudaStreamCaptureModeThreadLocal &&
+        stream->captureThread != std::this_thread::get_id()) {
+    return ret(cudaErrorStreamCaptureWrongThread);
+  }
+  auto g = std::exchange(stream->graph, nullptr);
+  if(stream->invalid) {
+    if(stream->ownsGraph) delete g;
+    *graph = nullptr;
+    return ret(cudaErrorStreamCaptureInvalidated);
+  }
+  *graph = g;
+  return cudaSuccess;
+}
+
+cudaError_t cudaGraphCreate(cudaGraph_t *graph, unsigned) {
+  *graph = new HostGraph;
+  return cudaSuccess;
+}
+
+cudaError_t cudaGraphDestroy(cudaGraph_t graph) {
+  delete graph;
+  return cudaSuccess;
+}
+
+// the ops are copied: the graph may be changed or destroyed afterwards
+cudaError_t cudaGraphInstantiate(cudaGraphExec_t *exec, cudaGraph_t graph,
+      cudaGraphNode_t *, char *, size_t) {
+  if(graph == nullptr) return ret(cudaErrorInvalidValue);
+  *exec = new HostGraphExec{graph->ops};
+  return cudaSuccess;
+}
+
+cudaError_t cudaGraphExecDestroy(cudaGraphExec_t exec) {
+  delete exec;
+  return cudaSuccess;
+}
+
+// all ops of the graph are queued at once (one lock and one wake-up)
+cudaError_t cudaGraphLaunch(cudaGraphExec_t exec, cudaStream_t stream) {
+  if(exec == nullptr) return ret(cudaErrorInvalidValue);
+  return ret(enqueueOps(stream, exec->ops.data(), exec->ops.size()));
+}
+
+void hostrt::registerKernel(const void *func, KernelLauncher launcher) {
+  auto& r = Registry::get();
+  std::lock_guard _(r.mtx);
+  r.kernels.emplace(func, launcher);
+}
+
+cudaError_t cudaLaunchKernel(const void *func, dim3 grid, dim3 block,
+      void **args, size_t shmemBytes, cudaStream_t stream) {
+  hostrt::KernelLauncher launcher = nullptr;
+  {
+    auto& r = Registry::get();
+    std::lock_guard _(r.mtx);
+    if(auto it = r.kernels.find(func); it != r.kernels.end()) {
+      launcher = it->second;
+    }
+  }
+  if(launcher == nullptr) return ret(cudaErrorInvalidDeviceFunction);
+  return ret(launcher(func, grid, block, args, shmemBytes, stream));
+}
+
+namespace {
+
+// a pool thread holds one block of at most s_maxBlockSize lanes and its
+// dynamic shared memory
+bool blockFits(int blockSize, size_t dynSmemBytes) {
+  return blockSize > 0 && (uint32_t)blockSize <= simt::s_maxBlockSize &&
+        dynSmemBytes <= simt::s_maxDynSharedBytes;
+}
+
+} // namespace
+
+cudaError_t cudaOccupancyAvailableDynamicSMemPerBlock(size_t *dynSmemBytes,
+      const void *func, int numBlocks, int blockSize) {
+  if(func == nullptr) return ret(cudaErrorInvalidDeviceFunction);
+  if(numBlocks <= 0 || !blockFits(blockSize, 0)) {
+    return ret(cudaErrorInvalidValue);
+  }
+  *dynSmemBytes = numBlocks == 1 ? simt::s_maxDynSharedBytes : 0;
+  return cudaSuccess;
+}
+
+cudaError_t cudaOccupancyMaxActiveBlocksPerMultiprocessor(int *numBlocks,
+      const void *func, int blockSize, size_t dynSmemBytes) {
+  if(func == nullptr) return ret(cudaErrorInvalidDeviceFunction);
+  if(blockSize <= 0) return ret(cudaErrorInvalidValue);
+  *numBlocks = blockFits(blockSize, dynSmemBytes) ? 1 : 0;
+  return cudaSuccess;
+}
+
+// the largest block keeps all lanes of a pool thread busy, one block per
+// pool thread fills the device
+cudaError_t cudaOccupancyMaxPotentialBlockSize(int *minGridSize,
+      int *blockSize, const void *func, size_t dynSmemBytes,
+      int blockSizeLimit) {
+  if(func == nullptr) return ret(cudaErrorInvalidDeviceFunction);
+  if(blockSizeLimit < 0) return ret(cudaErrorInvalidValue);
+  int size = simt::s_maxBlockSize;
+  if(blockSizeLimit > 0) size = std::min(size, blockSizeLimit);
+  bool fits = blockFits(size, dynSmemBytes);
+  *blockSize = fits ? size : 0;
+  *minGridSize = fits ? (int)hostrt::pool()->numThreads() : 0;
+  return cudaSuccess;
+}
+
+#endif // COMPILE_FOR_HOST
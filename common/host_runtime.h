@@ -0,0 +1,271 @@
+#ifndef COMMON_HOST_RUNTIME_H
+#define COMMON_HOST_RUNTIME_H 1
+
+// CPU implementation of the CUDA / HIP runtime subset used in this repo
+// (COMPILE_FOR_HOST=1, see common/host_runtime.cc):
+//  - "devices" are HOST_NUM_DEVICES (default 8) views of host memory:
+//    cudaMalloc is an aligned allocation, peer access always works;
+//  - a stream is an in-order queue served by its own worker thread, the
+//    null stream is one more such stream (no implicit synchronization with
+//    the other streams);
+//  - events are steady_clock timestamps taken when the stream reaches them;
+//  - copies run on a shared thread pool with streaming SIMD stores
+//    (common/host_memcpy.hpp);
+//  - stream capture records the enqueued ops into a graph instead of
+//    running them, a graph exec replays them in order on a stream.
+//    Synchronous calls from a capturing thread (or from any thread with
+//    cudaStreamCaptureModeGlobal) fail and invalidate the capture;
+//  - kernels are emulated with simt::launch (link common/simt_emulator.cc)
+//    and enqueued by cudaLaunchKernel or hostLaunchKernel. Untyped
+//    (void *) kernels must be registered first with hostrt::registerKernel;
+//  - a multiprocessor is a thread of the shared pool running one block at a
+//    time: the occupancy calls report one resident block per multiprocessor.
+// Errors of asynchronous ops (exceptions) are reported by the next call
+// synchronizing with the stream.
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "common/float16.hpp"
+
+enum cudaError_t : int {
+  cudaSuccess = 0,
+  cudaErrorInvalidValue = 1,
+  cudaErrorMemoryAllocation = 2,
+  cudaErrorInvalidDeviceFunction = 98,
+  cudaErrorInvalidDevice = 101,
+  cudaErrorInvalidResourceHandle = 400,
+  cudaErrorNotReady = 600,
+  cudaErrorPeerAccessAlreadyEnabled = 704,
+  cudaErrorPeerAccessNotEnabled = 705,
+  cudaErrorLaunchFailure = 719,
+  cudaErrorStreamCaptureUnsupported = 900,
+  cudaErrorStreamCaptureInvalidated = 901,
+  cudaErrorStreamCaptureWrongThread = 908,
+  cudaErrorUnknown = 999,
+};
+
+enum cudaMemcpyKind : int {
+  cudaMemcpyHostToHost = 0,
+  cudaMemcpyHostToDevice = 1,
+  cudaMemcpyDeviceToHost = 2,
+  cudaMemcpyDeviceToDevice = 3,
+  cudaMemcpyDefault = 4,
+};
+
+enum cudaStreamCaptureMode : int {
+  cudaStreamCaptureModeGlobal = 0,
+  cudaStreamCaptureModeThreadLocal = 1,
+  cudaStreamCaptureModeRelaxed = 2,
+};
+
+#define cudaStreamDefault 0u
+#define cudaStreamNonBlocking 1u
+#define cudaHostAllocDefault 0u
+
+typedef struct HostStream *cudaStream_t;
+typedef struct HostEvent *cudaEvent_t;
+typedef struct HostGraph *cudaGraph_t;
+typedef struct HostGraphExec *cudaGraphExec_t;
+typedef struct HostGraphNode *cudaGraphNode_t;
+typedef void (*cudaHostFn_t)(void *userData);
+
+struct cudaDeviceProp {
+  char name[256];
+  size_t totalGlobalMem, sharedMemPerBlock;
+  int warpSize, maxThreadsPerBlock, maxThreadsPerMultiProcessor;
+  int multiProcessorCount;
+  int major, minor, clockRate;
+  int memoryClockRate, memoryBusWidth, l2CacheSize, ECCEnabled;
+};
+
+const char *cudaGetErrorString(cudaError_t err);
+const char *cudaGetErrorName(cudaError_t err);
+cudaError_t cudaGetLastError();
+cudaError_t cudaPeekAtLastError();
+
+cudaError_t cudaGetDeviceCount(int *count);
+cudaError_t cudaSetDevice(int dev);
+cudaError_t cudaGetDevice(int *dev);
+cudaError_t cudaGetDeviceProperties(cudaDeviceProp *prop, int dev);
+cudaError_t cudaMemGetInfo(size_t *free, size_t *total);
+cudaError_t cudaDeviceSynchronize();
+cudaError_t cudaDeviceCanAccessPeer(int *canAccess, int dev, int peer);
+cudaError_t cudaDeviceEnablePeerAccess(int peer, unsigned flags);
+cudaError_t cudaDeviceDisablePeerAccess(int peer);
+
+cudaError_t cudaMalloc(void **ptr, size_t size);
+cudaError_t cudaFree(void *ptr);
+cudaError_t cudaHostAlloc(void **ptr, size_t size, unsigned flags);
+cudaError_t cudaFreeHost(void *ptr);
+cudaError_t cudaMemcpy(void *dst, const void *src, size_t size,
+      cudaMemcpyKind kind);
+cudaError_t cudaMemcpyAsync(void *dst, const void *src, size_t size,
+      cudaMemcpyKind kind, cudaStream_t stream = nullptr);
+cudaError_t cudaMemcpyPeer(void *dst, int dstDev, const void *src,
+      int srcDev, size_t size);
+cudaError_t cudaMemcpyPeerAsync(void *dst, int dstDev, const void *src,
+      int srcDev, size_t size, cudaStream_t stream = nullptr);
+cudaError_t cudaMemset(void *ptr, int value, size_t size);
+cudaError_t cudaMemsetAsync(void *ptr, int value, size_t size,
+      cudaStream_t stream = nullptr);
+
+cudaError_t cudaStreamCreate(cudaStream_t *stream);
+cudaError_t cudaStreamCreateWithFlags(cudaStream_t *stream, unsigned flags);
+cudaError_t cudaStreamCreateWithPriority(cudaStream_t *stream,
+      unsigned flags, int priority);
+cudaError_t cudaStreamDestroy(cudaStream_t stream);
+cudaError_t cudaStreamSynchronize(cudaStream_t stream);
+cudaError_t cudaStreamQuery(cudaStream_t stream);
+cudaError_t cudaStreamWaitEvent(cudaStream_t stream, cudaEvent_t event,
+      unsigned flags = 0);
+cudaError_t cudaLaunchHostFunc(cudaStream_t stream, cudaHostFn_t fn,
+      void *userData);
+
+cudaError_t cudaEventCreate(cudaEvent_t *event);
+cudaError_t cudaEventDestroy(cudaEvent_t event);
+cudaError_t cudaEventRecord(cudaEvent_t event, cudaStream_t stream = nullptr);
+cudaError_t cudaEventQuery(cudaEvent_t event);
+cudaError_t cudaEventSynchronize(cudaEvent_t event);
+cudaError_t cudaEventElapsedTime(float *ms, cudaEvent_t start,
+      cudaEvent_t stop);
+
+cudaError_t cudaStreamBeginCapture(cudaStream_t stream,
+      cudaStreamCaptureMode mode);
+// captures into 'graph' after its existing ops ('deps' are ignored: graphs
+// are sequences)
+cudaError_t cudaStreamBeginCaptureToGraph(cudaStream_t stream,
+      cudaGraph_t graph, const cudaGraphNode_t *deps, const void *depData,
+      size_t numDeps, cudaStreamCaptureMode mode);
+cudaError_t cudaStreamEndCapture(cudaStream_t stream, cudaGraph_t *graph);
+cudaError_t cudaGraphCreate(cudaGraph_t *graph, unsigned flags);
+cudaError_t cudaGraphDestroy(cudaGraph_t graph);
+cudaError_t cudaGraphInstantiate(cudaGraphExec_t *exec, cudaGraph_t graph,
+      cudaGraphNode_t *errorNode = nullptr, char *logBuffer = nullptr,
+      size_t bufferSize = 0);
+cudaError_t cudaGraphExecDestroy(cudaGraphExec_t exec);
+cudaError_t cudaGraphLaunch(cudaGraphExec_t exec, cudaStream_t stream);
+
+cudaError_t cudaOccupancyAvailableDynamicSMemPerBlock(size_t *dynSmemBytes,
+      const void *func, int numBlocks, int blockSize);
+cudaError_t cudaOccupancyMaxActiveBlocksPerMultiprocessor(int *numBlocks,
+      const void *func, int blockSize, size_t dynSmemBytes);
+cudaError_t cudaOccupancyMaxPotentialBlockSize(int *minGridSize,
+      int *blockSize, const void *func, size_t dynSmemBytes = 0,
+      int blockSizeLimit = 0);
+
+// HIP extensions used by the harnesses
+#define hipDeviceMallocDefault 0u
+#define hipDeviceMallocFinegrained 1u
+#define hipDeviceMallocUncached 3u
+#define hipMallocSignalMemory 2u
+cudaError_t hipExtMallocWithFlags(void **ptr, size_t size, unsigned flags);
+#define hipDeviceSynchronize cudaDeviceSynchronize
+#define hipGetDeviceCount cudaGetDeviceCount
+#define hipFree cudaFree
+
+typedef _Float16 __half;
+typedef __half half;
+
+// bfloat16 storage with the conversions of common/float16.hpp; arithmetic
+// is done in float like the ROCm type
+struct hip_bfloat16 {
+  uint16_t data;
+
+  hip_bfloat16() = default;
+  explicit hip_bfloat16(float f) : data(fp16::toBFloat16(f).bits) { }
+  operator float() const {
+    return fp16::toFloat(fp16::BFloat16{ data });
+  }
+};
+
+#define HIP_BFLOAT16_OP(op) \
+  inline hip_bfloat16 operator op(hip_bfloat16 a, hip_bfloat16 b) { \
+    return hip_bfloat16((float)a op (float)b); \
+  } \
+  inline hip_bfloat16& operator op##=(hip_bfloat16& a, hip_bfloat16 b) { \
+    return a = a op b; \
+  }
+HIP_BFLOAT16_OP(+) HIP_BFLOAT16_OP(-) HIP_BFLOAT16_OP(*) HIP_BFLOAT16_OP(/)
+#undef HIP_BFLOAT16_OP
+
+namespace hostrt {
+
+// threads shared by copies and emulated kernels of all streams
+ThreadPool *pool();
+
+// enqueues fn(arg) on the stream (or appends it to the graph being
+// captured); 'release' frees 'arg' when the op is dropped
+cudaError_t enqueue(cudaStream_t stream, void (*fn)(void *), void *arg,
+      void (*release)(void *));
+
+// enqueues a copy of the callable 'f'
+template < class F >
+cudaError_t enqueue(cudaStream_t stream, F&& f) {
+  using C = std::decay_t< F >;
+  return enqueue(stream, [](void *p) { (*(C *)p)(); }, new C(std::forward< F >(f)),
+        [](void *p) { delete (C *)p; });
+}
+
+} // namespace hostrt
+
+// the same as kernel<<<grid, block, shmemBytes, stream>>>(args...): the
+// arguments are copied when the launch is enqueued
+template < class... Params, class... Args >
+cudaError_t hostLaunchKernel(void (*kernel)(Params...), dim3 grid,
+      dim3 block, size_t shmemBytes, cudaStream_t stream, Args&&... args) {
+  return hostrt::enqueue(stream, [=, targs = std::tuple< std::decay_t< Params >... >(
+          std::forward< Args >(args)...)]() {
+    std::apply([&](const auto&... xs) {
+      simt::launch(hostrt::pool(), kernel, grid, block, shmemBytes, xs...);
+    }, targs);
+  });
+}
+
+template < class... Params, size_t... Is >
+cudaError_t hostLaunchKernelArgs(void (*kernel)(Params...), dim3 grid,
+      dim3 block, void **args, size_t shmemBytes, cudaStream_t stream,
+      std::index_sequence< Is... >) {
+  return hostLaunchKernel(kernel, grid, block, shmemBytes, stream,
+        *(std::decay_t< Params > *)args[Is]...);
+}
+
+template < class... Params >
+cudaError_t cudaLaunchKernel(void (*kernel)(Params...), dim3 grid, dim3 block,
+      void **args, size_t shmemBytes = 0, cudaStream_t stream = nullptr) {
+  return hostLaunchKernelArgs(kernel, grid, block, args, shmemBytes, stream,
+        std::index_sequence_for< Params... >{});
+}
+
+// launches a kernel registered with hostrt::registerKernel: fails with
+// cudaErrorInvalidDeviceFunction for any other address
+cudaError_t cudaLaunchKernel(const void *func, dim3 grid, dim3 block,
+      void **args, size_t shmemBytes = 0, cudaStream_t stream = nullptr);
+
+namespace hostrt {
+
+using KernelLauncher = cudaError_t (*)(const void *func, dim3 grid,
+      dim3 block, void **args, size_t shmemBytes, cudaStream_t stream);
+
+void registerKernel(const void *func, KernelLauncher launcher);
+
+// the host side of __cudaRegisterFunction: remembers how to unpack the
+// arguments of 'kernel' and returns its untyped address for
+// cudaLaunchKernel and the occupancy calls
+template < class... Params >
+void *registerKernel(void (*kernel)(Params...)) {
+  auto func = reinterpret_cast< void * >(kernel);
+  registerKernel(func, [](const void *f, dim3 grid, dim3 block, void **args,
+        size_t shmemBytes, cudaStream_t stream) {
+    return cudaLaunchKernel(reinterpret_cast< void (*)(Params...) >(
+          const_cast< void * >(f)), grid, block, args, shmemBytes, stream);
+  });
+  return func;
+}
+
+} // namespace hostrt
+
+#endif // COMMON_HOST_RUNTIME_H
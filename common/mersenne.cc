@@ -3,6 +3,10 @@
 
 namespace mersenne {
 
+// defined here rather than in the header: one state for all translation units
+static uint32_t mt[N];  /* the array for the state vector  */
+static int mti = N + 1;     /* mti==N+1 means mt[N] is not initialized */
+
 /* initializes mt[N] with a seed */
 void init_genrand(uint32_t s)
 {
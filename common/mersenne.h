@@ -55,8 +55,8 @@ const uint32_t MATRIX_A   = 0x9908b0df; /* constant vector a */
 const uint32_t UPPER_MASK = 0x80000000; /* most significant w-r bits */
 const uint32_t LOWER_MASK = 0x7fffffff; /* least significant r bits */
 
-static uint32_t mt[N];  /* the array for the state vector  */
-static int mti = N + 1;     /* mti==N+1 means mt[N] is not initialized */
+// NOTE: the state is global and not thread-safe, use PhiloxStream or bulk
+// RandomBits from common/random.hpp for parallel generation
 
 /* initializes mt[N] with a seed */
 void init_genrand(uint32_t s);
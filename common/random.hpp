@@ -0,0 +1,253 @@
+
+#ifndef COMMON_RANDOM_HPP
+#define COMMON_RANDOM_HPP 1
+
+// Counter-based random number generation on the host (Philox4x32-10,
+// Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC'11).
+// Word w of stream s for a given seed is a pure function of (seed, s, w),
+// hence any range of the sequence can be generated independently: buffers
+// filled in parallel are identical for any number of threads. Counters are
+// processed in groups of s_lanes with fully unrolled rounds so that the loop
+// over counters is vectorized by the compiler.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "common/common.h"
+#include "common/threading.hpp"
+
+namespace philox {
+
+constexpr uint32_t s_M0 = 0xD2511F53u, s_M1 = 0xCD9E8D57u,
+                   s_W0 = 0x9E3779B9u, s_W1 = 0xBB67AE85u;
+constexpr uint32_t s_rounds = 10;
+// number of counters processed together
+constexpr uint32_t s_lanes = 16;
+
+// derives a 64-bit key from the user seed (splitmix64 finalizer)
+FORCEINLINE uint64_t seedKey(uint64_t seed) {
+  uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+// one Philox4x32-10 block: ctr = {c0, c1, c2, c3}, key = {k0, k1}
+FORCEINLINE void block(uint32_t ctr[4], uint32_t k0, uint32_t k1) {
+#pragma GCC unroll 10
+  for(uint32_t r = 0; r < s_rounds; r++) {
+    uint64_t p0 = (uint64_t)s_M0 * ctr[0], p1 = (uint64_t)s_M1 * ctr[2];
+    uint32_t c0 = (uint32_t)(p1 >> 32) ^ ctr[1] ^ k0,
+             c2 = (uint32_t)(p0 >> 32) ^ ctr[3] ^ k1;
+    ctr[0] = c0, ctr[1] = (uint32_t)p1, ctr[2] = c2, ctr[3] = (uint32_t)p0;
+    k0 += s_W0, k1 += s_W1;
+  }
+}
+
+// writes 4 words for each of the counters [ctr, ctr + num) of 'stream':
+// counter i produces words out[4*i .. 4*i + 3]
+inline void generateBlocks(uint64_t key, uint64_t stream, uint64_t ctr,
+      size_t num, uint32_t *out) {
+
+  const uint32_t s0 = (uint32_t)stream, s1 = (uint32_t)(stream >> 32);
+  for(size_t b = 0; b < num; b += s_lanes) {
+    uint32_t c0[s_lanes], c1[s_lanes], c2[s_lanes], c3[s_lanes];
+    // rounds are unrolled completely: the loop over lanes is vectorized
+    for(uint32_t j = 0; j < s_lanes; j++) {
+      uint64_t c = ctr + b + j;
+      uint32_t x[4] = {(uint32_t)c, (uint32_t)(c >> 32), s0, s1};
+      block(x, (uint32_t)key, (uint32_t)(key >> 32));
+      c0[j] = x[0], c1[j] = x[1], c2[j] = x[2], c3[j] = x[3];
+    }
+    const size_t nb = std::min< size_t >(s_lanes, num - b);
+    auto pout = out + 4*b;
+    for(uint32_t j = 0; j < nb; j++) {
+      pout[4*j] = c0[j], pout[4*j + 1] = c1[j];
+      pout[4*j + 2] = c2[j], pout[4*j + 3] = c3[j];
+    }
+  }
+}
+
+// writes words [first, first + num) of 'stream' to out
+inline void generate(uint64_t key, uint64_t stream, uint64_t first, size_t num,
+      uint32_t *out) {
+
+  constexpr size_t s_bufBlocks = s_lanes * 4;
+  uint32_t buf[s_bufBlocks * 4];
+  // unaligned head and tail go through the buffer
+  while(num > 0) {
+    uint64_t ctr = first / 4;
+    uint32_t ofs = first % 4;
+    if(ofs == 0 && num >= s_bufBlocks * 4) {
+      size_t nblocks = num / 4;
+      generateBlocks(key, stream, ctr, nblocks, out);
+      first += nblocks * 4, out += nblocks * 4, num -= nblocks * 4;
+      continue;
+    }
+    size_t nblocks = std::min(s_bufBlocks, (ofs + num + 3) / 4),
+           n = std::min(num, nblocks * 4 - ofs);
+    generateBlocks(key, stream, ctr, nblocks, buf);
+    std::copy(buf + ofs, buf + ofs + n, out);
+    first += n, out += n, num -= n;
+  }
+}
+
+} // namespace philox
+
+// sequential generator over one stream of a seed: e.g. one stream per thread
+class PhiloxStream {
+public:
+  explicit PhiloxStream(uint64_t seed, uint64_t stream = 0) :
+        m_key(philox::seedKey(seed)), m_stream(stream) { }
+
+  uint32_t next() {
+    if(m_pos == s_bufSize) {
+      refill();
+    }
+    return m_buf[m_pos++];
+  }
+
+  uint64_t next64() {
+    uint64_t lo = next();
+    return lo | (uint64_t)next() << 32;
+  }
+
+  // uniform in [0, 1)
+  double uniform() {
+    return (double)(next64() >> 11) * 0x1.0p-53;
+  }
+
+  // bulk version of next(): equal to 'num' consecutive calls
+  void fill(uint32_t *out, size_t num) {
+    for(; num > 0 && m_pos < s_bufSize; num--) {
+      *out++ = m_buf[m_pos++];
+    }
+    philox::generate(m_key, m_stream, m_word, num, out);
+    m_word += num;
+  }
+
+  // skips 'num' words of the stream
+  void discard(uint64_t num) {
+    auto n = std::min< uint64_t >(num, s_bufSize - m_pos);
+    m_pos += n, m_word += num - n;
+  }
+
+private:
+  void refill() {
+    philox::generate(m_key, m_stream, m_word, s_bufSize, m_buf);
+    m_word += s_bufSize, m_pos = 0;
+  }
+
+  constexpr static uint32_t s_bufSize = philox::s_lanes * 4;
+  uint64_t m_key, m_stream;
+  uint64_t m_word = 0;            // next word of the stream to generate
+  uint32_t m_pos = s_bufSize;     // position in m_buf
+  uint32_t m_buf[s_bufSize];
+};
+
+namespace random_detail {
+
+// key bits [begin_bit, end_bit) of the 32-bit word j
+FORCEINLINE uint32_t wordMask(int j, int begin_bit, int end_bit) {
+  int current_bit = j * 32;
+  uint64_t word = 0xffffffffu;
+  word &= word << std::max(0, std::min(32, begin_bit - current_bit));
+  word &= 0xffffffffu >> std::max(0, std::min(32, current_bit + 32 - end_bit));
+  return (uint32_t)word;
+}
+
+// composes keys [0, num) from 'words' (which are overwritten): each word of
+// a key is AND of (entropy_reduction + 1) consecutive random words
+template < class K >
+void composeKeys(K *keys, size_t num, uint32_t *words, int entropy_reduction,
+      int begin_bit, int end_bit) {
+
+  constexpr int NUM_WORDS = (sizeof(K) + 3) / 4;
+  const int reps = entropy_reduction + 1;
+  uint32_t masks[NUM_WORDS];
+  for(int j = 0; j < NUM_WORDS; j++) {
+    masks[j] = wordMask(j, begin_bit, end_bit);
+  }
+  if constexpr(sizeof(K) % 4 == 0) {
+    if(reps == 1) { // vectorized path for full-entropy keys: in place
+      for(size_t i = 0; i < num * NUM_WORDS; i += NUM_WORDS) {
+        for(int j = 0; j < NUM_WORDS; j++) {
+          words[i + j] &= masks[j];
+        }
+      }
+      std::memcpy((void *)keys, words, num * sizeof(K));
+      return;
+    }
+  }
+  for(size_t i = 0; i < num; i++) {
+    uint32_t buf[NUM_WORDS];
+    for(int j = 0; j < NUM_WORDS; j++, words += reps) {
+      uint32_t w = masks[j];
+      for(int r = 0; r < reps; r++) {
+        w &= words[r];
+      }
+      buf[j] = w;
+    }
+    std::memcpy(keys + i, buf, sizeof(K));
+  }
+}
+
+} // namespace random_detail
+
+//! bulk version of RandomBits (common_utils.hpp) over a counter-based
+//! generator: fills \c keys[0..num) with random bits in [begin_bit, end_bit);
+//! \c entropy_reduction > 0 ANDs that many extra words into each key word
+//! (fewer bits set), -1 produces zero keys. NaNs are never generated for
+//! floating-point keys. Keys only depend on \c seed and their index, so the
+//! result is the same for any \c pool (which may be null).
+template < class K >
+void RandomBits(ThreadPool *pool, K *keys, size_t num, uint64_t seed,
+      int entropy_reduction = 0, int begin_bit = 0, int end_bit = sizeof(K) * 8) {
+
+  static_assert(std::is_trivially_copyable_v< K >, "Key type must be POD!");
+  if(entropy_reduction == -1) {
+    std::fill(keys, keys + num, K{});
+    return;
+  }
+  if(end_bit < 0)
+    end_bit = sizeof(K) * 8;
+
+  constexpr int NUM_WORDS = (sizeof(K) + 3) / 4;
+  // the same chunking for any number of threads: multiple of 4 words
+  constexpr size_t s_chunk = 4096;
+  const size_t wordsPerKey = (size_t)NUM_WORDS * (entropy_reduction + 1);
+  const uint64_t key = philox::seedKey(seed);
+
+  auto f = [=](size_t b, size_t e) {
+    std::vector< uint32_t > words(s_chunk * wordsPerKey);
+    for(size_t i = b * s_chunk; i < std::min(e * s_chunk, num); i += s_chunk) {
+      size_t n = std::min(s_chunk, num - i);
+      // stream 0 holds the first attempt of all keys
+      philox::generate(key, 0, i * wordsPerKey, n * wordsPerKey, words.data());
+      random_detail::composeKeys(keys + i, n, words.data(), entropy_reduction,
+            begin_bit, end_bit);
+      if constexpr(std::is_floating_point_v< K >) {
+        // avoids NaNs: redraw from stream 'attempt' at the key's index
+        for(size_t j = i; j < i + n; j++) {
+          for(uint64_t attempt = 1; std::isnan(keys[j]); attempt++) {
+            philox::generate(key, attempt, j * wordsPerKey, wordsPerKey,
+                  words.data());
+            random_detail::composeKeys(keys + j, 1, words.data(),
+                  entropy_reduction, begin_bit, end_bit);
+          }
+        }
+      }
+    }
+  };
+  const size_t nChunks = (num + s_chunk - 1) / s_chunk;
+  if(pool != nullptr && nChunks > 1) {
+    pool->parallelFor(0, nChunks, 1, f);
+  } else {
+    f(0, nChunks);
+  }
+}
+
+#endif // COMMON_RANDOM_HPP
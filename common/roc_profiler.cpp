@@ -1,4 +1,5 @@
 
+#if !COMPILE_FOR_HOST
 #include <thread>
 #include <mutex>
 #include <iostream>
@@ -344,3 +345,5 @@ RocProfilerSession::~RocProfilerSession() try {
 catch(std::exception& ex) {
   VLOG(0) << "ZException: " << ex.what();
 }
+
+#endif // !COMPILE_FOR_HOST
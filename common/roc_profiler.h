@@ -1,5 +1,14 @@
 
 #include "common/common.h"
+
+#if COMPILE_FOR_HOST
+// there are no hardware counters to collect on the host: sessions do nothing
+class RocProfilerSession {
+public:
+  void start() { }
+  void stop() { }
+};
+#else
 #include <rocprofiler/v2/rocprofiler.h>
 
 #define CHECK_ROCPROFILER(call)                                     \
@@ -21,3 +30,4 @@ private:
   rocprofiler_session_id_t session_id;
   rocprofiler_buffer_id_t buffer_id;
 };
+#endif // COMPILE_FOR_HOST
@@ -0,0 +1,203 @@
+
+#if COMPILE_FOR_HOST
+
+#include <algorithm>
+#include "common/common.h"
+#include "common/threading.hpp"
+
+#if defined(__x86_64__)
+// saves callee-saved registers and control words on the current stack,
+// stores the stack pointer to *from and restores the context saved at 'to'
+extern "C" void simt_switch_stack(void **from, void *to);
+asm(R"(
+  .text
+  .p2align 4
+  .type simt_switch_stack,@function
+simt_switch_stack:
+  pushq %rbp
+  pushq %rbx
+  pushq %r12
+  pushq %r13
+  pushq %r14
+  pushq %r15
+  subq $8, %rsp
+  stmxcsr (%rsp)
+  fnstcw 4(%rsp)
+  movq %rsp, (%rdi)
+  movq %rsi, %rsp
+  ldmxcsr (%rsp)
+  fldcw 4(%rsp)
+  addq $8, %rsp
+  popq %r15
+  popq %r14
+  popq %r13
+  popq %r12
+  popq %rbx
+  popq %rbp
+  ret
+  .size simt_switch_stack,.-simt_switch_stack
+)");
+#endif
+
+namespace simt::detail {
+
+static void laneEntry();
+
+#if defined(__x86_64__)
+void switchContext(Context& from, Context& to) {
+  simt_switch_stack(&from.sp, to.sp);
+}
+
+// prepares the stack such that switching to it "returns" to laneEntry
+static void initContext(Context& ctx, char *stack, size_t size) {
+  auto top = (uintptr_t)(stack + size) & ~(uintptr_t)15;
+  auto sp = (uint64_t *)top;
+  *--sp = 0;                        // fake return address of laneEntry
+  *--sp = (uint64_t)&laneEntry;
+  for(int i = 0; i < 6; i++) {
+    *--sp = 0;                      // rbp, rbx, r12 - r15
+  }
+  *--sp = 0x037F00001F80ull;        // default fpu control word and mxcsr
+  ctx.sp = sp;
+}
+#else
+void switchContext(Context& from, Context& to) {
+  swapcontext(&from.uc, &to.uc);
+}
+
+static void initContext(Context& ctx, char *stack, size_t size) {
+  getcontext(&ctx.uc);
+  ctx.uc.uc_stack.ss_sp = stack;
+  ctx.uc.uc_stack.ss_size = size;
+  ctx.uc.uc_link = nullptr;
+  makecontext(&ctx.uc, laneEntry, 0);
+}
+#endif
+
+static Block& threadBlock() {
+  static thread_local Block block;
+  return block;
+}
+
+static void laneEntry() {
+  auto b = s_block;
+  try {
+    b->kernel();
+  } catch(...) {
+    if(!b->ex) b->ex = std::current_exception();
+  }
+  b->cur->state = LaneState::Done;
+  // never resumed
+  switchContext(b->cur->ctx, b->sched);
+}
+
+// performs a pending shuffle for 'num' lanes of a warp starting at L
+static void exchange(Block& b, Lane *L, uint32_t num) {
+  uint32_t vals[WaveSize];
+  bool active[WaveSize] = {};
+  for(uint32_t i = 0; i < num; i++) {
+    vals[i] = L[i].value;
+    active[i] = L[i].state == LaneState::Shuffle;
+  }
+  for(uint32_t i = 0; i < num; i++) {
+    if(!active[i]) continue;
+    auto s = L[i].src;
+    // sources outside of the segment or inactive ones return the own value
+    bool valid = L[i].srcValid && active[s];
+    b.cnt.inactiveReads += L[i].srcValid && !active[s];
+    L[i].value = valid ? vals[s] : vals[i];
+    L[i].state = LaneState::Ready;
+    b.cnt.shuffles++;
+  }
+  b.cnt.warpShuffles++;
+}
+
+static void runBlock(Block& b) {
+
+  const auto& bd = b.m_blockDim;
+  const uint32_t nThreads = bd.x * bd.y * bd.z;
+  b.lanes.resize(nThreads);
+  while(b.stacks.size() < nThreads) {
+    b.stacks.emplace_back(new char[s_laneStackSize]);
+  }
+  for(uint32_t i = 0; i < nThreads; i++) {
+    auto& L = b.lanes[i];
+    L.state = LaneState::Ready;
+    L.tid = dim3(i % bd.x, (i / bd.x) % bd.y, i / (bd.x * bd.y));
+    L.lane = i % WaveSize;
+    initContext(L.ctx, b.stacks[i].get(), s_laneStackSize);
+  }
+
+  uint32_t nDone = 0;
+  while(true) {
+    for(uint32_t first = 0; first < nThreads; first += WaveSize) {
+      uint32_t num = std::min(WaveSize, nThreads - first);
+      auto L = b.lanes.data() + first;
+      // run lanes of this warp till all of them block or exit
+      while(true) {
+        bool shuffle = false;
+        for(uint32_t i = 0; i < num; i++) {
+          if(L[i].state == LaneState::Ready) {
+            b.cur = L + i;
+            switchContext(b.sched, L[i].ctx);
+            if(b.ex) {
+              // NOTE: stacks of the remaining lanes are not unwound
+              std::rethrow_exception(b.ex);
+            }
+            nDone += L[i].state == LaneState::Done;
+          }
+          shuffle |= L[i].state == LaneState::Shuffle;
+        }
+        if(!shuffle) break;
+        exchange(b, L, num);
+      }
+    } // for first
+    if(nDone == nThreads)
+      break;
+    // all remaining threads are waiting at __syncthreads
+    for(auto& L : b.lanes) {
+      if(L.state == LaneState::Barrier) L.state = LaneState::Ready;
+    }
+    b.cnt.barriers++;
+  }
+}
+
+void runGrid(ThreadPool *pool, dim3 grid, dim3 block, size_t shmemBytes,
+      Counters& total, llvm::function_ref< void() > kernel) {
+
+  uint32_t nThreads = block.x * block.y * block.z;
+  if(nThreads == 0 || nThreads > s_maxBlockSize) {
+    ThrowError< >("SIMT: invalid block size: %u", nThreads);
+  }
+  if(shmemBytes > s_maxDynSharedBytes) {
+    ThrowError< >("SIMT: shared memory size %zu exceeds %zu bytes",
+        shmemBytes, s_maxDynSharedBytes);
+  }
+  std::mutex mtx;
+  auto runBlocks = [&](size_t begin, size_t end) {
+    auto& b = threadBlock();
+    s_block = &b;
+    b.kernel = kernel;
+    b.cnt = Counters{};
+    b.ex = nullptr;
+    b.m_blockDim = block, b.m_gridDim = grid;
+    for(auto i = begin; i < end; i++) {
+      b.m_blockIdx = dim3(i % grid.x, (i / grid.x) % grid.y,
+            i / (grid.x * grid.y));
+      runBlock(b);
+    }
+    s_block = nullptr;
+    std::lock_guard _(mtx);
+    total += b.cnt;
+  };
+  size_t nBlocks = (size_t)grid.x * grid.y * grid.z;
+  if(pool == nullptr) {
+    runBlocks(0, nBlocks);
+  } else {
+    pool->parallelFor(0, nBlocks, 1, runBlocks);
+  }
+}
+
+} // namespace simt::detail
+
+#endif // COMPILE_FOR_HOST
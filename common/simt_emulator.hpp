@@ -0,0 +1,261 @@
+
+#ifndef COMMON_SIMT_EMULATOR_HPP
+#define COMMON_SIMT_EMULATOR_HPP 1
+
+// Lock-step SIMT emulation of device code on the host (COMPILE_FOR_HOST=1).
+//
+// Every thread of a block runs as a fiber on one CPU thread. Lanes
+// of a warp run until all of them reach the next warp-wide operation
+// (shuffle) or __syncthreads(): then the operation is performed for the whole
+// warp at once, hence shuffles see the values of all active lanes just like
+// on hardware. Blocks of a grid run in parallel on a ThreadPool.
+// Wavefront size is selected with -DHOST_WAVEFRONT_SIZE=32|64 (default 32).
+//
+// Dynamic shared memory must be defined by the program which launches
+// kernels using SIMT_DEFINE_DYNAMIC_SHARED, e.g.:
+//   SIMT_DEFINE_DYNAMIC_SHARED(int32_t, g_shared_mem);
+
+#include <ucontext.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include "common/function_ref.hpp"
+
+#ifndef HOST_WAVEFRONT_SIZE
+#define HOST_WAVEFRONT_SIZE 32
+#endif
+
+#define __device__
+#define __host__
+#define __global__
+// shared variables are static per CPU thread running the block
+#define __shared__ thread_local
+#define __forceinline__ inline
+#define __launch_bounds__(...)
+
+struct dim3 {
+  uint32_t x, y, z;
+  constexpr dim3(uint32_t x_ = 1, uint32_t y_ = 1, uint32_t z_ = 1) :
+        x(x_), y(y_), z(z_) { }
+};
+
+struct uint4 {
+  uint32_t x, y, z, w;
+};
+
+class ThreadPool;
+
+namespace simt {
+
+constexpr uint32_t WaveSize = HOST_WAVEFRONT_SIZE;
+static_assert(WaveSize == 32 || WaveSize == 64, "Unsupported wavefront size!");
+
+constexpr uint32_t s_maxBlockSize = 1024;
+constexpr size_t s_maxDynSharedBytes = 64 * 1024;
+constexpr size_t s_laneStackSize = 64 * 1024;
+
+enum class ShflOp {
+  Idx,
+  Up,
+  Down,
+  Xor
+};
+
+// operation counters accumulated over all lanes of a kernel launch
+struct Counters {
+  uint64_t shuffles = 0;      // 32-bit shuffles executed by all lanes
+  uint64_t warpShuffles = 0;  // warp-wide shuffle steps
+  uint64_t bitExtracts = 0;   // gpuGetBit / bfe
+  uint64_t compares = 0;      // counted comparisons (GPU_COUNT_COMPARE)
+  uint64_t barriers = 0;      // block-wide __syncthreads steps
+  uint64_t inactiveReads = 0; // shuffles reading from exited/diverged lanes
+
+  // total number of emulated instructions: used as a cost proxy
+  uint64_t instructions() const {
+    return shuffles + bitExtracts + compares + barriers;
+  }
+
+  Counters& operator +=(const Counters& rhs) {
+    shuffles += rhs.shuffles, warpShuffles += rhs.warpShuffles;
+    bitExtracts += rhs.bitExtracts, compares += rhs.compares;
+    barriers += rhs.barriers, inactiveReads += rhs.inactiveReads;
+    return *this;
+  }
+};
+
+namespace detail {
+
+enum class LaneState : uint8_t {
+  Ready,
+  Shuffle,  // waits for warp-wide shuffle
+  Barrier,  // waits in __syncthreads
+  Done
+};
+
+// saved execution context of a lane or of the scheduler
+struct Context {
+#if defined(__x86_64__)
+  void *sp = nullptr;  // callee-saved registers are kept on the stack
+#else
+  ucontext_t uc;
+#endif
+};
+
+// saves the current context to 'from' and resumes 'to' (simt_emulator.cc)
+void switchContext(Context& from, Context& to);
+
+struct Lane {
+  Context ctx;
+  LaneState state;
+  dim3 tid;
+  uint32_t lane;       // lane index within a warp
+  uint32_t value;      // shuffle input / output
+  uint32_t src;        // source lane index within a warp
+  bool srcValid;       // whether src is within the shuffle segment
+};
+
+struct Block {
+  Context sched;
+  std::vector< Lane > lanes;
+  std::vector< std::unique_ptr< char[] > > stacks;
+  llvm::function_ref< void() > kernel;
+  Lane *cur = nullptr;
+  dim3 m_blockIdx, m_blockDim, m_gridDim;
+  Counters cnt;
+  std::exception_ptr ex;
+};
+
+// block running on this CPU thread
+inline thread_local Block *s_block = nullptr;
+
+inline void yield() {
+  auto b = s_block;
+  switchContext(b->cur->ctx, b->sched);
+}
+
+// runs all blocks of the grid (simt_emulator.cc)
+void runGrid(ThreadPool *pool, dim3 grid, dim3 block, size_t shmemBytes,
+      Counters& total, llvm::function_ref< void() > kernel);
+
+} // namespace detail
+
+inline uint32_t laneId() {
+  return detail::s_block->cur->lane;
+}
+
+// warp shuffle of 32-bit value: semantics of __shfl*_sync; 'pred' is set to
+// whether the source lane was within the segment of size 'width'
+inline uint32_t shuffle(ShflOp op, uint32_t val, int32_t arg,
+        uint32_t width = WaveSize, int32_t *pred = nullptr) {
+  auto& L = *detail::s_block->cur;
+  const uint32_t lane = L.lane, base = lane & ~(width - 1);
+  int32_t src = lane;
+  switch(op) {
+  case ShflOp::Idx:
+    src = base + ((uint32_t)arg & (width - 1));
+    break;
+  case ShflOp::Up:
+    src = (int32_t)lane - arg;
+    break;
+  case ShflOp::Down:
+    src = (int32_t)lane + arg;
+    break;
+  case ShflOp::Xor:
+    src = (int32_t)(lane ^ (uint32_t)arg);
+    break;
+  }
+  L.srcValid = src >= (int32_t)base && src < (int32_t)(base + width);
+  L.src = L.srcValid ? src : lane;
+  L.value = val;
+  if(pred) *pred = L.srcValid;
+  L.state = detail::LaneState::Shuffle;
+  detail::yield();
+  return L.value;
+}
+
+inline uint32_t bfe(uint32_t src, uint32_t startIdx, uint32_t width) {
+  detail::s_block->cnt.bitExtracts++;
+  return (src >> startIdx) & (width >= 32 ? ~0u : (1u << width) - 1);
+}
+
+inline void countCompare() {
+  if(auto b = detail::s_block) b->cnt.compares++;
+}
+
+inline void syncThreads() {
+  detail::s_block->cur->state = detail::LaneState::Barrier;
+  detail::yield();
+}
+
+// launches kernel on the host: runs blocks in parallel on 'pool' (or on the
+// calling thread if pool is null) and returns operation counters
+template < class... Params, class... Args >
+Counters launch(ThreadPool *pool, void (*kernel)(Params...), dim3 grid,
+      dim3 block, size_t shmemBytes, Args&&... args) {
+
+  std::tuple< Params... > targs(std::forward< Args >(args)...);
+  Counters total;
+  detail::runGrid(pool, grid, block, shmemBytes, total, [&]() {
+    std::apply(kernel, targs);
+  });
+  return total;
+}
+
+} // namespace simt
+
+constexpr int warpSize = simt::WaveSize;
+
+#define threadIdx (simt::detail::s_block->cur->tid)
+#define blockIdx (simt::detail::s_block->m_blockIdx)
+#define blockDim (simt::detail::s_block->m_blockDim)
+#define gridDim (simt::detail::s_block->m_gridDim)
+
+inline void __syncthreads() {
+  simt::syncThreads();
+}
+
+template < class NT >
+inline NT simtShuffle(simt::ShflOp op, NT val, int32_t arg, int width) {
+  static_assert(sizeof(NT) == sizeof(uint32_t), "Only 32-bit shuffles supported!");
+  uint32_t u;
+  memcpy(&u, &val, sizeof(u));
+  u = simt::shuffle(op, u, arg, width);
+  memcpy(&val, &u, sizeof(u));
+  return val;
+}
+
+template < class NT >
+inline NT __shfl_sync(uint32_t, NT val, int32_t src, int width = warpSize) {
+  return simtShuffle(simt::ShflOp::Idx, val, src, width);
+}
+
+template < class NT >
+inline NT __shfl_up_sync(uint32_t, NT val, uint32_t delta, int width = warpSize) {
+  return simtShuffle(simt::ShflOp::Up, val, delta, width);
+}
+
+template < class NT >
+inline NT __shfl_down_sync(uint32_t, NT val, uint32_t delta, int width = warpSize) {
+  return simtShuffle(simt::ShflOp::Down, val, delta, width);
+}
+
+template < class NT >
+inline NT __shfl_xor_sync(uint32_t, NT val, int32_t mask, int width = warpSize) {
+  return simtShuffle(simt::ShflOp::Xor, val, mask, width);
+}
+
+// shared memory is per CPU thread but global memory is accessed by blocks
+// running in parallel: use real atomics for both
+template < class NT >
+inline NT atomicAdd(NT *addr, NT val) {
+  return std::atomic_ref< NT >(*addr).fetch_add(val, std::memory_order_relaxed);
+}
+
+#define SIMT_DEFINE_DYNAMIC_SHARED(type, name) \
+  thread_local type name[simt::s_maxDynSharedBytes / sizeof(type)]
+
+#endif // COMMON_SIMT_EMULATOR_HPP
@@ -0,0 +1,417 @@
+#ifndef COMMON_TASK_GRAPH_HPP
+#define COMMON_TASK_GRAPH_HPP 1
+
+// Host-side task graphs: a TaskGraph records ops (copies, GEMMs,
+// collectives, host lambdas) with explicit dependencies or with the implicit
+// in-order dependencies of a Lane (a recording "stream"). instantiate()
+// validates the DAG once and lays it out flat; the resulting Executable is
+// replayed any number of times on a ThreadPool:
+//  - ready nodes are picked by critical-path priority (the longest chain of
+//    node costs from the node to a sink), a worker continues with the most
+//    urgent successor it made ready and publishes the others;
+//  - node functions and copy parameters can be updated between launches
+//    without re-instantiation (node IDs are the same in both);
+//  - launch(pool, nIters) replays the graph nIters times in one pool job,
+//    which is what a captured loop of nIters iterations would do, but
+//    without baking nIters into the graph;
+//  - optionally, begin/end timestamps and the worker of every node are
+//    recorded, and measured durations can replace the cost estimates.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "common/host_memcpy.hpp"
+#include "common/threading.hpp"
+
+enum class OpKind : uint32_t { Host, Memcpy, Gemm, Collective };
+
+inline const char *opKindName(OpKind k) {
+  const char *names[] = { "host", "memcpy", "gemm", "collective" };
+  return names[(uint32_t)k];
+}
+
+struct TaskGraph {
+
+  using NodeId = uint32_t;
+  using Func = std::function< void() >;
+  static constexpr NodeId s_none = ~0u;
+
+  struct CopyParams {
+    void *dst = nullptr;
+    const void *src = nullptr;
+    size_t bytes = 0;
+  };
+
+  struct Node {
+    OpKind kind = OpKind::Host;
+    Func func;            // empty for Memcpy nodes
+    CopyParams copy;
+    double cost = 1;      // estimate in arbitrary (but common) units
+    std::vector< NodeId > succ;
+  };
+
+  // in-order sequence of ops: each op depends on the previous one of the
+  // lane (like a stream during capture)
+  struct Lane {
+    NodeId add(OpKind kind, Func f, double cost = 1) {
+      return chain(m_g->add(kind, std::move(f), deps(), cost));
+    }
+    NodeId host(Func f, double cost = 1) {
+      return add(OpKind::Host, std::move(f), cost);
+    }
+    NodeId memcpy(void *dst, const void *src, size_t bytes) {
+      return chain(m_g->addMemcpy(dst, src, bytes, deps()));
+    }
+    // the next op of this lane also waits for 'node' (an event wait)
+    void wait(NodeId node) {
+      if(node != s_none) m_waits.push_back(node);
+    }
+    void wait(const Lane& other) {
+      wait(other.m_last);
+    }
+    NodeId last() const {
+      return m_last;
+    }
+
+  private:
+    friend struct TaskGraph;
+    explicit Lane(TaskGraph *g) : m_g(g) { }
+
+    std::vector< NodeId > deps() {
+      auto d = std::move(m_waits);
+      m_waits.clear();
+      if(m_last != s_none) d.push_back(m_last);
+      return d;
+    }
+    NodeId chain(NodeId n) {
+      return m_last = n;
+    }
+
+    TaskGraph *m_g;
+    NodeId m_last = s_none;
+    std::vector< NodeId > m_waits;
+  };
+
+  Lane lane() {
+    return Lane(this);
+  }
+
+  NodeId add(OpKind kind, Func f, const std::vector< NodeId >& deps = {},
+        double cost = 1) {
+    NodeId id = m_nodes.size();
+    m_nodes.push_back(Node{ kind, std::move(f), {}, cost, {} });
+    for(auto d : deps) addDependency(d, id);
+    return id;
+  }
+
+  // copies use one thread with streaming stores: parallelism comes from
+  // independent nodes. The cost is the size in Mb
+  NodeId addMemcpy(void *dst, const void *src, size_t bytes,
+        const std::vector< NodeId >& deps = {}) {
+    auto id = add(OpKind::Memcpy, {}, deps, bytes / double(1 << 20));
+    m_nodes[id].copy = CopyParams{ dst, src, bytes };
+    return id;
+  }
+
+  // 'to' runs after 'from'
+  void addDependency(NodeId from, NodeId to) {
+    if(from >= m_nodes.size() || to >= m_nodes.size() || from == to) {
+      ThrowError< >("TaskGraph: invalid dependency %u -> %u", from, to);
+    }
+    m_nodes[from].succ.push_back(to);
+  }
+
+  size_t size() const {
+    return m_nodes.size();
+  }
+
+  const Node& node(NodeId id) const {
+    return m_nodes[id];
+  }
+
+  struct Executable;
+  // validates the graph (throws on cycles) and lays it out for launches
+  std::unique_ptr< Executable > instantiate() const;
+
+private:
+  std::vector< Node > m_nodes;
+};
+
+struct TaskGraph::Executable {
+
+  struct Timing {
+    int64_t beginNs = 0, endNs = 0;  // steady_clock
+    int32_t worker = -1;             // pool worker ID (0 without a pool)
+  };
+
+  Executable() = default;
+  Executable(const Executable&) = delete;
+  Executable& operator=(const Executable&) = delete;
+
+  size_t size() const {
+    return m_nodes.size();
+  }
+
+  void setFunc(NodeId id, Func f) {
+    m_nodes.at(id).func = std::move(f);
+  }
+
+  void setMemcpy(NodeId id, void *dst, const void *src, size_t bytes) {
+    auto& n = m_nodes.at(id);
+    if(n.kind != OpKind::Memcpy) {
+      ThrowError< >("TaskGraph: node %u is not a copy", id);
+    }
+    n.copy = CopyParams{ dst, src, bytes };
+  }
+
+  // costs only change the order in which ready nodes are picked
+  void setCost(NodeId id, double cost) {
+    m_nodes.at(id).cost = cost;
+    prioritize();
+  }
+
+  void enableTiming(bool on) {
+    m_timing.assign(on ? m_nodes.size() : 0, Timing{});
+  }
+
+  // of the last iteration of the last launch
+  const Timing& timing(NodeId id) const {
+    return m_timing.at(id);
+  }
+
+  // uses the measured durations as node costs
+  void costsFromTiming() {
+    for(size_t i = 0; i < m_timing.size(); i++) {
+      m_nodes[i].cost = (m_timing[i].endNs - m_timing[i].beginNs) * 1e-3;
+    }
+    prioritize();
+  }
+
+  double priority(NodeId id) const {
+    return m_nodes.at(id).prio;
+  }
+
+  // runs the graph nIters times (one iteration after the other) on the
+  // pool's threads, or on the calling thread if pool is null. The first
+  // exception thrown by a node is rethrown after the remaining nodes of
+  // the iteration have been skipped. Must not be called concurrently with
+  // itself or with the setters above
+  void launch(ThreadPool *pool, uint32_t nIters = 1) {
+    if(m_nodes.empty() || nIters == 0) return;
+    m_itersLeft = nIters;
+    m_ex = nullptr;
+    m_failed.store(false, std::memory_order_relaxed);
+    m_finished.store(false, std::memory_order_relaxed);
+    startIteration();
+    if(pool == nullptr || pool->numThreads() < 2) {
+      work(0);
+    } else {
+      pool->runJob([this](int id) { work(id); });
+    }
+    if(m_ex) std::rethrow_exception(std::exchange(m_ex, nullptr));
+  }
+
+private:
+  friend struct TaskGraph;
+
+  struct XNode {
+    OpKind kind;
+    Func func;
+    CopyParams copy;
+    double cost, prio = 0;
+    uint32_t succBegin, succEnd;  // in m_succ
+    uint32_t nPreds;
+  };
+
+  // critical path: cost of the node plus the longest path of its successors
+  void prioritize() {
+    for(auto it = m_topo.rbegin(); it != m_topo.rend(); ++it) {
+      auto& n = m_nodes[*it];
+      double m = 0;
+      for(auto s = n.succBegin; s < n.succEnd; s++) {
+        m = std::max(m, m_nodes[m_succ[s]].prio);
+      }
+      n.prio = n.cost + m;
+    }
+    m_roots.clear();
+    for(NodeId i = 0; i < m_nodes.size(); i++) {
+      if(m_nodes[i].nPreds == 0) m_roots.push_back(i);
+    }
+    std::sort(m_roots.begin(), m_roots.end(), [this](NodeId a, NodeId b) {
+      return m_nodes[a].prio > m_nodes[b].prio;
+    });
+  }
+
+  bool higher(NodeId a, NodeId b) const {
+    return m_nodes[a].prio > m_nodes[b].prio;
+  }
+
+  // heap ordered by priority (the top is the most urgent)
+  void pushReady(const NodeId *ids, size_t n) {
+    if(n == 0) return;
+    {
+      std::lock_guard _(m_readyMtx);
+      auto cmp = [this](NodeId a, NodeId b) { return higher(b, a); };
+      for(size_t i = 0; i < n; i++) {
+        m_ready.push_back(ids[i]);
+        std::push_heap(m_ready.begin(), m_ready.end(), cmp);
+      }
+      m_numReady.store(m_ready.size(), std::memory_order_relaxed);
+    }
+    m_epoch.fetch_add(1, std::memory_order_release);
+    m_epoch.notify_all();
+  }
+
+  NodeId popReady() {
+    if(m_numReady.load(std::memory_order_relaxed) == 0) return s_none;
+    std::lock_guard _(m_readyMtx);
+    if(m_ready.empty()) return s_none;
+    auto cmp = [this](NodeId a, NodeId b) { return higher(b, a); };
+    std::pop_heap(m_ready.begin(), m_ready.end(), cmp);
+    auto id = m_ready.back();
+    m_ready.pop_back();
+    m_numReady.store(m_ready.size(), std::memory_order_relaxed);
+    return id;
+  }
+
+  // called when no node of the graph is running or ready
+  void startIteration() {
+    for(size_t i = 0; i < m_nodes.size(); i++) {
+      m_pending[i].store(m_nodes[i].nPreds, std::memory_order_relaxed);
+    }
+    m_remaining.store(m_nodes.size(), std::memory_order_relaxed);
+    pushReady(m_roots.data(), m_roots.size());
+  }
+
+  void execute(NodeId id, int worker) {
+    if(m_failed.load(std::memory_order_relaxed)) return;
+    auto& n = m_nodes[id];
+    Timing *t = m_timing.empty() ? nullptr : &m_timing[id];
+    if(t != nullptr) {
+      t->worker = worker;
+      t->beginNs = std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+    try {
+      if(n.kind == OpKind::Memcpy) {
+        if(n.copy.bytes < hostcpy::s_streamThreshold) {
+          std::memcpy(n.copy.dst, n.copy.src, n.copy.bytes);
+        } else {
+          hostcpy::streamCopy(n.copy.dst, n.copy.src, n.copy.bytes);
+        }
+      } else if(n.func) {
+        n.func();
+      }
+    } catch(...) {
+      std::lock_guard _(m_readyMtx);
+      if(!m_ex) m_ex = std::current_exception();
+      m_failed.store(true, std::memory_order_relaxed);
+    }
+    if(t != nullptr) {
+      t->endNs = std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+  }
+
+  void work(int worker) {
+    NodeId cur = s_none;
+    std::vector< NodeId > released;
+    uint32_t nspins = 0;
+    while(true) {
+      if(cur == s_none) {
+        auto epoch = m_epoch.load(std::memory_order_acquire);
+        if(m_finished.load(std::memory_order_acquire)) break;
+        if((cur = popReady()) == s_none) {
+          if(nspins++ < 256) {
+            (nspins % 64 == 0) ? std::this_thread::yield() : cpuRelax();
+          } else {
+            m_epoch.wait(epoch, std::memory_order_acquire);
+          }
+          continue;
+        }
+      }
+      nspins = 0;
+      execute(cur, worker);
+      // continue with the most urgent successor, publish the others
+      const auto& n = m_nodes[cur];
+      NodeId next = s_none;
+      for(auto s = n.succBegin; s < n.succEnd; s++) {
+        auto id = m_succ[s];
+        if(m_pending[id].fetch_sub(1, std::memory_order_acq_rel) != 1) continue;
+        if(next == s_none) {
+          next = id;
+        } else if(higher(id, next)) {
+          released.push_back(std::exchange(next, id));
+        } else {
+          released.push_back(id);
+        }
+      }
+      pushReady(released.data(), released.size());
+      released.clear();
+      cur = next;
+      if(m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        // the last node of the iteration: nothing else is running
+        if(--m_itersLeft > 0 && !m_failed.load(std::memory_order_relaxed)) {
+          startIteration();
+        } else {
+          m_finished.store(true, std::memory_order_release);
+          m_epoch.fetch_add(1, std::memory_order_release);
+          m_epoch.notify_all();
+        }
+      }
+    }
+  }
+
+  std::vector< XNode > m_nodes;
+  std::vector< NodeId > m_succ, m_topo, m_roots;
+  std::unique_ptr< std::atomic< uint32_t >[] > m_pending;
+  std::vector< Timing > m_timing;
+
+  std::mutex m_readyMtx;
+  std::vector< NodeId > m_ready;
+  std::atomic< uint32_t > m_numReady{0}, m_remaining{0}, m_epoch{0};
+  std::atomic< bool > m_failed{false}, m_finished{false};
+  uint32_t m_itersLeft = 0;
+  std::exception_ptr m_ex;
+};
+
+inline auto TaskGraph::instantiate() const -> std::unique_ptr< Executable > {
+  auto px = std::make_unique< Executable >();
+  auto& x = *px;
+  const size_t n = m_nodes.size();
+  x.m_nodes.resize(n);
+  x.m_pending.reset(new std::atomic< uint32_t >[n]);
+  std::vector< uint32_t > nPreds(n);
+  for(const auto& nd : m_nodes) {
+    for(auto s : nd.succ) nPreds[s]++;
+  }
+  for(size_t i = 0; i < n; i++) {
+    const auto& nd = m_nodes[i];
+    auto& xn = x.m_nodes[i];
+    xn.kind = nd.kind, xn.func = nd.func, xn.copy = nd.copy;
+    xn.cost = nd.cost, xn.nPreds = nPreds[i];
+    xn.succBegin = x.m_succ.size();
+    x.m_succ.insert(x.m_succ.end(), nd.succ.begin(), nd.succ.end());
+    xn.succEnd = x.m_succ.size();
+  }
+  // Kahn's algorithm: the topological order is needed for priorities
+  for(NodeId i = 0; i < n; i++) {
+    if(nPreds[i] == 0) x.m_topo.push_back(i);
+  }
+  for(size_t k = 0; k < x.m_topo.size(); k++) {
+    for(auto s : m_nodes[x.m_topo[k]].succ) {
+      if(--nPreds[s] == 0) x.m_topo.push_back(s);
+    }
+  }
+  if(x.m_topo.size() != n) {
+    ThrowError< >("TaskGraph: the graph has a cycle");
+  }
+  x.m_ready.reserve(n);
+  x.prioritize();
+  return px;
+}
+
+#endif // COMMON_TASK_GRAPH_HPP
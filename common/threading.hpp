@@ -1,24 +1,57 @@
 // Author: Kirk Saunders (ks825016@ohio.edu)
-// Description: Simple implementation of a thread barrier
-//              using C++ condition variables.
+// Description: Thread barrier and work-stealing thread pool.
 // Date: 2/17/2020
 
 #ifndef THREADING_HPP
 #define THREADING_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <exception>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <thread>
 #include <functional>
+#include <limits>
+#include <vector>
 #include "common.h"
+#include "function_ref.hpp"
 
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+// cheap timestamp counter used for spin timeouts: TSC cycles on x86
+inline uint64_t cpuCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Sense-reversing barrier: threads spin on a cache-line padded flag for
+// 'spinCycles' cycles and then park on it via futex (std::atomic::wait).
+// If participants pass their id to wait(), arrival timestamps are recorded,
+// so that the per-phase arrival skew can be reported separately.
 class Barrier {
  public:
+    static constexpr uint64_t s_defSpinCycles = 200000; // ~50-100us
+
     // Construct barrier for use with num threads.
-    explicit Barrier(std::size_t num)
-        : num_threads(num), wait_count(0), instance(0)
-    {  }
+    explicit Barrier(std::size_t num, uint64_t spinCycles = s_defSpinCycles)
+        : num_threads(num), spin_cycles(spinCycles), slots(num)
+    {  
+      remaining.store(num, std::memory_order_relaxed);
+    }
 
     // disable copying of barrier
     Barrier(const Barrier&) = delete;
@@ -26,66 +59,358 @@ class Barrier {
 
     // This function blocks the calling thread until
     // all threads (specified by num_threads) have
-    // called it. Blocking is achieved using a
-    // call to condition_variable.wait().
+    // called it. 
     void wait() {
-        std::unique_lock<std::mutex> lock(mut); // acquire lock
-        std::size_t inst = instance; // store current instance for comparison
-                                     // in predicate
-
-        if (++wait_count == num_threads) { // all threads reached barrier
-            wait_count = 0; // reset wait_count
-            instance++; // increment instance for next use of barrier and to
-                        // pass condition variable predicate
-            cv.notify_all();
-        } else { // not all threads have reached barrier
-            cv.wait(lock, [this, &inst]() { return instance != inst; });
-            // NOTE: The predicate lambda here protects against spurious
-            //       wakeups of the thread. As long as this->instance is
-            //       equal to inst, the thread will not wake.
-            //       this->instance will only increment when all threads
-            //       have reached the barrier and are ready to be unblocked.
-        }
+      arrive(-1);
+    }
+
+    // same as above but also records the arrival time of participant 'id'
+    void wait(uint32_t id) {
+      slots[id].arrivalNs = nowNs();
+      arrive(id);
+    }
+
+    // the difference between the last and the first arrival of the last
+    // completed phase (only participants calling wait(id) are accounted)
+    // NOTE: valid after wait() returns and until the next phase completes
+    double lastSkewMs() const {
+      return last_skew_ns * 1e-6;
+    }
+
+    // how late participant 'id' arrived relative to the first one in the 
+    // last completed phase
+    double arrivalSkewMs(uint32_t id) const {
+      return slots[id].latenessNs * 1e-6;
+    }
+
+    // the number of completed phases
+    uint64_t numPhases() const {
+      return num_phases.load(std::memory_order_acquire);
     }
+
  private:
-    std::size_t num_threads; // number of threads using barrier
-    std::size_t wait_count; // counter to keep track of waiting threads
-    std::size_t instance; // counter to keep track of barrier use count
-    std::mutex mut; // mutex used to protect resources
-    std::condition_variable cv; // condition variable used to block threads
+    static int64_t nowNs() {
+      return std::chrono::duration_cast< std::chrono::nanoseconds >(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void arrive(int32_t id) {
+      // sense cannot flip before we arrive hence this is our local sense
+      const uint32_t my_sense = sense.load(std::memory_order_acquire) ^ 1;
+      if(id >= 0) {
+        slots[id].phaseSense = my_sense;
+      }
+      if(remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) { 
+        // all threads reached barrier
+        finish_phase(my_sense);
+        remaining.store(num_threads, std::memory_order_relaxed);
+        num_phases.fetch_add(1, std::memory_order_relaxed);
+        sense.store(my_sense, std::memory_order_seq_cst);
+        if(num_parked.load(std::memory_order_seq_cst) > 0) {
+          sense.notify_all();
+        }
+        return;
+      } 
+      auto start = cpuCycles();
+      for(uint32_t i = 1; cpuCycles() - start < spin_cycles; i++) {
+        if(sense.load(std::memory_order_acquire) == my_sense)
+          return;
+        // yield now and then in case we are oversubscribed
+        if(i % 64 == 0) std::this_thread::yield();
+        else cpuRelax();
+      }
+      num_parked.fetch_add(1, std::memory_order_seq_cst);
+      while(true) {
+        auto s = sense.load(std::memory_order_seq_cst);
+        if(s == my_sense) break;
+        sense.wait(s, std::memory_order_seq_cst);
+      }
+      num_parked.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // called by the last arriving thread: computes arrival skews
+    void finish_phase(uint32_t my_sense) {
+      int64_t tmin = std::numeric_limits< int64_t >::max(), tmax = 0;
+      for(const auto& s : slots) {
+        if(s.phaseSense != my_sense) continue; // did not call wait(id)
+        tmin = std::min(tmin, s.arrivalNs);
+        tmax = std::max(tmax, s.arrivalNs);
+      }
+      last_skew_ns = tmax >= tmin ? tmax - tmin : 0;
+      for(auto& s : slots) {
+        s.latenessNs = s.phaseSense == my_sense ? s.arrivalNs - tmin : 0;
+      }
+    }
+
+    struct alignas(64) Slot {
+      int64_t arrivalNs = 0;      // arrival timestamp in the current phase
+      int64_t latenessNs = 0;     // arrival - first arrival for the last phase
+      uint32_t phaseSense = 2;    // sense of the phase arrivalNs belongs to
+    };
+
+    const std::size_t num_threads; // number of threads using barrier
+    const uint64_t spin_cycles;    // spin this many cycles before parking
+    alignas(64) std::atomic< std::size_t > remaining; // threads yet to arrive
+    alignas(64) std::atomic< uint32_t > sense{0};     // flipped on each phase
+    alignas(64) std::atomic< uint32_t > num_parked{0}; // threads sleeping on futex
+    std::atomic< uint64_t > num_phases{0};
+    int64_t last_skew_ns = 0;
+    std::vector< Slot > slots;      // per-participant arrival info
 };
 
 
+// Bounded Chase-Lev work-stealing deque of task pointers:
+// the owner thread pushes / pops at the bottom, other threads steal from the top.
+// See Le et al. "Correct and Efficient Work-Stealing for Weak Memory Models".
+// The capacity is fixed so that pushing never allocates: if the deque is full,
+// push() returns false and the caller is expected to run the task inline.
+template < class T, uint32_t Capacity = 1024 >
+class WorkStealingDeque {
+
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two!");
+  static constexpr int64_t s_mask = Capacity - 1;
+
+public:
+  WorkStealingDeque() {
+    for(auto& x : m_buf) x.store(nullptr, std::memory_order_relaxed);
+  }
+
+  // owner only
+  bool push(T *x) {
+    auto b = m_bottom.load(std::memory_order_relaxed),
+         t = m_top.load(std::memory_order_acquire);
+    if(b - t >= (int64_t)Capacity) 
+      return false;
+    m_buf[b & s_mask].store(x, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // owner only: returns nullptr if the deque is empty
+  T *pop() {
+    auto b = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto t = m_top.load(std::memory_order_relaxed);
+    if(t > b) { // deque was empty
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T *x = m_buf[b & s_mask].load(std::memory_order_relaxed);
+    if(t == b) { // last element: race against thieves
+      if(!m_top.compare_exchange_strong(t, t + 1, 
+            std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        x = nullptr;
+      }
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return x;
+  }
+
+  // any thread: returns nullptr if the deque is empty or we lost the race
+  T *steal() {
+    auto t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto b = m_bottom.load(std::memory_order_acquire);
+    if(t >= b) 
+      return nullptr;
+    T *x = m_buf[t & s_mask].load(std::memory_order_relaxed);
+    if(!m_top.compare_exchange_strong(t, t + 1, 
+            std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return x;
+  }
+
+  bool empty() const {
+    return m_bottom.load(std::memory_order_relaxed) <= 
+           m_top.load(std::memory_order_relaxed);
+  }
+
+private:
+  alignas(64) std::atomic< int64_t > m_top{0};
+  alignas(64) std::atomic< int64_t > m_bottom{0};
+  alignas(64) std::array< std::atomic< T* >, Capacity > m_buf;
+};
+
+// Bounded lock-free multi-producer single-consumer queue of values (after
+// Vyukov's bounded queue): each cell carries a sequence number which tells
+// whose turn it is, producers claim cells by a CAS on the tail and the
+// consumer owns the head. Like WorkStealingDeque, it never allocates after
+// construction: push() returns false if the queue is full.
+template < class T, uint32_t Capacity = 1024 >
+class MpscQueue {
+
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two!");
+  static constexpr uint64_t s_mask = Capacity - 1;
+
+  struct Cell {
+    std::atomic< uint64_t > seq; // pos: free for push, pos + 1: full
+    T value;
+  };
+
+public:
+  MpscQueue() : m_cells(new Cell[Capacity]) {
+    for(uint64_t i = 0; i < Capacity; i++) {
+      m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // any thread
+  bool push(const T& x) {
+    auto pos = m_tail.load(std::memory_order_relaxed);
+    Cell *c;
+    while(1) {
+      c = &m_cells[pos & s_mask];
+      auto diff = (int64_t)(c->seq.load(std::memory_order_acquire) - pos);
+      if(diff == 0) {
+        if(m_tail.compare_exchange_weak(pos, pos + 1,
+              std::memory_order_relaxed)) break;
+      } else if(diff < 0) {
+        return false; // the consumer has not freed this cell yet
+      } else {
+        pos = m_tail.load(std::memory_order_relaxed);
+      }
+    }
+    c->value = x;
+    c->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer only: false if the queue is empty or the next value is still
+  // being written (values pushed before are always seen)
+  bool pop(T& x) {
+    auto& c = m_cells[m_head & s_mask];
+    if(c.seq.load(std::memory_order_acquire) != m_head + 1)
+      return false;
+    x = c.value;
+    c.seq.store(m_head + Capacity, std::memory_order_release);
+    m_head++;
+    return true;
+  }
+
+  bool empty() const {
+    return m_tail.load(std::memory_order_relaxed) == m_head;
+  }
+
+private:
+  alignas(64) std::atomic< uint64_t > m_tail{0};
+  alignas(64) uint64_t m_head = 0;
+  std::unique_ptr< Cell[] > m_cells;
+};
+
+// Work-stealing thread pool.
+// runJob() keeps the old broadcast semantics: f(id) is called exactly once on 
+// each of the nThreads workers and all of them run concurrently (the callers 
+// rely on that since they synchronize through a Barrier inside the job).
+// On top of that, parallelFor() / forkJoin() can be called from anywhere 
+// (including from inside runJob) to fan out finer-grained work: tasks live on 
+// the stack of the forking frame and are referenced via llvm::function_ref, 
+// hence task submission never allocates.
 struct ThreadPool {
 
-  using JobFunc = std::function<void(int)>;//llvm::function_ref<void(int)>;
-  explicit ThreadPool(size_t nThreads) : m_threads(nThreads) {
+  using JobFunc = llvm::function_ref<void(int)>;
+  using RangeFunc = llvm::function_ref<void(size_t, size_t)>;
+
+  explicit ThreadPool(size_t nThreads) : m_numThreads(nThreads),
+        m_workers(new Worker[nThreads]), m_threads(nThreads) {
 
     for(size_t i = 0; i < nThreads; i++) {
+      m_workers[i].pool = this;
+      m_workers[i].id = i;
+      m_workers[i].rngState = 0x9E3779B9u * (i + 1);
       m_threads[i] = std::thread{&ThreadPool::threadFunc, this, i};
     }
   }
 
+  size_t numThreads() const {
+    return m_numThreads;
+  }
+
+  // id of the calling worker thread or -1 if called from outside of the pool
+  int workerId() const {
+    auto w = s_curWorker;
+    return w != nullptr && w->pool == this ? w->id : -1;
+  }
+
+  // runs f(id) on every worker thread and waits until all of them are done
+  // NOTE: must not be called from within the pool's own worker threads
   void runJob(JobFunc f) {
     m_func = f;
-    m_currentJobID += m_threads.size();
-    m_jobCv.notify_all();
+    m_jobPending.store(m_numThreads, std::memory_order_relaxed);
+    m_jobGen.fetch_add(1, std::memory_order_release);
+    wakeAll();
     wait();
   }
 
   void wait() {
-    std::unique_lock lock(m_finishedMtx); 
-    m_finishedCv.wait(lock, [this](){
-      return !m_isRunning || m_arrived == m_currentJobID;
-    });
+    while(true) {
+      auto n = m_jobPending.load(std::memory_order_acquire);
+      if(n == 0) break;
+      m_jobPending.wait(n, std::memory_order_acquire);
+    }
+    m_func = nullptr;
     if(m_threadException) {
-        throw std::runtime_error("Thread exception!");
+      auto ex = std::exchange(m_threadException, nullptr);
+      std::rethrow_exception(ex);
     }
   }
 
+  // runs f1 and f2 potentially in parallel and returns when both are finished
+  template < class F1, class F2 >
+  void forkJoin(F1&& f1, F2&& f2) {
+    auto w = s_curWorker;
+    if(w == nullptr || w->pool != this) {
+      if(m_numThreads == 0) { // no workers to hand the fork over to
+        f1(), f2();
+        return;
+      }
+      // external thread: hand the whole fork over to the workers
+      auto root = [&]() { forkJoin(f1, f2); };
+      Task t{llvm::function_ref<void()>(root)};
+      waitExternal(&t);
+      return;
+    }
+    Task t{llvm::function_ref<void()>(f2)};
+    if(!w->deque.push(&t)) { // deque overflow: just run sequentially
+      f1(), f2();
+      return;
+    }
+    wakeOne();
+    try {
+      f1();
+    } catch(...) {
+      join(w, &t); // t references our stack frame: must not leave before it's done
+      throw;
+    }
+    join(w, &t);
+  }
+
+  // calls f(b, e) on disjoint subranges [b, e) of [begin, end) of size at most grain
+  void parallelFor(size_t begin, size_t end, size_t grain, RangeFunc f) {
+    grain = std::max< size_t >(grain, 1);
+    if(end <= begin) 
+      return;
+    if(end - begin <= grain) {
+      f(begin, end);
+      return;
+    }
+    auto mid = begin + (end - begin) / 2;
+    forkJoin([&]() { parallelFor(begin, mid, grain, f); },
+             [&]() { parallelFor(mid, end, grain, f); });
+  }
+
+  // same as above with grain chosen to give each thread several chunks to steal
+  void parallelFor(size_t begin, size_t end, RangeFunc f) {
+    size_t n = std::max< size_t >(m_numThreads, 1) * 8;
+    size_t grain = end > begin ? (end - begin + n - 1) / n : 1;
+    parallelFor(begin, end, grain, f);
+  }
+
   ~ThreadPool() try {
-    m_isRunning = false;
-    m_jobCv.notify_all();
+    m_isRunning.store(false, std::memory_order_release);
+    wakeAll();
     for(auto& th: m_threads) {
       if(th.joinable())
         th.join();
@@ -97,45 +422,202 @@ struct ThreadPool {
   }
 
 private:
+  // lives in the frame of an external thread waiting for its injected task
+  struct Waiter {
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done = false;
+  };
+
+  struct Task {
+    llvm::function_ref<void()> func;
+    std::atomic< uint32_t > done{0};
+    std::exception_ptr ex;
+    Waiter *waiter = nullptr;
+
+    explicit Task(llvm::function_ref<void()> f) : func(f) {}
+
+    // the task may be destroyed as soon as it is signalled: nothing in it
+    // is touched afterwards
+    void run() {
+      try {
+        func();
+      } catch(...) {
+        ex = std::current_exception();
+      }
+      if(auto wt = waiter; wt != nullptr) {
+        // notify under the lock: the waiter cannot leave before we unlock
+        std::lock_guard _(wt->mtx);
+        wt->done = true;
+        wt->cv.notify_one();
+        return;
+      }
+      done.store(1, std::memory_order_release);
+    }
+  };
+
+  struct alignas(64) Worker {
+    ThreadPool *pool = nullptr;
+    int id = -1;
+    uint32_t rngState = 1;
+    WorkStealingDeque< Task > deque;
+  };
+
+  // the number of idle spins before a worker goes to sleep
+  static constexpr uint32_t s_numIdleSpins = 1024;
+
+  static inline thread_local Worker *s_curWorker = nullptr;
 
   void threadFunc(int id) 
   {
-    m_isRunning = true;
-    uint32_t localJobId = 0;
-    while(m_isRunning) 
-    try
-    {
-      // VLOG(0) << "My job ID: " << localJobId;
-      {
-        std::unique_lock lock(m_jobMtx); 
-        m_jobCv.wait(lock, [this, &localJobId]() 
-        { return !m_isRunning || localJobId < m_currentJobID; });
+    auto w = &m_workers[id];
+    s_curWorker = w;
+    uint32_t localJobGen = 0, nspins = 0;
+    while(true) {
+      auto gen = m_jobGen.load(std::memory_order_acquire);
+      if(gen != localJobGen) {
+        localJobGen = gen;
+        runBroadcast(id);
+        nspins = 0;
+        continue;
+      }
+      if(auto t = w->deque.pop(); t != nullptr || (t = trySteal(w)) != nullptr) {
+        t->run();
+        nspins = 0;
+        continue;
+      }
+      if(!m_isRunning.load(std::memory_order_acquire))
+        break;
+      if(nspins++ < s_numIdleSpins) {
+        // yield from time to time in case we are oversubscribed
+        (nspins % 64 == 0) ? std::this_thread::yield() : cpuRelax();
+        continue;
       }
+      // go to sleep: register ourselves first and then re-check for work
+      // so that a concurrent wakeOne() cannot be missed
+      auto epoch = m_epoch.load(std::memory_order_seq_cst);
+      m_numSleeping.fetch_add(1, std::memory_order_seq_cst);
+      if(m_jobGen.load(std::memory_order_seq_cst) == localJobGen && 
+                !hasWork() && m_isRunning.load(std::memory_order_seq_cst)) {
+        m_epoch.wait(epoch, std::memory_order_seq_cst);
+      }
+      m_numSleeping.fetch_sub(1, std::memory_order_relaxed);
+      nspins = 0;
+    }
+    s_curWorker = nullptr;
+  }
+
+  void runBroadcast(int id) {
+    try {
       if(m_func) {
         m_func(id);
       }
-      localJobId += m_threads.size();
-      std::lock_guard _(m_finishedMtx);
-      if(++m_arrived == m_currentJobID) {
-        m_func = nullptr;
-        // VLOG(0) << "JOB finished: " << m_currentJobID;
-        m_finishedCv.notify_one(); // last thread notifies about finished job
+    }
+    catch(...) {
+      VLOG(0) << "Thread exception in worker " << id;
+      std::lock_guard _(m_exMtx);
+      if(!m_threadException)
+        m_threadException = std::current_exception();
+    }
+    if(m_jobPending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      m_jobPending.notify_all(); // last thread notifies about finished job
+    }
+  }
+
+  // waits for a forked task: if it was stolen, help others meanwhile
+  void join(Worker *w, Task *t) {
+    if(auto x = w->deque.pop(); x != nullptr) {
+      // since forks are strictly nested, this can only be our own task
+      x->run();
+    }
+    for(uint32_t nspins = 1; t->done.load(std::memory_order_acquire) == 0; nspins++) {
+      if(auto x = w->deque.pop(); x != nullptr || (x = trySteal(w)) != nullptr) {
+        x->run();
+      } else {
+        (nspins % 64 == 0) ? std::this_thread::yield() : cpuRelax();
+      }
+    }
+    if(t->ex) {
+      std::rethrow_exception(t->ex);
+    }
+  }
+
+  void inject(Task *t) {
+    {
+      std::lock_guard _(m_injectMtx);
+      while(!m_injected.push(t)) {
+        cpuRelax();
       }
     }
-    catch(std::exception& ex) {
-      VLOG(0) << "Thread exception: " << ex.what();
-      m_isRunning = false, m_threadException = true;
-      m_jobCv.notify_all();
-      m_finishedCv.notify_one();
+    wakeOne();
+  }
+
+  // injects 't' and blocks the calling (non-worker) thread until it's done
+  void waitExternal(Task *t) {
+    Waiter wt;
+    t->waiter = &wt;
+    inject(t);
+    std::unique_lock lk(wt.mtx);
+    wt.cv.wait(lk, [&wt]() { return wt.done; });
+    if(t->ex) {
+      std::rethrow_exception(t->ex);
+    }
+  }
+
+  Task *trySteal(Worker *w) {
+    if(auto t = m_injected.steal(); t != nullptr)
+      return t;
+    if(m_numThreads < 2)
+      return nullptr;
+    // xorshift32 for picking a random victim
+    auto& s = w->rngState;
+    s ^= s << 13, s ^= s >> 17, s ^= s << 5;
+    uint32_t start = s % m_numThreads;
+    for(uint32_t i = 0; i < m_numThreads; i++) {
+      auto victim = (start + i) % m_numThreads;
+      if(victim == (uint32_t)w->id) 
+        continue;
+      if(auto t = m_workers[victim].deque.steal(); t != nullptr)
+        return t;
     }
+    return nullptr;
   }
 
-  uint32_t m_currentJobID = 0, m_arrived = 0;
-  bool m_isRunning = true, m_jobFinished = false;
-  bool m_threadException = false;
+  bool hasWork() const {
+    if(!m_injected.empty()) 
+      return true;
+    for(uint32_t i = 0; i < m_numThreads; i++) {
+      if(!m_workers[i].deque.empty())
+        return true;
+    }
+    return false;
+  }
+
+  void wakeOne() {
+    m_epoch.fetch_add(1, std::memory_order_seq_cst);
+    if(m_numSleeping.load(std::memory_order_seq_cst) > 0) {
+      m_epoch.notify_one();
+    }
+  }
+
+  void wakeAll() {
+    m_epoch.fetch_add(1, std::memory_order_seq_cst);
+    m_epoch.notify_all();
+  }
+
+  const uint32_t m_numThreads;
+  std::unique_ptr< Worker[] > m_workers;
+  WorkStealingDeque< Task > m_injected; // tasks submitted from outside of the pool
+  std::mutex m_injectMtx;               // serializes pushes to m_injected
+
   JobFunc m_func;
-  std::mutex m_jobMtx, m_finishedMtx;
-  std::condition_variable m_jobCv, m_finishedCv;
+  alignas(64) std::atomic< uint32_t > m_jobGen{0};
+  alignas(64) std::atomic< uint32_t > m_jobPending{0};
+  alignas(64) std::atomic< uint32_t > m_epoch{0};
+  alignas(64) std::atomic< uint32_t > m_numSleeping{0};
+  std::atomic< bool > m_isRunning{true};
+  std::mutex m_exMtx;
+  std::exception_ptr m_threadException;
   std::vector< std::thread > m_threads;
 };
 